@@ -0,0 +1,155 @@
+/*
+ * Copyright 2024 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SIMBRICKS_BASE_TS_HEAP_HH_
+#define SIMBRICKS_BASE_TS_HEAP_HH_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace simbricks {
+
+/**
+ * Indexed binary min-heap over the timestamps of a fixed set of ids (e.g.
+ * interfaces, numbered 0..n-1).
+ *
+ * Simulators with many interfaces use it to track the next input timestamp
+ * of each one: after polling an interface only its entry is updated
+ * (O(log n)), the global minimum is O(1), and the interfaces that may have
+ * a message due can be enumerated without touching the others.
+ */
+class TimestampHeap {
+ public:
+  static constexpr uint64_t kNever = UINT64_MAX;
+
+  explicit TimestampHeap(size_t n = 0, uint64_t ts = 0) {
+    Reset(n, ts);
+  }
+
+  /** Track ids 0..n-1, all at timestamp `ts`. */
+  void Reset(size_t n, uint64_t ts = 0) {
+    heap_.resize(n);
+    pos_.resize(n);
+    ts_.assign(n, ts);
+    for (size_t i = 0; i < n; i++) {
+      heap_[i] = i;
+      pos_[i] = i;
+    }
+  }
+
+  size_t Size() const {
+    return heap_.size();
+  }
+
+  /** Smallest timestamp, kNever if there are no ids. */
+  uint64_t Min() const {
+    return heap_.empty() ? kNever : ts_[heap_[0]];
+  }
+
+  /** Id with the smallest timestamp, only valid if Size() > 0. */
+  size_t MinId() const {
+    return heap_[0];
+  }
+
+  uint64_t Get(size_t id) const {
+    return ts_[id];
+  }
+
+  void Update(size_t id, uint64_t ts) {
+    assert(id < ts_.size());
+    uint64_t old = ts_[id];
+    if (ts == old)
+      return;
+    ts_[id] = ts;
+    if (ts < old)
+      SiftUp(pos_[id]);
+    else
+      SiftDown(pos_[id]);
+  }
+
+  /** Append the ids with a timestamp of at most `ts` to `ids`, in no
+   * particular order. Only visits those ids and their direct children. */
+  void CollectUpTo(uint64_t ts, std::vector<size_t> &ids) const {
+    if (heap_.empty() || ts_[heap_[0]] > ts)
+      return;
+
+    size_t first = ids.size();
+    ids.push_back(heap_[0]);
+    // walk the heap breadth-first, ids double as the work list
+    for (size_t i = first; i < ids.size(); i++) {
+      size_t h = pos_[ids[i]];
+      for (size_t c = 2 * h + 1; c <= 2 * h + 2 && c < heap_.size(); c++) {
+        if (ts_[heap_[c]] <= ts)
+          ids.push_back(heap_[c]);
+      }
+    }
+  }
+
+ private:
+  std::vector<size_t> heap_;  // ids in heap order
+  std::vector<size_t> pos_;  // position of each id in heap_
+  std::vector<uint64_t> ts_;  // timestamp of each id
+
+  void Swap(size_t a, size_t b) {
+    size_t ia = heap_[a];
+    size_t ib = heap_[b];
+    heap_[a] = ib;
+    heap_[b] = ia;
+    pos_[ib] = a;
+    pos_[ia] = b;
+  }
+
+  void SiftUp(size_t h) {
+    while (h > 0) {
+      size_t parent = (h - 1) / 2;
+      if (ts_[heap_[parent]] <= ts_[heap_[h]])
+        break;
+      Swap(h, parent);
+      h = parent;
+    }
+  }
+
+  void SiftDown(size_t h) {
+    size_t n = heap_.size();
+    while (true) {
+      size_t min = h;
+      size_t l = 2 * h + 1;
+      size_t r = l + 1;
+      if (l < n && ts_[heap_[l]] < ts_[heap_[min]])
+        min = l;
+      if (r < n && ts_[heap_[r]] < ts_[heap_[min]])
+        min = r;
+      if (min == h)
+        break;
+      Swap(h, min);
+      h = min;
+    }
+  }
+};
+
+}  // namespace simbricks
+
+#endif  // SIMBRICKS_BASE_TS_HEAP_HH_
@@ -0,0 +1,388 @@
+/*
+ * Copyright 2024 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "lib/simbricks/netport/netport.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace netport {
+
+void StreamCopy(volatile void *dst, const void *src, size_t len) {
+  uint8_t *d = (uint8_t *)dst;
+  const uint8_t *s = (const uint8_t *)src;
+#ifdef __SSE2__
+  size_t head = -(uintptr_t)d & 63;
+  if (head > len)
+    head = len;
+  memcpy(d, s, head);
+  d += head;
+  s += head;
+  len -= head;
+  for (; len >= 64; d += 64, s += 64, len -= 64) {
+    __m128i v0 = _mm_loadu_si128((const __m128i *)s);
+    __m128i v1 = _mm_loadu_si128((const __m128i *)(s + 16));
+    __m128i v2 = _mm_loadu_si128((const __m128i *)(s + 32));
+    __m128i v3 = _mm_loadu_si128((const __m128i *)(s + 48));
+    _mm_stream_si128((__m128i *)d, v0);
+    _mm_stream_si128((__m128i *)(d + 16), v1);
+    _mm_stream_si128((__m128i *)(d + 32), v2);
+    _mm_stream_si128((__m128i *)(d + 48), v3);
+  }
+  memcpy(d, s, len);
+  // streaming stores are not ordered with the release of the slot
+  _mm_sfence();
+#else
+  memcpy(d, s, len);
+#endif
+}
+
+NetPort::NetPort(const char *path, int sync,
+                 const struct SimbricksBaseIfParams *params)
+    : params_(params),
+      path_(path),
+      sync_(sync),
+      rx_(nullptr),
+      burst_n_(0),
+      tx_(nullptr),
+      backlog_cap_(0),
+      backlog_head_(0),
+      backlog_tail_(0),
+      backlog_bytes_(0),
+      backlog_limit_(0) {
+  memset(&netif_, 0, sizeof(netif_));
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+bool NetPort::Init() {
+  struct SimbricksBaseIfParams params = *params_;
+  params.sync_mode =
+      (sync_ ? kSimbricksBaseIfSyncOptional : kSimbricksBaseIfSyncDisabled);
+  params.sock_path = path_;
+  params.blocking_conn = false;
+
+  if (SimbricksBaseIfInit(&netif_.base, &params)) {
+    perror("Init: SimbricksBaseIfInit failed");
+    return false;
+  }
+
+  return true;
+}
+
+bool NetPort::Prepare() {
+  if (!Init())
+    return false;
+
+  if (SimbricksBaseIfConnect(&netif_.base)) {
+    perror("Prepare: SimbricksBaseIfConnect failed");
+    return false;
+  }
+
+  return true;
+}
+
+void NetPort::Prepared() {
+  sync_ = SimbricksBaseIfSyncEnabled(&netif_.base);
+}
+
+void NetPort::SetBacklog(size_t bytes) {
+  assert(BacklogEmpty());
+  backlog_limit_ = bytes;
+  backlog_head_ = backlog_tail_ = 0;
+  if (!bytes) {
+    backlog_cap_ = 0;
+    backlog_.clear();
+    return;
+  }
+  // twice the limit covers the record headers and padding of frames of 16
+  // bytes and more, plus the unused tail before a skip to the ring start
+  size_t max_rec = sizeof(BacklogRec) + UINT16_MAX + 8;
+  backlog_cap_ = (2 * (bytes + max_rec) + 7) & ~(size_t)7;
+  backlog_.assign(backlog_cap_ / 8, 0);
+}
+
+bool NetPort::BacklogPush(const void *data, size_t len) {
+  if (backlog_bytes_ + len > backlog_limit_)
+    return false;
+  size_t size = (sizeof(BacklogRec) + len + 7) & ~(size_t)7;
+  size_t off = backlog_tail_ % backlog_cap_;
+  size_t skip = off + size > backlog_cap_ ? backlog_cap_ - off : 0;
+  if (backlog_tail_ + skip + size - backlog_head_ > backlog_cap_)
+    return false;
+  if (skip) {
+    BacklogAt(backlog_tail_)->size = 0;
+    backlog_tail_ += skip;
+  }
+
+  BacklogRec *r = BacklogAt(backlog_tail_);
+  r->size = size;
+  r->len = len;
+  memcpy(r + 1, data, len);
+  backlog_tail_ += size;
+  backlog_bytes_ += len;
+  return true;
+}
+
+void NetPort::Sync(uint64_t cur_ts) {
+  // sync messages must not overtake packets
+  if (!BacklogEmpty() && !TxFlush(cur_ts))
+    return;
+  while (SimbricksNetIfOutSync(&netif_, cur_ts)) {
+  }
+}
+
+uint64_t NetPort::NextTimestamp() {
+  return SimbricksNetIfInTimestamp(&netif_);
+}
+
+enum NetPort::RxPollState NetPort::RxPacket(const void *&data, size_t &len,
+                                            uint64_t cur_ts) {
+  assert(rx_ == nullptr && burst_n_ == 0);
+
+  rx_ = SimbricksNetIfInPoll(&netif_, cur_ts);
+  if (!rx_)
+    return kRxPollFail;
+
+  uint8_t type = SimbricksNetIfInType(&netif_, rx_);
+  if (type == SIMBRICKS_PROTO_NET_MSG_PACKET) {
+    data = (const void *)rx_->packet.data;
+    len = rx_->packet.len;
+    stats_.rx_packets++;
+    stats_.rx_bytes += len;
+    return kRxPollSuccess;
+  } else if (type == SIMBRICKS_PROTO_MSG_TYPE_SYNC) {
+    stats_.rx_syncs++;
+    return kRxPollSync;
+  } else {
+    fprintf(stderr, "RxPacket: unsupported type=%u\n", type);
+    abort();
+  }
+}
+
+void NetPort::RxDone() {
+  assert(rx_ != nullptr);
+
+  SimbricksNetIfInDone(&netif_, rx_);
+  rx_ = nullptr;
+}
+
+size_t NetPort::RxBurst(RxView *pkts, size_t max, uint64_t cur_ts) {
+  assert(rx_ == nullptr && burst_n_ == 0);
+
+  if (max > kMaxBurst)
+    max = kMaxBurst;
+  while (burst_n_ < max) {
+    volatile union SimbricksProtoNetMsg *msg =
+        SimbricksNetIfInPoll(&netif_, cur_ts);
+    if (!msg)
+      break;
+
+    uint8_t type = SimbricksNetIfInType(&netif_, msg);
+    if (type == SIMBRICKS_PROTO_NET_MSG_PACKET) {
+      RxView &v = pkts[burst_n_];
+      v.data = (const void *)msg->packet.data;
+      v.len = msg->packet.len;
+      v.timestamp = msg->packet.timestamp;
+      burst_[burst_n_++] = msg;
+      stats_.rx_packets++;
+      stats_.rx_bytes += v.len;
+    } else if (type == SIMBRICKS_PROTO_MSG_TYPE_SYNC) {
+      // slots are handed back individually, no need to keep this one
+      SimbricksNetIfInDone(&netif_, msg);
+      stats_.rx_syncs++;
+    } else {
+      fprintf(stderr, "RxBurst: unsupported type=%u\n", type);
+      abort();
+    }
+  }
+  return burst_n_;
+}
+
+void NetPort::RxBurstDone() {
+  for (size_t i = 0; i < burst_n_; i++)
+    SimbricksNetIfInDone(&netif_, burst_[i]);
+  burst_n_ = 0;
+}
+
+bool NetPort::Send(const void *data, size_t len, uint64_t cur_ts,
+                   bool stream) {
+  volatile union SimbricksProtoNetMsg *msg_to =
+      SimbricksNetIfOutAlloc(&netif_, cur_ts);
+  if (!msg_to) {
+    stats_.tx_full++;
+    return false;
+  }
+
+  assert(len <= TxMaxLen());
+  volatile struct SimbricksProtoNetMsgPacket *pkt = &msg_to->packet;
+  pkt->len = len;
+  pkt->port = 0;
+  if (stream)
+    StreamCopy(pkt->data, data, len);
+  else
+    memcpy((void *)pkt->data, data, len);
+
+  SimbricksNetIfOutSend(&netif_, msg_to, SIMBRICKS_PROTO_NET_MSG_PACKET);
+  stats_.tx_packets++;
+  stats_.tx_bytes += len;
+  return true;
+}
+
+bool NetPort::TxPacket(const void *data, size_t len, uint64_t cur_ts,
+                       bool stream) {
+  // would overrun the slot, and block the backlog for good
+  if (len > TxMaxLen()) {
+    stats_.tx_drops++;
+    return false;
+  }
+
+  // packets already waiting go first
+  if ((BacklogEmpty() || TxFlush(cur_ts)) && Send(data, len, cur_ts, stream))
+    return true;
+
+  if (!BacklogPush(data, len)) {
+    stats_.tx_drops++;
+    return false;
+  }
+  stats_.tx_backlogged++;
+  return true;
+}
+
+void *NetPort::TxAlloc(uint64_t cur_ts, size_t &max) {
+  assert(tx_ == nullptr);
+
+  if (!BacklogEmpty() && !TxFlush(cur_ts))
+    return nullptr;
+  tx_ = SimbricksNetIfOutAlloc(&netif_, cur_ts);
+  if (!tx_) {
+    stats_.tx_full++;
+    return nullptr;
+  }
+  max = TxMaxLen();
+  return (void *)tx_->packet.data;
+}
+
+void NetPort::TxCommit(size_t len) {
+  assert(tx_ != nullptr);
+
+  tx_->packet.len = len;
+  tx_->packet.port = 0;
+  SimbricksNetIfOutSend(&netif_, tx_, SIMBRICKS_PROTO_NET_MSG_PACKET);
+  tx_ = nullptr;
+  stats_.tx_packets++;
+  stats_.tx_bytes += len;
+}
+
+size_t NetPort::TxBurst(const TxView *pkts, size_t n, uint64_t cur_ts,
+                        bool stream) {
+  size_t sent = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (TxPacket(pkts[i].data, pkts[i].len, cur_ts, stream))
+      sent++;
+  }
+  return sent;
+}
+
+bool NetPort::TxFlush(uint64_t cur_ts) {
+  while (!BacklogEmpty()) {
+    BacklogRec *r = BacklogAt(backlog_head_);
+    if (r->size == 0) {
+      backlog_head_ += backlog_cap_ - backlog_head_ % backlog_cap_;
+      r = BacklogAt(backlog_head_);
+    }
+    if (!Send(r + 1, r->len, cur_ts, false))
+      return false;
+    backlog_bytes_ -= r->len;
+    backlog_head_ += r->size;
+  }
+  return true;
+}
+
+NetListenPort::NetListenPort(const char *path, int sync,
+                             const struct SimbricksBaseIfParams *params)
+    : NetPort(path, sync, params) {
+  memset(&pool_, 0, sizeof(pool_));
+}
+
+bool NetListenPort::Prepare() {
+  if (!Init())
+    return false;
+
+  std::string shm_path = path_;
+  shm_path += "-shm";
+
+  if (SimbricksBaseIfSHMPoolCreate(
+          &pool_, shm_path.c_str(),
+          SimbricksBaseIfSHMSize(&netif_.base.params)) != 0) {
+    perror("Prepare: SimbricksBaseIfSHMPoolCreate failed");
+    return false;
+  }
+
+  if (SimbricksBaseIfListen(&netif_.base, &pool_) != 0) {
+    perror("Prepare: SimbricksBaseIfListen failed");
+    return false;
+  }
+
+  return true;
+}
+
+bool ConnectAll(const std::vector<NetPort *> &ports) {
+  size_t n = ports.size();
+  std::vector<struct SimBricksBaseIfEstablishData> ests(n);
+  struct SimbricksProtoNetIntro intro;
+  memset(&intro, 0, sizeof(intro));
+
+  printf("start connecting...\n");
+  for (size_t i = 0; i < n; i++) {
+    NetPort *p = ports[i];
+    ests[i].base_if = &p->netif_.base;
+    ests[i].tx_intro = &intro;
+    ests[i].tx_intro_len = sizeof(intro);
+    ests[i].rx_intro = &intro;
+    ests[i].rx_intro_len = sizeof(intro);
+
+    if (!p->Prepare())
+      return false;
+  }
+
+  if (SimBricksBaseIfEstablish(ests.data(), n)) {
+    fprintf(stderr, "ConnectAll: SimBricksBaseIfEstablish failed\n");
+    return false;
+  }
+
+  for (NetPort *p : ports)
+    p->Prepared();
+  printf("done connecting\n");
+  return true;
+}
+
+}  // namespace netport
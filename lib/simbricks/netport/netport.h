@@ -0,0 +1,218 @@
+/*
+ * Copyright 2024 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef SIMBRICKS_NETPORT_NETPORT_H_
+#define SIMBRICKS_NETPORT_NETPORT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <simbricks/base/cxxatomicfix.h>
+extern "C" {
+#include <simbricks/network/if.h>
+}
+
+namespace netport {
+
+/** Counters kept by every port */
+struct PortStats {
+  uint64_t rx_packets;
+  uint64_t rx_bytes;
+  uint64_t rx_syncs;
+  uint64_t tx_packets;
+  uint64_t tx_bytes;
+  uint64_t tx_full;        // sends that found the egress ring full
+  uint64_t tx_backlogged;  // packets that had to wait in the backlog
+  uint64_t tx_drops;       // packets dropped, the backlog was full as well
+};
+
+/** A received packet, pointing into the ingress ring */
+struct RxView {
+  const void *data;
+  size_t len;
+  uint64_t timestamp;
+};
+
+/** A packet to send */
+struct TxView {
+  const void *data;
+  size_t len;
+};
+
+/**
+ * Copy a frame into a shared memory slot, with non-temporal stores for the
+ * whole cache lines. Worth it when sending the same frame to many ports: the
+ * receivers are the only ones to read the copies again.
+ */
+void StreamCopy(volatile void *dst, const void *src, size_t len);
+
+/**
+ * Network port connecting to a peer listening on a SimBricks Ethernet
+ * socket. Ports are set up with Prepare() and connected together with
+ * ConnectAll().
+ *
+ * Packets are received one at a time (RxPacket()/RxDone()) or in bursts
+ * (RxBurst()/RxBurstDone()), both hand out the packet in the ingress ring
+ * without copying it. Sending never blocks: if the egress ring is full the
+ * packet goes into a backlog of up to SetBacklog() bytes (by default there is
+ * none and the send fails), which is flushed ahead of the next packets and
+ * before sync messages. The backlog is a ring allocated up front, queueing a
+ * packet only copies it.
+ */
+class NetPort {
+ public:
+  enum RxPollState {
+    kRxPollSuccess = 0,
+    kRxPollFail = 1,
+    kRxPollSync = 2,
+  };
+  static constexpr size_t kMaxBurst = 32;
+
+  struct SimbricksNetIf netif_;
+
+ protected:
+  const struct SimbricksBaseIfParams *params_;
+  const char *path_;
+  int sync_;
+  volatile union SimbricksProtoNetMsg *rx_;
+  volatile union SimbricksProtoNetMsg *burst_[kMaxBurst];
+  size_t burst_n_;
+  volatile union SimbricksProtoNetMsg *tx_;
+
+  /** Backlogged packet, followed by its data */
+  struct BacklogRec {
+    uint32_t size;  // of the whole record, 0 marks a skip to the ring start
+    uint32_t len;
+  };
+  std::vector<uint64_t> backlog_;
+  size_t backlog_cap_;
+  size_t backlog_head_;
+  size_t backlog_tail_;
+  size_t backlog_bytes_;
+  size_t backlog_limit_;
+  PortStats stats_;
+
+  /** Initialize the base interface from params_ */
+  bool Init();
+  bool Send(const void *data, size_t len, uint64_t cur_ts, bool stream);
+
+  BacklogRec *BacklogAt(size_t pos) {
+    return reinterpret_cast<BacklogRec *>(
+        reinterpret_cast<uint8_t *>(backlog_.data()) + pos % backlog_cap_);
+  }
+  bool BacklogEmpty() const {
+    return backlog_head_ == backlog_tail_;
+  }
+  /** Queue a copy of the packet, false if the backlog is full. */
+  bool BacklogPush(const void *data, size_t len);
+
+ public:
+  /** `params` is read when the port is prepared, not copied here. */
+  NetPort(const char *path, int sync,
+          const struct SimbricksBaseIfParams *params);
+  virtual ~NetPort() = default;
+
+  /** Start connecting (or listening), to be completed by ConnectAll(). */
+  virtual bool Prepare();
+  /** Called once connected, picks up whether synchronization was agreed. */
+  virtual void Prepared();
+
+  bool IsSync() const {
+    return sync_;
+  }
+
+  const char *Name() const {
+    return path_;
+  }
+
+  const PortStats &Stats() const {
+    return stats_;
+  }
+
+  /** Keep up to `bytes` of packets that do not fit into the egress ring,
+   * must be called while the backlog is empty. */
+  void SetBacklog(size_t bytes);
+
+  /** Bytes currently waiting in the backlog */
+  size_t Backlog() const {
+    return backlog_bytes_;
+  }
+
+  /** Flush the backlog and send a sync message if one is due. */
+  virtual void Sync(uint64_t cur_ts);
+  virtual uint64_t NextTimestamp();
+
+  virtual enum RxPollState RxPacket(const void *&data, size_t &len,
+                                    uint64_t cur_ts);
+  virtual void RxDone();
+
+  /** Receive up to `max` (at most kMaxBurst) packets that are due. Sync
+   * messages are consumed on the way. The views stay valid until
+   * RxBurstDone(), which has to be called before the next receive. */
+  virtual size_t RxBurst(RxView *pkts, size_t max, uint64_t cur_ts);
+  virtual void RxBurstDone();
+
+  /** Largest packet an egress slot holds, once connected. */
+  size_t TxMaxLen() {
+    return SimbricksBaseIfOutMsgLen(&netif_.base) -
+           sizeof(struct SimbricksProtoNetMsgPacket);
+  }
+
+  /** Send a packet, with `stream` using StreamCopy(). Returns false if it
+   * was dropped because it is larger than TxMaxLen() or neither the ring
+   * nor the backlog had room. */
+  virtual bool TxPacket(const void *data, size_t len, uint64_t cur_ts,
+                        bool stream = false);
+  /** Zero-copy send: the data area of the next egress slot, `max` is set to
+   * its size. Fill it and hand it over with TxCommit(). nullptr if the ring
+   * is full or packets are waiting in the backlog. */
+  void *TxAlloc(uint64_t cur_ts, size_t &max);
+  void TxCommit(size_t len);
+  /** Send `n` packets, returns how many were not dropped. */
+  size_t TxBurst(const TxView *pkts, size_t n, uint64_t cur_ts,
+                 bool stream = false);
+  /** Move backlogged packets to the ring, true if the backlog is empty. */
+  bool TxFlush(uint64_t cur_ts);
+};
+
+/** Port listening for a peer to connect to it */
+class NetListenPort : public NetPort {
+ protected:
+  struct SimbricksBaseIfSHMPool pool_;
+
+ public:
+  NetListenPort(const char *path, int sync,
+                const struct SimbricksBaseIfParams *params);
+
+  bool Prepare() override;
+};
+
+/** Prepare all `ports` and wait until all of them are connected. */
+bool ConnectAll(const std::vector<NetPort *> &ports);
+
+}  // namespace netport
+
+#endif  // SIMBRICKS_NETPORT_NETPORT_H_
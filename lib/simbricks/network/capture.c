@@ -0,0 +1,685 @@
+/*
+ * Copyright 2024 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "lib/simbricks/network/capture.h"
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <simbricks/parser/parser.h>
+
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+#define PCAP_LINKTYPE_ETHERNET 1
+#define PCAP_MAX_SNAPLEN 65535
+
+#define WRITE_BUF_SIZE (1 << 20)
+#define FILTER_MAX_NODES 64
+
+/******************************************************************************/
+/* Filter */
+
+enum FilterOp {
+  kFltAnd,
+  kFltOr,
+  kFltNot,
+  kFltEtherType,
+  kFltIpProto,
+  kFltHost,
+  kFltPort,
+  kFltEtherHost,
+  kFltLess,
+  kFltGreater,
+};
+
+enum FilterDir {
+  kDirAny,
+  kDirSrc,
+  kDirDst,
+};
+
+struct FilterNode {
+  enum FilterOp op;
+  enum FilterDir dir;
+  uint64_t val;
+  int a;
+  int b;
+};
+
+struct Filter {
+  struct FilterNode nodes[FILTER_MAX_NODES];
+  int n;
+  int root;
+};
+
+struct FilterParser {
+  struct Filter *f;
+  const char *pos;
+  char tok[64];
+};
+
+/** Fields of a frame the filter primitives look at */
+struct PacketInfo {
+  size_t len;
+  uint16_t ether_type;
+  uint64_t ether_src;
+  uint64_t ether_dst;
+  bool vlan;
+  bool ip4;
+  bool ip6;
+  uint8_t ip_proto;
+  uint32_t ip_src;
+  uint32_t ip_dst;
+  bool has_ports;
+  uint16_t sport;
+  uint16_t dport;
+};
+
+static void FilterNext(struct FilterParser *p) {
+  size_t n = 0;
+  while (isspace((unsigned char)*p->pos))
+    p->pos++;
+
+  if (*p->pos == '(' || *p->pos == ')' || *p->pos == '!') {
+    p->tok[n++] = *p->pos++;
+  } else if ((p->pos[0] == '&' && p->pos[1] == '&') ||
+             (p->pos[0] == '|' && p->pos[1] == '|')) {
+    p->tok[n++] = *p->pos++;
+    p->tok[n++] = *p->pos++;
+  } else if (*p->pos == '&' || *p->pos == '|') {
+    // a lone one is no operator, but must not look like the end either
+    p->tok[n++] = *p->pos++;
+  } else {
+    while (*p->pos && !isspace((unsigned char)*p->pos) && *p->pos != '(' &&
+           *p->pos != ')' && *p->pos != '!' && *p->pos != '&' &&
+           *p->pos != '|' && n < sizeof(p->tok) - 1)
+      p->tok[n++] = *p->pos++;
+  }
+  p->tok[n] = 0;
+}
+
+static int FilterNode(struct FilterParser *p, enum FilterOp op,
+                      enum FilterDir dir, uint64_t val, int a, int b) {
+  struct Filter *f = p->f;
+  if (f->n == FILTER_MAX_NODES) {
+    fprintf(stderr, "SimbricksCapture: filter too long\n");
+    return -1;
+  }
+  f->nodes[f->n].op = op;
+  f->nodes[f->n].dir = dir;
+  f->nodes[f->n].val = val;
+  f->nodes[f->n].a = a;
+  f->nodes[f->n].b = b;
+  return f->n++;
+}
+
+static int FilterNumber(struct FilterParser *p, uint64_t *val) {
+  char *end;
+  if (!p->tok[0])
+    return -1;
+  *val = strtoull(p->tok, &end, 0);
+  return *end ? -1 : 0;
+}
+
+static int FilterExpr(struct FilterParser *p);
+
+static int FilterPrimitive(struct FilterParser *p) {
+  enum FilterDir dir = kDirAny;
+  uint64_t val;
+
+  if (!strcmp(p->tok, "not") || !strcmp(p->tok, "!")) {
+    FilterNext(p);
+    int a = FilterPrimitive(p);
+    return a < 0 ? -1 : FilterNode(p, kFltNot, kDirAny, 0, a, -1);
+  }
+  if (!strcmp(p->tok, "(")) {
+    FilterNext(p);
+    int a = FilterExpr(p);
+    if (a < 0 || strcmp(p->tok, ")"))
+      return -1;
+    FilterNext(p);
+    return a;
+  }
+
+  if (!strcmp(p->tok, "ip")) {
+    FilterNext(p);
+    return FilterNode(p, kFltEtherType, kDirAny, 0x0800, -1, -1);
+  } else if (!strcmp(p->tok, "ip6")) {
+    FilterNext(p);
+    return FilterNode(p, kFltEtherType, kDirAny, 0x86dd, -1, -1);
+  } else if (!strcmp(p->tok, "arp")) {
+    FilterNext(p);
+    return FilterNode(p, kFltEtherType, kDirAny, 0x0806, -1, -1);
+  } else if (!strcmp(p->tok, "vlan")) {
+    FilterNext(p);
+    return FilterNode(p, kFltEtherType, kDirAny, 0x8100, -1, -1);
+  } else if (!strcmp(p->tok, "tcp")) {
+    FilterNext(p);
+    return FilterNode(p, kFltIpProto, kDirAny, 6, -1, -1);
+  } else if (!strcmp(p->tok, "udp")) {
+    FilterNext(p);
+    return FilterNode(p, kFltIpProto, kDirAny, 17, -1, -1);
+  } else if (!strcmp(p->tok, "icmp")) {
+    FilterNext(p);
+    return FilterNode(p, kFltIpProto, kDirAny, 1, -1, -1);
+  } else if (!strcmp(p->tok, "less") || !strcmp(p->tok, "greater")) {
+    enum FilterOp op = p->tok[0] == 'l' ? kFltLess : kFltGreater;
+    FilterNext(p);
+    if (FilterNumber(p, &val))
+      return -1;
+    FilterNext(p);
+    return FilterNode(p, op, kDirAny, val, -1, -1);
+  }
+
+  bool ether = false;
+  if (!strcmp(p->tok, "ether")) {
+    ether = true;
+    FilterNext(p);
+    if (!strcmp(p->tok, "proto")) {
+      FilterNext(p);
+      if (FilterNumber(p, &val))
+        return -1;
+      FilterNext(p);
+      return FilterNode(p, kFltEtherType, kDirAny, val, -1, -1);
+    }
+  }
+  if (!strcmp(p->tok, "src")) {
+    dir = kDirSrc;
+    FilterNext(p);
+  } else if (!strcmp(p->tok, "dst")) {
+    dir = kDirDst;
+    FilterNext(p);
+  }
+
+  if (!strcmp(p->tok, "host")) {
+    FilterNext(p);
+    if (ether) {
+      uint8_t mac[8] = {0};
+      if (sscanf(p->tok, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &mac[0], &mac[1],
+                 &mac[2], &mac[3], &mac[4], &mac[5]) != 6)
+        return -1;
+      memcpy(&val, mac, sizeof(val));
+      FilterNext(p);
+      return FilterNode(p, kFltEtherHost, dir, val, -1, -1);
+    }
+    struct in_addr addr;
+    if (!inet_aton(p->tok, &addr))
+      return -1;
+    FilterNext(p);
+    return FilterNode(p, kFltHost, dir, addr.s_addr, -1, -1);
+  } else if (!strcmp(p->tok, "port") && !ether) {
+    FilterNext(p);
+    if (FilterNumber(p, &val) || val > 65535)
+      return -1;
+    FilterNext(p);
+    return FilterNode(p, kFltPort, dir, val, -1, -1);
+  }
+  return -1;
+}
+
+static int FilterTerm(struct FilterParser *p) {
+  int a = FilterPrimitive(p);
+  while (a >= 0 && (!strcmp(p->tok, "and") || !strcmp(p->tok, "&&"))) {
+    FilterNext(p);
+    int b = FilterPrimitive(p);
+    a = b < 0 ? -1 : FilterNode(p, kFltAnd, kDirAny, 0, a, b);
+  }
+  return a;
+}
+
+static int FilterExpr(struct FilterParser *p) {
+  int a = FilterTerm(p);
+  while (a >= 0 && (!strcmp(p->tok, "or") || !strcmp(p->tok, "||"))) {
+    FilterNext(p);
+    int b = FilterTerm(p);
+    a = b < 0 ? -1 : FilterNode(p, kFltOr, kDirAny, 0, a, b);
+  }
+  return a;
+}
+
+static int FilterCompile(struct Filter *f, const char *expr) {
+  struct FilterParser p;
+  p.f = f;
+  p.pos = expr;
+  f->n = 0;
+  FilterNext(&p);
+  f->root = FilterExpr(&p);
+  if (f->root < 0 || p.tok[0]) {
+    fprintf(stderr, "SimbricksCapture: cannot parse filter at '%s'\n",
+            p.tok);
+    return -1;
+  }
+  return 0;
+}
+
+static void PacketParse(struct PacketInfo *pi, const uint8_t *pkt,
+                        size_t len) {
+  memset(pi, 0, sizeof(*pi));
+  pi->len = len;
+  if (len < 14)
+    return;
+
+  memcpy(&pi->ether_dst, pkt, 6);
+  memcpy(&pi->ether_src, pkt + 6, 6);
+  size_t off = 12;
+  pi->ether_type = pkt[off] << 8 | pkt[off + 1];
+  if (pi->ether_type == 0x8100 && len >= 18) {
+    pi->vlan = true;
+    off += 4;
+    pi->ether_type = pkt[off] << 8 | pkt[off + 1];
+  }
+  off += 2;
+
+  size_t l4 = 0;
+  if (pi->ether_type == 0x0800 && len >= off + 20) {
+    const uint8_t *ip = pkt + off;
+    pi->ip4 = true;
+    pi->ip_proto = ip[9];
+    memcpy(&pi->ip_src, ip + 12, 4);
+    memcpy(&pi->ip_dst, ip + 16, 4);
+    // ports only in the first fragment
+    if (!((ip[6] & 0x1f) | ip[7]))
+      l4 = off + (ip[0] & 0xf) * 4;
+  } else if (pi->ether_type == 0x86dd && len >= off + 40) {
+    pi->ip6 = true;
+    pi->ip_proto = pkt[off + 6];
+    l4 = off + 40;
+  }
+
+  if (l4 && (pi->ip_proto == 6 || pi->ip_proto == 17) && len >= l4 + 4) {
+    pi->has_ports = true;
+    pi->sport = pkt[l4] << 8 | pkt[l4 + 1];
+    pi->dport = pkt[l4 + 2] << 8 | pkt[l4 + 3];
+  }
+}
+
+static bool FilterMatchDir(enum FilterDir dir, uint64_t src, uint64_t dst,
+                           uint64_t val) {
+  return (dir != kDirDst && src == val) || (dir != kDirSrc && dst == val);
+}
+
+static bool FilterEval(const struct Filter *f, int i,
+                       const struct PacketInfo *pi) {
+  const struct FilterNode *n = &f->nodes[i];
+  switch (n->op) {
+    case kFltAnd:
+      return FilterEval(f, n->a, pi) && FilterEval(f, n->b, pi);
+    case kFltOr:
+      return FilterEval(f, n->a, pi) || FilterEval(f, n->b, pi);
+    case kFltNot:
+      return !FilterEval(f, n->a, pi);
+    case kFltEtherType:
+      return (n->val == 0x8100 && pi->vlan) || pi->ether_type == n->val;
+    case kFltIpProto:
+      return (pi->ip4 || pi->ip6) && pi->ip_proto == n->val;
+    case kFltHost:
+      return pi->ip4 &&
+             FilterMatchDir(n->dir, pi->ip_src, pi->ip_dst, n->val);
+    case kFltPort:
+      return pi->has_ports &&
+             FilterMatchDir(n->dir, pi->sport, pi->dport, n->val);
+    case kFltEtherHost:
+      return FilterMatchDir(n->dir, pi->ether_src, pi->ether_dst, n->val);
+    case kFltLess:
+      return pi->len <= n->val;
+    case kFltGreater:
+      return pi->len >= n->val;
+  }
+  return false;
+}
+
+/******************************************************************************/
+/* Capture */
+
+/** Ring record, followed by caplen bytes of packet data, 8-byte aligned. A
+ * record with size 0 marks the rest of the ring as unused. */
+struct CaptureRec {
+  uint32_t size;
+  uint32_t caplen;
+  uint32_t len;
+  uint32_t pad;
+  uint64_t ts;
+};
+
+struct PcapFileHdr {
+  uint32_t magic;
+  uint16_t version_major;
+  uint16_t version_minor;
+  int32_t thiszone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t linktype;
+};
+
+struct PcapRecHdr {
+  uint32_t ts_sec;
+  uint32_t ts_nsec;
+  uint32_t caplen;
+  uint32_t len;
+};
+
+struct SimbricksCapture {
+  struct SimbricksCaptureParams params;
+  struct Filter filter;
+  bool has_filter;
+  uint32_t snaplen;
+
+  /* producer side */
+  _Alignas(64) _Atomic size_t tail;
+  size_t head_cache;
+  uint64_t sample_cnt;
+  uint64_t drops;
+
+  /* writer side */
+  _Alignas(64) _Atomic size_t head;
+  _Atomic bool stop;
+  pthread_t thread;
+  FILE *file;
+  unsigned file_idx;
+  uint64_t file_bytes;
+  uint8_t *wbuf;
+  size_t wbuf_len;
+
+  uint8_t *ring;
+  size_t ring_size;
+};
+
+void SimbricksCaptureDefaultParams(struct SimbricksCaptureParams *params) {
+  params->path = NULL;
+  params->snaplen = 0;
+  params->sample = 1;
+  params->rotate_bytes = 0;
+  params->port = -1;
+  params->filter = NULL;
+  params->ring_size = 16 << 20;
+}
+
+int SimbricksCaptureParseOpt(struct SimbricksCaptureParams *params,
+                             char *opt) {
+  char *next;
+  char *end;
+
+  params->path = opt;
+  next = strchr(opt, ',');
+  while (next) {
+    *next = 0;
+    opt = next + 1;
+    if (!strncmp(opt, "filter=", 7)) {
+      // the filter takes the rest of the string, commas included
+      params->filter = opt + 7;
+      return 0;
+    }
+
+    next = strchr(opt, ',');
+    if (next)
+      *next = 0;
+    char *val = strchr(opt, '=');
+    if (!val)
+      goto err;
+    *val++ = 0;
+
+    if (!strcmp(opt, "snaplen")) {
+      params->snaplen = strtoul(val, &end, 0);
+    } else if (!strcmp(opt, "sample")) {
+      params->sample = strtoul(val, &end, 0);
+    } else if (!strcmp(opt, "rotate")) {
+      params->rotate_bytes = SimbricksParseSize(val, &end);
+    } else if (!strcmp(opt, "port")) {
+      params->port = strtol(val, &end, 0);
+    } else if (!strcmp(opt, "ring")) {
+      params->ring_size = SimbricksParseSize(val, &end);
+    } else {
+      goto err;
+    }
+    if (*end)
+      goto err;
+  }
+  return 0;
+
+err:
+  fprintf(stderr, "SimbricksCaptureParseOpt: invalid option '%s'\n", opt);
+  return -1;
+}
+
+static int CaptureOpenFile(struct SimbricksCapture *cap) {
+  const char *path = cap->params.path;
+  char *rpath = NULL;
+
+  if (cap->file_idx > 0) {
+    if (asprintf(&rpath, "%s.%u", path, cap->file_idx) < 0)
+      return -1;
+    path = rpath;
+  }
+
+  cap->file = fopen(path, "wb");
+  if (!cap->file) {
+    perror("SimbricksCapture: opening output file failed");
+    free(rpath);
+    return -1;
+  }
+  free(rpath);
+
+  struct PcapFileHdr hdr;
+  hdr.magic = PCAP_MAGIC_NSEC;
+  hdr.version_major = 2;
+  hdr.version_minor = 4;
+  hdr.thiszone = 0;
+  hdr.sigfigs = 0;
+  hdr.snaplen = cap->snaplen;
+  hdr.linktype = PCAP_LINKTYPE_ETHERNET;
+  memcpy(cap->wbuf, &hdr, sizeof(hdr));
+  cap->wbuf_len = sizeof(hdr);
+  cap->file_bytes = sizeof(hdr);
+  return 0;
+}
+
+static void CaptureFlush(struct SimbricksCapture *cap) {
+  if (cap->wbuf_len &&
+      fwrite(cap->wbuf, 1, cap->wbuf_len, cap->file) != cap->wbuf_len)
+    perror("SimbricksCapture: write failed");
+  cap->wbuf_len = 0;
+}
+
+/** Move records from the ring into the write buffer. Returns whether there
+ * were any. */
+static bool CaptureDrain(struct SimbricksCapture *cap) {
+  size_t head = atomic_load_explicit(&cap->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&cap->tail, memory_order_acquire);
+  if (head == tail)
+    return false;
+
+  while (head != tail) {
+    size_t off = head % cap->ring_size;
+    const struct CaptureRec *rec = (const void *)(cap->ring + off);
+    if (rec->size == 0) {
+      head += cap->ring_size - off;
+      continue;
+    }
+
+    size_t bytes = sizeof(struct PcapRecHdr) + rec->caplen;
+    if (cap->params.rotate_bytes && cap->file_bytes > sizeof(struct PcapFileHdr)
+        && cap->file_bytes + bytes > cap->params.rotate_bytes) {
+      CaptureFlush(cap);
+      fclose(cap->file);
+      cap->file_idx++;
+      if (CaptureOpenFile(cap)) {
+        fprintf(stderr, "SimbricksCapture: rotation failed, stopping\n");
+        abort();
+      }
+    }
+    if (cap->wbuf_len + bytes > WRITE_BUF_SIZE)
+      CaptureFlush(cap);
+
+    struct PcapRecHdr ph;
+    ph.ts_sec = rec->ts / 1000000000000ULL;
+    ph.ts_nsec = (rec->ts % 1000000000000ULL) / 1000ULL;
+    ph.caplen = rec->caplen;
+    ph.len = rec->len;
+    memcpy(cap->wbuf + cap->wbuf_len, &ph, sizeof(ph));
+    memcpy(cap->wbuf + cap->wbuf_len + sizeof(ph), rec + 1, rec->caplen);
+    cap->wbuf_len += bytes;
+    cap->file_bytes += bytes;
+
+    head += rec->size;
+  }
+  atomic_store_explicit(&cap->head, head, memory_order_release);
+  return true;
+}
+
+static void *CaptureThread(void *arg) {
+  struct SimbricksCapture *cap = arg;
+  struct timespec idle = {0, 200000};
+  unsigned idle_rounds = 0;
+
+  while (true) {
+    bool stop = atomic_load_explicit(&cap->stop, memory_order_acquire);
+    if (CaptureDrain(cap)) {
+      idle_rounds = 0;
+      continue;
+    }
+    if (stop)
+      break;
+
+    // write out a partial buffer once things have been quiet for a while
+    if (++idle_rounds == 500)
+      CaptureFlush(cap);
+    nanosleep(&idle, NULL);
+  }
+
+  CaptureFlush(cap);
+  return NULL;
+}
+
+struct SimbricksCapture *SimbricksCaptureOpen(
+    const struct SimbricksCaptureParams *params) {
+  struct SimbricksCapture *cap = calloc(1, sizeof(*cap));
+  if (!cap)
+    return NULL;
+
+  cap->params = *params;
+  cap->snaplen = params->snaplen && params->snaplen < PCAP_MAX_SNAPLEN
+                     ? params->snaplen
+                     : PCAP_MAX_SNAPLEN;
+  if (cap->params.sample == 0)
+    cap->params.sample = 1;
+  if (params->filter && *params->filter) {
+    if (FilterCompile(&cap->filter, params->filter))
+      goto err;
+    cap->has_filter = true;
+  }
+
+  /* at least two of the largest records, records are 8-byte aligned and so
+   * has the ring size to be */
+  size_t min_ring =
+      2 * ((sizeof(struct CaptureRec) + PCAP_MAX_SNAPLEN + 7) & ~(size_t)7);
+  cap->ring_size = params->ring_size > min_ring ? params->ring_size : min_ring;
+  cap->ring_size = (cap->ring_size + 7) & ~(size_t)7;
+  cap->ring = malloc(cap->ring_size);
+  cap->wbuf = malloc(WRITE_BUF_SIZE);
+  if (!cap->ring || !cap->wbuf)
+    goto err;
+
+  if (CaptureOpenFile(cap))
+    goto err;
+
+  if (pthread_create(&cap->thread, NULL, CaptureThread, cap)) {
+    perror("SimbricksCaptureOpen: pthread_create failed");
+    fclose(cap->file);
+    goto err;
+  }
+  return cap;
+
+err:
+  free(cap->ring);
+  free(cap->wbuf);
+  free(cap);
+  return NULL;
+}
+
+void SimbricksCapturePacket(struct SimbricksCapture *cap, uint64_t ts,
+                            const void *data, size_t len, int iport,
+                            int eport) {
+  if (cap->params.port >= 0 && iport != cap->params.port &&
+      eport != cap->params.port)
+    return;
+
+  if (cap->has_filter) {
+    struct PacketInfo pi;
+    PacketParse(&pi, data, len);
+    if (!FilterEval(&cap->filter, cap->filter.root, &pi))
+      return;
+  }
+
+  if (cap->sample_cnt++ % cap->params.sample)
+    return;
+
+  uint32_t caplen = len < cap->snaplen ? len : cap->snaplen;
+  size_t size = (sizeof(struct CaptureRec) + caplen + 7) & ~(size_t)7;
+  size_t tail = atomic_load_explicit(&cap->tail, memory_order_relaxed);
+  size_t off = tail % cap->ring_size;
+  size_t skip = off + size > cap->ring_size ? cap->ring_size - off : 0;
+  if (tail + skip + size - cap->head_cache > cap->ring_size) {
+    cap->head_cache = atomic_load_explicit(&cap->head, memory_order_acquire);
+    if (tail + skip + size - cap->head_cache > cap->ring_size) {
+      cap->drops++;
+      return;
+    }
+  }
+
+  if (skip) {
+    ((struct CaptureRec *)(void *)(cap->ring + off))->size = 0;
+    tail += skip;
+    off = 0;
+  }
+  struct CaptureRec *rec = (void *)(cap->ring + off);
+  rec->size = size;
+  rec->caplen = caplen;
+  rec->len = len;
+  rec->ts = ts;
+  memcpy(rec + 1, data, caplen);
+  atomic_store_explicit(&cap->tail, tail + size, memory_order_release);
+}
+
+void SimbricksCaptureClose(struct SimbricksCapture *cap) {
+  atomic_store_explicit(&cap->stop, true, memory_order_release);
+  pthread_join(cap->thread, NULL);
+  fclose(cap->file);
+
+  if (cap->drops)
+    fprintf(stderr,
+            "SimbricksCapture: %lu packets not captured (ring full)\n",
+            cap->drops);
+
+  free(cap->ring);
+  free(cap->wbuf);
+  free(cap);
+}
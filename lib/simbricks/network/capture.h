@@ -0,0 +1,99 @@
+/*
+ * Copyright 2024 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SIMBRICKS_NETWORK_CAPTURE_H_
+#define SIMBRICKS_NETWORK_CAPTURE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Packet capture to pcap files (nanosecond timestamps, Ethernet link type)
+ * off the forwarding path: packets are filtered and copied into a lock-free
+ * ring, a background thread drains the ring and writes the file in large
+ * chunks. If the ring is full the packet is not captured (and counted),
+ * capturing never blocks the caller.
+ *
+ * A capture has a single producer, callers capturing from multiple threads
+ * need to serialize SimbricksCapturePacket().
+ */
+struct SimbricksCapture;
+
+/** Parameters for a capture */
+struct SimbricksCaptureParams {
+  /** Output file, rotated files get a .1, .2, ... suffix */
+  const char *path;
+  /** Bytes captured per packet, 0 for the whole frame */
+  uint32_t snaplen;
+  /** Capture only one in this many (matching) packets, 0 or 1 for all */
+  uint32_t sample;
+  /** Start a new file once this many bytes were written, 0 for never */
+  uint64_t rotate_bytes;
+  /** Only capture packets entering or leaving this port, -1 for all */
+  int port;
+  /** Filter expression (see SimbricksCaptureParseOpt()), NULL for none */
+  const char *filter;
+  /** Size of the ring between producer and writer thread [bytes] */
+  size_t ring_size;
+};
+
+void SimbricksCaptureDefaultParams(struct SimbricksCaptureParams *params);
+
+/**
+ * Parse a capture option of the form
+ *   PATH[,snaplen=N][,sample=N][,rotate=N[k|m|g]][,port=N][,ring=N[k|m|g]]
+ *       [,filter=EXPR]
+ * into params (which should hold the defaults). The filter has to come last
+ * and extends to the end of the string. It is a subset of the BPF syntax:
+ * primitives ip, ip6, arp, tcp, udp, icmp, vlan, [src|dst] host A.B.C.D,
+ * [src|dst] port N, ether [src|dst] host XX:XX:XX:XX:XX:XX, ether proto N,
+ * less N and greater N, combined with and/&&, or/||, not/! and
+ * parentheses. The string is modified and referenced from params.
+ *
+ * @return 0 on success, -1 on a malformed option.
+ */
+int SimbricksCaptureParseOpt(struct SimbricksCaptureParams *params, char *opt);
+
+/** Open the output file and start the writer thread. NULL on error. */
+struct SimbricksCapture *SimbricksCaptureOpen(
+    const struct SimbricksCaptureParams *params);
+
+/**
+ * Capture a packet.
+ *
+ * @param cap    Capture handle.
+ * @param ts     Timestamp [picoseconds].
+ * @param data   Ethernet frame.
+ * @param len    Length of the frame.
+ * @param iport  Port the packet arrived on, -1 if none.
+ * @param eport  Port the packet leaves on, -1 if none.
+ */
+void SimbricksCapturePacket(struct SimbricksCapture *cap, uint64_t ts,
+                            const void *data, size_t len, int iport,
+                            int eport);
+
+/** Write out everything captured so far, stop the thread, close the file. */
+void SimbricksCaptureClose(struct SimbricksCapture *cap);
+
+#endif  // SIMBRICKS_NETWORK_CAPTURE_H_
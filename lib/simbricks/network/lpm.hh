@@ -0,0 +1,210 @@
+/*
+ * Copyright 2024 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef SIMBRICKS_NETWORK_LPM_HH_
+#define SIMBRICKS_NETWORK_LPM_HH_
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace simbricks {
+
+/**
+ * IPv4 longest prefix match table mapping prefixes to 15-bit values, DIR-24-8
+ * style: the first 24 address bits index a table of 2^24 entries (32 MB)
+ * that holds the value directly for prefixes of up to 24 bits, so most
+ * lookups are a single memory access. Entries covered by longer prefixes
+ * instead point to a group of 256 entries indexed by the last address byte.
+ *
+ * Routes are collected with Add() and the table is (re)built with Build().
+ */
+class Lpm4 {
+ public:
+  static constexpr uint16_t kNone = 0;
+  static constexpr uint16_t kMaxValue = 0x7fff;
+
+  /** Map `prefix` (host byte order) of length `len` to `value` (1 to
+   * kMaxValue). Of identical prefixes the one added last wins. */
+  void Add(uint32_t prefix, unsigned len, uint16_t value) {
+    assert(len <= 32 && value != kNone && value <= kMaxValue);
+    uint32_t mask = len ? ~0U << (32 - len) : 0;
+    rules_.push_back({prefix & mask, (uint8_t)len, value});
+  }
+
+  void Build() {
+    tbl24_.assign(1 << 24, kNone);
+    tbl8_.clear();
+    // shorter prefixes first so longer ones overwrite them
+    std::stable_sort(rules_.begin(), rules_.end(),
+                     [](const Rule &a, const Rule &b) {
+                       return a.len < b.len;
+                     });
+
+    for (const Rule &r : rules_) {
+      if (r.len <= 24) {
+        size_t first = r.prefix >> 8;
+        size_t n = (size_t)1 << (24 - r.len);
+        std::fill(tbl24_.begin() + first, tbl24_.begin() + first + n, r.value);
+        continue;
+      }
+
+      uint16_t &e = tbl24_[r.prefix >> 8];
+      if (!(e & kGroup)) {
+        size_t group = tbl8_.size() >> 8;
+        assert(group <= kMaxValue);
+        tbl8_.resize(tbl8_.size() + 256, e);
+        e = kGroup | group;
+      }
+      size_t first = (size_t)(e & ~kGroup) << 8 | (r.prefix & 0xff);
+      size_t n = (size_t)1 << (32 - r.len);
+      std::fill(tbl8_.begin() + first, tbl8_.begin() + first + n, r.value);
+    }
+  }
+
+  /** Value of the longest prefix matching `addr` (host byte order), kNone if
+   * there is none. Only valid after Build(). */
+  uint16_t Lookup(uint32_t addr) const {
+    uint16_t e = tbl24_[addr >> 8];
+    if (e & kGroup)
+      e = tbl8_[(size_t)(e & ~kGroup) << 8 | (addr & 0xff)];
+    return e;
+  }
+
+ private:
+  static constexpr uint16_t kGroup = 0x8000;
+
+  struct Rule {
+    uint32_t prefix;
+    uint8_t len;
+    uint16_t value;
+  };
+
+  std::vector<Rule> rules_;
+  std::vector<uint16_t> tbl24_;
+  std::vector<uint16_t> tbl8_;
+};
+
+/**
+ * IPv6 longest prefix match table, a trie with 8-bit strides. Each node
+ * covers one address byte and holds, per byte value, the value of the
+ * longest prefix ending in that node (prefixes not ending on a byte boundary
+ * are expanded over the byte values they cover) and the child node for the
+ * next byte. A lookup visits at most 16 nodes and remembers the last value
+ * seen on the way.
+ *
+ * Routes are collected with Add() and the table is (re)built with Build().
+ */
+class Lpm6 {
+ public:
+  static constexpr uint16_t kNone = 0;
+
+  /** Map `prefix` of length `len` to `value` (not kNone). Of identical
+   * prefixes the one added last wins. */
+  void Add(const uint8_t *prefix, unsigned len, uint16_t value) {
+    assert(len <= 128 && value != kNone);
+    Rule r;
+    memcpy(r.prefix, prefix, 16);
+    r.len = len;
+    r.value = value;
+    rules_.push_back(r);
+  }
+
+  void Build() {
+    nodes_.assign(1, Node());
+    default_ = kNone;
+    std::stable_sort(rules_.begin(), rules_.end(),
+                     [](const Rule &a, const Rule &b) {
+                       return a.len < b.len;
+                     });
+
+    for (const Rule &r : rules_) {
+      if (r.len == 0) {
+        default_ = r.value;
+        continue;
+      }
+
+      // node for the byte the prefix ends in
+      unsigned level = (r.len - 1) / 8;
+      size_t node = 0;
+      for (unsigned i = 0; i < level; i++) {
+        uint8_t b = r.prefix[i];
+        if (!nodes_[node].child[b]) {
+          uint32_t child = nodes_.size();
+          nodes_.emplace_back();
+          nodes_[node].child[b] = child;
+        }
+        node = nodes_[node].child[b];
+      }
+
+      unsigned bits = r.len - level * 8;
+      unsigned first = r.prefix[level] & (0xff00 >> bits);
+      unsigned n = 1 << (8 - bits);
+      Node &nd = nodes_[node];
+      std::fill(nd.value + first, nd.value + first + n, r.value);
+    }
+  }
+
+  /** Value of the longest prefix matching `addr`, kNone if there is none.
+   * Only valid after Build(). */
+  uint16_t Lookup(const uint8_t *addr) const {
+    uint16_t best = default_;
+    size_t node = 0;
+    for (unsigned i = 0; i < 16; i++) {
+      const Node &nd = nodes_[node];
+      uint8_t b = addr[i];
+      if (nd.value[b] != kNone)
+        best = nd.value[b];
+      // the root is never a child, so 0 marks a missing one
+      if (!nd.child[b])
+        break;
+      node = nd.child[b];
+    }
+    return best;
+  }
+
+ private:
+  struct Node {
+    uint16_t value[256] = {};
+    uint32_t child[256] = {};
+  };
+
+  struct Rule {
+    uint8_t prefix[16];
+    uint8_t len;
+    uint16_t value;
+  };
+
+  std::vector<Rule> rules_;
+  std::vector<Node> nodes_;
+  uint16_t default_ = kNone;
+};
+
+}  // namespace simbricks
+
+#endif  // SIMBRICKS_NETWORK_LPM_HH_
@@ -0,0 +1,264 @@
+/*
+ * Copyright 2024 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SIMBRICKS_NETWORK_MAC_TABLE_HH_
+#define SIMBRICKS_NETWORK_MAC_TABLE_HH_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace simbricks {
+
+/** Pack a 6-byte MAC address into the low 48 bits of a 64-bit key. */
+static inline uint64_t MacKey(const void *mac) {
+  uint64_t key = 0;
+  memcpy(&key, mac, 6);
+  return key;
+}
+
+/** Group (multicast or broadcast) addresses have the I/G bit set. */
+static inline bool MacIsGroup(uint64_t key) {
+  return key & 1;
+}
+
+/**
+ * Learning table mapping MAC addresses to switch ports.
+ *
+ * Open addressing over cache-line sized buckets: a lookup hashes the packed
+ * 48-bit address to a bucket and normally finds it within that one line,
+ * probing linearly to following buckets on overflow. Entries remember when
+ * they were last seen and expire after the aging time (in simulated
+ * picoseconds) has passed. Expired entries keep their slot until a learn
+ * reuses it or the table is rehashed, so probe chains never break and no
+ * tombstones are needed. Static entries never expire and are never moved
+ * by learning.
+ */
+class MacTable {
+ public:
+  static constexpr int kNoPort = -1;
+  /** 802.1D default aging time of 300 s */
+  static constexpr uint64_t kDefaultAgeTime = 300ULL * 1000000000000ULL;
+
+  explicit MacTable(uint64_t age_time = kDefaultAgeTime,
+                    size_t n_buckets = 64)
+      : age_time_(age_time), used_(0) {
+    size_t n = 1;
+    while (n < n_buckets)
+      n <<= 1;
+    buckets_.resize(n);
+    mask_ = n - 1;
+  }
+
+  void SetAgeTime(uint64_t age_time) {
+    age_time_ = age_time;
+  }
+
+  uint64_t AgeTime() const {
+    return age_time_;
+  }
+
+  /** Number of entry slots, used or not. */
+  size_t Capacity() const {
+    return buckets_.size() * kWays;
+  }
+
+  /** Learn that `mac` was seen as a source on `port` at time `now`. Group
+   * addresses are never learned. Returns whether the table was written. */
+  bool Learn(const void *mac, int port, uint64_t now) {
+    uint64_t key = MacKey(mac);
+    if (MacIsGroup(key))
+      return false;
+    return Insert(key, port, now, 0);
+  }
+
+  /** Pin `mac` to `port` permanently. */
+  void AddStatic(const void *mac, int port) {
+    Insert(MacKey(mac), port, 0, kStatic);
+  }
+
+  /** Port `mac` was last learned on, or kNoPort if unknown or expired. */
+  int Lookup(const void *mac, uint64_t now) const {
+    uint64_t key = MacKey(mac);
+    if (MacIsGroup(key))
+      return kNoPort;
+
+    const Bucket *bk;
+    int i;
+    if (!Find(key, bk, i) || Expired(*bk, i, now))
+      return kNoPort;
+    return bk->ports[i];
+  }
+
+  bool Contains(const void *mac) const {
+    const Bucket *bk;
+    int i;
+    return Find(MacKey(mac), bk, i);
+  }
+
+  /** Call `f(const uint8_t *mac, int port)` for every live entry. */
+  template <typename F>
+  void ForEach(uint64_t now, F f) const {
+    for (const Bucket &bk : buckets_) {
+      for (int i = 0; i < kWays; i++) {
+        if (!bk.keys[i] || Expired(bk, i, now))
+          continue;
+        uint64_t key = bk.keys[i];
+        f(reinterpret_cast<const uint8_t *>(&key), bk.ports[i]);
+      }
+    }
+  }
+
+ private:
+  static constexpr int kWays = 3;
+  static constexpr uint64_t kValid = 1ULL << 63;
+  static constexpr uint64_t kStatic = 1ULL << 62;
+
+  /** keys hold the packed address plus kValid/kStatic, 0 marks a slot that
+   * was never used (and so ends every probe chain through it) */
+  struct alignas(64) Bucket {
+    uint64_t keys[kWays];
+    uint64_t seen[kWays];
+    uint16_t ports[kWays];
+  };
+  static_assert(sizeof(Bucket) == 64, "bucket must fill one cache line");
+
+  std::vector<Bucket> buckets_;
+  size_t mask_;
+  uint64_t age_time_;
+  size_t used_;
+
+  size_t Hash(uint64_t key) const {
+    return (key * 0x9E3779B97F4A7C15ULL) >> 32 & mask_;
+  }
+
+  bool Expired(const Bucket &bk, int i, uint64_t now) const {
+    return age_time_ && !(bk.keys[i] & kStatic) && now > bk.seen[i] &&
+           now - bk.seen[i] > age_time_;
+  }
+
+  bool Find(uint64_t key, const Bucket *&bk, int &i) const {
+    uint64_t tag = key | kValid;
+    for (size_t b = Hash(key), n = 0; n <= mask_; b = (b + 1) & mask_, n++) {
+      bk = &buckets_[b];
+      for (i = 0; i < kWays; i++) {
+        if ((bk->keys[i] & ~kStatic) == tag)
+          return true;
+        if (!bk->keys[i])
+          return false;
+      }
+    }
+    return false;
+  }
+
+  bool Insert(uint64_t key, int port, uint64_t now, uint64_t flags) {
+    assert(port >= 0 && port <= UINT16_MAX);
+    uint64_t tag = key | kValid;
+    Bucket *reuse = nullptr;
+    int reuse_i = 0;
+
+    for (size_t b = Hash(key), n = 0; n <= mask_; b = (b + 1) & mask_, n++) {
+      Bucket &bk = buckets_[b];
+      for (int i = 0; i < kWays; i++) {
+        if ((bk.keys[i] & ~kStatic) == tag) {
+          // static entries are only ever replaced by static ones
+          if ((bk.keys[i] & kStatic) && !flags)
+            return false;
+          // without aging there is no last-seen time to refresh
+          if (!flags && bk.ports[i] == port && !age_time_)
+            return false;
+          bk.keys[i] = tag | flags;
+          bk.ports[i] = port;
+          bk.seen[i] = now;
+          return true;
+        }
+        if (!bk.keys[i]) {
+          if (!reuse) {
+            // keep the load factor below 3/4 so chains stay short
+            if ((used_ + 1) * 4 > buckets_.size() * kWays * 3) {
+              Rehash(now);
+              return Insert(key, port, now, flags);
+            }
+            reuse = &bk;
+            reuse_i = i;
+            used_++;
+          }
+          reuse->keys[reuse_i] = tag | flags;
+          reuse->ports[reuse_i] = port;
+          reuse->seen[reuse_i] = now;
+          return true;
+        }
+        if (!reuse && Expired(bk, i, now)) {
+          reuse = &bk;
+          reuse_i = i;
+        }
+      }
+    }
+
+    // no never-used slot left on the whole probe path
+    if (reuse) {
+      reuse->keys[reuse_i] = tag | flags;
+      reuse->ports[reuse_i] = port;
+      reuse->seen[reuse_i] = now;
+      return true;
+    }
+    Rehash(now);
+    return Insert(key, port, now, flags);
+  }
+
+  /** Rebuild without expired entries, doubling unless that frees enough. */
+  void Rehash(uint64_t now) {
+    std::vector<Bucket> old;
+    old.swap(buckets_);
+
+    size_t live = 0;
+    for (const Bucket &bk : old)
+      for (int i = 0; i < kWays; i++)
+        if (bk.keys[i] && !Expired(bk, i, now))
+          live++;
+
+    size_t n = old.size();
+    if (live * 2 > n * kWays)
+      n *= 2;
+    buckets_.clear();
+    buckets_.resize(n);
+    mask_ = n - 1;
+    used_ = 0;
+
+    for (const Bucket &bk : old) {
+      for (int i = 0; i < kWays; i++) {
+        if (!bk.keys[i] || Expired(bk, i, now))
+          continue;
+        uint64_t key = bk.keys[i] & ~(kValid | kStatic);
+        Insert(key, bk.ports[i], bk.seen[i], bk.keys[i] & kStatic);
+      }
+    }
+  }
+};
+
+}  // namespace simbricks
+
+#endif  // SIMBRICKS_NETWORK_MAC_TABLE_HH_
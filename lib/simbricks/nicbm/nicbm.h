@@ -52,11 +52,14 @@ class DMAOp {
 
 class TimedEvent {
  public:
-  TimedEvent() : time_(0), priority_(0) {
+  TimedEvent() : time_(0), priority_(0), kind_(0) {
   }
   virtual ~TimedEvent() = default;
   uint64_t time_;
   int priority_;
+  /** Device-defined tag for the concrete event type, so `Device::Timed` can
+   * dispatch with a switch instead of RTTI. Ignored by the runner. */
+  int kind_;
 };
 
 /**
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <simbricks/base/if.h>
 
 struct SimbricksAdapterParams {
@@ -33,4 +34,31 @@ int SimbricksParametersEstablish(struct SimBricksBaseIfEstablishData *ifs,
                                  struct SimbricksBaseIfSHMPool *pool,
                                  const char *pool_path);
 
+/**
+ * Parse a size with an optional k, m or g suffix (powers of 1024), with the
+ * same number syntax as strtoull() in base 0. `*end` is set past the suffix,
+ * callers reject the value if anything they do not expect follows.
+ */
+static inline uint64_t SimbricksParseSize(const char *str, char **end) {
+    uint64_t val = strtoull(str, end, 0);
+    if (*end == str)
+        return 0;
+    switch (**end) {
+        case 'g':
+        case 'G':
+            val <<= 10;
+            // fall through
+        case 'm':
+        case 'M':
+            val <<= 10;
+            // fall through
+        case 'k':
+        case 'K':
+            val <<= 10;
+            (*end)++;
+            break;
+    }
+    return val;
+}
+
 #endif // UTILS_PARSER_H_
\ No newline at end of file
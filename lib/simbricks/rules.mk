@@ -33,6 +33,7 @@ $(eval $(call subdir,network))
 $(eval $(call subdir,pcie))
 $(eval $(call subdir,nicif))
 $(eval $(call subdir,nicbm))
+$(eval $(call subdir,netport))
 
 $(lib_simbricks): $(libsimbricks_objs)
 	$(AR) rcs $@ $(libsimbricks_objs)
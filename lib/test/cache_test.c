@@ -0,0 +1,199 @@
+/*
+ * Copyright 2025 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sims/mem/memnic/cache.h"
+
+#include <stdio.h>
+
+#define TEST_CASE(test_fn, name) \
+    printf("Executing test %s\n", name); \
+    if (test_fn()) { \
+        printf("SUCCESS: %s\n", name); \
+    } else { \
+        fprintf(stderr, "FAILED: %s\n", name); \
+    }
+
+#define LINE 64
+
+// fill the single set of `c` with lines 0..ways-1
+static void fill_set(struct MemCache *c) {
+    for (unsigned i = 0; i < c->ways; i++) {
+        uint64_t addr = i * LINE * c->num_sets;
+        MemCacheInstall(c, MemCacheVictim(c, 0, addr), 0, addr);
+    }
+}
+
+// check that the victim for a new line in set 0 holds line `n` of fill_set
+static bool check_victim(struct MemCache *c, unsigned n) {
+    uint64_t addr = 100 * LINE * c->num_sets;
+    struct MemCacheLine *l = MemCacheVictim(c, 0, addr);
+    uint64_t expected = n * LINE * c->num_sets;
+    if (!l->valid || l->addr != expected) {
+        fprintf(stderr, "Victim holds %lx but expected %lx\n",
+            l->valid ? l->addr : ~0UL, expected);
+        return false;
+    }
+    return true;
+}
+
+static bool touch(struct MemCache *c, unsigned n) {
+    if (!MemCacheLookup(c, 0, n * LINE * c->num_sets, true)) {
+        fprintf(stderr, "Line %u is not cached\n", n);
+        return false;
+    }
+    return true;
+}
+
+static bool test_init() {
+    struct MemCache c;
+    if (MemCacheInit(&c, 0, LINE, 4, kMemCacheLru) == 0 ||
+            MemCacheInit(&c, 4096, 0, 4, kMemCacheLru) == 0 ||
+            MemCacheInit(&c, 4096, 48, 4, kMemCacheLru) == 0 ||
+            MemCacheInit(&c, 4096, LINE, 0, kMemCacheLru) == 0 ||
+            MemCacheInit(&c, 4096 + LINE, LINE, 4, kMemCacheLru) == 0 ||
+            MemCacheInit(&c, 4096, LINE, 3, kMemCacheLru) == 0) {
+        fprintf(stderr, "Invalid parameters were accepted\n");
+        return false;
+    }
+
+    if (MemCacheInit(&c, 4096, LINE, 4, kMemCacheLru) != 0) {
+        fprintf(stderr, "Valid parameters were rejected\n");
+        return false;
+    }
+    if (c.num_sets != 16 || c.line_shift != 6) {
+        fprintf(stderr, "Cache has %zu sets and line shift %u\n", c.num_sets,
+            c.line_shift);
+        return false;
+    }
+
+    // a fully associative cache with a single set
+    if (MemCacheInit(&c, 3 * LINE, LINE, 3, kMemCacheClock) != 0 ||
+            c.num_sets != 1) {
+        fprintf(stderr, "Single set cache was rejected\n");
+        return false;
+    }
+    return true;
+}
+
+static bool test_lookup() {
+    struct MemCache c;
+    if (MemCacheInit(&c, 4096, LINE, 4, kMemCacheLru) != 0)
+        return false;
+
+    // lines of consecutive addresses go to different sets
+    struct MemCacheLine *a = MemCacheVictim(&c, 1, 0);
+    MemCacheInstall(&c, a, 1, 0);
+    struct MemCacheLine *b = MemCacheVictim(&c, 1, LINE);
+    MemCacheInstall(&c, b, 1, LINE);
+    if ((a - c.lines) / c.ways == (b - c.lines) / c.ways) {
+        fprintf(stderr, "Adjacent lines share a set\n");
+        return false;
+    }
+
+    if (MemCacheLookup(&c, 1, 0, true) != a ||
+            MemCacheLookup(&c, 1, LINE, true) != b ||
+            MemCacheLookup(&c, 2, 0, true) != NULL ||
+            MemCacheLookup(&c, 1, 2 * LINE, true) != NULL ||
+            MemCacheLookup(&c, 2, LINE, false) != NULL) {
+        fprintf(stderr, "Lookup returned the wrong line\n");
+        return false;
+    }
+    if (c.hits != 2 || c.misses != 2) {
+        fprintf(stderr, "Counted %lu hits and %lu misses but expected 2 and "
+            "2\n", c.hits, c.misses);
+        return false;
+    }
+    return true;
+}
+
+static bool test_lru() {
+    struct MemCache c;
+    if (MemCacheInit(&c, 4 * LINE, LINE, 4, kMemCacheLru) != 0)
+        return false;
+
+    // free ways are used first
+    for (unsigned i = 0; i < 4; i++) {
+        struct MemCacheLine *l = MemCacheVictim(&c, 0, i * LINE);
+        if (l != &c.lines[i] || l->valid) {
+            fprintf(stderr, "Victim %u is not the next free way\n", i);
+            return false;
+        }
+        MemCacheInstall(&c, l, 0, i * LINE);
+    }
+
+    // installed in order, the first is least recently used
+    if (!check_victim(&c, 0))
+        return false;
+    if (!(touch(&c, 1) && touch(&c, 0) && touch(&c, 3) && check_victim(&c, 2)))
+        return false;
+
+    // lookups without touch leave the order alone
+    MemCacheLookup(&c, 0, 2 * LINE, false);
+    if (!check_victim(&c, 2))
+        return false;
+
+    // replacing the victim makes the next oldest one the victim
+    struct MemCacheLine *l = MemCacheVictim(&c, 0, 100 * LINE);
+    MemCacheInstall(&c, l, 0, 100 * LINE);
+    return check_victim(&c, 1) && touch(&c, 1) && check_victim(&c, 0);
+}
+
+static bool test_clock() {
+    struct MemCache c;
+    if (MemCacheInit(&c, 4 * LINE, LINE, 4, kMemCacheClock) != 0)
+        return false;
+    fill_set(&c);
+
+    // all lines referenced: the hand clears every bit and comes back to 0
+    if (!check_victim(&c, 0))
+        return false;
+    for (unsigned i = 0; i < 4; i++) {
+        if (c.lines[i].ref) {
+            fprintf(stderr, "Line %u still has its referenced bit\n", i);
+            return false;
+        }
+    }
+
+    // the hand moved past the victim, line 1 is next
+    MemCacheInstall(&c, &c.lines[0], 0, 100 * LINE);
+    if (!check_victim(&c, 1))
+        return false;
+
+    // a referenced line gets a second chance
+    if (!(touch(&c, 2) && check_victim(&c, 3)))
+        return false;
+    if (c.lines[2].ref) {
+        fprintf(stderr, "Second chance did not clear the referenced bit\n");
+        return false;
+    }
+    // the hand wrapped around, the newly installed line 0 is referenced
+    return check_victim(&c, 1);
+}
+
+int main(void) {
+    TEST_CASE(test_init, "test_init")
+    TEST_CASE(test_lookup, "test_lookup")
+    TEST_CASE(test_lru, "test_lru")
+    TEST_CASE(test_clock, "test_clock")
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2025 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+
+#include "lib/simbricks/network/lpm.hh"
+
+using simbricks::Lpm4;
+using simbricks::Lpm6;
+
+#define TEST_CASE(test_fn, name) \
+    printf("Executing test %s\n", name); \
+    if (test_fn()) { \
+        printf("SUCCESS: %s\n", name); \
+    } else { \
+        fprintf(stderr, "FAILED: %s\n", name); \
+    }
+
+static uint32_t ip4(const char *s) {
+    struct in_addr a;
+    inet_pton(AF_INET, s, &a);
+    return ntohl(a.s_addr);
+}
+
+struct Ip6 {
+    uint8_t b[16];
+};
+
+static Ip6 ip6(const char *s) {
+    Ip6 a;
+    inet_pton(AF_INET6, s, a.b);
+    return a;
+}
+
+static bool check4(const Lpm4 &lpm, const char *addr, uint16_t expected) {
+    uint16_t v = lpm.Lookup(ip4(addr));
+    if (v != expected) {
+        fprintf(stderr, "Lookup of %s returned %u but expected %u\n", addr, v,
+            expected);
+        return false;
+    }
+    return true;
+}
+
+static bool check6(const Lpm6 &lpm, const char *addr, uint16_t expected) {
+    uint16_t v = lpm.Lookup(ip6(addr).b);
+    if (v != expected) {
+        fprintf(stderr, "Lookup of %s returned %u but expected %u\n", addr, v,
+            expected);
+        return false;
+    }
+    return true;
+}
+
+static bool test_lpm4_longest() {
+    Lpm4 lpm;
+    lpm.Add(ip4("10.1.2.129"), 32, 5);
+    lpm.Add(ip4("10.1.2.128"), 25, 4);
+    lpm.Add(ip4("10.0.0.0"), 8, 1);
+    lpm.Add(ip4("10.1.2.0"), 24, 3);
+    lpm.Add(ip4("10.1.0.0"), 16, 2);
+    lpm.Build();
+
+    return check4(lpm, "10.9.9.9", 1) &&
+        check4(lpm, "10.1.9.9", 2) &&
+        check4(lpm, "10.1.2.5", 3) &&
+        check4(lpm, "10.1.2.127", 3) &&
+        check4(lpm, "10.1.2.128", 4) &&
+        check4(lpm, "10.1.2.200", 4) &&
+        check4(lpm, "10.1.2.129", 5) &&
+        check4(lpm, "11.0.0.1", Lpm4::kNone) &&
+        check4(lpm, "9.255.255.255", Lpm4::kNone);
+}
+
+static bool test_lpm4_default() {
+    Lpm4 lpm;
+    lpm.Add(ip4("192.168.0.0"), 16, 1);
+    lpm.Add(ip4("192.168.7.8"), 30, 2);
+    // host bits of the prefix are ignored
+    lpm.Add(ip4("1.2.3.4"), 0, 7);
+    lpm.Build();
+
+    return check4(lpm, "0.0.0.0", 7) &&
+        check4(lpm, "255.255.255.255", 7) &&
+        check4(lpm, "192.169.0.1", 7) &&
+        check4(lpm, "192.168.3.3", 1) &&
+        check4(lpm, "192.168.7.11", 2) &&
+        check4(lpm, "192.168.7.12", 1);
+}
+
+static bool test_lpm4_overlap() {
+    Lpm4 lpm;
+    lpm.Add(ip4("10.1.0.0"), 16, 1);
+    lpm.Add(ip4("10.1.3.16"), 28, 2);
+    lpm.Add(ip4("10.1.3.0"), 24, 3);
+    lpm.Add(ip4("10.1.3.20"), 30, 4);
+    // identical prefix, the later one wins
+    lpm.Add(ip4("10.1.3.0"), 24, 5);
+    lpm.Build();
+
+    if (!(check4(lpm, "10.1.4.1", 1) &&
+            check4(lpm, "10.1.3.1", 5) &&
+            check4(lpm, "10.1.3.16", 2) &&
+            check4(lpm, "10.1.3.19", 2) &&
+            check4(lpm, "10.1.3.20", 4) &&
+            check4(lpm, "10.1.3.23", 4) &&
+            check4(lpm, "10.1.3.24", 2) &&
+            check4(lpm, "10.1.3.32", 5)))
+        return false;
+
+    // rebuilding keeps the earlier routes and picks up new ones
+    lpm.Add(ip4("10.1.3.0"), 25, 6);
+    lpm.Build();
+    return check4(lpm, "10.1.3.1", 6) &&
+        check4(lpm, "10.1.3.21", 4) &&
+        check4(lpm, "10.1.3.200", 5) &&
+        check4(lpm, "10.1.4.1", 1);
+}
+
+static bool test_lpm6_longest() {
+    Lpm6 lpm;
+    lpm.Add(ip6("2001:db8::").b, 32, 1);
+    lpm.Add(ip6("2001:db8:0:1::").b, 64, 2);
+    lpm.Add(ip6("2001:db8:0:1::1").b, 128, 3);
+    lpm.Build();
+
+    return check6(lpm, "2001:db8:ffff::1", 1) &&
+        check6(lpm, "2001:db8:0:1::2", 2) &&
+        check6(lpm, "2001:db8:0:1::1", 3) &&
+        check6(lpm, "2001:db8:0:2::1", 1) &&
+        check6(lpm, "2001:db9::1", Lpm6::kNone) &&
+        check6(lpm, "::", Lpm6::kNone);
+}
+
+static bool test_lpm6_default() {
+    Lpm6 lpm;
+    lpm.Add(ip6("fd00::").b, 8, 1);
+    lpm.Add(ip6("::").b, 0, 9);
+    lpm.Build();
+
+    return check6(lpm, "fd12::1", 1) &&
+        check6(lpm, "fe80::1", 9) &&
+        check6(lpm, "::", 9) &&
+        check6(lpm, "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff", 9);
+}
+
+static bool test_lpm6_unaligned() {
+    Lpm6 lpm;
+    lpm.Add(ip6("2000::").b, 3, 1);
+    lpm.Add(ip6("2001:db8::").b, 32, 2);
+    lpm.Add(ip6("2001:db8:0:10::").b, 60, 3);
+    lpm.Add(ip6("2001:db8:0:10:8000::").b, 65, 4);
+    lpm.Add(ip6("2001:db8::2").b, 127, 5);
+    lpm.Build();
+
+    return check6(lpm, "3fff::1", 1) &&
+        check6(lpm, "4000::1", Lpm6::kNone) &&
+        check6(lpm, "1fff::1", Lpm6::kNone) &&
+        check6(lpm, "2001:db8:0:10::1", 3) &&
+        check6(lpm, "2001:db8:0:1f:ffff::1", 3) &&
+        check6(lpm, "2001:db8:0:20::1", 2) &&
+        check6(lpm, "2001:db8:0:f::1", 2) &&
+        check6(lpm, "2001:db8:0:10:8000::1", 4) &&
+        check6(lpm, "2001:db8:0:10:ffff::", 4) &&
+        check6(lpm, "2001:db8:0:10:7fff::1", 3) &&
+        check6(lpm, "2001:db8::2", 5) &&
+        check6(lpm, "2001:db8::3", 5) &&
+        check6(lpm, "2001:db8::1", 2) &&
+        check6(lpm, "2001:db8::4", 2);
+}
+
+int main(void) {
+    TEST_CASE(test_lpm4_longest, "test_lpm4_longest")
+    TEST_CASE(test_lpm4_default, "test_lpm4_default")
+    TEST_CASE(test_lpm4_overlap, "test_lpm4_overlap")
+    TEST_CASE(test_lpm6_longest, "test_lpm6_longest")
+    TEST_CASE(test_lpm6_default, "test_lpm6_default")
+    TEST_CASE(test_lpm6_unaligned, "test_lpm6_unaligned")
+}
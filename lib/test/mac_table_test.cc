@@ -0,0 +1,220 @@
+/*
+ * Copyright 2025 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "lib/simbricks/network/mac_table.hh"
+
+using simbricks::MacTable;
+
+#define TEST_CASE(test_fn, name) \
+    printf("Executing test %s\n", name); \
+    if (test_fn()) { \
+        printf("SUCCESS: %s\n", name); \
+    } else { \
+        fprintf(stderr, "FAILED: %s\n", name); \
+    }
+
+struct Mac {
+    uint8_t b[6];
+};
+
+static Mac mac(unsigned n) {
+    // locally administered unicast
+    Mac m = {{0x02, 0x00, (uint8_t)(n >> 24), (uint8_t)(n >> 16),
+              (uint8_t)(n >> 8), (uint8_t)n}};
+    return m;
+}
+
+// bucket `m` hashes to in a table of `n` buckets, mirrors MacTable::Hash
+static size_t bucket(const Mac &m, size_t n) {
+    return (simbricks::MacKey(m.b) * 0x9E3779B97F4A7C15ULL) >> 32 & (n - 1);
+}
+
+static bool check(const MacTable &tbl, unsigned n, uint64_t now,
+                  int expected) {
+    int port = tbl.Lookup(mac(n).b, now);
+    if (port != expected) {
+        fprintf(stderr, "Lookup of mac %u at %lu returned port %d but "
+            "expected %d\n", n, now, port, expected);
+        return false;
+    }
+    return true;
+}
+
+static bool check_capacity(const MacTable &tbl, size_t expected) {
+    if (tbl.Capacity() != expected) {
+        fprintf(stderr, "Capacity is %zu but expected %zu\n", tbl.Capacity(),
+            expected);
+        return false;
+    }
+    return true;
+}
+
+static bool test_aging() {
+    MacTable tbl(1000);
+    tbl.Learn(mac(1).b, 1, 0);
+    tbl.Learn(mac(2).b, 2, 500);
+    if (!(check(tbl, 1, 1000, 1) && check(tbl, 1, 1001, MacTable::kNoPort) &&
+            check(tbl, 2, 1001, 2) && check(tbl, 2, 1501, MacTable::kNoPort)))
+        return false;
+
+    // expired entries keep their slot until reused
+    if (!tbl.Contains(mac(1).b)) {
+        fprintf(stderr, "Expired entry lost its slot\n");
+        return false;
+    }
+    size_t live = 0;
+    tbl.ForEach(1001, [&live](const uint8_t *m, int port) { live++; });
+    if (live != 1) {
+        fprintf(stderr, "ForEach visited %zu entries but expected 1\n", live);
+        return false;
+    }
+
+    // learning again refreshes the entry, and moves it
+    if (!tbl.Learn(mac(1).b, 3, 1200)) {
+        fprintf(stderr, "Learn did not refresh the entry\n");
+        return false;
+    }
+    if (!(check(tbl, 1, 2200, 3) && check(tbl, 1, 2201, MacTable::kNoPort)))
+        return false;
+
+    // lookups from before the last sighting do not expire it
+    if (!check(tbl, 2, 0, 2))
+        return false;
+
+    // an age time of 0 disables aging
+    tbl.SetAgeTime(0);
+    if (!(check(tbl, 1, UINT64_MAX, 3) && check(tbl, 2, UINT64_MAX, 2)))
+        return false;
+
+    // group addresses are never learned
+    Mac group = mac(3);
+    group.b[0] |= 1;
+    if (tbl.Learn(group.b, 1, 0) ||
+            tbl.Lookup(group.b, 0) != MacTable::kNoPort) {
+        fprintf(stderr, "Group address was learned\n");
+        return false;
+    }
+    return true;
+}
+
+static bool test_static() {
+    MacTable tbl(1000);
+    tbl.AddStatic(mac(1).b, 4);
+    tbl.Learn(mac(2).b, 5, 0);
+    if (!(check(tbl, 1, 1000000, 4) &&
+            check(tbl, 2, 1000000, MacTable::kNoPort)))
+        return false;
+
+    // learning does not move static entries
+    if (tbl.Learn(mac(1).b, 6, 2000)) {
+        fprintf(stderr, "Learn overwrote a static entry\n");
+        return false;
+    }
+    if (!check(tbl, 1, 1000000, 4))
+        return false;
+
+    // but static entries replace learned ones and each other
+    tbl.AddStatic(mac(2).b, 7);
+    tbl.AddStatic(mac(1).b, 8);
+    return check(tbl, 1, UINT64_MAX, 8) && check(tbl, 2, UINT64_MAX, 7);
+}
+
+static bool test_rehash() {
+    // 4 buckets of 3 slots, the 10th entry exceeds 3/4 load and doubles
+    MacTable tbl(0, 4);
+    if (!check_capacity(tbl, 12))
+        return false;
+    for (unsigned i = 0; i < 9; i++)
+        tbl.Learn(mac(i).b, i, 0);
+    if (!check_capacity(tbl, 12))
+        return false;
+    tbl.Learn(mac(9).b, 9, 0);
+    if (!check_capacity(tbl, 24))
+        return false;
+
+    // everything survives growing further
+    for (unsigned i = 10; i < 1000; i++)
+        tbl.Learn(mac(i).b, i % 100, 0);
+    for (unsigned i = 0; i < 1000; i++) {
+        if (!check(tbl, i, 0, i < 10 ? i : i % 100))
+            return false;
+    }
+    return true;
+}
+
+static bool test_rehash_aging() {
+    // 2 buckets of 3 slots, the 5th entry exceeds 3/4 load
+    const uint64_t age = 1000;
+    MacTable tbl(age, 2);
+
+    // two addresses for each bucket
+    std::vector<unsigned> in[2];
+    for (unsigned i = 0; in[0].size() < 2 || in[1].size() < 2; i++) {
+        std::vector<unsigned> &v = in[bucket(mac(i), 2)];
+        if (v.size() < 2)
+            v.push_back(i);
+    }
+    // and one more for bucket 1 to trigger the rehash with
+    unsigned extra = in[1].back() + 1;
+    while (bucket(mac(extra), 2) != 1)
+        extra++;
+
+    // bucket 0 gets an entry that will expire and a static one, bucket 1
+    // two live ones. The probe path of `extra` ends in bucket 1, so the
+    // expired entry is not reused and has to be dropped by the rehash.
+    tbl.Learn(mac(in[0][0]).b, 1, 0);
+    tbl.AddStatic(mac(in[0][1]).b, 2);
+    tbl.Learn(mac(in[1][0]).b, 3, 1500);
+    tbl.Learn(mac(in[1][1]).b, 4, 1500);
+    if (!check_capacity(tbl, 6))
+        return false;
+
+    // 3 live entries fit in half of the slots, so the table keeps its size
+    tbl.Learn(mac(extra).b, 5, 2000);
+    if (!check_capacity(tbl, 6))
+        return false;
+    if (tbl.Contains(mac(in[0][0]).b)) {
+        fprintf(stderr, "Expired entry survived the rehash\n");
+        return false;
+    }
+    if (!(check(tbl, in[0][1], UINT64_MAX, 2) &&
+            check(tbl, in[1][0], 2000, 3) && check(tbl, in[1][1], 2000, 4) &&
+            check(tbl, extra, 2000, 5)))
+        return false;
+
+    // entries keep their last-seen time across the rehash
+    return check(tbl, in[1][0], 2501, MacTable::kNoPort) &&
+        check(tbl, extra, 2501, 5);
+}
+
+int main(void) {
+    TEST_CASE(test_aging, "test_aging")
+    TEST_CASE(test_static, "test_static")
+    TEST_CASE(test_rehash, "test_rehash")
+    TEST_CASE(test_rehash_aging, "test_rehash_aging")
+}
@@ -0,0 +1,232 @@
+/*
+ * Copyright 2025 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sims/mem/netproto/netproto.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_CASE(test_fn, name) \
+    printf("Executing test %s\n", name); \
+    if (test_fn()) { \
+        printf("SUCCESS: %s\n", name); \
+    } else { \
+        fprintf(stderr, "FAILED: %s\n", name); \
+    }
+
+struct TestOp {
+    uint8_t type;
+    uint64_t req_id;
+    uint64_t addr;
+    uint16_t len;
+    uint64_t as_id;
+};
+
+static const struct TestOp test_ops[] = {
+    {SIMBRICKS_PROTO_MEM_H2M_MSG_READ, 1, 0x1000, 64, 7},
+    {SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE, 2, 0x2000, 16, 7},
+    {SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP, 3, 0x3000, 8, 9},
+    {SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP, 4, 0x4000, 32, 9},
+    {SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE, 5, 0x5000, 0, 7},
+};
+#define NUM_TEST_OPS (sizeof(test_ops) / sizeof(test_ops[0]))
+
+static uint8_t test_data[64];
+
+// build a frame from the first n test ops, returns false if one did not fit
+static bool build_frame(struct MemOpFrame *f, void *buf, size_t cap,
+                        size_t max_len, size_t n, uint8_t flags) {
+    MemOpFrameInit(f, buf, cap, max_len);
+    for (size_t i = 0; i < n; i++) {
+        const struct TestOp *t = &test_ops[i];
+        if (!MemOpFrameAdd(f, t->type, t->req_id, t->addr, t->len, t->as_id,
+                test_data + i)) {
+            fprintf(stderr, "Op %zu did not fit at length %zu\n", i, f->len);
+            return false;
+        }
+    }
+    MemOpFrameFinish(f, flags);
+    return true;
+}
+
+// iterate over `len` bytes of `buf` and compare with the first n test ops
+static bool check_ops(void *buf, size_t len, size_t n) {
+    struct MemOpIter it;
+    struct MemOpNext *op;
+    uint8_t *data;
+    size_t i = 0;
+
+    MemOpIterInit(&it, buf, len);
+    while ((op = MemOpIterNext(&it, &data))) {
+        if (i >= n) {
+            fprintf(stderr, "Iterator returned more than %zu ops\n", n);
+            return false;
+        }
+        const struct TestOp *t = &test_ops[i];
+        if (op->OpType != t->type || op->req_id != t->req_id ||
+                op->addr != t->addr || op->len != t->len ||
+                op->as_id != t->as_id) {
+            fprintf(stderr, "Op %zu has wrong header fields\n", i);
+            return false;
+        }
+        if (MemOpHasData(t->type) && memcmp(data, test_data + i, t->len)) {
+            fprintf(stderr, "Op %zu has wrong data\n", i);
+            return false;
+        }
+        i++;
+    }
+    if (i != n) {
+        fprintf(stderr, "Iterator returned %zu ops but expected %zu\n", i, n);
+        return false;
+    }
+    return true;
+}
+
+static bool test_single() {
+    uint8_t buf[256];
+    struct MemOpFrame f;
+    if (!build_frame(&f, buf, sizeof(buf), sizeof(buf), 1, MEMOP_F_BATCH))
+        return false;
+
+    // a read request carries no data
+    struct MemOp *op = (struct MemOp *)buf;
+    if (f.len != sizeof(struct MemOp)) {
+        fprintf(stderr, "Frame has length %zu but expected %zu\n", f.len,
+            sizeof(struct MemOp));
+        return false;
+    }
+    if (op->flags != MEMOP_F_BATCH || op->num_ops != 1) {
+        fprintf(stderr, "Frame has flags %x and %u ops\n", op->flags,
+            op->num_ops);
+        return false;
+    }
+    return check_ops(buf, f.len, 1);
+}
+
+static bool test_batch() {
+    uint8_t buf[512];
+    struct MemOpFrame f;
+    if (!build_frame(&f, buf, sizeof(buf), sizeof(buf), NUM_TEST_OPS, 0))
+        return false;
+
+    size_t expected = sizeof(struct MemOp) +
+        (NUM_TEST_OPS - 1) * sizeof(struct MemOpNext) + 16 + 8;
+    struct MemOp *op = (struct MemOp *)buf;
+    if (f.len != expected) {
+        fprintf(stderr, "Frame has length %zu but expected %zu\n", f.len,
+            expected);
+        return false;
+    }
+    if (op->flags != MEMOP_F_BATCHED || op->num_ops != NUM_TEST_OPS) {
+        fprintf(stderr, "Frame has flags %x and %u ops\n", op->flags,
+            op->num_ops);
+        return false;
+    }
+    if (!check_ops(buf, f.len, NUM_TEST_OPS))
+        return false;
+
+    // trailing bytes after the last op are ignored
+    return check_ops(buf, f.len + 10, NUM_TEST_OPS);
+}
+
+static bool test_limits() {
+    uint8_t buf[512];
+    struct MemOpFrame f;
+
+    // the first op only has to fit the buffer, the rest max_len
+    MemOpFrameInit(&f, buf, sizeof(struct MemOp) + 16, 8);
+    if (!MemOpFrameAdd(&f, SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE, 1, 0, 16, 0,
+            test_data)) {
+        fprintf(stderr, "First op was rejected\n");
+        return false;
+    }
+    if (MemOpFrameAdd(&f, SIMBRICKS_PROTO_MEM_H2M_MSG_READ, 2, 0, 8, 0,
+            NULL)) {
+        fprintf(stderr, "Op beyond max_len was accepted\n");
+        return false;
+    }
+
+    MemOpFrameInit(&f, buf, sizeof(struct MemOp) + 15, sizeof(buf));
+    if (MemOpFrameAdd(&f, SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE, 1, 0, 16, 0,
+            test_data)) {
+        fprintf(stderr, "First op larger than the buffer was accepted\n");
+        return false;
+    }
+
+    // num_ops is a byte
+    uint8_t big[8192];
+    MemOpFrameInit(&f, big, sizeof(big), sizeof(big));
+    unsigned n = 0;
+    while (MemOpFrameAdd(&f, SIMBRICKS_PROTO_MEM_H2M_MSG_READ, n, 0, 8, 0,
+            NULL))
+        n++;
+    if (n != UINT8_MAX) {
+        fprintf(stderr, "Frame took %u ops but expected %u\n", n, UINT8_MAX);
+        return false;
+    }
+    return true;
+}
+
+static bool test_truncated() {
+    uint8_t buf[512];
+    struct MemOpFrame f;
+    if (!build_frame(&f, buf, sizeof(buf), sizeof(buf), NUM_TEST_OPS, 0))
+        return false;
+
+    // end offset of each op
+    size_t ends[NUM_TEST_OPS];
+    size_t off = 0;
+    for (size_t i = 0; i < NUM_TEST_OPS; i++) {
+        off += i ? sizeof(struct MemOpNext) : sizeof(struct MemOp);
+        if (MemOpHasData(test_ops[i].type))
+            off += test_ops[i].len;
+        ends[i] = off;
+    }
+
+    // a cut frame only yields the ops that are complete
+    for (size_t len = 0; len < f.len; len++) {
+        size_t complete = 0;
+        while (complete < NUM_TEST_OPS && ends[complete] <= len)
+            complete++;
+        if (!check_ops(buf, len, complete)) {
+            fprintf(stderr, "Frame truncated to %zu bytes was accepted\n",
+                len);
+            return false;
+        }
+    }
+
+    // same for a frame claiming more ops than it carries
+    ((struct MemOp *)buf)->num_ops = NUM_TEST_OPS + 1;
+    return check_ops(buf, f.len, NUM_TEST_OPS);
+}
+
+int main(void) {
+    for (size_t i = 0; i < sizeof(test_data); i++)
+        test_data[i] = i * 7 + 1;
+
+    TEST_CASE(test_single, "test_single")
+    TEST_CASE(test_batch, "test_batch")
+    TEST_CASE(test_limits, "test_limits")
+    TEST_CASE(test_truncated, "test_truncated")
+}
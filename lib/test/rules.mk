@@ -24,11 +24,17 @@ include mk/subdir_pre.mk
 
 dir := $(d)
 
-OBJS := $(d)parser_test.o
+OBJS := $(addprefix $(d),parser_test.o lpm_test.o ts_heap_test.o \
+    mac_table_test.o netproto_test.o cache_test.o)
 
-bin_tests := $(d)parser_test
+bin_tests := $(OBJS:.o=)
 
 $(d)parser_test: $(d)parser_test.o $(lib_parser)
+$(d)lpm_test: $(d)lpm_test.o
+$(d)ts_heap_test: $(d)ts_heap_test.o
+$(d)mac_table_test: $(d)mac_table_test.o
+$(d)netproto_test: $(d)netproto_test.o
+$(d)cache_test: $(d)cache_test.o sims/mem/memnic/cache.o
 
 .PHONY: lib-tests run-lib-tests
 
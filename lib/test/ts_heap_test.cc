@@ -0,0 +1,190 @@
+/*
+ * Copyright 2025 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "lib/simbricks/base/ts_heap.hh"
+
+using simbricks::TimestampHeap;
+
+#define TEST_CASE(test_fn, name) \
+    printf("Executing test %s\n", name); \
+    if (test_fn()) { \
+        printf("SUCCESS: %s\n", name); \
+    } else { \
+        fprintf(stderr, "FAILED: %s\n", name); \
+    }
+
+// compare the heap against the plain timestamp array `ts`
+static bool check_heap(const TimestampHeap &heap,
+                       const std::vector<uint64_t> &ts) {
+    uint64_t min = TimestampHeap::kNever;
+    for (size_t i = 0; i < ts.size(); i++) {
+        if (heap.Get(i) != ts[i]) {
+            fprintf(stderr, "Id %zu has timestamp %lu but expected %lu\n", i,
+                heap.Get(i), ts[i]);
+            return false;
+        }
+        min = std::min(min, ts[i]);
+    }
+    if (heap.Min() != min) {
+        fprintf(stderr, "Min is %lu but expected %lu\n", heap.Min(), min);
+        return false;
+    }
+    if (!ts.empty() && ts[heap.MinId()] != min) {
+        fprintf(stderr, "MinId %zu has timestamp %lu but the min is %lu\n",
+            heap.MinId(), ts[heap.MinId()], min);
+        return false;
+    }
+    return true;
+}
+
+static bool check_collect(const TimestampHeap &heap,
+                          const std::vector<uint64_t> &ts, uint64_t upto) {
+    std::vector<size_t> ids;
+    // CollectUpTo appends, keep what is already there
+    ids.push_back(ts.size());
+    heap.CollectUpTo(upto, ids);
+    if (ids[0] != ts.size()) {
+        fprintf(stderr, "CollectUpTo overwrote existing entries\n");
+        return false;
+    }
+    ids.erase(ids.begin());
+    std::sort(ids.begin(), ids.end());
+
+    std::vector<size_t> expected;
+    for (size_t i = 0; i < ts.size(); i++) {
+        if (ts[i] <= upto)
+            expected.push_back(i);
+    }
+    if (ids != expected) {
+        fprintf(stderr, "CollectUpTo(%lu) returned %zu ids but expected %zu\n",
+            upto, ids.size(), expected.size());
+        return false;
+    }
+    return true;
+}
+
+static bool test_update() {
+    std::vector<uint64_t> ts(5, 10);
+    TimestampHeap heap(5, 10);
+    if (!check_heap(heap, ts))
+        return false;
+
+    // decrease
+    ts[3] = 4;
+    heap.Update(3, 4);
+    if (!check_heap(heap, ts) || heap.MinId() != 3)
+        return false;
+
+    // increase the minimum, the next smallest takes over
+    ts[1] = 7;
+    heap.Update(1, 7);
+    ts[3] = 20;
+    heap.Update(3, 20);
+    if (!check_heap(heap, ts) || heap.MinId() != 1)
+        return false;
+
+    // unchanged
+    heap.Update(1, 7);
+    if (!check_heap(heap, ts))
+        return false;
+
+    // random updates in both directions
+    srand(42);
+    ts.assign(37, 0);
+    heap.Reset(37);
+    for (int i = 0; i < 10000; i++) {
+        size_t id = rand() % ts.size();
+        uint64_t t = rand() % 100;
+        ts[id] = t;
+        heap.Update(id, t);
+        if (!check_heap(heap, ts))
+            return false;
+    }
+    return true;
+}
+
+static bool test_collect_ties() {
+    // many equal timestamps at and around the threshold
+    std::vector<uint64_t> ts = {5, 3, 5, 5, 8, 3, 5, 9, 5, 1, 5, 5, 8};
+    TimestampHeap heap(ts.size());
+    for (size_t i = 0; i < ts.size(); i++)
+        heap.Update(i, ts[i]);
+    if (!check_heap(heap, ts))
+        return false;
+
+    for (uint64_t upto = 0; upto <= 10; upto++) {
+        if (!check_collect(heap, ts, upto))
+            return false;
+    }
+
+    // all equal
+    ts.assign(20, 7);
+    heap.Reset(20, 7);
+    return check_collect(heap, ts, 6) && check_collect(heap, ts, 7);
+}
+
+static bool test_never() {
+    const uint64_t never = TimestampHeap::kNever;
+
+    TimestampHeap empty;
+    if (empty.Min() != never) {
+        fprintf(stderr, "Empty heap has min %lu\n", empty.Min());
+        return false;
+    }
+
+    std::vector<uint64_t> ts(6, never);
+    TimestampHeap heap(6, never);
+    if (!check_heap(heap, ts) || !check_collect(heap, ts, never - 1))
+        return false;
+
+    ts[4] = 12;
+    heap.Update(4, 12);
+    ts[2] = 15;
+    heap.Update(2, 15);
+    if (!check_heap(heap, ts) || !check_collect(heap, ts, 100) ||
+            !check_collect(heap, ts, never - 1))
+        return false;
+
+    // back to never
+    ts[4] = never;
+    heap.Update(4, never);
+    if (!check_heap(heap, ts) || heap.MinId() != 2)
+        return false;
+    ts[2] = never;
+    heap.Update(2, never);
+    return check_heap(heap, ts) && check_collect(heap, ts, never - 1) &&
+        check_collect(heap, ts, never);
+}
+
+int main(void) {
+    TEST_CASE(test_update, "test_update")
+    TEST_CASE(test_collect_ties, "test_collect_ties")
+    TEST_CASE(test_never, "test_never")
+}
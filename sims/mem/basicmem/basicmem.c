@@ -28,7 +28,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <simbricks/mem/if.h>
@@ -41,6 +43,23 @@ static uint64_t cur_ts = 0;
 uint8_t *mem_array;
 uint64_t size;
 uint64_t base_addr;
+// memory is backed by explicit huge pages
+static bool mem_huge = false;
+
+/* Listening port, each connects one host. */
+struct MemPort {
+  struct SimbricksMemIf memif;
+  // completions waiting for a free M2H slot, a ring of slot-sized entries
+  uint8_t *backlog;
+  size_t *backlog_len;  // bytes past the header
+  size_t backlog_head;
+  size_t backlog_num;
+};
+
+static struct MemPort *ports;
+static size_t num_ports;
+static size_t backlog_max = 64;
+static size_t burst = 32;
 
 static void sigint_handler(int dummy) {
   exiting = 1;
@@ -50,41 +69,54 @@ static void sigusr1_handler(int dummy) {
   fprintf(stderr, "main_time = %lu\n", cur_ts);
 }
 
-bool MemifInit(struct SimbricksMemIf *memif, const char *shm_path,
-               struct SimbricksBaseIfParams *memParams) {
-  struct SimbricksBaseIf *membase = &memif->base;
+bool MemifInit(const char *shm_path, struct SimbricksBaseIfParams *memParams,
+               char *sock_paths) {
   struct SimbricksBaseIfSHMPool pool_;
   memset(&pool_, 0, sizeof(pool_));
 
-  struct SimBricksBaseIfEstablishData ests[1];
-  struct SimbricksProtoMemHostIntro m_intro;
-  struct SimbricksProtoMemHostIntro h_intro;
-  unsigned n_bifs = 0;
+  num_ports = 1;
+  for (const char *c = sock_paths; *c; c++)
+    num_ports += *c == ',';
 
+  ports = calloc(num_ports, sizeof(*ports));
+  struct SimBricksBaseIfEstablishData ests[num_ports];
+  struct SimbricksProtoMemHostIntro m_intro;
+  struct SimbricksProtoMemHostIntro h_intros[num_ports];
   memset(&m_intro, 0, sizeof(m_intro));
-  ests[n_bifs].base_if = membase;
-  ests[n_bifs].tx_intro = &m_intro;
-  ests[n_bifs].tx_intro_len = sizeof(m_intro);
-  ests[n_bifs].rx_intro = &h_intro;
-  ests[n_bifs].rx_intro_len = sizeof(h_intro);
-  n_bifs++;
-
-  if (SimbricksBaseIfInit(membase, memParams)) {
-    perror("Init: SimbricksBaseIfInit failed");
-  }
 
   if (SimbricksBaseIfSHMPoolCreate(
-          &pool_, shm_path, SimbricksBaseIfSHMSize(&membase->params)) != 0) {
+          &pool_, shm_path,
+          num_ports * SimbricksBaseIfSHMSize(memParams)) != 0) {
     perror("MemifInit: SimbricksBaseIfSHMPoolCreate failed");
     return false;
   }
 
-  if (SimbricksBaseIfListen(membase, &pool_) != 0) {
-    perror("MemifInit: SimbricksBaseIfListen failed");
-    return false;
+  char *ctx;
+  char *path = strtok_r(sock_paths, ",", &ctx);
+  for (size_t i = 0; i < num_ports; i++, path = strtok_r(NULL, ",", &ctx)) {
+    struct SimbricksBaseIf *membase = &ports[i].memif.base;
+    memParams->sock_path = path;
+    if (SimbricksBaseIfInit(membase, memParams)) {
+      perror("Init: SimbricksBaseIfInit failed");
+    }
+
+    if (SimbricksBaseIfListen(membase, &pool_) != 0) {
+      perror("MemifInit: SimbricksBaseIfListen failed");
+      return false;
+    }
+
+    ests[i].base_if = membase;
+    ests[i].tx_intro = &m_intro;
+    ests[i].tx_intro_len = sizeof(m_intro);
+    ests[i].rx_intro = &h_intros[i];
+    ests[i].rx_intro_len = sizeof(h_intros[i]);
+
+    size_t elen = membase->out_elen;
+    ports[i].backlog = malloc(backlog_max * elen);
+    ports[i].backlog_len = calloc(backlog_max, sizeof(size_t));
   }
 
-  if (SimBricksBaseIfEstablish(ests, 1)) {
+  if (SimBricksBaseIfEstablish(ests, num_ports)) {
     fprintf(stderr, "SimBricksBaseIfEstablish failed\n");
     return false;
   }
@@ -93,31 +125,92 @@ bool MemifInit(struct SimbricksMemIf *memif, const char *shm_path,
   return true;
 }
 
-volatile union SimbricksProtoMemM2H *M2HAlloc(struct SimbricksMemIf *memif,
-                                              uint64_t cur_ts) {
-  volatile union SimbricksProtoMemM2H *msg_to;
-  bool first = true;
-  while ((msg_to = SimbricksMemIfM2HOutAlloc(memif, cur_ts)) == NULL) {
-    if (first) {
-      fprintf(stderr, "M2HAlloc: warning waiting for entry (%zu)\n",
-              memif->base.out_pos);
-      first = false;
-    }
+/*
+ * Completion to fill in and pass to M2HSend(): the next M2H slot, or a
+ * backlog entry if the queue is full or older completions are still
+ * waiting. Callers check for a free backlog entry first.
+ */
+static volatile union SimbricksProtoMemM2H *M2HAlloc(struct MemPort *port) {
+  volatile union SimbricksProtoMemM2H *msg = NULL;
+  if (port->backlog_num == 0)
+    msg = SimbricksMemIfM2HOutAlloc(&port->memif, cur_ts);
+  if (msg != NULL)
+    return msg;
+
+  size_t i = (port->backlog_head + port->backlog_num) % backlog_max;
+  return (volatile union SimbricksProtoMemM2H *)(port->backlog +
+                                                 i * port->memif.base.out_elen);
+}
+
+static void M2HSend(struct MemPort *port,
+                    volatile union SimbricksProtoMemM2H *msg, uint8_t type,
+                    size_t len) {
+  uint8_t *bl = port->backlog;
+  if ((uint8_t *)msg < bl ||
+      (uint8_t *)msg >= bl + backlog_max * port->memif.base.out_elen) {
+    SimbricksMemIfM2HOutSend(&port->memif, msg, type);
+    return;
   }
 
-  if (!first) {
-    fprintf(stderr, "D2HAlloc: entry successfully allocated\n");
+  msg->base.header.own_type = type;
+  port->backlog_len[(port->backlog_head + port->backlog_num) % backlog_max] =
+      len;
+  port->backlog_num++;
+}
+
+/* Move waiting completions to the queue as slots free up. They are sent at
+ * the current time, the time spent waiting counts as latency. */
+static void FlushBacklog(struct MemPort *port) {
+  size_t hdr_len = offsetof(struct SimbricksProtoBaseMsgHeader, timestamp);
+  size_t elen = port->memif.base.out_elen;
+  while (port->backlog_num > 0) {
+    volatile union SimbricksProtoMemM2H *msg =
+        SimbricksMemIfM2HOutAlloc(&port->memif, cur_ts);
+    if (msg == NULL)
+      return;
+
+    size_t i = port->backlog_head;
+    const uint8_t *m = port->backlog + i * elen;
+    const union SimbricksProtoMemM2H *q =
+        (const union SimbricksProtoMemM2H *)m;
+    memcpy((void *)msg, m, hdr_len);
+    memcpy((uint8_t *)msg + sizeof(*msg), m + sizeof(*msg),
+           port->backlog_len[i]);
+    SimbricksMemIfM2HOutSend(&port->memif, msg, q->base.header.own_type);
+
+    port->backlog_head = (i + 1) % backlog_max;
+    port->backlog_num--;
   }
+}
 
-  return msg_to;
+/* Every request is served with exactly one completion, so read data has to
+ * fit into one M2H slot. Larger accesses are split up by the interconnect
+ * (or the host) to what our slots hold. */
+static void CheckAccess(struct SimbricksMemIf *memif, uint64_t addr,
+                        uint64_t len, bool read) {
+  size_t max_read = memif->base.out_elen - sizeof(union SimbricksProtoMemM2H);
+  if (addr > size || len > size - addr) {
+    fprintf(stderr, "CheckAccess: 0x%lx+0x%lx outside of memory (0x%lx)\n",
+            addr, len, size);
+    abort();
+  }
+  if (read && len > max_read) {
+    fprintf(stderr,
+            "CheckAccess: read of 0x%lx bytes does not fit into a "
+            "completion (0x%zx)\n",
+            len, max_read);
+    abort();
+  }
 }
 
-void PollH2M(struct SimbricksMemIf *memif, uint64_t cur_ts) {
+/* Serve one request, false if there is none ready. */
+static bool PollH2M(struct MemPort *port) {
+  struct SimbricksMemIf *memif = &port->memif;
   volatile union SimbricksProtoMemH2M *msg =
       SimbricksMemIfH2MInPoll(memif, cur_ts);
 
   if (msg == NULL) {
-    return;
+    return false;
   }
 
   uint8_t type;
@@ -129,13 +222,13 @@ void PollH2M(struct SimbricksMemIf *memif, uint64_t cur_ts) {
     case SIMBRICKS_PROTO_MEM_H2M_MSG_READ:
       addr = msg->read.addr;
       len = msg->read.len;
+      CheckAccess(memif, addr, len, true);
 
-      msg_to = M2HAlloc(memif, cur_ts);
+      msg_to = M2HAlloc(port);
       msg_to->readcomp.req_id = msg->read.req_id;
       memcpy((void *)msg_to->readcomp.data, &mem_array[addr], len);
 
-      SimbricksMemIfM2HOutSend(memif, msg_to,
-                               SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP);
+      M2HSend(port, msg_to, SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP, len);
 
 #if BASICMEM_DEBUG
       printf("received H2M read. addr: 0x%lx size: 0x%lx\n", addr, len);
@@ -144,12 +237,12 @@ void PollH2M(struct SimbricksMemIf *memif, uint64_t cur_ts) {
     case SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE:
       addr = msg->write.addr;
       len = msg->write.len;
+      CheckAccess(memif, addr, len, false);
       memcpy(&mem_array[addr], (const void *)msg->write.data, len);
 
-      msg_to = M2HAlloc(memif, cur_ts);
+      msg_to = M2HAlloc(port);
       msg_to->writecomp.req_id = msg->write.req_id;
-      SimbricksMemIfM2HOutSend(memif, msg_to,
-                               SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP);
+      M2HSend(port, msg_to, SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP, 0);
 
 #if BASICMEM_DEBUG
       printf("received H2M write addr: 0x%lx size: %d\n", addr, msg->write.len);
@@ -162,6 +255,7 @@ void PollH2M(struct SimbricksMemIf *memif, uint64_t cur_ts) {
     case SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE_POSTED:
       addr = msg->write.addr;
       len = msg->write.len;
+      CheckAccess(memif, addr, len, false);
       memcpy(&mem_array[addr], (const void *)msg->write.data, len);
 
 #if BASICMEM_DEBUG
@@ -180,6 +274,121 @@ void PollH2M(struct SimbricksMemIf *memif, uint64_t cur_ts) {
   }
 
   SimbricksMemIfH2MInDone(memif, msg);
+  return true;
+}
+
+/* Serve up to a burst of ready requests, as long as every completion is
+ * sure to find room. Otherwise requests wait in the H2M queue, and the host
+ * sees the backpressure. */
+static void DrainPort(struct MemPort *port) {
+  for (size_t n = 0; n < burst && port->backlog_num < backlog_max; n++) {
+    if (!PollH2M(port))
+      return;
+  }
+}
+
+/*
+ * Reserve the memory image as an anonymous mapping, pages are only allocated
+ * (and zeroed) by the kernel once they are touched. With `huge` explicit huge
+ * pages are tried first, then transparent ones.
+ */
+static bool AllocMemory(bool huge) {
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  void *mem = MAP_FAILED;
+
+  // reserved, so running out of huge pages fails here instead of faulting
+  // on first touch
+  if (huge) {
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+    if (mem == MAP_FAILED)
+      perror("AllocMemory: no explicit huge pages, falling back");
+    else
+      mem_huge = true;
+  }
+  if (mem == MAP_FAILED)
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE, flags | MAP_NORESERVE, -1,
+               0);
+  if (mem == MAP_FAILED) {
+    perror("AllocMemory: mmap failed");
+    return false;
+  }
+  if (huge && !mem_huge && madvise(mem, size, MADV_HUGEPAGE))
+    perror("AllocMemory: madvise failed");
+
+  mem_array = mem;
+  return true;
+}
+
+static bool ReadFile(int fd, uint64_t off, uint64_t addr, uint64_t len) {
+  while (len > 0) {
+    ssize_t ret = pread(fd, mem_array + addr, len, off);
+    if (ret <= 0) {
+      fprintf(stderr, "ReadFile: reading 0x%lx bytes at 0x%lx failed\n", len,
+              off);
+      return false;
+    }
+    off += ret;
+    addr += ret;
+    len -= ret;
+  }
+  return true;
+}
+
+/*
+ * Place `len` bytes from `fd` at file offset `off` into memory at `addr`.
+ * Whole pages are mapped copy-on-write from the file if file offset and
+ * address are equally aligned, partial pages are read in.
+ */
+static bool MapFile(int fd, uint64_t off, uint64_t addr, uint64_t len) {
+  uint64_t page = sysconf(_SC_PAGESIZE);
+  // part of the range to map, relative to addr
+  uint64_t map_start = len;
+  uint64_t map_end = len;
+
+  if (!mem_huge && off % page == addr % page) {
+    uint64_t start = (page - addr % page) % page;
+    uint64_t end = (addr + len) / page * page - addr;
+    if (start < end && end <= len) {
+      void *p = mmap(mem_array + addr + start, end - start,
+                     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd,
+                     off + start);
+      if (p == MAP_FAILED) {
+        perror("MapFile: mmap failed");
+        return false;
+      }
+      map_start = start;
+      map_end = end;
+    }
+  }
+
+  return ReadFile(fd, off, addr, map_start) &&
+         ReadFile(fd, off + map_end, addr + map_end, len - map_end);
+}
+
+/* Use the contents of `path` as the initial memory image. */
+static bool LoadSnapshot(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror("LoadSnapshot: open failed");
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st)) {
+    perror("LoadSnapshot: fstat failed");
+    close(fd);
+    return false;
+  }
+  if ((uint64_t)st.st_size > size) {
+    fprintf(stderr, "LoadSnapshot: snapshot larger than memory\n");
+    close(fd);
+    return false;
+  }
+
+  bool ok = MapFile(fd, 0, 0, st.st_size);
+  // the mappings keep their own reference to the file
+  close(fd);
+  return ok;
 }
 
 bool LoadElf(const char *elf_file) {
@@ -192,9 +401,6 @@ bool LoadElf(const char *elf_file) {
     return false;
   }
 
-  size_t file_size;
-  const char *raw_data = elf_rawfile(elf, &file_size);
-
   size_t ident_size;
   const char* ident = elf_getident(elf, &ident_size);
   bool is_64 = ident[EI_CLASS] == ELFCLASS64;
@@ -220,7 +426,8 @@ bool LoadElf(const char *elf_file) {
         fprintf(stderr, "elf does not fit inside memory\n");
         return false;
       }
-      memcpy(mem_array + phdr[i].p_vaddr, raw_data + phdr[i].p_offset, phdr[i].p_filesz);
+      if (!MapFile(fd, phdr[i].p_offset, phdr[i].p_vaddr, phdr[i].p_filesz))
+        return false;
     }
   } else {
     Elf32_Phdr *phdr = elf32_getphdr(elf);
@@ -237,7 +444,8 @@ bool LoadElf(const char *elf_file) {
         fprintf(stderr, "elf does not fit inside memory\n");
         return false;
       }
-      memcpy(mem_array + phdr[i].p_vaddr, raw_data + phdr[i].p_offset, phdr[i].p_filesz);
+      if (!MapFile(fd, phdr[i].p_offset, phdr[i].p_vaddr, phdr[i].p_filesz))
+        return false;
     }
   }
 
@@ -251,19 +459,44 @@ int main(int argc, char *argv[]) {
   signal(SIGINT, sigint_handler);
   signal(SIGUSR1, sigusr1_handler);
 
-  int sync_mem = 1;
   uint64_t next_ts = 0;
   const char *shmPath;
+  char *sockPaths;
   struct SimbricksBaseIfParams memParams;
-  struct SimbricksMemIf memif;
   const char *elf_file = NULL;
+  const char *snapshot = NULL;
+  bool huge = false;
+  int c;
 
   SimbricksMemIfDefaultParams(&memParams);
 
-  if (argc < 6 || argc > 11) {
+  // options go before the positional arguments
+  while ((c = getopt(argc, argv, "+Hs:q:b:")) != -1) {
+    switch (c) {
+      case 'H':
+        huge = true;
+        break;
+      case 's':
+        snapshot = optarg;
+        break;
+      case 'q':
+        backlog_max = strtoull(optarg, NULL, 0);
+        break;
+      case 'b':
+        burst = strtoull(optarg, NULL, 0);
+        break;
+      default:
+        argc = 0;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  if (argc < 6 || argc > 11 || backlog_max < 1 || burst < 1) {
     fprintf(stderr,
-            "Usage: basicmem [SIZE] [BASE-ADDR] [ASID] [MEM-SOCKET] "
-            "SHM [SYNC-MODE] [START-TICK] [SYNC-PERIOD] [MEM-LATENCY] [ELF]\n");
+            "Usage: basicmem [-H] [-s SNAPSHOT] [-q BACKLOG-MSGS] [-b BURST] "
+            "[SIZE] [BASE-ADDR] [ASID] [MEM-SOCKET[,MEM-SOCKET...]] SHM "
+            "[SYNC-MODE] [START-TICK] [SYNC-PERIOD] [MEM-LATENCY] [ELF]\n");
     return -1;
   }
   if (argc >= 8)
@@ -277,15 +510,22 @@ int main(int argc, char *argv[]) {
 
   size = strtoull(argv[1], NULL, 0);
   base_addr = strtoull(argv[2], NULL, 0);
-  memParams.sock_path = argv[4];
+  sockPaths = argv[4];
   shmPath = argv[5];
 
   memParams.sync_mode = kSimbricksBaseIfSyncOptional;
-  memParams.blocking_conn = true;
+  // all ports listen at once, the hosts may connect in any order
+  memParams.blocking_conn = false;
 
-  mem_array = (uint8_t *)calloc(size, sizeof(uint8_t));
-  if (!mem_array) {
-    perror("no array allocated\n");
+  if (!AllocMemory(huge)) {
+    return EXIT_FAILURE;
+  }
+
+  if (snapshot != NULL) {
+    if (!LoadSnapshot(snapshot)) {
+      fprintf(stderr, "failed to load snapshot %s\n", snapshot);
+      return EXIT_FAILURE;
+    }
   }
 
   if (elf_file != NULL) {
@@ -295,25 +535,31 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  if (!MemifInit(&memif, shmPath, &memParams)) {
+  if (!MemifInit(shmPath, &memParams, sockPaths)) {
     return EXIT_FAILURE;
   }
 
   printf("start polling\n");
   while (!exiting) {
-    while (SimbricksMemIfM2HOutSync(&memif, cur_ts)) {
-      fprintf(stderr, "warn: SimbricksMemIfSync failed (t=%lu)\n", cur_ts);
+    // no waiting for a free slot: with a full queue the host has messages
+    // to advance its time with
+    for (size_t i = 0; i < num_ports; i++) {
+      FlushBacklog(&ports[i]);
+      if (ports[i].backlog_num == 0)
+        SimbricksMemIfM2HOutSync(&ports[i].memif, cur_ts);
     }
 
-    do {
-      PollH2M(&memif, cur_ts);
-
-      if (sync_mem) {
-        next_ts = SimbricksMemIfH2MInTimestamp(&memif);
-      }
-    } while (!exiting && next_ts <= cur_ts);
+    next_ts = UINT64_MAX;
+    for (size_t i = 0; i < num_ports; i++) {
+      DrainPort(&ports[i]);
+      uint64_t ts = SimbricksMemIfH2MInTimestamp(&ports[i].memif);
+      if (ts < next_ts)
+        next_ts = ts;
+    }
 
-    cur_ts = next_ts;
+    // poll again at the same time until every port is through
+    if (next_ts > cur_ts)
+      cur_ts = next_ts;
   }
   return 0;
 }
@@ -24,13 +24,20 @@
 
 #include <unistd.h>
 
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <climits>
 #include <csignal>
+#include <cstddef>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -43,10 +50,54 @@ extern "C" {
 //#define INTERCONN_DEBUG
 
 struct Pending;
+struct Device;
+struct Host;
+
+// every thread keeps its own copy, they all step through the same times
+static thread_local uint64_t cur_ts = 0;
+
+/** Host request (or a fragment of one) taken in, waiting for the thread
+ * that owns its device */
+struct Request {
+  uint32_t round;
+  uint32_t src;  // port index of the host
+  Host *host;
+  volatile union SimbricksProtoMemH2M *msg;  // still in the host's ring
+  uint8_t type;
+  uint64_t addr;  // translated
+  size_t off;  // of the fragment within the request
+  size_t len;
+  Pending *pending;  // nullptr for posted writes
+};
+
+/** Device completion, waiting for the thread that owns its host */
+struct Completion {
+  uint32_t round;
+  uint32_t src;  // port index of the device
+  Device *dev;
+  volatile union SimbricksProtoMemM2H *msg;  // still in the device's ring
+  uint8_t type;
+  Pending *pending;
+};
 
 struct Port {
   struct SimbricksMemIf memif;
   std::string url;
+  uint32_t idx = 0;  // position on the command line
+
+  // messages waiting for a free slot in the egress ring, in order
+  std::deque<std::vector<uint8_t>> backlog;
+  size_t backlog_limit = 1;
+  bool staged = false;
+
+  // ingress stalled on a full backlog elsewhere, since stall_start
+  bool stalled = false;
+  uint64_t stall_start = 0;
+
+  uint64_t stat_queued = 0;
+  size_t stat_backlog_max = 0;
+  uint64_t stat_stalls = 0;
+  uint64_t stat_stall_time = 0;
 
   Port(std::string url_) : url(url_) {
     SimbricksMemIfDefaultParams(&memif.base.params);
@@ -64,11 +115,91 @@ struct Port {
     est->tx_intro_len = sizeof(SimbricksProtoMemMemIntro);
   }
 
+  /** Does not wait for a slot: with a full ring the peer has messages to
+   * advance its time with, and spinning here could deadlock with a peer
+   * that waits for us to drain its ring. */
   void Sync(uint64_t cur_ts) {
-    while (SimbricksBaseIfOutSync(&memif.base, cur_ts)) {
+    Flush();
+    if (backlog.empty())
+      SimbricksBaseIfOutSync(&memif.base, cur_ts);
+  }
+
+  /**
+   * Message of `len` bytes (header included) to fill in and pass to
+   * OutSend(): the next egress slot, or a backlog entry if the ring is full
+   * or older messages are still waiting.
+   */
+  volatile union SimbricksProtoBaseMsg *OutAlloc(size_t len) {
+    volatile union SimbricksProtoBaseMsg *msg = nullptr;
+    if (backlog.empty())
+      msg = SimbricksBaseIfOutAlloc(&memif.base, cur_ts);
+    staged = msg == nullptr;
+    if (!staged)
+      return msg;
+
+    backlog.emplace_back(len);
+    stat_queued++;
+    if (backlog.size() > stat_backlog_max)
+      stat_backlog_max = backlog.size();
+    return reinterpret_cast<volatile union SimbricksProtoBaseMsg *>(
+        backlog.back().data());
+  }
+
+  void OutSend(volatile union SimbricksProtoBaseMsg *msg, uint8_t type) {
+    if (staged)
+      msg->header.own_type = type;
+    else
+      SimbricksBaseIfOutSend(&memif.base, msg, type);
+  }
+
+  /** Move queued messages to the ring as slots free up. They are sent at
+   * the current time, so the time spent waiting counts as latency. */
+  void Flush() {
+    const size_t hdr_len = offsetof(struct SimbricksProtoBaseMsgHeader,
+                                    timestamp);
+    while (!backlog.empty()) {
+      volatile union SimbricksProtoBaseMsg *msg =
+          SimbricksBaseIfOutAlloc(&memif.base, cur_ts);
+      if (!msg)
+        return;
+      const std::vector<uint8_t> &m = backlog.front();
+      const union SimbricksProtoBaseMsg *q =
+          reinterpret_cast<const union SimbricksProtoBaseMsg *>(m.data());
+      memcpy((void *)msg, m.data(), hdr_len);
+      memcpy((uint8_t *)msg + sizeof(*msg), m.data() + sizeof(*msg),
+             m.size() - sizeof(*msg));
+      SimbricksBaseIfOutSend(&memif.base, msg, q->header.own_type);
+      backlog.pop_front();
     }
   }
 
+  /** Track whether ingress processing is held back. */
+  void Stall(bool stall) {
+    if (stall && !stalled) {
+      stat_stalls++;
+      stall_start = cur_ts;
+    } else if (!stall && stalled) {
+      stat_stall_time += cur_ts - stall_start;
+    }
+    stalled = stall;
+  }
+
+  /** Egress slots the peer has released, from the next one on. */
+  size_t OutFree() {
+    struct SimbricksBaseIf &base = memif.base;
+    size_t n = 0;
+    for (; n < base.out_enum; n++) {
+      size_t pos = (base.out_pos + n) % base.out_enum;
+      volatile union SimbricksProtoBaseMsg *msg =
+          (volatile union SimbricksProtoBaseMsg *) ((uint8_t *) base.out_queue +
+                                                    pos * base.out_elen);
+      uint8_t own = __atomic_load_n(&msg->header.own_type, __ATOMIC_ACQUIRE);
+      if ((own & SIMBRICKS_PROTO_MSG_OWN_MASK) != SIMBRICKS_PROTO_MSG_OWN_PRO)
+        break;
+    }
+    return n;
+  }
+
   bool IsSync() {
     return SimbricksBaseIfSyncEnabled(&memif.base);
   }
@@ -76,32 +207,126 @@ struct Port {
   uint64_t NextTimestamp() {
     return SimbricksBaseIfInTimestamp(&memif.base);
   }
-
-  virtual void Poll() = 0;
 };
 
+class PendingSlab;
+
 struct Device: public Port {
   std::string name;
+  // largest access fitting into one slot in both directions, and into
+  // every host's completion slot
+  size_t max_len = 0;
+  // requests handed over by each thread during this step
+  std::vector<std::vector<Request>> inbox;
+  std::vector<Request> merged;
+  // requests each host may hand over this step, indexed by Host::num
+  std::vector<size_t> budget;
+  uint64_t steps = 0;
+
   Device(std::string name_, std::string url_) : Port(url_), name(name_) {
   }
-  virtual void Poll() override;
-  void Read(Pending *p);
-  void Write(Pending *p, const void *data, bool posted);
+
+  /** Whether `host` may hand over `n` more requests this step. The room
+   * is the free ring slots plus what is left of the backlog when the step
+   * starts (slots only free up after that, Forward() flushes the backlog
+   * into them first). It is split evenly over the hosts, so the hosts
+   * together stay within backlog_limit without coordinating, and what a
+   * host may send does not depend on which thread serves it. Completions
+   * are always queued, the pending slab bounds them. */
+  bool CanAccept(const Host *host, size_t n) const;
+  void Drain(size_t thread);
+  void Forward();
+  void Read(Pending *p, uint64_t addr, size_t off, size_t len);
+  void Write(Pending *p, uint64_t addr, size_t off, size_t len,
+             const volatile void *data);
+  void WritePosted(uint64_t addr, const void *data, size_t len);
 };
 
 struct Host: public Port {
+  size_t num = 0;  // position among the hosts
+  PendingSlab *slab = nullptr;
+  // completions handed over by each thread during this step
+  std::vector<std::vector<Completion>> inbox;
+  std::vector<Completion> merged;
+  // messages taken this step, request slots stay held until the next
+  // step, when the device owners have forwarded them
+  size_t polled = 0;
+  std::vector<volatile union SimbricksProtoMemH2M *> taken;
+  std::vector<std::pair<Device *, Request>> frags;
+
   Host(std::string url_) : Port(url_) { }
-  virtual void Poll() override;
+  void Serve(size_t thread);
+  bool TakeRequest(size_t thread, uint32_t round);
+  void Complete(const Completion &c);
   void CompletePendingR(Pending *p, const void *data);
   void CompletePendingW(Pending *p);
 };
 
+bool Device::CanAccept(const Host *host, size_t n) const {
+  return budget[host->num] >= n;
+}
+
 struct Pending {
   Host *host;
   bool write;
   uint64_t req_id;
-  uint64_t addr;
   size_t len;
+  size_t parts;  // fragments not completed yet
+  std::vector<uint8_t> data;  // read data of split requests
+};
+
+/**
+ * Fixed pool of pending requests, one per host. The slot index (offset by
+ * `base`) is sent downstream as the req_id, so completions find their
+ * request without any lookup, and slots are recycled through a free list
+ * instead of the allocator.
+ */
+class PendingSlab {
+ public:
+  PendingSlab(size_t n, uint64_t base)
+      : slots_(n), used_(n, false), base_(base) {
+    free_.reserve(n);
+    for (size_t i = n; i > 0; i--)
+      free_.push_back(i - 1);
+  }
+
+  /** nullptr if all slots are in use. */
+  Pending *Alloc() {
+    if (free_.empty())
+      return nullptr;
+    uint32_t i = free_.back();
+    free_.pop_back();
+    used_[i] = true;
+    return &slots_[i];
+  }
+
+  void Free(Pending *p) {
+    uint32_t i = p - slots_.data();
+    assert(used_[i]);
+    used_[i] = false;
+    free_.push_back(i);
+  }
+
+  uint64_t Id(const Pending *p) const {
+    return base_ + (p - slots_.data());
+  }
+
+  /** Request for a req_id echoed back by a device, aborts on unknown ids. */
+  Pending *Get(uint64_t id) {
+    uint64_t i = id - base_;
+    if (id < base_ || i >= slots_.size() || !used_[i]) {
+      fprintf(stderr, "PendingSlab: completion for unknown req_id %lu\n",
+              id);
+      abort();
+    }
+    return &slots_[i];
+  }
+
+ private:
+  std::vector<Pending> slots_;
+  std::vector<bool> used_;
+  std::vector<uint32_t> free_;
+  uint64_t base_;
 };
 
 struct TableEntry {
@@ -111,8 +336,10 @@ struct TableEntry {
   Device *dev;
 };
 
+// sorted by vaddr_start, without overlaps
 std::vector<struct TableEntry> map_table;
-static uint64_t cur_ts = 0;
+static std::vector<Host *> hosts;
+static size_t slab_size;
 static int exiting = 0;
 struct SimbricksBaseIfSHMPool pool;
 
@@ -140,189 +367,457 @@ static bool ConnectAll(std::vector<Port*> &ports, const char *pool_path) {
   return ret == 0;
 }
 
-// Will look up the device to access at this address, and re-map the address
-static Device *Lookup(uint64_t &addr, uint64_t len) {
-  for (auto te: map_table) {
-    if (te.vaddr_start <= addr && te.vaddr_end > addr) {
-      if (addr + len > te.vaddr_end) {
-        fprintf(stderr, "Lookup: End of accessed range (%lx + %lx) is not in "
-                        "same range as start. Unsupported.\n",
-                addr, len);
-        abort();
-      }
-      addr = te.phys_start + (addr - te.vaddr_start);
-      return te.dev;
+// Will look up the device to access at this address, and re-map the address.
+// len is cut off at the end of the range.
+static Device *Lookup(uint64_t &addr, size_t &len) {
+  auto it = std::upper_bound(map_table.begin(), map_table.end(), addr,
+                             [](uint64_t a, const TableEntry &te) {
+                               return a < te.vaddr_start;
+                             });
+  if (it == map_table.begin() || addr >= (it - 1)->vaddr_end)
+    throw "No matching device found.";
+
+  const TableEntry &te = *(it - 1);
+  len = std::min<uint64_t>(len, te.vaddr_end - addr);
+  addr = te.phys_start + (addr - te.vaddr_start);
+  return te.dev;
+}
+
+/** Sort the map table, false if ranges overlap. */
+static bool BuildMapTable() {
+  std::sort(map_table.begin(), map_table.end(),
+            [](const TableEntry &a, const TableEntry &b) {
+              return a.vaddr_start < b.vaddr_start;
+            });
+  for (size_t i = 1; i < map_table.size(); i++) {
+    if (map_table[i].vaddr_start < map_table[i - 1].vaddr_end) {
+      fprintf(stderr, "map ranges %lx-%lx and %lx-%lx overlap\n",
+              map_table[i - 1].vaddr_start, map_table[i - 1].vaddr_end,
+              map_table[i].vaddr_start, map_table[i].vaddr_end);
+      return false;
     }
   }
+  return true;
+}
 
-  throw "No matching device found.";
+/*
+ * req_ids sent to devices: the pending slot in the low 32 bits, offset and
+ * length of the fragment above, so completions of split requests can be
+ * put back together without any per-fragment state.
+ */
+static const uint64_t kSlotBits = 32;
+
+static Pending *FindPending(uint64_t req_id) {
+  req_id &= (1ULL << kSlotBits) - 1;
+  size_t h = req_id / slab_size;
+  if (h >= hosts.size()) {
+    fprintf(stderr, "FindPending: completion for unknown req_id %lu\n",
+            req_id);
+    abort();
+  }
+  return hosts[h]->slab->Get(req_id);
 }
 
-void Device::Poll() {
-  volatile union SimbricksProtoMemM2H *msg = SimbricksMemIfM2HInPoll(&memif, cur_ts);
-  if (msg == nullptr)
+static uint64_t ReqId(const Pending *p, size_t off, size_t len) {
+  return p->host->slab->Id(p) | off << kSlotBits | len << (kSlotBits + 16);
+}
+
+/** Reusable barrier for a fixed number of threads, spins (yielding). */
+class SpinBarrier {
+ public:
+  explicit SpinBarrier(size_t n) : n_(n), waiting_(0), phase_(0) {
+  }
+
+  void Wait() {
+    if (n_ == 1)
       return;
+    unsigned phase = phase_.load(std::memory_order_relaxed);
+    if (waiting_.fetch_add(1, std::memory_order_acq_rel) + 1 == n_) {
+      waiting_.store(0, std::memory_order_relaxed);
+      phase_.store(phase + 1, std::memory_order_release);
+    } else {
+      while (phase_.load(std::memory_order_acquire) == phase)
+        sched_yield();
+    }
+  }
 
-#ifdef INTERCONN_DEBUG
-  fprintf(stderr, "Device %p: Polled\n", this);
-#endif
+ private:
+  const size_t n_;
+  std::atomic<size_t> waiting_;
+  std::atomic<unsigned> phase_;
+};
 
-  uint8_t type = SimbricksMemIfM2HInType(&memif, msg);
-  switch (type) {
-    case SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP: {
-      volatile struct SimbricksProtoMemM2HReadcomp &readcomp = msg->readcomp;
-      Pending *pending = (Pending *) readcomp.req_id;
+/**
+ * Ports split over the threads, each port is only ever touched by its own
+ * thread. Every time step runs in three phases separated by barriers:
+ *   1. device owners sync and drain completions, handing them to hosts
+ *   2. host owners sync, send completions and take in requests, handing
+ *      them to devices
+ *   3. device owners forward the requests
+ * Messages get the polling round they would have had in a loop polling each
+ * port once per round (in command line order), and the handoffs are merged
+ * in (round, port) order, and devices admit requests per host. So every
+ * ring sees the same messages in the same order and at the same times for
+ * any thread count, as long as the peers release ring slots the same way.
+ */
+struct Worker {
+  std::vector<Device *> devs;
+  std::vector<Host *> hosts;
+  uint64_t min_ts = ULLONG_MAX;
+  bool stop = false;
+};
 
-#ifdef INTERCONN_DEBUG
-      fprintf(stderr, "Device %p: READCOMP %p->%lu\n", this, pending, pending->req_id);
-#endif
+static std::vector<Worker> workers;
+static SpinBarrier *barrier;
+
+template <typename T>
+static void MergeInbox(std::vector<std::vector<T>> &inbox,
+                       std::vector<T> &merged) {
+  merged.clear();
+  for (std::vector<T> &in : inbox) {
+    merged.insert(merged.end(), in.begin(), in.end());
+    in.clear();
+  }
+  // fragments of a request share round and port, and keep their order
+  std::stable_sort(merged.begin(), merged.end(), [](const T &a, const T &b) {
+    return a.round < b.round || (a.round == b.round && a.src < b.src);
+  });
+}
 
-      pending->host->CompletePendingR(pending, (void *) readcomp.data);
+static void RunWorker(size_t t) {
+  Worker &w = workers[t];
+  while (true) {
+    for (Device *d : w.devs)
+      d->Drain(t);
+    barrier->Wait();
+
+    for (Host *h : w.hosts)
+      h->Serve(t);
+    barrier->Wait();
+
+    // a stalled port must not hold back the time its backlog needs to
+    // drain, its message is processed late instead
+    uint64_t min_ts = ULLONG_MAX;
+    for (Device *d : w.devs) {
+      d->Forward();
+      if (d->IsSync())
+        min_ts = std::min(min_ts, d->NextTimestamp());
+    }
+    for (Host *h : w.hosts) {
+      if (h->IsSync() && !h->stalled)
+        min_ts = std::min(min_ts, h->NextTimestamp());
+    }
+    w.min_ts = min_ts;
+    if (t == 0)
+      w.stop = exiting;
+    barrier->Wait();
+
+    if (workers[0].stop)
       break;
+    for (const Worker &o : workers)
+      min_ts = std::min(min_ts, o.min_ts);
+    // without a message due later, poll again at the same time
+    if (min_ts < ULLONG_MAX && min_ts > cur_ts)
+      cur_ts = min_ts;
+    barrier->Wait();
   }
-  case SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP: {
-    volatile struct SimbricksProtoMemM2HWritecomp &writecomp = msg->writecomp;
-    Pending *pending = (Pending *) writecomp.req_id;
+}
+
+
+
+void Device::Drain(size_t thread) {
+  Sync(cur_ts);
+  size_t room =
+      backlog_limit - std::min(backlog_limit, backlog.size()) + OutFree();
+  // the remainder goes to different hosts in turn
+  size_t n = budget.size();
+  for (size_t h = 0; h < n; h++)
+    budget[h] = room / n + ((h + steps) % n < room % n);
+  steps++;
+  // completions are only released by the hosts' owners later in this step,
+  // after in_enum messages the ring wraps around to the first one
+  for (uint32_t round = 0; round < memif.base.in_enum; round++) {
+    volatile union SimbricksProtoMemM2H *msg =
+        SimbricksMemIfM2HInPoll(&memif, cur_ts);
+    if (msg == nullptr)
+      return;
 
 #ifdef INTERCONN_DEBUG
-      fprintf(stderr, "Device %p: WRITECOMP %p->%lu\n", this, pending, pending->req_id);
+    fprintf(stderr, "Device %p: Polled\n", this);
 #endif
 
-    pending->host->CompletePendingW(pending);
-    break;
+    // the host's owner sends the completion and releases the slot
+    uint8_t type = SimbricksMemIfM2HInType(&memif, msg);
+    switch (type) {
+      case SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP: {
+        Pending *pending = FindPending(msg->readcomp.req_id);
+#ifdef INTERCONN_DEBUG
+        fprintf(stderr, "Device %p: READCOMP %p->%lu\n", this, pending,
+                pending->req_id);
+#endif
+        pending->host->inbox[thread].push_back(
+            {round, idx, this, msg, type, pending});
+        break;
+      }
+      case SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP: {
+        Pending *pending = FindPending(msg->writecomp.req_id);
+#ifdef INTERCONN_DEBUG
+        fprintf(stderr, "Device %p: WRITECOMP %p->%lu\n", this, pending,
+                pending->req_id);
+#endif
+        pending->host->inbox[thread].push_back(
+            {round, idx, this, msg, type, pending});
+        break;
+      }
+      case SIMBRICKS_PROTO_MSG_TYPE_SYNC:
+        SimbricksMemIfM2HInDone(&memif, msg);
+        break;
+      default:
+        fprintf(stderr, "Device::Drain: unsupported type=%d", type);
+        abort();
+    }
   }
-  case SIMBRICKS_PROTO_MSG_TYPE_SYNC:
-    break;
-  default:
-    fprintf(stderr, "Device::Poll: unsupported type=%d", type);
-    abort();
+}
+
+void Device::Forward() {
+  // slots freed since the room was counted go to the backlog first
+  Flush();
+  MergeInbox(inbox, merged);
+  for (const Request &r : merged) {
+    const volatile uint8_t *data = r.msg->write.data + r.off;
+    if (r.type == SIMBRICKS_PROTO_MEM_H2M_MSG_READ)
+      Read(r.pending, r.addr, r.off, r.len);
+    else if (r.type == SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE)
+      Write(r.pending, r.addr, r.off, r.len, data);
+    else
+      WritePosted(r.addr, (const void *) data, r.len);
+  }
+}
+
+void Host::Serve(size_t thread) {
+  Sync(cur_ts);
+  for (volatile union SimbricksProtoMemH2M *msg : taken)
+    SimbricksMemIfH2MInDone(&memif, msg);
+  taken.clear();
+
+  // replay the rounds: completions from devices listed before this host,
+  // then this host's next request, then completions from the rest
+  MergeInbox(inbox, merged);
+  polled = 0;
+  size_t ci = 0;
+  bool more = true;
+  for (uint32_t round = 0; more || ci < merged.size(); round++) {
+    while (ci < merged.size() && merged[ci].round == round &&
+           merged[ci].src < idx)
+      Complete(merged[ci++]);
+    if (more)
+      more = TakeRequest(thread, round);
+    while (ci < merged.size() && merged[ci].round == round)
+      Complete(merged[ci++]);
   }
+}
 
-  SimbricksMemIfM2HInDone(&memif, msg);
+void Host::Complete(const Completion &c) {
+  Pending *p = c.pending;
+  volatile struct SimbricksProtoMemM2HReadcomp &rc = c.msg->readcomp;
+  p->parts--;
+  if (c.type == SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP) {
+    if (p->parts == 0 && p->data.empty()) {
+      CompletePendingR(p, (const void *) rc.data);
+    } else {
+      // split read, collect the fragments
+      size_t off = (rc.req_id >> kSlotBits) & 0xffff;
+      size_t len = rc.req_id >> (kSlotBits + 16);
+      memcpy(p->data.data() + off, (const void *) rc.data, len);
+      if (p->parts == 0)
+        CompletePendingR(p, p->data.data());
+    }
+  } else if (p->parts == 0) {
+    CompletePendingW(p);
+  }
+  SimbricksMemIfM2HInDone(&c.dev->memif, c.msg);
 }
 
-void Host::Poll() {
-  volatile union SimbricksProtoMemH2M *msg = SimbricksMemIfH2MInPoll(&memif, cur_ts);
+bool Host::TakeRequest(size_t thread, uint32_t round) {
+  // the ring has wrapped around to the requests taken earlier
+  if (polled == memif.base.in_enum)
+    return false;
+  volatile union SimbricksProtoMemH2M *msg = SimbricksMemIfH2MInPeek(&memif, cur_ts);
   if (msg == nullptr)
-      return;
+      return false;
 
 #ifdef INTERCONN_DEBUG
   fprintf(stderr, "Host %p: Polled\n", this);
 #endif
 
   uint8_t type = SimbricksMemIfH2MInType(&memif, msg);
+
+  // requests are split where they cross into another range and into
+  // pieces the device's slots can hold, and wait here while one of their
+  // devices is backed up or no pending slot is free for them
+  Pending *pending = nullptr;
+  frags.clear();
+  if (type == SIMBRICKS_PROTO_MEM_H2M_MSG_READ ||
+      type == SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE ||
+      type == SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE_POSTED) {
+    size_t len = msg->read.len;
+    size_t off = 0;
+    bool stall = false;
+    // the completion has to fit into one of this host's slots, however the
+    // read is split on the way
+    size_t max_read = memif.base.out_elen - sizeof(union SimbricksProtoMemM2H);
+    if (type == SIMBRICKS_PROTO_MEM_H2M_MSG_READ && len > max_read) {
+      fprintf(stderr,
+              "Host::TakeRequest: read of 0x%zx bytes does not fit into a "
+              "completion (0x%zx)\n",
+              len, max_read);
+      abort();
+    }
+    do {
+      uint64_t addr = msg->read.addr + off;
+      size_t n = len - off;
+      Device *dev = Lookup(addr, n);
+      n = std::min(n, dev->max_len);
+      size_t k = 1;
+      for (auto &f : frags)
+        k += f.first == dev;
+      stall = stall || !dev->CanAccept(this, k);
+      frags.push_back(
+          {dev, {round, idx, this, msg, type, addr, off, n, nullptr}});
+      off += n;
+    } while (off < len);
+
+    if (!stall && type != SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE_POSTED) {
+      pending = slab->Alloc();
+      stall = pending == nullptr;
+    }
+    Stall(stall);
+    if (stalled)
+      return false;
+  }
+  SimbricksMemIfH2MInPoll(&memif, cur_ts);
+  polled++;
+
   switch (type) {
     case SIMBRICKS_PROTO_MEM_H2M_MSG_READ: {
       volatile struct SimbricksProtoMemH2MRead &read = msg->read;
 
-      uint64_t addr = read.addr;
-      Device *dev = Lookup(addr, read.len);
-
-      Pending *pending = new Pending;
       pending->write = false;
       pending->host = this;
-      pending->addr = addr;
       pending->len = read.len;
       pending->req_id = read.req_id;
+      pending->parts = frags.size();
+      if (frags.size() > 1)
+        pending->data.resize(read.len);
+      else
+        pending->data.clear();
 
 #ifdef INTERCONN_DEBUG
-      fprintf(stderr, "Host %p: READ id=%lu->%p a=%lx->%lx l=%u\n", this,
-              read.req_id, pending, read.addr, addr, read.len);
+      fprintf(stderr, "Host %p: READ id=%lu->%p a=%lx->%lx l=%u parts=%zu\n",
+              this, read.req_id, pending, read.addr, frags[0].second.addr,
+              read.len, frags.size());
 #endif
-
-      dev->Read(pending);
       break;
     }
     case SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE: /* fallthru */
     case SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE_POSTED: {
       volatile struct SimbricksProtoMemH2MWrite &write = msg->write;
 
-      uint64_t addr = write.addr;
-      Device *dev = Lookup(addr, write.len);
-      
-      Pending *pending = new Pending;
-      pending->write = false;
-      pending->host = this;
-      pending->addr = addr;
-      pending->len = write.len;
-      pending->req_id = write.req_id;
-
 #ifdef INTERCONN_DEBUG
-      fprintf(stderr, "Host %p: WRITE id=%lu->%p a=%lx->%lx l=%u\n", this,
-              write.req_id, pending, write.addr, addr, write.len);
+      fprintf(stderr, "Host %p: WRITE id=%lu->%p a=%lx->%lx l=%u parts=%zu\n",
+              this, write.req_id, pending, write.addr, frags[0].second.addr,
+              write.len, frags.size());
 #endif
 
-      dev->Write(pending, (const void *) write.data,
-                 type == SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE_POSTED);
+      if (type == SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE_POSTED)
+        break;
+      pending->write = true;
+      pending->host = this;
+      pending->len = write.len;
+      pending->req_id = write.req_id;
+      pending->parts = frags.size();
+      pending->data.clear();
       break;
   }
   case SIMBRICKS_PROTO_MSG_TYPE_SYNC:
-    break;
+    SimbricksMemIfH2MInDone(&memif, msg);
+    return true;
   default:
-    fprintf(stderr, "Device::Poll: unsupported type=%d", type);
+    fprintf(stderr, "Host::TakeRequest: unsupported type=%d", type);
     abort();
   }
 
-  SimbricksMemIfH2MInDone(&memif, msg);
+  // the devices' owners forward the fragments, the slot is released with
+  // the next step
+  taken.push_back(msg);
+  for (auto &f : frags) {
+    f.second.pending = pending;
+    f.first->inbox[thread].push_back(f.second);
+    f.first->budget[num]--;
+  }
+  return true;
 }
 
-void Device::Read(Pending *p) {
-  volatile union SimbricksProtoMemH2M *msg = SimbricksMemIfH2MOutAlloc(&memif, cur_ts);
-  if (!msg)
-    throw "No message buffer available";
+void Device::Read(Pending *p, uint64_t addr, size_t off, size_t len) {
+  volatile union SimbricksProtoMemH2M *msg =
+      (volatile union SimbricksProtoMemH2M *) OutAlloc(sizeof(*msg));
 
   volatile struct SimbricksProtoMemH2MRead *read = &msg->read;
-  read->addr = p->addr;
-  read->len = p->len;
+  read->addr = addr;
+  read->len = len;
   read->as_id = 0;
-  read->req_id = (uintptr_t) p;
-  SimbricksMemIfH2MOutSend(&memif, msg, SIMBRICKS_PROTO_MEM_H2M_MSG_READ);
+  read->req_id = ReqId(p, off, len);
+  OutSend(&msg->base, SIMBRICKS_PROTO_MEM_H2M_MSG_READ);
 }
 
-void Device::Write(Pending *p, const void *data, bool posted) {
-  volatile union SimbricksProtoMemH2M *msg = SimbricksMemIfH2MOutAlloc(&memif, cur_ts);
-  if (!msg)
-    throw "No message buffer available";
+void Device::Write(Pending *p, uint64_t addr, size_t off, size_t len,
+                   const volatile void *data) {
+  volatile union SimbricksProtoMemH2M *msg =
+      (volatile union SimbricksProtoMemH2M *) OutAlloc(sizeof(*msg) + len);
 
   volatile struct SimbricksProtoMemH2MWrite *write = &msg->write;
-  write->addr = p->addr;
-  write->len = p->len;
+  write->addr = addr;
+  write->len = len;
   write->as_id = 0;
-  memcpy((void *) write->data, data, p->len);
+  write->req_id = ReqId(p, off, len);
+  memcpy((void *) write->data, (const void *) data, len);
+  OutSend(&msg->base, SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE);
+}
 
-  if (!posted) {
-    write->req_id = (uintptr_t) p;
-    SimbricksMemIfH2MOutSend(&memif, msg, SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE);
-  } else {
-    write->req_id = 0;
-    delete p;
-    SimbricksMemIfH2MOutSend(&memif, msg, SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE_POSTED);
-  }
+void Device::WritePosted(uint64_t addr, const void *data, size_t len) {
+  volatile union SimbricksProtoMemH2M *msg =
+      (volatile union SimbricksProtoMemH2M *) OutAlloc(sizeof(*msg) + len);
+
+  volatile struct SimbricksProtoMemH2MWrite *write = &msg->write;
+  write->addr = addr;
+  write->len = len;
+  write->as_id = 0;
+  write->req_id = 0;
+  memcpy((void *) write->data, data, len);
+  OutSend(&msg->base, SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE_POSTED);
 }
 
 void Host::CompletePendingR(Pending *p, const void *data) {
-  volatile union SimbricksProtoMemM2H *msg = SimbricksMemIfM2HOutAlloc(&memif, cur_ts);
-  if (!msg)
-    throw "No message buffer available";
+  volatile union SimbricksProtoMemM2H *msg =
+      (volatile union SimbricksProtoMemM2H *) OutAlloc(sizeof(*msg) + p->len);
 
   volatile struct SimbricksProtoMemM2HReadcomp *rc = &msg->readcomp;
   rc->req_id = p->req_id;
   memcpy((void *) rc->data, data, p->len);
 
-  delete p;
-  SimbricksMemIfM2HOutSend(&memif, msg, SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP);
+  slab->Free(p);
+  OutSend(&msg->base, SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP);
 }
 
 void Host::CompletePendingW(Pending *p) {
-  volatile union SimbricksProtoMemM2H *msg = SimbricksMemIfM2HOutAlloc(&memif, cur_ts);
-  if (!msg)
-    throw "No message buffer available";
+  volatile union SimbricksProtoMemM2H *msg =
+      (volatile union SimbricksProtoMemM2H *) OutAlloc(sizeof(*msg));
 
   volatile struct SimbricksProtoMemM2HWritecomp *wc = &msg->writecomp;
   wc->req_id = p->req_id;
 
-  delete p;
-  SimbricksMemIfM2HOutSend(&memif, msg, SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP);
+  slab->Free(p);
+  OutSend(&msg->base, SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP);
 }
 
 int main(int argc, char *argv[]) {
@@ -330,11 +825,14 @@ int main(int argc, char *argv[]) {
   int bad_option = 0;
 
   const char *pool_path = NULL;
+  size_t max_pending = 65536;
+  size_t backlog_limit = 64;
+  size_t num_threads = 1;
   std::unordered_map<std::string, Device *> devices;
   std::vector<Port *> ports;
 
   // Parse command line argument
-  while ((c = getopt(argc, argv, "d:h:p:m:")) != -1 && !bad_option) {
+  while ((c = getopt(argc, argv, "d:h:p:m:n:q:t:")) != -1 && !bad_option) {
     switch (c) {
       case 'd': {
         std::string arg = optarg;
@@ -348,6 +846,7 @@ int main(int argc, char *argv[]) {
         std::string url = arg.substr(eq_pos + 1);
 
         Device *d = new Device(name, url);
+        d->idx = ports.size();
         devices[name] = d;
         ports.push_back(d);
 
@@ -359,6 +858,8 @@ int main(int argc, char *argv[]) {
 
       case 'h': {
         Host *h = new Host(optarg);
+        h->idx = ports.size();
+        hosts.push_back(h);
         ports.push_back(h);
 #ifdef INTERCONN_DEBUG
         fprintf(stderr, "Host %p: Added url=%s\n", h, optarg);
@@ -390,7 +891,12 @@ int main(int argc, char *argv[]) {
               ent.phys_start = strtoull(token, NULL, 0);
               break;
             case 3: {
-              ent.dev = devices[token];
+              auto dev = devices.find(token);
+              if (dev == devices.end()) {
+                fprintf(stderr, "unknown device %s in map config\n", token);
+                return EXIT_FAILURE;
+              }
+              ent.dev = dev->second;
               break;
             }
             default:
@@ -408,6 +914,18 @@ int main(int argc, char *argv[]) {
         break;
       }
 
+      case 'n':
+        max_pending = strtoull(optarg, NULL, 0);
+        break;
+
+      case 'q':
+        backlog_limit = strtoull(optarg, NULL, 0);
+        break;
+
+      case 't':
+        num_threads = strtoull(optarg, NULL, 0);
+        break;
+
       default:
         fprintf(stderr, "unknown option %c\n", c);
         bad_option = 1;
@@ -418,9 +936,43 @@ int main(int argc, char *argv[]) {
   if (devices.empty() || map_table.empty() || ports.empty() || bad_option) {
     fprintf(stderr,
             "Usage: interconnect -p POOL-PATH [-d DEV-NAME=DEV-URL ...] "
-            "[-h HOST—URL ...] [-m ROUTE ...]\n");
+            "[-h HOST—URL ...] [-m ROUTE ...] [-n MAX-PENDING] "
+            "[-q BACKLOG-MSGS] [-t THREADS]\n");
     return EXIT_FAILURE;
   }
+  if (backlog_limit < 1)
+    backlog_limit = 1;
+  for (auto port : ports)
+    port->backlog_limit = backlog_limit;
+
+  if (!BuildMapTable())
+    return EXIT_FAILURE;
+
+  // hosts and devices dealt out round-robin, each has exactly one owner
+  if (num_threads < 1)
+    num_threads = 1;
+  workers.resize(num_threads);
+  size_t n_devs = 0;
+  for (auto port : ports) {
+    if (Device *d = dynamic_cast<Device *>(port)) {
+      d->inbox.resize(num_threads);
+      d->budget.resize(hosts.size());
+      workers[n_devs++ % num_threads].devs.push_back(d);
+    }
+  }
+  if (max_pending < 1 || hosts.size() * max_pending > (1ULL << kSlotBits)) {
+    fprintf(stderr, "too many pending requests for %zu hosts\n",
+            hosts.size());
+    return EXIT_FAILURE;
+  }
+  slab_size = max_pending;
+  for (size_t i = 0; i < hosts.size(); i++) {
+    hosts[i]->num = i;
+    hosts[i]->slab = new PendingSlab(max_pending, i * max_pending);
+    hosts[i]->inbox.resize(num_threads);
+    workers[i % num_threads].hosts.push_back(hosts[i]);
+  }
+  barrier = new SpinBarrier(num_threads);
 
   signal(SIGINT, sigint_handler);
   signal(SIGTERM, sigint_handler);
@@ -428,31 +980,34 @@ int main(int argc, char *argv[]) {
 
   if (!ConnectAll(ports, pool_path))
     return EXIT_FAILURE;
+  // no fragment is larger than any host's completion slot either
+  size_t host_max = UINT16_MAX;
+  for (auto host : hosts) {
+    struct SimbricksBaseIf &base = host->memif.base;
+    host_max = std::min(host_max,
+                        base.out_elen - sizeof(union SimbricksProtoMemM2H));
+  }
+  for (auto &dev : devices) {
+    struct SimbricksBaseIf &base = dev.second->memif.base;
+    size_t in = base.in_elen - sizeof(union SimbricksProtoMemM2H);
+    size_t out = base.out_elen - sizeof(union SimbricksProtoMemH2M);
+    dev.second->max_len = std::min({in, out, host_max});
+  }
 
   fprintf(stderr, "start polling\n");
-  while (!exiting) {
-    // Sync all interfaces
-    for (auto port : ports)
-      port->Sync(cur_ts);
-
-    // Switch packets
-    uint64_t min_ts;
-    do {
-      min_ts = ULLONG_MAX;
-      for (auto port : ports) {
-        port->Poll();
-        if (port->IsSync()) {
-          uint64_t ts = port->NextTimestamp();
-          min_ts = ts < min_ts ? ts : min_ts;
-        }
-      }
-    } while (!exiting && (min_ts <= cur_ts));
-
-    // Update cur_ts
-    if (min_ts < ULLONG_MAX) {
-      cur_ts = min_ts;
-    }
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < num_threads; t++)
+    threads.emplace_back(RunWorker, t);
+  RunWorker(0);
+  for (std::thread &thread : threads)
+    thread.join();
+
+  for (auto port : ports) {
+    port->Stall(false);
+    fprintf(stderr,
+            "%s: queued %lu backlog_max %zu stalls %lu stall_time %lu\n",
+            port->url.c_str(), port->stat_queued, port->stat_backlog_max,
+            port->stat_stalls, port->stat_stall_time);
   }
-
   return 0;
 }
@@ -28,7 +28,7 @@ OBJS := $(d)interconnect.o
 
 $(OBJS): CPPFLAGS := $(CPPFLAGS) -I$(d)include/
 
-$(bin_interconnect): $(OBJS)  $(lib_parser) $(lib_mem) $(lib_base)
+$(bin_interconnect): $(OBJS)  $(lib_parser) $(lib_mem) $(lib_base) -lpthread
 
 CLEAN := $(bin_interconnect) $(OBJS)
 ALL := $(bin_interconnect)
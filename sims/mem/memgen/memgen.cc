@@ -0,0 +1,292 @@
+/*
+ * Copyright 2024 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <simbricks/base/cxxatomicfix.h>
+extern "C" {
+#include <simbricks/mem/if.h>
+#include <simbricks/parser/parser.h>
+};
+
+#include "sims/mem/memgen/stream.h"
+
+/* Synthetic host issuing streams of memory requests to a memory simulator
+ * (or anything else speaking the memory side of the protocol) and reporting
+ * throughput and latencies. With synchronization, time is simulated time;
+ * without, the generator uses wall-clock time. */
+
+struct SimbricksMemIf memif;
+struct SimbricksBaseIfSHMPool pool;
+static uint64_t cur_ts = 0;
+static int exiting = 0;
+static bool sync_mem;
+static uint64_t wall_start;
+
+static std::vector<MemStream *> streams;
+// bit 63 of the request id is reserved, streams and slots fit in 31 and 32
+static constexpr unsigned kSlotBits = 32;
+
+static void sigint_handler(int dummy) {
+  exiting = 1;
+}
+
+static void sigusr1_handler(int dummy) {
+  fprintf(stderr, "main_time = %lu\n", cur_ts);
+}
+
+static uint64_t WallClock() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000000000ULL + ts.tv_nsec) * 1000ULL;
+}
+
+static bool Connect(const char *url, const char *pool_path) {
+  SimbricksMemIfDefaultParams(&memif.base.params);
+
+  struct SimBricksBaseIfEstablishData est;
+  est.base_if = &memif.base;
+  assert(sizeof(SimbricksProtoMemMemIntro) ==
+         sizeof(SimbricksProtoMemHostIntro));
+  est.rx_intro = new SimbricksProtoMemMemIntro;
+  est.rx_intro_len = sizeof(SimbricksProtoMemMemIntro);
+  est.tx_intro = new SimbricksProtoMemHostIntro;
+  est.tx_intro_len = sizeof(SimbricksProtoMemHostIntro);
+
+  int ret = SimbricksParametersEstablish(&est, &url, 1, &pool, pool_path);
+  return ret == 0;
+}
+
+static void Complete(uint64_t req_id) {
+  size_t s = req_id >> kSlotBits;
+  uint32_t slot = req_id;
+  if (s >= streams.size() || !streams[s]->Outstanding(slot)) {
+    fprintf(stderr, "memgen: completion for unknown request %lx\n", req_id);
+    abort();
+  }
+  streams[s]->Complete(slot, cur_ts);
+}
+
+static void PollM2H() {
+  volatile union SimbricksProtoMemM2H *msg =
+      SimbricksMemIfM2HInPoll(&memif, cur_ts);
+  if (msg == nullptr)
+    return;
+
+  uint8_t type = SimbricksMemIfM2HInType(&memif, msg);
+  switch (type) {
+    case SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP:
+      Complete(msg->readcomp.req_id);
+      break;
+    case SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP:
+      Complete(msg->writecomp.req_id);
+      break;
+    case SIMBRICKS_PROTO_MSG_TYPE_SYNC:
+      break;
+    default:
+      fprintf(stderr, "memgen: unsupported type=%u\n", type);
+      abort();
+  }
+
+  SimbricksMemIfM2HInDone(&memif, msg);
+}
+
+/* Issue all requests that are due. Returns false if the queue to the memory
+ * is full. */
+static bool IssueRequests() {
+  for (size_t s = 0; s < streams.size(); s++) {
+    MemStream &st = *streams[s];
+    const StreamParams &p = st.Params();
+    while (st.NextIssue() <= cur_ts) {
+      volatile union SimbricksProtoMemH2M *msg =
+          SimbricksMemIfH2MOutAlloc(&memif, cur_ts);
+      if (!msg)
+        return false;
+
+      bool write;
+      uint64_t addr;
+      uint32_t slot = st.Issue(cur_ts, write, addr);
+      uint64_t req_id = (uint64_t) s << kSlotBits | slot;
+      if (write) {
+        volatile struct SimbricksProtoMemH2MWrite &wr = msg->write;
+        wr.req_id = req_id;
+        wr.as_id = p.as_id;
+        wr.addr = addr;
+        wr.len = p.size;
+        // deterministic contents, the address repeated
+        for (size_t i = 0; i < p.size; i += 8) {
+          uint64_t val = addr + i;
+          memcpy((void *) (wr.data + i), &val,
+                 p.size - i < 8 ? p.size - i : 8);
+        }
+        SimbricksMemIfH2MOutSend(&memif, msg,
+                                 SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE);
+      } else {
+        volatile struct SimbricksProtoMemH2MRead &rd = msg->read;
+        rd.req_id = req_id;
+        rd.as_id = p.as_id;
+        rd.addr = addr;
+        rd.len = p.size;
+        SimbricksMemIfH2MOutSend(&memif, msg,
+                                 SIMBRICKS_PROTO_MEM_H2M_MSG_READ);
+      }
+    }
+  }
+  return true;
+}
+
+static bool AllDone() {
+  for (MemStream *s : streams)
+    if (!s->Done())
+      return false;
+  return true;
+}
+
+static uint64_t NextIssue() {
+  uint64_t next = MemStream::kNever;
+  for (MemStream *s : streams)
+    next = std::min(next, s->NextIssue());
+  return next;
+}
+
+int main(int argc, char *argv[]) {
+  int c;
+  bool bad_option = false;
+  const char *pool_path = nullptr;
+  uint64_t stop_ts = UINT64_MAX;
+  std::vector<StreamParams> params;
+
+  while ((c = getopt(argc, argv, "s:p:t:")) != -1 && !bad_option) {
+    switch (c) {
+      case 's': {
+        StreamParams p;
+        StreamDefaultParams(&p);
+        if (!StreamParseOpt(&p, optarg))
+          bad_option = true;
+        params.push_back(p);
+        break;
+      }
+
+      case 'p':
+        pool_path = optarg;
+        break;
+
+      case 't':
+        stop_ts = strtoull(optarg, nullptr, 0) * 1000ULL;
+        break;
+
+      default:
+        bad_option = true;
+    }
+  }
+
+  if (bad_option || optind + 1 != argc) {
+    fprintf(stderr,
+            "Usage: memgen [-s STREAM]... [-p SHM-POOL-PATH] [-t STOP-NS] "
+            "URL\n"
+            "  STREAM: KEY=VALUE[,KEY=VALUE...] with keys\n"
+            "    pattern=seq|random|zipf[:THETA], base=ADDR, range=BYTES,\n"
+            "    size=BYTES, align=BYTES, reads=PERCENT, window=N, count=N,\n"
+            "    gap=NS, start=NS, as_id=N, seed=N\n");
+    return EXIT_FAILURE;
+  }
+  if (params.empty()) {
+    StreamParams p;
+    StreamDefaultParams(&p);
+    params.push_back(p);
+  }
+
+  signal(SIGINT, sigint_handler);
+  signal(SIGTERM, sigint_handler);
+  signal(SIGUSR1, sigusr1_handler);
+
+  if (!Connect(argv[optind], pool_path))
+    return EXIT_FAILURE;
+  sync_mem = SimbricksBaseIfSyncEnabled(&memif.base);
+
+  // write data has to fit into a request slot, read data into a completion
+  // slot (the memory aborts on reads that do not)
+  size_t max_write = SimbricksMemIfH2MOutMsgLen(&memif) -
+                     sizeof(struct SimbricksProtoMemH2MWrite);
+  size_t max_read = memif.base.in_elen - sizeof(union SimbricksProtoMemM2H);
+  for (StreamParams &p : params) {
+    if (p.reads < 100 && p.size > max_write) {
+      fprintf(stderr, "memgen: write size %u exceeds queue entry (%zu)\n",
+              p.size, max_write);
+      return EXIT_FAILURE;
+    }
+    if (p.reads > 0 && p.size > max_read) {
+      fprintf(stderr, "memgen: read size %u exceeds completion entry (%zu)\n",
+              p.size, max_read);
+      return EXIT_FAILURE;
+    }
+    streams.push_back(new MemStream(p));
+  }
+
+  if (!sync_mem)
+    wall_start = WallClock();
+
+  while (!exiting && !AllDone() && cur_ts < stop_ts) {
+    while (SimbricksMemIfH2MOutSync(&memif, cur_ts)) {
+    }
+
+    uint64_t next_ts;
+    do {
+      PollM2H();
+      bool blocked = !IssueRequests();
+
+      if (!sync_mem) {
+        next_ts = WallClock() - wall_start;
+        break;
+      }
+      next_ts = SimbricksMemIfM2HInTimestamp(&memif);
+      // with a full queue only the memory side can move time forward
+      if (!blocked)
+        next_ts = std::min(next_ts, std::max(cur_ts, NextIssue()));
+    } while (!exiting && next_ts <= cur_ts);
+    if (next_ts > cur_ts)
+      cur_ts = next_ts;
+  }
+
+  for (size_t s = 0; s < streams.size(); s++) {
+    std::string name = "stream " + std::to_string(s);
+    streams[s]->Report(stdout, name.c_str());
+  }
+  if (streams.size() > 1)
+    MemStream::ReportTotal(stdout, streams);
+  fflush(stdout);
+
+  SimbricksBaseIfClose(&memif.base);
+  return 0;
+}
@@ -0,0 +1,277 @@
+/*
+ * Copyright 2024 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sims/mem/memgen/stream.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <simbricks/base/cxxatomicfix.h>
+extern "C" {
+#include <simbricks/parser/parser.h>
+};
+
+void StreamDefaultParams(StreamParams *params) {
+  memset(params, 0, sizeof(*params));
+  params->pattern = StreamParams::kSequential;
+  params->theta = 0.99;
+  params->range = 1 << 20;
+  params->size = 64;
+  params->reads = 100;
+  params->window = 16;
+  params->count = 10000;
+  params->seed = 1;
+}
+
+static bool parse_size(const char *s, uint64_t &v) {
+  char *end;
+  v = SimbricksParseSize(s, &end);
+  return end != s && !*end;
+}
+
+static bool parse_stream_opt(StreamParams &p, const char *key,
+                             const char *val) {
+  if (!strcmp(key, "pattern")) {
+    if (!strcmp(val, "seq")) {
+      p.pattern = StreamParams::kSequential;
+    } else if (!strcmp(val, "random")) {
+      p.pattern = StreamParams::kRandom;
+    } else if (!strncmp(val, "zipf", 4) && (!val[4] || val[4] == ':')) {
+      p.pattern = StreamParams::kZipf;
+      if (val[4])
+        p.theta = strtod(val + 5, nullptr);
+      return p.theta > 0 && p.theta < 1;
+    } else {
+      return false;
+    }
+  } else if (!strcmp(key, "base")) {
+    p.base = strtoull(val, nullptr, 0);
+  } else if (!strcmp(key, "range")) {
+    return parse_size(val, p.range);
+  } else if (!strcmp(key, "size")) {
+    uint64_t size;
+    if (!parse_size(val, size))
+      return false;
+    p.size = size;
+    return size && size <= UINT16_MAX;
+  } else if (!strcmp(key, "align")) {
+    return parse_size(val, p.align);
+  } else if (!strcmp(key, "reads")) {
+    p.reads = strtoul(val, nullptr, 0);
+    return p.reads <= 100;
+  } else if (!strcmp(key, "window")) {
+    p.window = strtoul(val, nullptr, 0);
+    return p.window > 0;
+  } else if (!strcmp(key, "count")) {
+    p.count = strtoull(val, nullptr, 0);
+  } else if (!strcmp(key, "gap")) {
+    p.gap = strtoull(val, nullptr, 0) * 1000ULL;
+  } else if (!strcmp(key, "start")) {
+    p.start = strtoull(val, nullptr, 0) * 1000ULL;
+  } else if (!strcmp(key, "as_id")) {
+    p.as_id = strtoull(val, nullptr, 0);
+  } else if (!strcmp(key, "seed")) {
+    p.seed = strtoull(val, nullptr, 0);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool StreamParseOpt(StreamParams *params, char *opt) {
+  char *save;
+  for (char *kv = strtok_r(opt, ",", &save); kv;
+       kv = strtok_r(nullptr, ",", &save)) {
+    char *val = strchr(kv, '=');
+    if (val)
+      *val++ = 0;
+    if (!val || !parse_stream_opt(*params, kv, val)) {
+      fprintf(stderr, "bad stream option %s\n", kv);
+      return false;
+    }
+  }
+
+  uint64_t align = params->align ? params->align : params->size;
+  if (params->range < params->size || params->range / align == 0) {
+    fprintf(stderr, "stream range smaller than a request\n");
+    return false;
+  }
+  return true;
+}
+
+static double zeta(uint64_t n, double theta) {
+  double sum = 0;
+  for (uint64_t i = 1; i <= n; i++)
+    sum += 1 / pow(i, theta);
+  return sum;
+}
+
+MemStream::MemStream(const StreamParams &params)
+    : p_(params),
+      rng_(params.seed),
+      next_item_(0),
+      next_issue_(params.start),
+      issued_(0),
+      issue_ts_(params.window, kNever),
+      write_(params.window, false),
+      reads_done_(0),
+      writes_done_(0),
+      first_issue_(kNever),
+      last_complete_(0) {
+  if (!p_.align)
+    p_.align = p_.size;
+  // every request has to lie within the range
+  items_ = (p_.range - p_.size) / p_.align + 1;
+
+  if (p_.pattern == StreamParams::kZipf) {
+    zeta_n_ = zeta(items_, p_.theta);
+    zeta_2_ = zeta(2, p_.theta);
+    alpha_ = 1 / (1 - p_.theta);
+    eta_ = (1 - pow(2.0 / items_, 1 - p_.theta)) / (1 - zeta_2_ / zeta_n_);
+  }
+
+  for (uint32_t i = params.window; i > 0; i--)
+    free_.push_back(i - 1);
+  if (p_.count)
+    latencies_.reserve(p_.count);
+}
+
+uint64_t MemStream::NextItem() {
+  switch (p_.pattern) {
+    case StreamParams::kSequential: {
+      uint64_t item = next_item_;
+      next_item_ = (next_item_ + 1) % items_;
+      return item;
+    }
+
+    case StreamParams::kRandom:
+      return rng_() % items_;
+
+    case StreamParams::kZipf: {
+      double u = std::uniform_real_distribution<double>(0, 1)(rng_);
+      double uz = u * zeta_n_;
+      if (uz < 1)
+        return 0;
+      if (uz < 1 + pow(0.5, p_.theta))
+        return 1;
+      uint64_t item = items_ * pow(eta_ * u - eta_ + 1, alpha_);
+      return item < items_ ? item : items_ - 1;
+    }
+  }
+  return 0;
+}
+
+uint64_t MemStream::NextIssue() const {
+  if (free_.empty() || (p_.count && issued_ == p_.count))
+    return kNever;
+  return next_issue_;
+}
+
+bool MemStream::Done() const {
+  return p_.count && issued_ == p_.count && free_.size() == p_.window;
+}
+
+uint32_t MemStream::Issue(uint64_t now, bool &write, uint64_t &addr) {
+  uint32_t slot = free_.back();
+  free_.pop_back();
+
+  addr = p_.base + NextItem() * p_.align;
+  write = rng_() % 100 >= p_.reads;
+  issue_ts_[slot] = now;
+  write_[slot] = write;
+
+  if (first_issue_ == kNever)
+    first_issue_ = now;
+  issued_++;
+  next_issue_ = now + p_.gap;
+  return slot;
+}
+
+bool MemStream::Outstanding(uint32_t slot) const {
+  return slot < issue_ts_.size() && issue_ts_[slot] != kNever;
+}
+
+void MemStream::Complete(uint32_t slot, uint64_t now) {
+  latencies_.push_back(now - issue_ts_[slot]);
+  if (write_[slot])
+    writes_done_++;
+  else
+    reads_done_++;
+  last_complete_ = now;
+  issue_ts_[slot] = kNever;
+  free_.push_back(slot);
+}
+
+static void report(FILE *out, const char *name, uint64_t reads,
+                   uint64_t writes, uint64_t bytes, uint64_t first,
+                   uint64_t last, std::vector<uint64_t> &lat) {
+  uint64_t ops = reads + writes;
+  double secs = last > first ? (last - first) / 1e12 : 0;
+  fprintf(out, "%s: %lu ops (%lu reads, %lu writes), %lu bytes in %.3f us",
+          name, ops, reads, writes, bytes, secs * 1e6);
+  if (secs > 0)
+    fprintf(out, ": %.3f Mops/s, %.3f GB/s", ops / secs / 1e6,
+            bytes / secs / 1e9);
+  fprintf(out, "\n");
+  if (lat.empty())
+    return;
+
+  std::sort(lat.begin(), lat.end());
+  double sum = 0;
+  for (uint64_t l : lat)
+    sum += l;
+  auto pct = [&lat](double p) {
+    size_t i = std::ceil(p / 100 * lat.size());
+    return lat[i ? i - 1 : 0] / 1e3;
+  };
+  fprintf(out,
+          "  latency [ns]: min %.1f avg %.1f p50 %.1f p90 %.1f p99 %.1f "
+          "p99.9 %.1f max %.1f\n",
+          lat.front() / 1e3, sum / lat.size() / 1e3, pct(50), pct(90),
+          pct(99), pct(99.9), lat.back() / 1e3);
+}
+
+void MemStream::Report(FILE *out, const char *name) const {
+  std::vector<uint64_t> lat = latencies_;
+  report(out, name, reads_done_, writes_done_,
+         (reads_done_ + writes_done_) * p_.size, first_issue_,
+         last_complete_, lat);
+}
+
+void MemStream::ReportTotal(FILE *out,
+                            const std::vector<MemStream *> &streams) {
+  uint64_t reads = 0, writes = 0, bytes = 0, first = kNever, last = 0;
+  std::vector<uint64_t> lat;
+  for (const MemStream *s : streams) {
+    reads += s->reads_done_;
+    writes += s->writes_done_;
+    bytes += (s->reads_done_ + s->writes_done_) * s->p_.size;
+    first = std::min(first, s->first_issue_);
+    last = std::max(last, s->last_complete_);
+    lat.insert(lat.end(), s->latencies_.begin(), s->latencies_.end());
+  }
+  report(out, "total", reads, writes, bytes, first, last, lat);
+}
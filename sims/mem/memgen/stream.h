@@ -0,0 +1,132 @@
+/*
+ * Copyright 2024 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SIMS_MEM_MEMGEN_STREAM_H_
+#define SIMS_MEM_MEMGEN_STREAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+/** Parameters of a stream of memory requests */
+struct StreamParams {
+  enum Pattern {
+    kSequential,
+    kRandom,
+    kZipf,
+  };
+
+  Pattern pattern;
+  double theta;  // zipf skew, in (0, 1)
+  uint64_t base;  // first address
+  uint64_t range;  // bytes covered from base
+  uint16_t size;  // request size
+  uint64_t align;  // requests start at multiples of this from base
+  unsigned reads;  // percentage of reads, the rest are writes
+  unsigned window;  // outstanding requests
+  uint64_t count;  // requests, 0 for no limit
+  uint64_t gap;  // [ps] minimum time between issues
+  uint64_t start;  // [ps]
+  uint64_t as_id;
+  uint64_t seed;
+};
+
+/** 64 byte sequential reads over 1 MiB, 16 outstanding, 10000 requests. */
+void StreamDefaultParams(StreamParams *params);
+
+/**
+ * Parse a stream option of the form KEY=VALUE[,KEY=VALUE...] into params
+ * (which should hold the defaults), with keys pattern (seq, random or
+ * zipf[:THETA]), base, range (k/m/g suffix), size, align, reads (percent),
+ * window, count, gap (ns), start (ns), as_id and seed. The string is
+ * modified. Returns false on a malformed option.
+ */
+bool StreamParseOpt(StreamParams *params, char *opt);
+
+/**
+ * Generates the requests of one stream and records their latencies. Up to
+ * `window` requests are outstanding, each identified by a slot number.
+ */
+class MemStream {
+ public:
+  static constexpr uint64_t kNever = UINT64_MAX;
+
+  explicit MemStream(const StreamParams &params);
+
+  /** Earliest time the next request can be issued, kNever if the window
+   * is full or all requests were issued. */
+  uint64_t NextIssue() const;
+
+  /** Whether all requests were issued and completed. */
+  bool Done() const;
+
+  /** Generate the next request at time `now`. Returns its slot. */
+  uint32_t Issue(uint64_t now, bool &write, uint64_t &addr);
+
+  /** Record the completion of the request in `slot` at time `now`. */
+  void Complete(uint32_t slot, uint64_t now);
+
+  /** Whether `slot` holds an outstanding request. */
+  bool Outstanding(uint32_t slot) const;
+
+  const StreamParams &Params() const {
+    return p_;
+  }
+
+  /** Print throughput and latency percentiles. */
+  void Report(FILE *out, const char *name) const;
+
+  /** Print the combined numbers of several streams. */
+  static void ReportTotal(FILE *out, const std::vector<MemStream *> &streams);
+
+ protected:
+  StreamParams p_;
+  std::mt19937_64 rng_;
+  uint64_t items_;
+  uint64_t next_item_;
+  uint64_t next_issue_;
+  uint64_t issued_;
+
+  // zipf state (Gray et al., as in YCSB), ranks map to items in order
+  double zeta_n_;
+  double zeta_2_;
+  double alpha_;
+  double eta_;
+
+  std::vector<uint64_t> issue_ts_;  // per slot, kNever if free
+  std::vector<bool> write_;  // per slot
+  std::vector<uint32_t> free_;
+
+  uint64_t reads_done_;
+  uint64_t writes_done_;
+  uint64_t first_issue_;
+  uint64_t last_complete_;
+  std::vector<uint64_t> latencies_;
+
+  uint64_t NextItem();
+};
+
+#endif  // SIMS_MEM_MEMGEN_STREAM_H_
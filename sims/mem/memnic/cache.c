@@ -0,0 +1,113 @@
+/*
+ * Copyright 2024 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sims/mem/memnic/cache.h"
+
+#include <stdlib.h>
+
+int MemCacheInit(struct MemCache *c, size_t size, size_t line_size,
+                 unsigned ways, enum MemCacheRepl repl) {
+  if (!line_size || (line_size & (line_size - 1)) || !ways ||
+      !size || size % (line_size * ways))
+    return -1;
+
+  c->size = size;
+  c->line_size = line_size;
+  c->line_shift = __builtin_ctzll(line_size);
+  c->ways = ways;
+  c->num_sets = size / line_size / ways;
+  c->repl = repl;
+  c->stamp = 0;
+  c->hits = c->misses = c->writebacks = 0;
+
+  c->lines = calloc(c->num_sets * ways, sizeof(*c->lines));
+  c->data = malloc(size);
+  c->hands = calloc(c->num_sets, sizeof(*c->hands));
+  if (!c->lines || !c->data || !c->hands)
+    return -1;
+  return 0;
+}
+
+static inline struct MemCacheLine *MemCacheSet(struct MemCache *c,
+                                               uint64_t addr) {
+  size_t set = (addr >> c->line_shift) % c->num_sets;
+  return c->lines + set * c->ways;
+}
+
+struct MemCacheLine *MemCacheLookup(struct MemCache *c, uint64_t as_id,
+                                    uint64_t addr, bool touch) {
+  struct MemCacheLine *set = MemCacheSet(c, addr);
+  for (unsigned i = 0; i < c->ways; i++) {
+    struct MemCacheLine *l = &set[i];
+    if (l->valid && l->addr == addr && l->as_id == as_id) {
+      if (touch) {
+        c->hits++;
+        l->stamp = ++c->stamp;
+        l->ref = true;
+      }
+      return l;
+    }
+  }
+  if (touch)
+    c->misses++;
+  return NULL;
+}
+
+struct MemCacheLine *MemCacheVictim(struct MemCache *c, uint64_t as_id,
+                                    uint64_t addr) {
+  struct MemCacheLine *set = MemCacheSet(c, addr);
+  for (unsigned i = 0; i < c->ways; i++) {
+    if (!set[i].valid)
+      return &set[i];
+  }
+
+  if (c->repl == kMemCacheLru) {
+    struct MemCacheLine *victim = &set[0];
+    for (unsigned i = 1; i < c->ways; i++) {
+      if (set[i].stamp < victim->stamp)
+        victim = &set[i];
+    }
+    return victim;
+  }
+
+  // CLOCK: give referenced lines a second chance
+  unsigned *hand = &c->hands[(set - c->lines) / c->ways];
+  while (set[*hand].ref) {
+    set[*hand].ref = false;
+    *hand = (*hand + 1) % c->ways;
+  }
+  struct MemCacheLine *victim = &set[*hand];
+  *hand = (*hand + 1) % c->ways;
+  return victim;
+}
+
+void MemCacheInstall(struct MemCache *c, struct MemCacheLine *l,
+                     uint64_t as_id, uint64_t addr) {
+  l->as_id = as_id;
+  l->addr = addr;
+  l->stamp = ++c->stamp;
+  l->valid = true;
+  l->dirty = false;
+  l->ref = true;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2024 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SIMS_MEM_MEMNIC_CACHE_H_
+#define SIMS_MEM_MEMNIC_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Set-associative cache of far-memory lines. This only tracks tags,
+ * replacement state and line data; fetching, write-back and the timing of
+ * accesses are up to the user. Lines are identified by address space and
+ * line-aligned address.
+ */
+enum MemCacheRepl {
+  kMemCacheLru,
+  kMemCacheClock,
+};
+
+struct MemCacheLine {
+  uint64_t as_id;
+  uint64_t addr;
+  // last access for LRU
+  uint64_t stamp;
+  bool valid;
+  bool dirty;
+  // referenced bit for CLOCK
+  bool ref;
+};
+
+struct MemCache {
+  size_t size;
+  size_t line_size;
+  unsigned line_shift;
+  unsigned ways;
+  size_t num_sets;
+  enum MemCacheRepl repl;
+
+  struct MemCacheLine *lines;
+  uint8_t *data;
+  // CLOCK hand per set
+  unsigned *hands;
+  uint64_t stamp;
+
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t writebacks;
+};
+
+/**
+ * Allocate a cache of `size` bytes. The line size has to be a power of two
+ * and size a multiple of line_size * ways. Returns 0 on success.
+ */
+int MemCacheInit(struct MemCache *c, size_t size, size_t line_size,
+                 unsigned ways, enum MemCacheRepl repl);
+
+/** Line-aligned address containing `addr`. */
+static inline uint64_t MemCacheLineAddr(const struct MemCache *c,
+                                        uint64_t addr) {
+  return addr & ~((uint64_t)c->line_size - 1);
+}
+
+/** Whether len bytes at addr lie within a single line. */
+static inline bool MemCacheSingleLine(const struct MemCache *c, uint64_t addr,
+                                      size_t len) {
+  return len && MemCacheLineAddr(c, addr) ==
+                    MemCacheLineAddr(c, addr + len - 1);
+}
+
+/** Data of a line. */
+static inline uint8_t *MemCacheData(const struct MemCache *c,
+                                    const struct MemCacheLine *l) {
+  return c->data + (size_t)(l - c->lines) * c->line_size;
+}
+
+/**
+ * Find the line `addr` (line-aligned) in address space as_id, NULL if it is
+ * not cached. With `touch` this is an access: it counts as hit or miss and
+ * a hit updates the replacement state.
+ */
+struct MemCacheLine *MemCacheLookup(struct MemCache *c, uint64_t as_id,
+                                    uint64_t addr, bool touch);
+
+/**
+ * Pick the line to replace for installing `addr`. If the returned line is
+ * valid and dirty, the caller has to write it back before calling
+ * MemCacheInstall().
+ */
+struct MemCacheLine *MemCacheVictim(struct MemCache *c, uint64_t as_id,
+                                    uint64_t addr);
+
+/** Install `addr` into line `l` (from MemCacheVictim()), clean. */
+void MemCacheInstall(struct MemCache *c, struct MemCacheLine *l,
+                     uint64_t as_id, uint64_t addr);
+
+#endif  // SIMS_MEM_MEMNIC_CACHE_H_
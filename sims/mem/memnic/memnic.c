@@ -36,8 +36,10 @@
 
 #include <simbricks/mem/if.h>
 #include <simbricks/network/if.h>
+#include <simbricks/parser/parser.h>
 
 #include "../netproto/netproto.h"
+#include "sims/mem/memnic/cache.h"
 
 //  #define MEMNIC_DEBUG 1
 
@@ -54,6 +56,74 @@ union mac_addr_ {
 
 union mac_addr_ mac_addr;
 
+// batching several MemOps into one frame, see netproto.h
+static bool batching = false;
+static uint64_t batch_window = 0;
+static size_t mtu = 1500;
+// netmem has advertised that it parses batched frames
+static bool peer_batch = false;
+// requests waiting to go out, and when they have to at the latest
+static struct MemOpFrame req_frame;
+static uint64_t req_deadline;
+// completions of the frame at the head of the net ring already delivered
+static unsigned n2m_done = 0;
+
+// far-memory cache, see cache.h
+#define MEMNIC_MSHRS 64
+#define MEMNIC_MSHR_WAITERS 16
+// requests memnic generates for the cache carry this bit in req_id, an MSHR
+// index for fills
+static const uint64_t kCacheReqBit = 1ULL << 63;
+static const uint64_t kCacheReqId = 1ULL << 63 | UINT32_MAX;
+
+static bool caching = false;
+static struct MemCache cache;
+static bool write_through = false;
+static uint64_t hit_latency = 50 * 1000ULL;
+
+// host request waiting for a line to be fetched
+struct CacheWaiter {
+  uint8_t type;
+  uint16_t len;
+  uint64_t req_id;
+  uint64_t addr;
+};
+
+// line being fetched, free if there are no waiters
+struct CacheMshr {
+  uint64_t as_id;
+  uint64_t addr;
+  unsigned num_waiters;
+  struct CacheWaiter waiters[MEMNIC_MSHR_WAITERS];
+  // write data of the waiters, one line each
+  uint8_t *data;
+};
+static struct CacheMshr mshrs[MEMNIC_MSHRS];
+
+// completion from the cache, due at a later time
+struct LocalComp {
+  uint64_t due;
+  uint64_t req_id;
+  uint8_t type;
+  uint16_t len;
+};
+// ring of local completions, data one line per entry
+static struct LocalComp *local_comps = NULL;
+static uint8_t *local_data = NULL;
+static size_t local_head = 0, local_num = 0, local_cap = 0;
+
+// request for the network that could not be queued yet
+struct NetReq {
+  uint8_t type;
+  uint16_t len;
+  uint64_t req_id;
+  uint64_t addr;
+  uint64_t as_id;
+  uint8_t *data;
+};
+static struct NetReq *net_backlog = NULL;
+static size_t net_backlog_head = 0, net_backlog_num = 0, net_backlog_cap = 0;
+
 static void sigint_handler(int dummy) {
   exiting = 1;
 }
@@ -156,12 +226,15 @@ static inline uint64_t SimbricksMemNicIfNextTimestamp(
   return (net_in < mem_in ? net_in : mem_in);
 }
 
-void ForwardToETH(struct SimbricksNetIf *netif,
-                  volatile union SimbricksProtoMemH2M *data, uint8_t type) {
+/** Send the queued requests as one frame, false if the ring is full. */
+static bool FlushRequests(struct SimbricksNetIf *netif) {
+  if (!req_frame.num_ops)
+    return true;
+
   volatile union SimbricksProtoNetMsg *msg =
       SimbricksNetIfOutAlloc(netif, cur_ts);
   if (msg == NULL)
-    return;
+    return false;
 
   volatile struct SimbricksProtoNetMsgPacket *packet = &msg->packet;
 
@@ -181,104 +254,435 @@ void ForwardToETH(struct SimbricksNetIf *netif,
   ip_hdr->daddr = 0xFFFFFFFF;
   ip_hdr->saddr = ip_addr;
   ip_hdr->tot_len =
-      sizeof(struct iphdr) + sizeof(struct udphdr) + sizeof(struct MemOp);
-  if (type == SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE) {
-    ip_hdr->tot_len += data->write.len;
-  }
-  ip_hdr->tot_len = htons(ip_hdr->tot_len);
+      htons(sizeof(struct iphdr) + sizeof(struct udphdr) + req_frame.len);
   // Add UDP header
   struct udphdr *udp_hdr = (struct udphdr *)(ip_hdr + 1);
   udp_hdr->uh_sport = src_port;
   udp_hdr->uh_dport = dest_port;
-  udp_hdr->uh_ulen = sizeof(struct udphdr) + sizeof(struct MemOp);
-  if (type == SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE) {
-    udp_hdr->uh_ulen += data->write.len;
-  }
+  udp_hdr->uh_ulen = sizeof(struct udphdr) + req_frame.len;
   udp_hdr->uh_sum = 0;  // To update later
 
-  packet->len = sizeof(struct ethhdr) + sizeof(struct iphdr) +
-                sizeof(struct udphdr) + sizeof(struct MemOp);
+  // we parse batched responses, whether or not we batch requests
+  MemOpFrameFinish(&req_frame, MEMOP_F_BATCH);
+  memcpy((void *)(udp_hdr + 1), req_frame.buf, req_frame.len);
+  packet->len = MEMOP_FRAME_HDR_LEN + req_frame.len;
 
-  // Fill the MemOps struct in the payload
-  struct MemOp *memop = (struct MemOp *)(udp_hdr + 1);
-  void *payload;
-  switch (type) {
-    case SIMBRICKS_PROTO_MEM_H2M_MSG_READ:
-      memop->OpType = type;
-      memop->req_id = data->read.req_id;
-      memop->as_id = data->read.as_id;
-      memop->addr = data->read.addr;
-      memop->len = data->read.len;
-      break;
-    case SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE:
-      memop->OpType = type;
-      memop->req_id = data->write.req_id;
-      memop->as_id = data->write.as_id;
-      memop->addr = data->write.addr;
-      memop->len = data->write.len;
-      payload = (void *)(memop + 1);
-      memcpy((void *)payload, (void *)data->write.data, data->write.len);
-      packet->len += data->write.len;
-      break;
+  SimbricksNetIfOutSend(netif, msg, SIMBRICKS_PROTO_NET_MSG_PACKET);
+  MemOpFrameReset(&req_frame);
+  return true;
+}
 
-    default:
-      fprintf(stderr, "ForwardToETH: unsupported type=%u\n", type);
+/**
+ * Queue a request for the network. Without batching it goes out in a frame
+ * of its own right away, with batching it is added to the current frame,
+ * which is sent once full or when the batching window has passed. Returns
+ * false if the request cannot be taken yet, and aborts on one that, or whose
+ * read response, does not fit into a frame at all.
+ */
+static bool QueueRequest(struct SimbricksNetIf *netif, uint8_t type,
+                         uint64_t req_id, uint64_t addr, uint16_t len,
+                         uint64_t as_id, const volatile void *payload) {
+  bool batch = batching && peer_batch;
+  // the read data comes back in a single frame of the same size
+  if (type == SIMBRICKS_PROTO_MEM_H2M_MSG_READ &&
+      sizeof(struct MemOp) + len > req_frame.cap) {
+    fprintf(stderr,
+            "ForwardToETH: read response too large for a frame (len=%u)\n",
+            len);
+    abort();
+  }
+  if (req_frame.num_ops) {
+    if (batch &&
+        MemOpFrameAdd(&req_frame, type, req_id, addr, len, as_id, payload))
+      return true;
+    if (!FlushRequests(netif))
+      return false;
   }
 
-  SimbricksNetIfOutSend(netif, msg, SIMBRICKS_PROTO_NET_MSG_PACKET);
+  // the memory side has no way to reassemble a request spread over several
+  // frames, and dropping it would leave the host waiting forever
+  if (!MemOpFrameAdd(&req_frame, type, req_id, addr, len, as_id, payload)) {
+    fprintf(stderr, "ForwardToETH: request too large for a frame (len=%u)\n",
+            len);
+    abort();
+  }
+  req_deadline = cur_ts + batch_window;
+  // if the ring is full this is retried from the main loop
+  if (!batch)
+    FlushRequests(netif);
+  return true;
 }
 
-void ForwardToMEM(struct SimbricksMemIf *memif,
-                  volatile struct SimbricksProtoNetMsgPacket *packet) {
-  volatile union SimbricksProtoMemM2H *msg =
-      SimbricksMemIfM2HOutAlloc(memif, cur_ts);
-
-  if (msg == NULL)
+/**
+ * Send a request the cache generated or passes on. Unlike QueueRequest()
+ * this always succeeds: requests that cannot be queued wait in net_backlog,
+ * in order.
+ */
+static void SendRequest(struct SimbricksNetIf *netif, uint8_t type,
+                        uint64_t req_id, uint64_t addr, uint16_t len,
+                        uint64_t as_id, const void *payload) {
+  if (net_backlog_head == net_backlog_num &&
+      QueueRequest(netif, type, req_id, addr, len, as_id, payload))
     return;
 
-  uint8_t type;
-  struct ethhdr *eth_hdr = (struct ethhdr *)packet->data;
-  struct iphdr *ip_hdr = (struct iphdr *)(eth_hdr + 1);
-  struct udphdr *udp_hdr = (struct udphdr *)(ip_hdr + 1);
-  struct MemOp *memop = (struct MemOp *)(udp_hdr + 1);
-  void *data = (void *)(memop + 1);
+  if (net_backlog_num == net_backlog_cap) {
+    net_backlog_cap = net_backlog_cap ? net_backlog_cap * 2 : 16;
+    net_backlog = realloc(net_backlog, net_backlog_cap * sizeof(*net_backlog));
+  }
+  struct NetReq *r = &net_backlog[net_backlog_num++];
+  r->type = type;
+  r->req_id = req_id;
+  r->addr = addr;
+  r->len = len;
+  r->as_id = as_id;
+  r->data = NULL;
+  if (MemOpHasData(type)) {
+    r->data = malloc(len);
+    memcpy(r->data, payload, len);
+  }
+}
 
-  type = memop->OpType;
+/** Queue the requests waiting in net_backlog, false if some still wait. */
+static bool DrainNetBacklog(struct SimbricksNetIf *netif) {
+  for (; net_backlog_head < net_backlog_num; net_backlog_head++) {
+    struct NetReq *r = &net_backlog[net_backlog_head];
+    if (!QueueRequest(netif, r->type, r->req_id, r->addr, r->len, r->as_id,
+                      r->data))
+      return false;
+    free(r->data);
+  }
+  net_backlog_head = net_backlog_num = 0;
+  return true;
+}
 
-  switch (type) {
-    case SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP: {
-      volatile struct SimbricksProtoMemM2HReadcomp *rc;
-      rc = &msg->readcomp;
-      rc->req_id = memop->req_id;
-
-      memcpy((void *)rc->data, (void *)data, memop->len);
-      SimbricksMemIfM2HOutSend(memif, msg,
-                               SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP);
-      break;
+/** Complete a host request from memnic itself at time `due`. */
+static void CompleteLocal(uint64_t due, uint8_t type, uint64_t req_id,
+                          const uint8_t *data, uint16_t len) {
+  if (local_num == local_cap) {
+    // grow, unwrapping the ring
+    size_t cap = local_cap ? local_cap * 2 : 64;
+    struct LocalComp *comps = malloc(cap * sizeof(*comps));
+    uint8_t *comp_data = malloc(cap * cache.line_size);
+    for (size_t i = 0; i < local_num; i++) {
+      size_t j = (local_head + i) % local_cap;
+      comps[i] = local_comps[j];
+      memcpy(comp_data + i * cache.line_size,
+             local_data + j * cache.line_size, cache.line_size);
     }
+    free(local_comps);
+    free(local_data);
+    local_comps = comps;
+    local_data = comp_data;
+    local_cap = cap;
+    local_head = 0;
+  }
 
-    case SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP: {
-      volatile struct SimbricksProtoMemM2HWritecomp *wc;
-      wc = &msg->writecomp;
-      wc->req_id = memop->req_id;
+  size_t i = (local_head + local_num++) % local_cap;
+  struct LocalComp *c = &local_comps[i];
+  c->due = due;
+  c->type = type;
+  c->req_id = req_id;
+  c->len = len;
+  if (data)
+    memcpy(local_data + i * cache.line_size, data, len);
+}
 
-      SimbricksMemIfM2HOutSend(memif, msg,
-                               SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP);
-      break;
+/** Hand completions from the cache that are due to the host. */
+static void DeliverLocal(struct SimbricksMemIf *memif) {
+  while (local_num && local_comps[local_head].due <= cur_ts) {
+    struct LocalComp *c = &local_comps[local_head];
+    volatile union SimbricksProtoMemM2H *msg =
+        SimbricksMemIfM2HOutAlloc(memif, cur_ts);
+    if (msg == NULL)
+      return;
+
+    if (c->type == SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP) {
+      msg->readcomp.req_id = c->req_id;
+      memcpy((void *)msg->readcomp.data,
+             local_data + local_head * cache.line_size, c->len);
+    } else {
+      msg->writecomp.req_id = c->req_id;
     }
+    SimbricksMemIfM2HOutSend(memif, msg, c->type);
 
-    case SIMBRICKS_PROTO_MSG_TYPE_SYNC:
+    local_head = (local_head + 1) % local_cap;
+    local_num--;
+  }
+}
+
+static void CacheWriteBack(struct SimbricksNetIf *netif,
+                           struct MemCacheLine *l) {
+  SendRequest(netif, SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE, kCacheReqId, l->addr,
+              cache.line_size, l->as_id, MemCacheData(&cache, l));
+  l->dirty = false;
+  cache.writebacks++;
+}
+
+/** Make room for and install a line, writing back the one it replaces. */
+static struct MemCacheLine *CacheAllocate(struct SimbricksNetIf *netif,
+                                          uint64_t as_id, uint64_t addr) {
+  struct MemCacheLine *l = MemCacheVictim(&cache, as_id, addr);
+  if (l->valid && l->dirty)
+    CacheWriteBack(netif, l);
+  MemCacheInstall(&cache, l, as_id, addr);
+  return l;
+}
+
+/** Serve a request from a cached line, completing it at `due`. */
+static void CacheAccess(struct SimbricksNetIf *netif, struct MemCacheLine *l,
+                        uint8_t type, uint64_t req_id, uint64_t addr,
+                        uint16_t len, const uint8_t *data, uint64_t due) {
+  uint8_t *line_data = MemCacheData(&cache, l) + (addr - l->addr);
+  if (type == SIMBRICKS_PROTO_MEM_H2M_MSG_READ) {
+    CompleteLocal(due, SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP, req_id,
+                  line_data, len);
+    return;
+  }
+
+  memcpy(line_data, data, len);
+  if (write_through) {
+    // netmem completes the write
+    SendRequest(netif, type, req_id, addr, len, l->as_id, data);
+  } else {
+    l->dirty = true;
+    CompleteLocal(due, SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP, req_id, NULL,
+                  0);
+  }
+}
+
+static struct CacheMshr *CacheFindMshr(uint64_t as_id, uint64_t addr) {
+  for (unsigned i = 0; i < MEMNIC_MSHRS; i++) {
+    struct CacheMshr *m = &mshrs[i];
+    if (m->num_waiters && m->addr == addr && m->as_id == as_id)
+      return m;
+  }
+  return NULL;
+}
+
+static void CacheAddWaiter(struct CacheMshr *m, uint8_t type, uint64_t req_id,
+                           uint64_t addr, uint16_t len,
+                           const volatile uint8_t *data) {
+  struct CacheWaiter *w = &m->waiters[m->num_waiters];
+  w->type = type;
+  w->req_id = req_id;
+  w->addr = addr;
+  w->len = len;
+  if (data)
+    memcpy(m->data + m->num_waiters * cache.line_size, (const void *)data,
+           len);
+  m->num_waiters++;
+}
+
+/** A line fetched for an MSHR arrived: install it and serve the waiters. */
+static void CacheFill(struct SimbricksNetIf *netif, uint64_t req_id,
+                      const uint8_t *data) {
+  uint64_t idx = req_id & ~kCacheReqBit;
+  if (idx >= MEMNIC_MSHRS || !mshrs[idx].num_waiters) {
+    fprintf(stderr, "CacheFill: unexpected fill req_id=%lx\n", req_id);
+    return;
+  }
+  struct CacheMshr *m = &mshrs[idx];
+  struct MemCacheLine *l = CacheAllocate(netif, m->as_id, m->addr);
+  memcpy(MemCacheData(&cache, l), data, cache.line_size);
+
+  for (unsigned i = 0; i < m->num_waiters; i++) {
+    struct CacheWaiter *w = &m->waiters[i];
+    CacheAccess(netif, l, w->type, w->req_id, w->addr, w->len,
+                m->data + i * cache.line_size, cur_ts);
+  }
+  m->num_waiters = 0;
+}
+
+/**
+ * Serve a host request through the cache. Requests within one line are
+ * served from the cache, fetching the line on a miss (except for
+ * write-through write misses), requests spanning lines bypass it. Returns
+ * false if the request has to wait.
+ */
+static bool CacheRequest(struct SimbricksNetIf *netif, uint8_t type,
+                         uint64_t req_id, uint64_t addr, uint16_t len,
+                         uint64_t as_id, const volatile uint8_t *payload) {
+  // its completion could not be told apart from a cache fill
+  if (req_id & kCacheReqBit) {
+    fprintf(stderr, "CacheRequest: req_id %lx collides with cache requests\n",
+            req_id);
+    abort();
+  }
+  // requests the cache generated have to go out first
+  if (!DrainNetBacklog(netif))
+    return false;
+
+  if (!MemCacheSingleLine(&cache, addr, len)) {
+    uint64_t first = MemCacheLineAddr(&cache, addr);
+    uint64_t end = addr + len;
+    for (uint64_t a = first; a < end; a += cache.line_size) {
+      if (CacheFindMshr(as_id, a))
+        return false;
+    }
+    // netmem has to see dirty data before the request, and writes leave
+    // no stale copies behind
+    for (uint64_t a = first; a < end; a += cache.line_size) {
+      struct MemCacheLine *l = MemCacheLookup(&cache, as_id, a, false);
+      if (!l)
+        continue;
+      if (l->dirty)
+        CacheWriteBack(netif, l);
+      if (type == SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE)
+        l->valid = false;
+    }
+    SendRequest(netif, type, req_id, addr, len, as_id, (const void *)payload);
+    return true;
+  }
+
+  uint64_t line = MemCacheLineAddr(&cache, addr);
+  struct CacheMshr *m = CacheFindMshr(as_id, line);
+  if (m) {
+    if (m->num_waiters == MEMNIC_MSHR_WAITERS)
+      return false;
+    CacheAddWaiter(m, type, req_id, addr, len, payload);
+    return true;
+  }
+
+  struct MemCacheLine *l = MemCacheLookup(&cache, as_id, line, true);
+  bool write = type == SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE;
+  if (!l && write && write_through) {
+    SendRequest(netif, type, req_id, addr, len, as_id, (const void *)payload);
+    return true;
+  }
+  if (!l && write && len == cache.line_size)
+    l = CacheAllocate(netif, as_id, line);  // no need to fetch
+  if (l) {
+    CacheAccess(netif, l, type, req_id, addr, len, (const uint8_t *)payload,
+                cur_ts + hit_latency);
+    return true;
+  }
+
+  for (unsigned i = 0; i < MEMNIC_MSHRS; i++) {
+    m = &mshrs[i];
+    if (m->num_waiters)
+      continue;
+    m->as_id = as_id;
+    m->addr = line;
+    CacheAddWaiter(m, type, req_id, addr, len, payload);
+    SendRequest(netif, SIMBRICKS_PROTO_MEM_H2M_MSG_READ, kCacheReqBit | i,
+                line, cache.line_size, as_id, NULL);
+    return true;
+  }
+  // undo the miss, the request is looked up again later
+  cache.misses--;
+  return false;
+}
+
+/**
+ * Forward a host request, through the cache if there is one. Returns false
+ * if the request cannot be taken yet.
+ */
+bool ForwardToETH(struct SimbricksNetIf *netif,
+                  volatile union SimbricksProtoMemH2M *data, uint8_t type) {
+  uint64_t req_id, addr, as_id;
+  uint16_t len;
+  volatile uint8_t *payload = NULL;
+
+  switch (type) {
+    case SIMBRICKS_PROTO_MEM_H2M_MSG_READ:
+      req_id = data->read.req_id;
+      as_id = data->read.as_id;
+      addr = data->read.addr;
+      len = data->read.len;
+      break;
+    case SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE:
+      req_id = data->write.req_id;
+      as_id = data->write.as_id;
+      addr = data->write.addr;
+      len = data->write.len;
+      payload = data->write.data;
       break;
 
     default:
-      fprintf(stderr, "poll_m2h: unsupported type=%u\n", type);
+      fprintf(stderr, "ForwardToETH: unsupported type=%u\n", type);
+      return true;
+  }
+
+  if (caching)
+    return CacheRequest(netif, type, req_id, addr, len, as_id, payload);
+  return QueueRequest(netif, type, req_id, addr, len, as_id, payload);
+}
+
+/**
+ * Hand the completions in a frame to the host. Returns false if the host
+ * ring filled up before all were delivered, the next call for the same frame
+ * continues where this one stopped.
+ */
+bool ForwardToMEM(struct SimbricksMemIf *memif, struct SimbricksNetIf *netif,
+                  volatile struct SimbricksProtoNetMsgPacket *packet) {
+  if (packet->len < MEMOP_FRAME_HDR_LEN) {
+    fprintf(stderr, "ForwardToMEM: short frame (len=%u)\n", packet->len);
+    return true;
   }
+
+  struct MemOp *memop =
+      (struct MemOp *)((uint8_t *)packet->data + MEMOP_FRAME_HDR_LEN);
+  if (batching && (memop->flags & MEMOP_F_BATCH))
+    peer_batch = true;
+
+  struct MemOpIter it;
+  struct MemOpNext *op;
+  uint8_t *data;
+  unsigned i = 0;
+  MemOpIterInit(&it, memop, packet->len - MEMOP_FRAME_HDR_LEN);
+  while ((op = MemOpIterNext(&it, &data)) != NULL) {
+    if (i++ < n2m_done)
+      continue;
+
+    if (caching && (op->req_id & kCacheReqBit)) {
+      // fills complete MSHRs, write-backs need no completion
+      if (op->OpType == SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP)
+        CacheFill(netif, op->req_id, data);
+      n2m_done++;
+      continue;
+    }
+
+    volatile union SimbricksProtoMemM2H *msg =
+        SimbricksMemIfM2HOutAlloc(memif, cur_ts);
+    if (msg == NULL)
+      return false;
+
+    switch (op->OpType) {
+      case SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP: {
+        volatile struct SimbricksProtoMemM2HReadcomp *rc;
+        rc = &msg->readcomp;
+        rc->req_id = op->req_id;
+
+        memcpy((void *)rc->data, (void *)data, op->len);
+        SimbricksMemIfM2HOutSend(memif, msg,
+                                 SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP);
+        break;
+      }
+
+      case SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP: {
+        volatile struct SimbricksProtoMemM2HWritecomp *wc;
+        wc = &msg->writecomp;
+        wc->req_id = op->req_id;
+
+        SimbricksMemIfM2HOutSend(memif, msg,
+                                 SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP);
+        break;
+      }
+
+      default:
+        fprintf(stderr, "poll_m2h: unsupported type=%u\n", op->OpType);
+    }
+    n2m_done++;
+  }
+
+  n2m_done = 0;
+  return true;
 }
 
 void PollN2M(struct SimbricksNetIf *netif, struct SimbricksMemIf *memif,
              uint64_t cur_ts) {
   volatile union SimbricksProtoNetMsg *msg =
-      SimbricksNetIfInPoll(netif, cur_ts);
+      SimbricksNetIfInPeek(netif, cur_ts);
   if (msg == NULL) {
     return;
   }
@@ -287,7 +691,8 @@ void PollN2M(struct SimbricksNetIf *netif, struct SimbricksMemIf *memif,
   type = SimbricksNetIfInType(netif, msg);
   switch (type) {
     case SIMBRICKS_PROTO_NET_MSG_PACKET:
-      ForwardToMEM(memif, &msg->packet);
+      if (!ForwardToMEM(memif, netif, &msg->packet))
+        return;
       break;
 
     case SIMBRICKS_PROTO_MSG_TYPE_SYNC:
@@ -297,16 +702,18 @@ void PollN2M(struct SimbricksNetIf *netif, struct SimbricksMemIf *memif,
       fprintf(stderr, "poll_n2m: unsupported type=%u\n", type);
   }
 
+  SimbricksNetIfInPoll(netif, cur_ts);
   SimbricksNetIfInDone(netif, msg);
 }
 
-void PollH2M(struct SimbricksMemIf *memif, struct SimbricksNetIf *netif,
+/** Returns false if the request at the head of the ring has to wait. */
+bool PollH2M(struct SimbricksMemIf *memif, struct SimbricksNetIf *netif,
              uint64_t cur_ts) {
   volatile union SimbricksProtoMemH2M *msg =
-      SimbricksMemIfH2MInPoll(memif, cur_ts);
+      SimbricksMemIfH2MInPeek(memif, cur_ts);
 
   if (msg == NULL) {
-    return;
+    return true;
   }
   uint8_t type;
 
@@ -316,14 +723,16 @@ void PollH2M(struct SimbricksMemIf *memif, struct SimbricksNetIf *netif,
 #if MEMNIC_DEBUG
       printf("received read request\n");
 #endif
-      ForwardToETH(netif, msg, type);
+      if (!ForwardToETH(netif, msg, type))
+        return false;
       break;
 
     case SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE:
 #if MEMNIC_DEBUG
       printf("received write request\n");
 #endif
-      ForwardToETH(netif, msg, type);
+      if (!ForwardToETH(netif, msg, type))
+        return false;
       break;
     case SIMBRICKS_PROTO_MSG_TYPE_SYNC:
       break;
@@ -331,7 +740,66 @@ void PollH2M(struct SimbricksMemIf *memif, struct SimbricksNetIf *netif,
       fprintf(stderr, "poll_h2m: unsupported type=%u\n", type);
   }
 
+  SimbricksMemIfH2MInPoll(memif, cur_ts);
   SimbricksMemIfH2MInDone(memif, msg);
+  return true;
+}
+
+/** Parse a whole option value as a size, false if anything follows it. */
+static bool ParseSize(const char *str, size_t *size) {
+  char *end;
+  *size = SimbricksParseSize(str, &end);
+  return end != str && !*end;
+}
+
+/**
+ * Set up the cache from an option of the form
+ *   SIZE[,line=N][,ways=N][,repl=lru|clock][,write=back|through]
+ *       [,latency=NS]
+ * Returns 0 on success.
+ */
+static int ParseCacheOpt(char *opt) {
+  char *ctx;
+  char *tok = strtok_r(opt, ",", &ctx);
+  size_t size;
+  size_t line_size = 64;
+  unsigned ways = 8;
+  enum MemCacheRepl repl = kMemCacheLru;
+
+  if (!tok || !ParseSize(tok, &size))
+    return -1;
+  while ((tok = strtok_r(NULL, ",", &ctx)) != NULL) {
+    char *val = strchr(tok, '=');
+    if (!val)
+      return -1;
+    *val++ = 0;
+    if (!strcmp(tok, "line")) {
+      if (!ParseSize(val, &line_size))
+        return -1;
+    } else if (!strcmp(tok, "ways")) {
+      ways = strtoul(val, NULL, 0);
+    } else if (!strcmp(tok, "repl") && !strcmp(val, "lru")) {
+      repl = kMemCacheLru;
+    } else if (!strcmp(tok, "repl") && !strcmp(val, "clock")) {
+      repl = kMemCacheClock;
+    } else if (!strcmp(tok, "write") && !strcmp(val, "back")) {
+      write_through = false;
+    } else if (!strcmp(tok, "write") && !strcmp(val, "through")) {
+      write_through = true;
+    } else if (!strcmp(tok, "latency")) {
+      hit_latency = strtoull(val, NULL, 0) * 1000ULL;
+    } else {
+      return -1;
+    }
+  }
+
+  if (line_size > UINT16_MAX ||
+      MemCacheInit(&cache, size, line_size, ways, repl))
+    return -1;
+  for (unsigned i = 0; i < MEMNIC_MSHRS; i++)
+    mshrs[i].data = malloc(MEMNIC_MSHR_WAITERS * line_size);
+  caching = true;
+  return 0;
 }
 
 int main(int argc, char *argv[]) {
@@ -353,11 +821,36 @@ int main(int argc, char *argv[]) {
   SimbricksMemIfDefaultParams(&memParams);
   SimbricksNetIfDefaultParams(&netParams);
 
-  if (argc < 4 || argc > 10) {
+  int c;
+  while ((c = getopt(argc, argv, "+b:m:c:")) != -1) {
+    switch (c) {
+      case 'b':
+        batching = true;
+        batch_window = strtoull(optarg, NULL, 0) * 1000ULL;
+        break;
+      case 'm':
+        mtu = strtoull(optarg, NULL, 0);
+        break;
+      case 'c':
+        if (ParseCacheOpt(optarg)) {
+          fprintf(stderr, "memnic: invalid cache option\n");
+          argc = 0;
+        }
+        break;
+      default:
+        argc = 0;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  if (argc < 4 || argc > 10 || mtu < 576) {
     fprintf(
         stderr,
-        "Usage: memnic MEM-SOCKET NET-SOCKET"
-        "SHM [MAC-ADDR] [SYNC-MODE] [START-TICK] [SYNC-PERIOD] [MEM-LATENCY]"
+        "Usage: memnic [-b BATCH-WINDOW] [-m MTU] "
+        "[-c SIZE[,line=N][,ways=N][,repl=lru|clock][,write=back|through]"
+        "[,latency=NS]] MEM-SOCKET NET-SOCKET "
+        "SHM [MAC-ADDR] [SYNC-MODE] [START-TICK] [SYNC-PERIOD] [MEM-LATENCY] "
         "[ETH-LATENCY]\n");
     return -1;
   }
@@ -392,6 +885,20 @@ int main(int argc, char *argv[]) {
     return -1;
   }
 
+  // frames have to fit a ring slot, batching also keeps them within the MTU
+  size_t frame_cap = netif.base.out_elen -
+                     sizeof(struct SimbricksProtoNetMsgPacket) -
+                     MEMOP_FRAME_HDR_LEN;
+  MemOpFrameInit(&req_frame, malloc(frame_cap), frame_cap,
+                 mtu - sizeof(struct iphdr) - sizeof(struct udphdr));
+  if (caching &&
+      (sizeof(struct MemOp) + cache.line_size > frame_cap ||
+       sizeof(struct SimbricksProtoMemM2HReadcomp) + cache.line_size >
+           memif.base.out_elen)) {
+    fprintf(stderr, "memnic: cache lines do not fit a frame\n");
+    return -1;
+  }
+
   fprintf(stderr, "start polling\n");
   while (!exiting) {
     while (SimbricksMemNicIfSync(&memif, &netif, cur_ts)) {
@@ -400,20 +907,47 @@ int main(int argc, char *argv[]) {
     }
 
     do {
-      PollH2M(&memif, &netif, cur_ts);
+      bool h2m_wait = !PollH2M(&memif, &netif, cur_ts);
       PollN2M(&netif, &memif, cur_ts);
 
-      ts_mem = SimbricksMemIfH2MInTimestamp(&memif);
+      // a request that has to wait does not hold back time, it is retried
+      // once there are responses or syncs from the network
+      ts_mem = h2m_wait ? UINT64_MAX : SimbricksMemIfH2MInTimestamp(&memif);
       ts_net = SimbricksNetIfInTimestamp(&netif);
     } while (!exiting && ((sync_mem && ts_mem <= cur_ts) ||
                           (sync_net && ts_net <= cur_ts)));
 
+    uint64_t prev_ts = cur_ts;
+    if (caching) {
+      DeliverLocal(&memif);
+      DrainNetBacklog(&netif);
+    }
+    if (req_frame.num_ops && req_deadline <= cur_ts)
+      FlushRequests(&netif);
+
     if (sync_mem && sync_net)
       cur_ts = ts_mem <= ts_net ? ts_mem : ts_net;
     else if (sync_mem)
       cur_ts = ts_mem;
     else if (sync_net)
       cur_ts = ts_net;
+
+    // wake up to send a batch when its window is over, for cache
+    // completions that become due, or to retry sending
+    uint64_t wake = UINT64_MAX;
+    if (req_frame.num_ops)
+      wake = req_deadline;
+    if (local_num && local_comps[local_head].due < wake)
+      wake = local_comps[local_head].due;
+    if (net_backlog_head < net_backlog_num)
+      wake = prev_ts;
+    if (wake < cur_ts)
+      cur_ts = wake > prev_ts ? wake : prev_ts;
+  }
+
+  if (caching) {
+    fprintf(stderr, "cache: hits=%lu misses=%lu writebacks=%lu\n", cache.hits,
+            cache.misses, cache.writebacks);
   }
 
   // Todo: cleanup
@@ -24,7 +24,7 @@ include mk/subdir_pre.mk
 
 bin_memnic := $(d)memnic
 
-OBJS := $(d)memnic.o
+OBJS := $(d)memnic.o $(d)cache.o
 
 $(bin_memnic): $(OBJS) $(lib_mem) $(lib_netif) $(lib_base)
 
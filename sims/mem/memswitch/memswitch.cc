@@ -25,9 +25,10 @@
 #include <arpa/inet.h>
 #include <linux/if_ether.h>
 #include <linux/ip.h>
-#include <pcap/pcap.h>
+#include <netinet/udp.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <climits>
 #include <csignal>
@@ -39,7 +40,11 @@
 #include <vector>
 
 #include <simbricks/base/cxxatomicfix.h>
+#include <simbricks/base/ts_heap.hh>
+#include <simbricks/network/mac_table.hh>
+#include <simbricks/netport/netport.h>
 extern "C" {
+#include <simbricks/network/capture.h>
 #include <simbricks/network/if.h>
 #include <simbricks/nicif/nicif.h>
 
@@ -50,7 +55,7 @@ extern "C" {
 #define NETSWITCH_STAT
 
 struct SimbricksBaseIfParams netParams;
-static pcap_dumper_t *dumpfile = nullptr;
+static struct SimbricksCapture *capture = nullptr;
 
 #ifdef NETSWITCH_STAT
 #endif
@@ -81,229 +86,103 @@ struct table_entry {
 
 std::vector<struct table_entry> map_table;
 
-/* MAC address type */
-struct MAC {
-  const uint8_t *data;
-
-  explicit MAC(const uint8_t *data) : data(data) {
-  }
-
-  bool operator==(const MAC &other) const {
-    for (int i = 0; i < 6; i++) {
-      if (data[i] != other.data[i]) {
-        return false;
-      }
-    }
-    return true;
-  }
-
-  MAC operator=(const uint8_t *other) const {
-    MAC mac(other);
-    return mac;
-  }
-};
-namespace std {
-template <>
-struct hash<MAC> {
-  size_t operator()(const MAC &m) const {
-    size_t res = 0;
-    for (int i = 0; i < 6; i++) {
-      res = (res << 4) | (res ^ m.data[i]);
-    }
-    return res;
-  }
-};
-}  // namespace std
-
-/** Normal network switch port (conneting to a NIC) */
-class NetPort {
- public:
-  enum RxPollState {
-    kRxPollSuccess = 0,
-    kRxPollFail = 1,
-    kRxPollSync = 2,
-  };
-  struct SimbricksNetIf netif_;
-  const char *path_;
-
- protected:
-  volatile union SimbricksProtoNetMsg *rx_;
-  int sync_;
-
-  bool Init() {
-    struct SimbricksBaseIfParams params = netParams;
-    params.sync_mode =
-        (sync_ ? kSimbricksBaseIfSyncOptional : kSimbricksBaseIfSyncDisabled);
-    params.sock_path = path_;
-    params.blocking_conn = false;
-
-    if (SimbricksBaseIfInit(&netif_.base, &params)) {
-      perror("Init: SimbricksBaseIfInit failed");
-      return false;
-    }
-
-    return true;
-  }
-
+/**
+ * Virtual to physical translation over map_table: per as_id the mappings
+ * sorted by start address (binary search), fronted by a direct-mapped cache
+ * of recently used pages.
+ */
+class AddrTranslator {
  public:
-  NetPort(const char *path, int sync) : path_(path), rx_(nullptr), sync_(sync) {
-    memset(&netif_, 0, sizeof(netif_));
-  }
-
-  NetPort(const NetPort &other)
-      : netif_(other.netif_),
-        path_(other.path_),
-        rx_(other.rx_),
-        sync_(other.sync_) {
-  }
-
-  virtual bool Prepare() {
-    if (!Init())
-      return false;
-
-    if (SimbricksBaseIfConnect(&netif_.base)) {
-      perror("Prepare: SimbricksBaseIfConnect failed");
-      return false;
+  static constexpr size_t kPageShift = 12;
+  static constexpr size_t kTlbEntries = 4096;
+
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+
+  /** Index the entries of map_table, false if mappings overlap. */
+  bool Build() {
+    spaces_.clear();
+    for (size_t i = 0; i < map_table.size(); i++)
+      spaces_[map_table[i].as_id].push_back(i);
+
+    for (auto &space : spaces_) {
+      std::vector<size_t> &v = space.second;
+      std::sort(v.begin(), v.end(), [](size_t a, size_t b) {
+        return map_table[a].vaddr_start < map_table[b].vaddr_start;
+      });
+      for (size_t i = 1; i < v.size(); i++) {
+        if (map_table[v[i]].vaddr_start <= map_table[v[i - 1]].vaddr_end) {
+          fprintf(stderr, "mappings for as_id %lu overlap at %lx\n",
+                  space.first, map_table[v[i]].vaddr_start);
+          return false;
+        }
+      }
     }
-
+    for (TlbEntry &e : tlb_)
+      e.entry = nullptr;
     return true;
   }
 
-  virtual void Prepared() {
-    sync_ = SimbricksBaseIfSyncEnabled(&netif_.base);
-  }
-
-  bool IsSync() {
-    return sync_;
-  }
-
-  void Sync(uint64_t cur_ts) {
-    while (SimbricksNetIfOutSync(&netif_, cur_ts)) {
+  /** Mapping containing `addr` in address space `as_id`, nullptr if none. */
+  const struct table_entry *Lookup(uint64_t as_id, uint64_t addr) {
+    uint64_t page = addr >> kPageShift;
+    TlbEntry &e = tlb_[(page ^ as_id * 0x9E3779B97F4A7C15ULL) %
+                       kTlbEntries];
+    if (e.entry && e.as_id == as_id && e.page == page) {
+      hits++;
+      return e.entry;
     }
-  }
-
-  uint64_t NextTimestamp() {
-    return SimbricksNetIfInTimestamp(&netif_);
-  }
-
-  enum RxPollState RxPacket(const void *&data, size_t &len, uint64_t cur_ts) {
-    assert(rx_ == nullptr);
-
-    rx_ = SimbricksNetIfInPoll(&netif_, cur_ts);
-    if (!rx_)
-      return kRxPollFail;
-
-    uint8_t type = SimbricksNetIfInType(&netif_, rx_);
-    if (type == SIMBRICKS_PROTO_NET_MSG_PACKET) {
-      data = (const void *)rx_->packet.data;
-      len = rx_->packet.len;
-      return kRxPollSuccess;
-    } else if (type == SIMBRICKS_PROTO_MSG_TYPE_SYNC) {
-      return kRxPollSync;
-    } else {
-      fprintf(stderr, "switch_pkt: unsupported type=%u\n", type);
-      abort();
+    misses++;
+
+    auto space = spaces_.find(as_id);
+    if (space == spaces_.end())
+      return nullptr;
+    const std::vector<size_t> &v = space->second;
+    auto it = std::upper_bound(v.begin(), v.end(), addr,
+                               [](uint64_t a, size_t i) {
+                                 return a < map_table[i].vaddr_start;
+                               });
+    if (it == v.begin())
+      return nullptr;
+    const struct table_entry *ent = &map_table[*(it - 1)];
+    if (addr > ent->vaddr_end)
+      return nullptr;
+
+    // only cache pages that lie entirely in this mapping
+    uint64_t first = page << kPageShift;
+    uint64_t last = first + (1ULL << kPageShift) - 1;
+    if (first >= ent->vaddr_start && last <= ent->vaddr_end) {
+      e.as_id = as_id;
+      e.page = page;
+      e.entry = ent;
     }
+    return ent;
   }
 
-  void RxDone() {
-    assert(rx_ != nullptr);
-
-    SimbricksNetIfInDone(&netif_, rx_);
-    rx_ = nullptr;
-  }
-
-  bool TxPacket(const void *data, size_t len, uint64_t cur_ts) {
-    volatile union SimbricksProtoNetMsg *msg_to =
-        SimbricksNetIfOutAlloc(&netif_, cur_ts);
-    if (!msg_to && !sync_) {
-      return false;
-    } else if (!msg_to && sync_) {
-      while (!msg_to)
-        msg_to = SimbricksNetIfOutAlloc(&netif_, cur_ts);
-    }
-    volatile struct SimbricksProtoNetMsgPacket *rx;
-    rx = &msg_to->packet;
-    rx->len = len;
-    rx->port = 0;
-    memcpy((void *)rx->data, data, len);
-
-    SimbricksNetIfOutSend(&netif_, msg_to, SIMBRICKS_PROTO_NET_MSG_PACKET);
-    return true;
-  }
-};
-
-/** Listening switch port (connected to by another network) */
-class NetListenPort : public NetPort {
- protected:
-  struct SimbricksBaseIfSHMPool pool_;
-
- public:
-  NetListenPort(const char *path, int sync) : NetPort(path, sync) {
-    memset(&pool_, 0, sizeof(pool_));
-  }
-
-  NetListenPort(const NetListenPort &other)
-      : NetPort(other), pool_(other.pool_) {
-  }
-
-  bool Prepare() override {
-    if (!Init())
-      return false;
-
-    std::string shm_path = path_;
-    shm_path += "-shm";
-
-    if (SimbricksBaseIfSHMPoolCreate(
-            &pool_, shm_path.c_str(),
-            SimbricksBaseIfSHMSize(&netif_.base.params)) != 0) {
-      perror("Prepare: SimbricksBaseIfSHMPoolCreate failed");
-      return false;
-    }
-
-    if (SimbricksBaseIfListen(&netif_.base, &pool_) != 0) {
-      perror("Prepare: SimbricksBaseIfListen failed");
-      return false;
-    }
+ private:
+  struct TlbEntry {
+    uint64_t as_id;
+    uint64_t page;
+    const struct table_entry *entry;
+  };
 
-    return true;
-  }
+  std::unordered_map<uint64_t, std::vector<size_t>> spaces_;
+  TlbEntry tlb_[kTlbEntries] = {};
 };
 
-static bool ConnectAll(std::vector<NetPort *> ports) {
-  size_t n = ports.size();
-  struct SimBricksBaseIfEstablishData ests[n];
-  struct SimbricksProtoNetIntro intro;
-
-  printf("start connecting...\n");
-  for (size_t i = 0; i < n; i++) {
-    NetPort *p = ports[i];
-    ests[i].base_if = &p->netif_.base;
-    ests[i].tx_intro = &intro;
-    ests[i].tx_intro_len = sizeof(intro);
-    ests[i].rx_intro = &intro;
-    ests[i].rx_intro_len = sizeof(intro);
-
-    if (!p->Prepare())
-      return false;
-  }
+static AddrTranslator translator;
 
-  if (SimBricksBaseIfEstablish(ests, n)) {
-    fprintf(stderr, "ConnectAll: SimBricksBaseIfEstablish failed\n");
-    return false;
-  }
+using netport::NetListenPort;
+using netport::NetPort;
 
-  printf("done connecting\n");
-  return true;
-}
+// packets that do not fit into a full egress ring wait instead of being lost
+static const size_t kBacklogBytes = 1024 * 1024;
 
 /* Global variables */
 static uint64_t cur_ts = 0;
 static int exiting = 0;
-static const uint8_t bcast[6] = {0xFF};
-static const MAC bcast_addr(bcast);
 static std::vector<NetPort *> ports;
-static std::unordered_map<MAC, int> mac_table;
+static simbricks::MacTable mac_table;
 
 static void sigint_handler(int dummy) {
   exiting = 1;
@@ -321,18 +200,12 @@ static void sigusr2_handler(int dummy) {
 
 static void forward_pkt(const void *pkt_data, size_t pkt_len, size_t port_id,
                         size_t iport_id) {
-  struct pcap_pkthdr ph;
   NetPort &dest_port = *ports[port_id];
 
-  // log to pcap file if initialized
-  if (dumpfile) {
-    memset(&ph, 0, sizeof(ph));
-    ph.ts.tv_sec = cur_ts / 1000000000000ULL;
-    ph.ts.tv_usec = (cur_ts % 1000000000000ULL) / 1000ULL;
-    ph.caplen = pkt_len;
-    ph.len = pkt_len;
-    pcap_dump((unsigned char *)dumpfile, &ph, (unsigned char *)pkt_data);
-  }
+  // capture if enabled
+  if (capture)
+    SimbricksCapturePacket(capture, cur_ts, pkt_data, pkt_len, iport_id,
+                           port_id);
   // print sending tick: [packet type] source_IP -> dest_IP len:
 
 #ifdef NETSWITCH_DEBUG
@@ -371,6 +244,132 @@ static void forward_pkt(const void *pkt_data, size_t pkt_len, size_t port_id,
     fprintf(stderr, "forward_pkt: dropping packet on port %zu\n", port_id);
 }
 
+/** Send a memop frame to the netmem `node`, to all ports while the port of
+ * that netmem is not known yet. */
+static void forward_memop(void *pkt_data, size_t pkt_len, size_t iport,
+                          const union ether_addr &node) {
+  struct ethhdr *eth_hdr = (struct ethhdr *)pkt_data;
+
+  // modify the destination MAC address
+  for (int k = 0; k < ETH_ALEN; k++) {
+    eth_hdr->h_dest[k] = node.ether_addr_octet[k];
+  }
+  int eport = mac_table.Lookup(eth_hdr->h_dest, cur_ts);
+  if (eport != simbricks::MacTable::kNoPort) {
+    if ((size_t)eport != iport) {
+#ifdef NETSWITCH_DEBUG
+      printf("Forwarding memop to netmem");
+#endif
+      forward_pkt(pkt_data, pkt_len, eport, iport);
+    }
+  } else {
+#ifdef NETSWITCH_DEBUG
+    printf("Dest netmem is not in the mac table, broadcast first\n");
+#endif
+    for (size_t eport = 0; eport < ports.size(); eport++) {
+      if (eport != iport) {
+        // Do not forward to ingress port
+        forward_pkt(pkt_data, pkt_len, eport, iport);
+      }
+    }
+  }
+}
+
+/** Send a frame split off a batched frame in `buf` to `node`. */
+static void send_split(uint8_t *buf, struct MemOpFrame *frame, uint8_t flags,
+                       size_t iport, const union ether_addr &node) {
+  MemOpFrameFinish(frame, flags);
+  struct iphdr *ip_hdr = (struct iphdr *)(buf + sizeof(struct ethhdr));
+  struct udphdr *udp_hdr = (struct udphdr *)(ip_hdr + 1);
+  ip_hdr->tot_len =
+      htons(sizeof(struct iphdr) + sizeof(struct udphdr) + frame->len);
+  udp_hdr->uh_ulen = sizeof(struct udphdr) + frame->len;
+  forward_memop(buf, MEMOP_FRAME_HDR_LEN + frame->len, iport, node);
+}
+
+/**
+ * Translate the ops of a batched frame. Ops for the same netmem stay in one
+ * frame, the frame is split up if they go to different ones. Split frames
+ * start with a full MemOp header and may come out larger than the original,
+ * so they are cut again where they would not fit into an egress slot.
+ */
+static void forward_batch(void *pkt_data, size_t pkt_len, size_t iport) {
+  struct BatchOp {
+    struct MemOpNext *op;
+    uint8_t *data;
+    const struct table_entry *ent;
+  };
+  static std::vector<BatchOp> ops;
+  static std::vector<uint8_t> buf;
+  static size_t slot_max = 0;
+
+  uint8_t *payload = (uint8_t *)pkt_data + MEMOP_FRAME_HDR_LEN;
+  uint8_t flags = ((struct MemOp *)payload)->flags & ~MEMOP_F_BATCHED;
+  struct MemOpIter it;
+  struct MemOpNext *op;
+  uint8_t *data;
+  bool split = false;
+
+  ops.clear();
+  MemOpIterInit(&it, payload, pkt_len - MEMOP_FRAME_HDR_LEN);
+  while ((op = MemOpIterNext(&it, &data)) != nullptr) {
+    const struct table_entry *ent = translator.Lookup(op->as_id, op->addr);
+    if (!ent) {
+      if (!map_table.empty())
+        fprintf(stderr, "Dest netmem is unavaliable.");
+      split = true;
+      continue;
+    }
+    // Translate the virtual address to physical address
+    op->addr = ent->phys_start + (op->addr - ent->vaddr_start);
+    if (!ops.empty() && memcmp(&ent->node_mac, &ops[0].ent->node_mac,
+                               ETH_ALEN))
+      split = true;
+    ops.push_back({op, data, ent});
+  }
+
+  if (ops.empty())
+    return;
+  if (!split) {
+    forward_memop(pkt_data, pkt_len, iport, ops[0].ent->node_mac);
+    return;
+  }
+
+  // the frame may be flooded, fit the smallest slot of all ports
+  if (!slot_max) {
+    slot_max = SIZE_MAX;
+    for (NetPort *port : ports)
+      slot_max = std::min(slot_max, port->TxMaxLen());
+  }
+  // a single op as the first of a frame is never larger than the original
+  buf.resize(std::max(pkt_len, slot_max));
+  size_t max_len = slot_max - MEMOP_FRAME_HDR_LEN;
+  for (size_t i = 0; i < ops.size(); i++) {
+    if (!ops[i].ent)
+      continue;
+    union ether_addr node = ops[i].ent->node_mac;
+
+    struct MemOpFrame frame;
+    memcpy(buf.data(), pkt_data, MEMOP_FRAME_HDR_LEN);
+    MemOpFrameInit(&frame, buf.data() + MEMOP_FRAME_HDR_LEN,
+                   buf.size() - MEMOP_FRAME_HDR_LEN, max_len);
+    for (size_t j = i; j < ops.size(); j++) {
+      if (!ops[j].ent || memcmp(&ops[j].ent->node_mac, &node, ETH_ALEN))
+        continue;
+      op = ops[j].op;
+      if (!MemOpFrameAdd(&frame, op->OpType, op->req_id, op->addr, op->len,
+                         op->as_id, ops[j].data)) {
+        send_split(buf.data(), &frame, flags, iport, node);
+        MemOpFrameReset(&frame);
+        MemOpFrameAdd(&frame, op->OpType, op->req_id, op->addr, op->len,
+                      op->as_id, ops[j].data);
+      }
+      ops[j].ent = nullptr;
+    }
+    send_split(buf.data(), &frame, flags, iport, node);
+  }
+}
+
 static void switch_pkt(NetPort &port, size_t iport) {
   const void *pkt_data;
   size_t pkt_len;
@@ -396,62 +395,29 @@ static void switch_pkt(NetPort &port, size_t iport) {
 
   if (poll == NetPort::kRxPollSuccess) {
     // Get MAC addresses
-    MAC dst((const uint8_t *)pkt_data), src((const uint8_t *)pkt_data + 6);
+    const uint8_t *dst = (const uint8_t *)pkt_data, *src = dst + 6;
     // MAC learning
-
-    if (!(src == bcast_addr)) {
-      mac_table[src] = iport;
-    }
+    mac_table.Learn(src, iport, cur_ts);
 
     // L2 forwarding
-    auto i = mac_table.find(dst);
-    if (i != mac_table.end()) {
-      size_t eport = i->second;
-      if (eport != iport)
+    int eport = mac_table.Lookup(dst, cur_ts);
+    if (eport != simbricks::MacTable::kNoPort) {
+      if ((size_t)eport != iport)
         forward_pkt(pkt_data, pkt_len, eport, iport);
     } else {
       // Broadcast
-      struct ethhdr *eth_hdr = (struct ethhdr *)pkt_data;
-      struct MemOp *memop = (struct MemOp *)(((const uint8_t *)pkt_data) + 42);
-      uint64_t phy_addr = 0;
-
-      for (size_t i = 0; i < map_table.size(); i++) {
-        if (memop->as_id == map_table[i].as_id &&
-            memop->addr >= map_table[i].vaddr_start &&
-            memop->addr <= map_table[i].vaddr_end) {
+      struct MemOp *memop = (struct MemOp *)(((const uint8_t *)pkt_data) +
+                                             MEMOP_FRAME_HDR_LEN);
+      if (memop->flags & MEMOP_F_BATCHED) {
+        forward_batch((void *)pkt_data, pkt_len, iport);
+      } else {
+        const struct table_entry *ent =
+            translator.Lookup(memop->as_id, memop->addr);
+        if (ent) {
           // Translate the virtual address to physical address
-          phy_addr = map_table[i].phys_start +
-                     (memop->addr - map_table[i].vaddr_start);
-          memop->addr = phy_addr;
-
-          // modify the destination MAC address
-          for (int k = 0; k < ETH_ALEN; k++) {
-            eth_hdr->h_dest[k] = map_table[i].node_mac.ether_addr_octet[k];
-          }
-          dst = eth_hdr->h_dest;
-          auto k = mac_table.find(dst);
-          if (k != mac_table.end()) {
-            size_t eport = k->second;
-            if (eport != iport) {
-#ifdef NETSWITCH_DEBUG
-              printf("Forwarding memop to netmem");
-#endif
-              forward_pkt(pkt_data, pkt_len, eport, iport);
-            }
-          } else {
-#ifdef NETSWITCH_DEBUG
-            printf("Dest netmem is not in the mac table, broadcast first\n");
-#endif
-            for (size_t eport = 0; eport < ports.size(); eport++) {
-              if (eport != iport) {
-                // Do not forward to ingress port
-                forward_pkt(pkt_data, pkt_len, eport, iport);
-              }
-            }
-          }
-          break;
-        }
-        if (i == map_table.size() - 1) {
+          memop->addr = ent->phys_start + (memop->addr - ent->vaddr_start);
+          forward_memop((void *)pkt_data, pkt_len, iport, ent->node_mac);
+        } else if (!map_table.empty()) {
           fprintf(stderr, "Dest netmem is unavaliable.");
         }
       }
@@ -474,26 +440,29 @@ int main(int argc, char *argv[]) {
   int c;
   int bad_option = 0;
   int sync_eth = 1;
-  pcap_t *pc = nullptr;
+  struct SimbricksCaptureParams cap_params;
   int netmem_idx = 0;
   size_t port_i;
   std::string netmem_name;
 
   SimbricksNetIfDefaultParams(&netParams);
+  SimbricksCaptureDefaultParams(&cap_params);
 
   // Parse command line argument
   while ((c = getopt(argc, argv, "s:h:uS:E:p:m:")) != -1 && !bad_option) {
     switch (c) {
       case 's': {
-        NetPort *port = new NetPort(optarg, sync_eth);
+        NetPort *port = new NetPort(optarg, sync_eth, &netParams);
         fprintf(stderr, "Switch connecting to: %s\n", optarg);
+        port->SetBacklog(kBacklogBytes);
         ports.push_back(port);
         break;
       }
 
       case 'h': {
-        NetListenPort *port = new NetListenPort(optarg, sync_eth);
+        NetListenPort *port = new NetListenPort(optarg, sync_eth, &netParams);
         fprintf(stderr, "Switch listening on: %s\n", optarg);
+        port->SetBacklog(kBacklogBytes);
         ports.push_back(port);
         break;
       }
@@ -511,14 +480,8 @@ int main(int argc, char *argv[]) {
         break;
 
       case 'p':
-        pc = pcap_open_dead_with_tstamp_precision(DLT_EN10MB, 65535,
-                                                  PCAP_TSTAMP_PRECISION_NANO);
-        if (pc == nullptr) {
-          perror("pcap_open_dead failed");
-          return EXIT_FAILURE;
-        }
-
-        dumpfile = pcap_dump_open(pc, optarg);
+        if (SimbricksCaptureParseOpt(&cap_params, optarg))
+          bad_option = 1;
         break;
 
       case 'm':
@@ -564,27 +527,16 @@ int main(int argc, char *argv[]) {
         netmem_name = std::string("netmem") + std::to_string(netmem_idx);
         for (port_i = 0; port_i < ports.size(); port_i++) {
           auto &port = *ports[port_i];
-          std::string sockpath = port.path_;
+          std::string sockpath = port.Name();
           if (sockpath.find(netmem_name) != std::string::npos) {
-            uint8_t *temp = (uint8_t *)malloc(6);
-            memcpy(temp, (const uint8_t *)ent.node_mac.ether_addr_octet, 6);
-            MAC node_mac((const uint8_t *)temp);
-            bool existing = false;
-            for (auto iter = mac_table.begin(); iter != mac_table.end();
-                 ++iter) {
-              if (iter->first == node_mac) {
-                existing = true;
-                break;
-              }
-            }
-            if (existing) {
+            const uint8_t *node_mac = ent.node_mac.ether_addr_octet;
+            if (mac_table.Contains(node_mac)) {
               break;
             } else {
               printf("port id for %s is %lu\n", netmem_name.c_str(), port_i);
-              mac_table.insert({node_mac, port_i});
-              printf("mac_8: %X:%X:%X:%X:%X:%X\n", node_mac.data[0],
-                     node_mac.data[1], node_mac.data[2], node_mac.data[3],
-                     node_mac.data[4], node_mac.data[5]);
+              mac_table.AddStatic(node_mac, port_i);
+              printf("mac_8: %X:%X:%X:%X:%X:%X\n", node_mac[0], node_mac[1],
+                     node_mac[2], node_mac[3], node_mac[4], node_mac[5]);
               netmem_idx++;
             }
           }
@@ -599,16 +551,25 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  for (auto &i : mac_table) {
-    printf("port id: %d: ", i.second);
-    printf("mac_8: %X:%X:%X:%X:%X:%X\n", i.first.data[0], i.first.data[1],
-           i.first.data[2], i.first.data[3], i.first.data[4], i.first.data[5]);
-  }
+  mac_table.ForEach(cur_ts, [](const uint8_t *mac, int port) {
+    printf("port id: %d: ", port);
+    printf("mac_8: %X:%X:%X:%X:%X:%X\n", mac[0], mac[1], mac[2], mac[3],
+           mac[4], mac[5]);
+  });
 
   if (ports.empty() || bad_option) {
     fprintf(stderr,
             "Usage: net_switch [-S SYNC-PERIOD] [-E ETH-LATENCY] "
-            "-s SOCKET-A [-s SOCKET-B ...]\n");
+            "[-p PCAP-FILE[,OPTS]] -s SOCKET-A [-s SOCKET-B ...]\n");
+    return EXIT_FAILURE;
+  }
+
+  if (!translator.Build())
+    return EXIT_FAILURE;
+
+  if (cap_params.path &&
+      !(capture = SimbricksCaptureOpen(&cap_params))) {
+    fprintf(stderr, "opening capture %s failed\n", cap_params.path);
     return EXIT_FAILURE;
   }
 
@@ -620,9 +581,21 @@ int main(int argc, char *argv[]) {
   signal(SIGUSR2, sigusr2_handler);
 #endif
 
-  if (!ConnectAll(ports))
+  if (!netport::ConnectAll(ports))
     return EXIT_FAILURE;
 
+  // next input timestamp of the synchronized ports, only ports with a
+  // message possibly due get polled
+  simbricks::TimestampHeap rx_ts(ports.size(), 0);
+  std::vector<size_t> unsync;
+  std::vector<size_t> due;
+  for (size_t port_i = 0; port_i < ports.size(); port_i++) {
+    if (!ports[port_i]->IsSync()) {
+      rx_ts.Update(port_i, simbricks::TimestampHeap::kNever);
+      unsync.push_back(port_i);
+    }
+  }
+
   printf("start polling\n");
   while (!exiting) {
     // Sync all interfaces
@@ -632,15 +605,18 @@ int main(int argc, char *argv[]) {
     // Switch packets
     uint64_t min_ts;
     do {
-      min_ts = ULLONG_MAX;
-      for (size_t port_i = 0; port_i < ports.size(); port_i++) {
+      due.clear();
+      rx_ts.CollectUpTo(cur_ts, due);
+      std::sort(due.begin(), due.end());
+      for (size_t port_i : due) {
         auto &port = *ports[port_i];
         switch_pkt(port, port_i);
-        if (port.IsSync()) {
-          uint64_t ts = port.NextTimestamp();
-          min_ts = ts < min_ts ? ts : min_ts;
-        }
+        rx_ts.Update(port_i, port.IsSync() ? port.NextTimestamp()
+                                           : simbricks::TimestampHeap::kNever);
       }
+      for (size_t port_i : unsync)
+        switch_pkt(*ports[port_i], port_i);
+      min_ts = rx_ts.Min();
     } while (!exiting && (min_ts <= cur_ts));
 
     // Update cur_ts
@@ -661,7 +637,13 @@ int main(int argc, char *argv[]) {
           s_d2n_poll_suc, (double)s_d2n_poll_suc / s_d2n_poll_total);
   fprintf(stderr, "%65s: %22lu  sync_rate: %f\n", "s_d2n_poll_sync",
           s_d2n_poll_sync, (double)s_d2n_poll_sync / s_d2n_poll_suc);
+
+  fprintf(stderr, "%20s: %22lu %20s: %22lu  hit_rate: %f\n", "tlb_hits",
+          translator.hits, "tlb_misses", translator.misses,
+          (double)translator.hits / (translator.hits + translator.misses));
 #endif
 
+  if (capture)
+    SimbricksCaptureClose(capture);
   return 0;
 }
@@ -28,7 +28,7 @@ OBJS := $(d)memswitch.o
 
 $(OBJS): CPPFLAGS := $(CPPFLAGS) -I$(d)include/
 
-$(bin_memswitch): $(OBJS) $(lib_netif) $(lib_nicif)  $(lib_base) -lpcap
+$(bin_memswitch): $(OBJS) $(lib_netport) $(lib_netif) $(lib_nicif)  $(lib_base) -lpthread
 
 CLEAN := $(bin_memswitch) $(OBJS)
 ALL := $(bin_memswitch)
@@ -55,6 +55,27 @@ union mac_addr_ {
 
 union mac_addr_ mac_addr;
 
+/** Where a response frame goes, the source of the requests it answers */
+struct RespDest {
+  uint8_t mac[ETH_ALEN];
+  uint16_t proto;
+  uint32_t ip;
+  uint16_t sport;
+  uint16_t dport;
+};
+
+// batching several responses into one frame, see netproto.h
+static bool batching = false;
+static uint64_t batch_window = 0;
+static size_t mtu = 1500;
+// responses waiting to go out, where to, and when at the latest
+static struct MemOpFrame resp_frame;
+static struct RespDest resp_dest;
+static bool resp_batch;
+static uint64_t resp_deadline;
+// requests of the frame at the head of the net ring already executed
+static unsigned n2m_done = 0;
+
 static void sigint_handler(int dummy) {
   exiting = 1;
 }
@@ -63,93 +84,42 @@ static void sigusr1_handler(int dummy) {
   fprintf(stderr, "main_time = %lu\n", cur_ts);
 }
 
-int HandleRequest(struct SimbricksNetIf *netif,
-                  volatile struct SimbricksProtoNetMsgPacket *packet) {
+/** Send the queued responses as one frame, false if the ring is full. */
+static bool FlushResponses(struct SimbricksNetIf *netif) {
+  if (!resp_frame.num_ops)
+    return true;
+
   volatile union SimbricksProtoNetMsg *msg_to =
       SimbricksNetIfOutAlloc(netif, cur_ts);
   if (msg_to == NULL) {
-    return 0;
+    return false;
   }
   volatile struct SimbricksProtoNetMsgPacket *packet_to = &msg_to->packet;
 
-  uint8_t type;
-  uint16_t pkt_len = sizeof(struct ethhdr) + sizeof(struct iphdr) +
-                     sizeof(struct udphdr) + sizeof(struct MemOp);
-  uint16_t ip_total_len;
-  struct ethhdr *eth_hdr = (struct ethhdr *)packet->data;
-  struct iphdr *ip_hdr = (struct iphdr *)(eth_hdr + 1);
-  struct udphdr *udp_hdr = (struct udphdr *)(ip_hdr + 1);
-  struct MemOp *memop = (struct MemOp *)(udp_hdr + 1);
-  void *data = (void *)(memop + 1);
-
   struct ethhdr *to_eth_hdr = (struct ethhdr *)packet_to->data;
   struct iphdr *to_ip_hdr = (struct iphdr *)(to_eth_hdr + 1);
   struct udphdr *to_udp_hdr = (struct udphdr *)(to_ip_hdr + 1);
-  struct MemOp *to_memop = (struct MemOp *)(to_udp_hdr + 1);
-  void *to_data = (void *)(to_memop + 1);
 
-  type = memop->OpType;
   // Add Ethernet Header
-  to_eth_hdr->h_proto = eth_hdr->h_proto;
-  memcpy(to_eth_hdr->h_dest, eth_hdr->h_source, ETH_ALEN);
+  to_eth_hdr->h_proto = resp_dest.proto;
+  memcpy(to_eth_hdr->h_dest, resp_dest.mac, ETH_ALEN);
   memcpy(to_eth_hdr->h_source, mac_addr.mac_byte, ETH_ALEN);
 
   // Add IP header
   to_ip_hdr->saddr = ip_addr;
-  to_ip_hdr->daddr = ip_hdr->saddr;
-  ip_total_len =
-      sizeof(struct iphdr) + sizeof(struct udphdr) + sizeof(struct MemOp);
-
-  if (type == SIMBRICKS_PROTO_MEM_H2M_MSG_READ) {
-    ip_total_len += memop->len;
-  }
-  to_ip_hdr->tot_len = htons(ip_total_len);
+  to_ip_hdr->daddr = resp_dest.ip;
+  to_ip_hdr->tot_len =
+      htons(sizeof(struct iphdr) + sizeof(struct udphdr) + resp_frame.len);
 
   // Add UDP header
-  to_udp_hdr->uh_sport = udp_hdr->uh_dport;
-  to_udp_hdr->uh_dport = udp_hdr->uh_sport;
-  to_udp_hdr->uh_ulen = sizeof(struct udphdr) + sizeof(struct MemOp);
-  if (type == SIMBRICKS_PROTO_MEM_H2M_MSG_READ) {
-    to_udp_hdr->uh_ulen += memop->len;
-  }
-
-  packet_to->len = pkt_len;
+  to_udp_hdr->uh_sport = resp_dest.dport;
+  to_udp_hdr->uh_dport = resp_dest.sport;
+  to_udp_hdr->uh_ulen = sizeof(struct udphdr) + resp_frame.len;
 
-  // Fill MemOp structure
-  to_memop->req_id = memop->req_id;
-  to_memop->as_id = memop->as_id;
-  to_memop->addr = memop->addr;
-  to_memop->len = memop->len;
-
-  switch (type) {
-    case SIMBRICKS_PROTO_MEM_H2M_MSG_READ:
-#if NETMEM_DEBUG
-      printf("received read request addr: 0x%lx size: 0x%x\n", memop->addr,
-             memop->len);
-
-#endif
-      //  send read complete message
-      to_memop->OpType = SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP;
-
-      memcpy((void *)to_data, &mem_array[memop->addr], memop->len);
-
-      packet_to->len += memop->len;
-      break;
-    case SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE:
-#if NETMEM_DEBUG
-      printf("received write request addr: 0x%lx size: 0x%x\n", memop->addr,
-             memop->len);
-#endif
-      //  write the data in local memory
-      memcpy(&mem_array[memop->addr], data, memop->len);
-
-      // send write complete message
-      to_memop->OpType = SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP;
-
-      break;
-    default:
-      fprintf(stderr, "poll_n2m: unsupported type=%u\n", type);
-  }
+  // we parse batched requests, whether or not we batch responses
+  MemOpFrameFinish(&resp_frame, MEMOP_F_BATCH);
+  memcpy((void *)(to_udp_hdr + 1), resp_frame.buf, resp_frame.len);
+  packet_to->len = MEMOP_FRAME_HDR_LEN + resp_frame.len;
 
 #if NETMEM_DEBUG
   int i;
@@ -165,12 +135,126 @@ int HandleRequest(struct SimbricksNetIf *netif,
 #endif
 
   SimbricksNetIfOutSend(netif, msg_to, SIMBRICKS_PROTO_NET_MSG_PACKET);
+  MemOpFrameReset(&resp_frame);
+  return true;
+}
+
+/**
+ * Make room for a response to `dest`: responses are only batched if the
+ * destination parses batched frames, and only with others to the same
+ * destination. Returns false if a frame had to go out but the ring is full.
+ */
+static bool PrepareResponse(struct SimbricksNetIf *netif,
+                            const struct RespDest *dest, bool batch,
+                            size_t op_len) {
+  if (!resp_frame.num_ops)
+    return true;
+  if (batch && resp_batch && !memcmp(dest, &resp_dest, sizeof(*dest)) &&
+      resp_frame.num_ops < UINT8_MAX &&
+      resp_frame.len + op_len <= resp_frame.max_len)
+    return true;
+  return FlushResponses(netif);
+}
+
+static void QueueResponse(struct SimbricksNetIf *netif,
+                          const struct RespDest *dest, bool batch,
+                          uint8_t type, struct MemOpNext *op,
+                          const void *data) {
+  bool first = !resp_frame.num_ops;
+  if (!MemOpFrameAdd(&resp_frame, type, op->req_id, op->addr, op->len,
+                     op->as_id, data)) {
+    // the request is already executed and the requester would wait forever
+    fprintf(stderr, "QueueResponse: response too large for a frame (len=%u)\n",
+            op->len);
+    abort();
+  }
+  if (first) {
+    resp_dest = *dest;
+    resp_batch = batch;
+    resp_deadline = cur_ts + batch_window;
+  }
+  // if the ring is full this is retried from the main loop
+  if (!batch)
+    FlushResponses(netif);
+}
+
+/**
+ * Execute the requests in a frame and queue their responses. Returns false
+ * if a response could not be queued, the next call for the same frame
+ * continues with that request.
+ */
+int HandleRequest(struct SimbricksNetIf *netif,
+                  volatile struct SimbricksProtoNetMsgPacket *packet) {
+  if (packet->len < MEMOP_FRAME_HDR_LEN) {
+    fprintf(stderr, "HandleRequest: short frame (len=%u)\n", packet->len);
+    return 1;
+  }
+
+  struct ethhdr *eth_hdr = (struct ethhdr *)packet->data;
+  struct iphdr *ip_hdr = (struct iphdr *)(eth_hdr + 1);
+  struct udphdr *udp_hdr = (struct udphdr *)(ip_hdr + 1);
+  struct MemOp *memop = (struct MemOp *)(udp_hdr + 1);
+
+  struct RespDest dest;
+  memset(&dest, 0, sizeof(dest));
+  memcpy(dest.mac, eth_hdr->h_source, ETH_ALEN);
+  dest.proto = eth_hdr->h_proto;
+  dest.ip = ip_hdr->saddr;
+  dest.sport = udp_hdr->uh_sport;
+  dest.dport = udp_hdr->uh_dport;
+  bool batch = batching && (memop->flags & MEMOP_F_BATCH);
+
+  struct MemOpIter it;
+  struct MemOpNext *op;
+  uint8_t *data;
+  unsigned i = 0;
+  MemOpIterInit(&it, memop, packet->len - MEMOP_FRAME_HDR_LEN);
+  while ((op = MemOpIterNext(&it, &data)) != NULL) {
+    if (i++ < n2m_done)
+      continue;
+
+    switch (op->OpType) {
+      case SIMBRICKS_PROTO_MEM_H2M_MSG_READ:
+#if NETMEM_DEBUG
+        printf("received read request addr: 0x%lx size: 0x%x\n", op->addr,
+               op->len);
+
+#endif
+        //  send read complete message
+        if (!PrepareResponse(netif, &dest, batch,
+                             sizeof(struct MemOpNext) + op->len))
+          return 0;
+        QueueResponse(netif, &dest, batch,
+                      SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP, op,
+                      &mem_array[op->addr]);
+        break;
+      case SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE:
+#if NETMEM_DEBUG
+        printf("received write request addr: 0x%lx size: 0x%x\n", op->addr,
+               op->len);
+#endif
+        if (!PrepareResponse(netif, &dest, batch, sizeof(struct MemOpNext)))
+          return 0;
+        //  write the data in local memory
+        memcpy(&mem_array[op->addr], data, op->len);
+
+        // send write complete message
+        QueueResponse(netif, &dest, batch,
+                      SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP, op, NULL);
+        break;
+      default:
+        fprintf(stderr, "poll_n2m: unsupported type=%u\n", op->OpType);
+    }
+    n2m_done++;
+  }
+
+  n2m_done = 0;
   return 1;
 }
 
 void PollN2M(struct SimbricksNetIf *netif, uint64_t cur_ts) {
   volatile union SimbricksProtoNetMsg *msg =
-      SimbricksNetIfInPoll(netif, cur_ts);
+      SimbricksNetIfInPeek(netif, cur_ts);
 
   if (msg == NULL) {
     return;
@@ -197,6 +281,7 @@ void PollN2M(struct SimbricksNetIf *netif, uint64_t cur_ts) {
       fprintf(stderr, "poll_n2m: unsupported type=%u\n", type);
   }
 
+  SimbricksNetIfInPoll(netif, cur_ts);
   SimbricksNetIfInDone(netif, msg);
 }
 
@@ -211,11 +296,28 @@ int main(int argc, char *argv[]) {
 
   SimbricksNetIfDefaultParams(&netParams);
 
-  if (argc < 7 || argc > 11) {
+  int c;
+  while ((c = getopt(argc, argv, "+b:m:")) != -1) {
+    switch (c) {
+      case 'b':
+        batching = true;
+        batch_window = strtoull(optarg, NULL, 0) * 1000ULL;
+        break;
+      case 'm':
+        mtu = strtoull(optarg, NULL, 0);
+        break;
+      default:
+        argc = 0;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  if (argc < 7 || argc > 11 || mtu < 576) {
     fprintf(stderr,
-            "Usage: netmem [SIZE] [BASE-ADDR] [ASID] [ETH-SOCKET] "
-            "[SHM] [MAC-ADDR] [SYNC-MODE] [START-TICK] [SYNC-PERIOD] "
-            "[ETH-LATENCY]\n");
+            "Usage: netmem [-b BATCH-WINDOW] [-m MTU] [SIZE] [BASE-ADDR] "
+            "[ASID] [ETH-SOCKET] [SHM] [MAC-ADDR] [SYNC-MODE] [START-TICK] "
+            "[SYNC-PERIOD] [ETH-LATENCY]\n");
     return -1;
   }
   if (argc >= 9)
@@ -280,6 +382,13 @@ int main(int argc, char *argv[]) {
   }
   sync_mem = SimbricksBaseIfSyncEnabled(&netif.base);
 
+  // frames have to fit a ring slot, batching also keeps them within the MTU
+  size_t frame_cap = netif.base.out_elen -
+                     sizeof(struct SimbricksProtoNetMsgPacket) -
+                     MEMOP_FRAME_HDR_LEN;
+  MemOpFrameInit(&resp_frame, malloc(frame_cap), frame_cap,
+                 mtu - sizeof(struct iphdr) - sizeof(struct udphdr));
+
   printf("start polling\n");
   while (!exiting) {
     while (SimbricksNetIfOutSync(&netif, cur_ts)) {
@@ -291,10 +400,20 @@ int main(int argc, char *argv[]) {
 
       if (sync_mem) {
         next_ts = SimbricksNetIfInTimestamp(&netif);
+      } else if (resp_frame.num_ops) {
+        // time does not advance without synchronization, send right away
+        FlushResponses(&netif);
       }
     } while (!exiting && next_ts <= cur_ts);
 
-    cur_ts = next_ts;
+    if (resp_frame.num_ops && resp_deadline <= cur_ts)
+      FlushResponses(&netif);
+
+    // wake up to send a batch when its window is over, or to retry sending
+    if (resp_frame.num_ops && resp_deadline < next_ts)
+      cur_ts = resp_deadline > cur_ts ? resp_deadline : cur_ts;
+    else
+      cur_ts = next_ts;
   }
   return 0;
 }
@@ -25,16 +25,165 @@
 #ifndef SIMS_MEM_NETPROTO_NETPROTO_H_
 #define SIMS_MEM_NETPROTO_NETPROTO_H_
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
+#include <simbricks/mem/proto.h>
+
+/** Offset of the first MemOp in a frame: Ethernet, IPv4 and UDP headers */
+#define MEMOP_FRAME_HDR_LEN 42
+
+/** MemOp.flags: the sender parses frames carrying multiple ops */
+#define MEMOP_F_BATCH 0x01
+/** MemOp.flags: this frame carries num_ops ops */
+#define MEMOP_F_BATCHED 0x02
+
+/**
+ * First op in a frame. Without MEMOP_F_BATCHED the frame carries just this
+ * op, followed by its data. With it, num_ops - 1 further ops follow the data,
+ * each as a struct MemOpNext directly followed by its own data.
+ *
+ * A side sets MEMOP_F_BATCH in every frame it sends to advertise that it
+ * parses batched frames, and only sends batched frames itself once it has
+ * seen the flag from its peer.
+ */
 struct MemOp {
   uint8_t OpType;
   uint64_t req_id;
   uint64_t addr;
   uint16_t len;  // length of data if there is any
   uint64_t as_id;
-  uint8_t pad[37];
+  uint8_t flags;
+  uint8_t num_ops;
+  uint8_t pad[35];
+  uint8_t data[];
+} __attribute__((packed));
+
+/** Header of the second and following ops of a batched frame, the leading
+ * fields of struct MemOp. */
+struct MemOpNext {
+  uint8_t OpType;
+  uint64_t req_id;
+  uint64_t addr;
+  uint16_t len;  // length of data if there is any
+  uint64_t as_id;
   uint8_t data[];
 } __attribute__((packed));
 
+/** Write requests and read completions carry len bytes of data. */
+static inline bool MemOpHasData(uint8_t type) {
+  return type == SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE ||
+         type == SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP;
+}
+
+/** Iterator over the ops in the payload of a frame. */
+struct MemOpIter {
+  uint8_t *pos;
+  uint8_t *end;
+  unsigned left;
+  bool first;
+};
+
+static inline void MemOpIterInit(struct MemOpIter *it, void *payload,
+                                 size_t len) {
+  struct MemOp *op = (struct MemOp *)payload;
+  it->pos = (uint8_t *)payload;
+  it->end = it->pos + len;
+  it->first = true;
+  it->left = 0;
+  if (len >= sizeof(*op))
+    it->left = (op->flags & MEMOP_F_BATCHED) ? op->num_ops : 1;
+}
+
+/**
+ * Next op header (for the first op the leading fields of its struct MemOp)
+ * and its data. Returns NULL once all ops were visited or if the frame is
+ * truncated.
+ */
+static inline struct MemOpNext *MemOpIterNext(struct MemOpIter *it,
+                                              uint8_t **data) {
+  if (it->left == 0)
+    return NULL;
+
+  struct MemOpNext *op = (struct MemOpNext *)it->pos;
+  size_t hdr_len = it->first ? sizeof(struct MemOp) : sizeof(*op);
+  if ((size_t)(it->end - it->pos) < hdr_len)
+    return NULL;
+  size_t data_len = MemOpHasData(op->OpType) ? op->len : 0;
+  if ((size_t)(it->end - it->pos) < hdr_len + data_len)
+    return NULL;
+
+  *data = it->pos + hdr_len;
+  it->pos += hdr_len + data_len;
+  it->left--;
+  it->first = false;
+  return op;
+}
+
+/**
+ * Payload of a frame under construction. Ops are only added while the
+ * payload stays within max_len, except for the first op which just has to
+ * fit the buffer.
+ */
+struct MemOpFrame {
+  uint8_t *buf;
+  size_t cap;
+  size_t max_len;
+  size_t len;
+  unsigned num_ops;
+};
+
+static inline void MemOpFrameInit(struct MemOpFrame *f, void *buf, size_t cap,
+                                  size_t max_len) {
+  f->buf = (uint8_t *)buf;
+  f->cap = cap;
+  f->max_len = max_len < cap ? max_len : cap;
+  f->len = 0;
+  f->num_ops = 0;
+}
+
+static inline void MemOpFrameReset(struct MemOpFrame *f) {
+  f->len = 0;
+  f->num_ops = 0;
+}
+
+/** Append an op, copying `data` if the type carries any. Returns false if it
+ * does not fit. */
+static inline bool MemOpFrameAdd(struct MemOpFrame *f, uint8_t type,
+                                 uint64_t req_id, uint64_t addr, uint16_t len,
+                                 uint64_t as_id, const volatile void *data) {
+  size_t hdr_len =
+      f->num_ops ? sizeof(struct MemOpNext) : sizeof(struct MemOp);
+  size_t data_len = MemOpHasData(type) ? len : 0;
+  size_t max_len = f->num_ops ? f->max_len : f->cap;
+  if (f->num_ops == UINT8_MAX || f->len + hdr_len + data_len > max_len)
+    return false;
+
+  struct MemOpNext *op = (struct MemOpNext *)(f->buf + f->len);
+  op->OpType = type;
+  op->req_id = req_id;
+  op->addr = addr;
+  op->len = len;
+  op->as_id = as_id;
+  if (!f->num_ops)
+    memset(op + 1, 0, sizeof(struct MemOp) - sizeof(*op));
+  if (data_len)
+    memcpy(f->buf + f->len + hdr_len, (const void *)data, data_len);
+
+  f->len += hdr_len + data_len;
+  f->num_ops++;
+  return true;
+}
+
+/** Fill in the flags of the first op once the frame is complete. */
+static inline void MemOpFrameFinish(struct MemOpFrame *f, uint8_t flags) {
+  struct MemOp *op = (struct MemOp *)f->buf;
+  if (f->num_ops > 1)
+    flags |= MEMOP_F_BATCHED;
+  op->flags = flags;
+  op->num_ops = f->num_ops;
+}
+
 #endif  // SIMS_MEM_NETPROTO_NETPROTO_H_
@@ -23,6 +23,7 @@
 include mk/subdir_pre.mk
 
 $(eval $(call subdir,basicmem))
+$(eval $(call subdir,memgen))
 $(eval $(call subdir,memnic))
 $(eval $(call subdir,memswitch))
 $(eval $(call subdir,netmem))
@@ -26,11 +26,13 @@
 #include <verilated.h>
 #include <verilated_fst_c.h>
 
+#include <cstring>
 #include <iostream>
 #include <vector>
 
+#include <simbricks/netport/netport.h>
+
 #include "sims/net/menshen/obj_dir/Vrmt_wrapper.h"
-#include "sims/net/menshen/ports.h"
 
 #define MAX_PKT_SIZE 2048
 
@@ -40,7 +42,9 @@
 class EthernetTx;
 class EthernetRx;
 
-std::vector<Port *> ports;
+using netport::NetPort;
+
+std::vector<NetPort *> ports;
 int synchronized = 0;
 uint64_t sync_period = (500 * 1000ULL);  // 500ns
 uint64_t eth_latency = (500 * 1000ULL);  // 500ns
@@ -287,11 +291,11 @@ static void poll_ports() {
     while (!exiting) {
       const void *data;
       size_t len;
-      enum Port::RxPollState ps = port->RxPacket(data, len, main_time);
-      if (ps == Port::kRxPollFail)
+      enum NetPort::RxPollState ps = port->RxPacket(data, len, main_time);
+      if (ps == NetPort::kRxPollFail)
         break;
 
-      if (ps == Port::kRxPollSuccess)
+      if (ps == NetPort::kRxPollSuccess)
         rxMAC->packet_received(data, len, p_id);
 
       port->RxDone();
@@ -334,13 +338,11 @@ int main(int argc, char *argv[]) {
   struct SimbricksBaseIfParams params;
   SimbricksNetIfDefaultParams(&params);
 
-  for (int i = 1; i < argc; i++) {
-    NetPort *np = new NetPort(&params);
-    if (!np->Connect(argv[i], synchronized)) {
-      std::cerr << "connecting to port " << argv[i] << " failed" << std::endl;
-      return EXIT_FAILURE;
-    }
-    ports.push_back(np);
+  for (int i = 1; i < argc; i++)
+    ports.push_back(new NetPort(argv[i], synchronized, &params));
+  if (!netport::ConnectAll(ports)) {
+    std::cerr << "connecting ports failed" << std::endl;
+    return EXIT_FAILURE;
   }
 
   txMAC = new EthernetTx(*top);
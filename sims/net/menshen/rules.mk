@@ -43,9 +43,11 @@ $(verilator_src_menshen): $(vsrcs_menshen)
 	    -y $(dir_menshen)rtl -y $(dir_menshen)rtl/extract \
 	    -y $(dir_menshen)rtl/action  -y $(dir_menshen)rtl/lookup -y $(dir_menshen)lib \
 	    $(dir_menshen)rtl/rmt_wrapper.v --exe $(abspath $(srcs_menshen)) \
-		$(abspath $(lib_netif)) $(abspath $(lib_base))
+		$(abspath $(lib_netport)) $(abspath $(lib_netif)) \
+		$(abspath $(lib_base))
 
-$(verilator_bin_menshen): $(verilator_src_menshen) $(srcs_menshen) $(lib_netif)
+$(verilator_bin_menshen): $(verilator_src_menshen) $(srcs_menshen) \
+    $(lib_netport) $(lib_netif)
 	$(MAKE) -C $(verilator_dir_menshen) -f Vrmt_wrapper.mk
 
 $(bin_menshen): $(verilator_bin_menshen)
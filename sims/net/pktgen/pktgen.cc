@@ -25,7 +25,6 @@
 #include <arpa/inet.h>
 #include <linux/if_ether.h>
 #include <linux/ip.h>
-#include <pcap/pcap.h>
 #include <unistd.h>
 
 #include <cassert>
@@ -35,30 +34,28 @@
 #include <cstdlib>
 #include <cstring>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 #include <simbricks/base/cxxatomicfix.h>
+#include <simbricks/netport/netport.h>
 extern "C" {
+#include <simbricks/network/capture.h>
 #include <simbricks/network/if.h>
 #include <simbricks/nicif/nicif.h>
 };
 
+#include "sims/net/pktgen/traffic.h"
+
 // #define NETSWITCH_DEBUG
 #define NETSWITCH_STAT
 
 struct SimbricksBaseIfParams netParams;
-static pcap_dumper_t *dumpfile = nullptr;
-#define PKT_LEN 1500                                           // byte
-static uint64_t bit_rate = 100 * 1000ULL * 1000ULL * 1000ULL;  // 100 Gbps
+static struct SimbricksCapture *capture = nullptr;
 static uint64_t target_tick = 1 * 1000ULL * 1000ULL * 1000ULL * 1000ULL;  // 1s
-static uint64_t last_pkt_sent = 0;
 static uint64_t pkt_recv_num = 0;
 static uint64_t pkt_recv_byte = 0;
 static uint64_t pkt_tx_num = 0;
 static uint64_t pkt_tx_byte = 0;
-static uint64_t period = (1E12 * 8 * PKT_LEN) / bit_rate;  // per packet
-static uint8_t packet[PKT_LEN];
 
 #ifdef NETSWITCH_STAT
 #endif
@@ -75,193 +72,18 @@ static uint64_t s_d2n_poll_sync = 0;
 static int stat_flag = 0;
 #endif
 
-/* MAC address type */
-struct MAC {
-  const uint8_t *data;
-
-  explicit MAC(const uint8_t *data) : data(data) {
-  }
-
-  bool operator==(const MAC &other) const {
-    for (int i = 0; i < 6; i++) {
-      if (data[i] != other.data[i]) {
-        return false;
-      }
-    }
-    return true;
-  }
-};
-
 struct mac_addr {
   uint8_t addr[6];
 };
 
-namespace std {
-template <>
-struct hash<MAC> {
-  size_t operator()(const MAC &m) const {
-    size_t res = 0;
-    for (int i = 0; i < 6; i++) {
-      res = (res << 4) | (res ^ m.data[i]);
-    }
-    return res;
-  }
-};
-}  // namespace std
-
-/** Abstract base switch port */
-class Port {
- public:
-  enum RxPollState {
-    kRxPollSuccess = 0,
-    kRxPollFail = 1,
-    kRxPollSync = 2,
-  };
-
-  struct mac_addr my_mac;
-  struct mac_addr dest_mac;
-
-  virtual ~Port() = default;
-
-  virtual bool Connect(const char *path, int sync) = 0;
-  virtual bool IsSync() = 0;
-  virtual void Sync(uint64_t cur_ts) = 0;
-  virtual uint64_t NextTimestamp() = 0;
-  virtual enum RxPollState RxPacket(const void *&data, size_t &len,
-                                    uint64_t cur_ts) = 0;
-  virtual void RxDone() = 0;
-  virtual bool TxPacket(const void *data, size_t len, uint64_t cur_ts) = 0;
-};
-
-/** Normal network switch port (conneting to a NIC) */
-class NetPort : public Port {
- protected:
-  struct SimbricksNetIf netifObj_;
-  struct SimbricksNetIf *netif_;
-  volatile union SimbricksProtoNetMsg *rx_;
-  int sync_;
-
- public:
-  NetPort() : netif_(&netifObj_), rx_(nullptr), sync_(0) {
-    memset(&netifObj_, 0, sizeof(netifObj_));
-    memset(&my_mac, 0, sizeof(my_mac));
-    memset(&dest_mac, 0, sizeof(dest_mac));
-  }
-
-  NetPort(const NetPort &other)
-      : netifObj_(other.netifObj_),
-        netif_(&netifObj_),
-        rx_(other.rx_),
-        sync_(other.sync_) {
-  }
-
-  bool Connect(const char *path, int sync) override {
-    sync_ = sync;
-    return SimbricksNetIfInit(netif_, &netParams, path, &sync_) == 0;
-  }
-
-  bool IsSync() override {
-    return sync_;
-  }
-
-  void Sync(uint64_t cur_ts) override {
-    while (SimbricksNetIfOutSync(netif_, cur_ts)) {
-    }
-  }
-
-  uint64_t NextTimestamp() override {
-    return SimbricksNetIfInTimestamp(netif_);
-  }
-
-  enum RxPollState RxPacket(const void *&data, size_t &len,
-                            uint64_t cur_ts) override {
-    assert(rx_ == nullptr);
-
-    rx_ = SimbricksNetIfInPoll(netif_, cur_ts);
-    if (!rx_)
-      return kRxPollFail;
-
-    uint8_t type = SimbricksNetIfInType(netif_, rx_);
-    if (type == SIMBRICKS_PROTO_NET_MSG_PACKET) {
-      data = (const void *)rx_->packet.data;
-      len = rx_->packet.len;
-      return kRxPollSuccess;
-    } else if (type == SIMBRICKS_PROTO_MSG_TYPE_SYNC) {
-      return kRxPollSync;
-    } else {
-      fprintf(stderr, "switch_pkt: unsupported type=%u\n", type);
-      abort();
-    }
-  }
-
-  void RxDone() override {
-    assert(rx_ != nullptr);
-
-    SimbricksNetIfInDone(netif_, rx_);
-    rx_ = nullptr;
-  }
-
-  bool TxPacket(const void *data, size_t len, uint64_t cur_ts) override {
-    volatile union SimbricksProtoNetMsg *msg_to =
-        SimbricksNetIfOutAlloc(netif_, cur_ts);
-    if (!msg_to && !sync_) {
-      return false;
-    } else if (!msg_to && sync_) {
-      while (!msg_to)
-        msg_to = SimbricksNetIfOutAlloc(netif_, cur_ts);
-    }
-    volatile struct SimbricksProtoNetMsgPacket *rx;
-    rx = &msg_to->packet;
-    rx->len = len;
-    rx->port = 0;
-    memcpy((void *)rx->data, data, len);
-
-    SimbricksNetIfOutSend(netif_, msg_to, SIMBRICKS_PROTO_NET_MSG_PACKET);
-    return true;
-  }
-};
-
-/** Hosting network switch port (connected to another network) */
-class NetHostPort : public NetPort {
- protected:
-  struct SimbricksNicIf nicif_;
-
- public:
-  NetHostPort() {
-    netif_ = &nicif_.net;
-    memset(&nicif_, 0, sizeof(nicif_));
-  }
-
-  NetHostPort(const NetHostPort &other) : NetPort(other), nicif_(other.nicif_) {
-    netif_ = &nicif_.net;
-  }
-
-  bool Connect(const char *path, int sync) override {
-    sync_ = sync;
-    std::string shm_path = path;
-    shm_path += "-shm";
-    struct SimbricksBaseIfParams params = netParams;
-    params.sock_path = path;
-    if (!sync)
-      params.sync_mode = kSimbricksBaseIfSyncDisabled;
-    int ret = SimbricksNicIfInit(&nicif_, shm_path.c_str(), &params, nullptr,
-                                 nullptr);
-    sync_ = SimbricksBaseIfSyncEnabled(&netif_->base);
-    return ret == 0;
-  }
-
-  bool IsSync() override {
-    return sync_;
-  }
-};
+using netport::NetListenPort;
+using netport::NetPort;
 
 /* Global variables */
 static uint64_t cur_ts = 0;
 static int exiting = 0;
-static const uint8_t bcast[6] = {0xFF};
-static const MAC bcast_addr(bcast);
-static std::vector<Port *> ports;
-static std::unordered_map<MAC, int> mac_table;
+static std::vector<NetPort *> ports;
+static std::vector<TrafficSource *> sources;
 
 static void sigint_handler(int dummy) {
   exiting = 1;
@@ -277,100 +99,100 @@ static void sigusr2_handler(int dummy) {
 }
 #endif
 
-static void pollq(Port &port, size_t iport) {
+static void pollq(NetPort &port, size_t iport) {
   // poll N2D queue
-  // send packet
-  const void *pkt_data;
-  size_t pkt_len;
+  netport::RxView pkts[NetPort::kMaxBurst];
 
 #ifdef NETSWITCH_STAT
+  uint64_t syncs = port.Stats().rx_syncs;
   d2n_poll_total += 1;
   if (stat_flag) {
     s_d2n_poll_total += 1;
   }
 #endif
 
+  size_t n = port.RxBurst(pkts, NetPort::kMaxBurst, cur_ts);
+  for (size_t i = 0; i < n; i++) {
+    // stat received bytes
+    pkt_recv_num++;
+    pkt_recv_byte += pkts[i].len;
+    if (capture)
+      SimbricksCapturePacket(capture, cur_ts, pkts[i].data, pkts[i].len,
+                             iport, -1);
+  }
+  port.RxBurstDone();
+
 #ifdef NETSWITCH_STAT
-  d2n_poll_suc += 1;
+  syncs = port.Stats().rx_syncs - syncs;
+  d2n_poll_suc += n + syncs;
+  d2n_poll_sync += syncs;
   if (stat_flag) {
-    s_d2n_poll_suc += 1;
+    s_d2n_poll_suc += n + syncs;
+    s_d2n_poll_sync += syncs;
   }
 #endif
+}
 
-  enum Port::RxPollState poll = port.RxPacket(pkt_data, pkt_len, cur_ts);
-  if (poll == Port::kRxPollFail) {
-    return;  // do nothing
-  }
-
-  if (poll == Port::kRxPollSuccess) {
-    // stat received bytes
-    pkt_recv_num++;
-    pkt_recv_byte += pkt_len;
-  } else if (poll == Port::kRxPollSync) {
-#ifdef NETSWITCH_STAT
-    d2n_poll_sync += 1;
-    if (stat_flag) {
-      s_d2n_poll_sync += 1;
-    }
-#endif
-  } else {
-    fprintf(stderr, "pktgen: unsupported poll result=%u\n", poll);
-    abort();
+/** Source with the earliest next packet, nullptr if there are none left. */
+static TrafficSource *next_source() {
+  TrafficSource *next = nullptr;
+  for (TrafficSource *src : sources) {
+    if (src->NextTime() != TrafficSource::kDone &&
+        (!next || src->NextTime() < next->NextTime()))
+      next = src;
   }
-  port.RxDone();
+  return next;
 }
 
-static void sendq(Port &port, size_t iport) {
-  // then send
-  if (port.IsSync()) {
-    while ((last_pkt_sent + period) <= cur_ts) {
-      port.TxPacket(packet, PKT_LEN, last_pkt_sent + period);
-      last_pkt_sent += period;
-      pkt_tx_num++;
-      pkt_tx_byte += PKT_LEN;
-    }
-  } else {
-    port.TxPacket(packet, PKT_LEN, last_pkt_sent + period);
+/** Send the packets due up to cur_ts, generated straight into the egress
+ * slots. Returns false if a port ran out of slots with packets still due. */
+static bool sendq() {
+  for (size_t n = 0; n < NetPort::kMaxBurst; n++) {
+    TrafficSource *src = next_source();
+    if (!src || src->NextTime() > cur_ts)
+      return true;
+
+    size_t iport = src->Port();
+    size_t max;
+    uint8_t *buf =
+        static_cast<uint8_t *>(ports[iport]->TxAlloc(cur_ts, max));
+    if (!buf)
+      return false;
+    size_t len = src->Generate(buf, max);
+    if (capture)
+      SimbricksCapturePacket(capture, cur_ts, buf, len, -1, iport);
+    ports[iport]->TxCommit(len);
+    pkt_tx_num++;
+    pkt_tx_byte += len;
   }
-  // if not sync: send packet
-  // else: send packet periodically until allowed time
-  // while(allowed_timestamp){ since_last_send + period = to_send_time <=
-  // curtick
-  //  txpacket(todest)
-  // }
+  return true;
 }
 
 int main(int argc, char *argv[]) {
   int c;
   int bad_option = 0;
   int sync_eth = 1;
-  pcap_t *pc = nullptr;
+  struct SimbricksCaptureParams cap_params;
   int my_num = 0;
-  int brate = 10;
+  int brate = 100;  // Gbps
+  const char *profile = nullptr;
 
   SimbricksNetIfDefaultParams(&netParams);
+  SimbricksCaptureDefaultParams(&cap_params);
 
   // Parse command line argument
-  while ((c = getopt(argc, argv, "s:h:uS:E:p:n:b:")) != -1 && !bad_option) {
+  while ((c = getopt(argc, argv, "s:h:uS:E:p:n:b:P:")) != -1 && !bad_option) {
     switch (c) {
       case 's': {
-        NetPort *port = new NetPort;
+        NetPort *port = new NetPort(optarg, sync_eth, &netParams);
         fprintf(stderr, "pktgen connecting to: %s\n", optarg);
-        if (!port->Connect(optarg, sync_eth)) {
-          fprintf(stderr, "connecting to %s failed\n", optarg);
-          return EXIT_FAILURE;
-        }
         ports.push_back(port);
         break;
       }
 
       case 'h': {
-        NetHostPort *port = new NetHostPort;
+        NetListenPort *port = new NetListenPort(optarg, sync_eth, &netParams);
         fprintf(stderr, "pktgen listening on: %s\n", optarg);
-        if (!port->Connect(optarg, sync_eth)) {
-          fprintf(stderr, "listening on %s failed\n", optarg);
-          return EXIT_FAILURE;
-        }
         ports.push_back(port);
         break;
       }
@@ -388,15 +210,10 @@ int main(int argc, char *argv[]) {
         break;
 
       case 'p':
-        pc = pcap_open_dead_with_tstamp_precision(DLT_EN10MB, 65535,
-                                                  PCAP_TSTAMP_PRECISION_NANO);
-        if (pc == nullptr) {
-          perror("pcap_open_dead failed");
-          return EXIT_FAILURE;
-        }
-
-        dumpfile = pcap_dump_open(pc, optarg);
+        if (SimbricksCaptureParseOpt(&cap_params, optarg))
+          bad_option = 1;
         break;
+
       case 'n':
         my_num = strtol(optarg, NULL, 0);
         fprintf(stderr, "my_num is: %d\n", my_num);
@@ -406,15 +223,13 @@ int main(int argc, char *argv[]) {
       case 'b':
         brate = strtol(optarg, NULL, 0);
         fprintf(stderr, "bit rate set to: %d Gbps\n", brate);
-        if (brate == 0) {
-          period = ULLONG_MAX;
-        } else {
-          bit_rate = brate * 1000ULL * 1000ULL * 1000ULL;
-          period = (1E12 * 8 * PKT_LEN) / bit_rate;  // per packet
-        }
         assert(brate < 200);
         break;
 
+      case 'P':
+        profile = optarg;
+        break;
+
       default:
         fprintf(stderr, "unknown option %c\n", c);
         bad_option = 1;
@@ -425,25 +240,46 @@ int main(int argc, char *argv[]) {
   if (ports.empty() || bad_option) {
     fprintf(stderr,
             "Usage: pktgen [-S SYNC-PERIOD] [-E ETH-LATENCY] "
-            "-s SOCKET-A [-s SOCKET-B ...] [-n my_num] [-b bitrate(GB)]\n");
+            "-s SOCKET-A [-s SOCKET-B ...] [-n my_num] [-b bitrate(GB)] "
+            "[-p PCAP-FILE[,OPTS]] [-P PROFILE]\n");
+    return EXIT_FAILURE;
+  }
+
+  if (cap_params.path &&
+      !(capture = SimbricksCaptureOpen(&cap_params))) {
+    fprintf(stderr, "opening capture %s failed\n", cap_params.path);
     return EXIT_FAILURE;
   }
 
-  Port *pkt_port = ports.front();
-  pkt_port->my_mac.addr[5] = my_num;
+  if (!netport::ConnectAll(ports))
+    return EXIT_FAILURE;
+
+  struct mac_addr my_mac = {};
+  struct mac_addr dest_mac = {};
+  my_mac.addr[5] = my_num;
   if (my_num % 2) {  // odd num
-    pkt_port->dest_mac.addr[5] = my_num - 1;
+    dest_mac.addr[5] = my_num - 1;
   } else {  // even number
-    pkt_port->dest_mac.addr[5] = my_num + 1;
+    dest_mac.addr[5] = my_num + 1;
+  }
+
+  if (profile) {
+    if (!TrafficLoadProfile(profile, my_mac.addr, dest_mac.addr, sources))
+      return EXIT_FAILURE;
+  } else {
+    // without a profile send 1500 byte raw frames at the -b rate
+    FlowParams params;
+    TrafficDefaultFlow(&params, my_mac.addr, dest_mac.addr);
+    params.proto = 0;
+    params.rate = brate * 1000ULL * 1000ULL * 1000ULL;
+    sources.push_back(new FlowSource(params));
   }
-  struct mac_addr *mac_tmp = (struct mac_addr *)(&packet[0]);
-  mac_tmp->addr[5] = pkt_port->dest_mac.addr[5];  // dest mac
-  mac_tmp = (struct mac_addr *)(&packet[6]);
-  mac_tmp->addr[5] = pkt_port->my_mac.addr[5];  // source mac
-
-  int kk;
-  for (kk = 12; kk < PKT_LEN - 12; kk++) {
-    packet[kk] = 0xFF;
+  for (TrafficSource *src : sources) {
+    if (src->Port() >= ports.size()) {
+      fprintf(stderr, "traffic source on port %zu, but only %zu ports\n",
+              src->Port(), ports.size());
+      return EXIT_FAILURE;
+    }
   }
 
   signal(SIGINT, sigint_handler);
@@ -454,35 +290,47 @@ int main(int argc, char *argv[]) {
   signal(SIGUSR2, sigusr2_handler);
 #endif
 
+  bool any_sync = false;
+  for (auto port : ports)
+    any_sync = any_sync || port->IsSync();
+
   printf("start polling\n");
   while (!exiting) {
     // Sync all interfaces
     for (auto port : ports)
       port->Sync(cur_ts);
 
-    // Switch packets
+    // Receive and send packets
     uint64_t min_ts;
     do {
       min_ts = ULLONG_MAX;
       for (size_t port_i = 0; port_i < ports.size(); port_i++) {
         auto &port = *ports[port_i];
         pollq(port, port_i);
-        sendq(port, port_i);
         if (port.IsSync()) {
           uint64_t ts = port.NextTimestamp();
           min_ts = ts < min_ts ? ts : min_ts;
         }
       }
+      // while blocked on a full ring only incoming messages move time on
+      if (sendq()) {
+        TrafficSource *src = next_source();
+        if (src && src->NextTime() < min_ts)
+          min_ts = src->NextTime();
+      }
     } while (!exiting && (min_ts <= cur_ts));
 
-    // Update cur_ts
+    // Update cur_ts, packets are never sent behind it
     if (min_ts < ULLONG_MAX) {
-      // a bit broken but should probably do
       cur_ts = min_ts;
       if (cur_ts >= target_tick) {
         printf("run to %lu tics\n", cur_ts);
         exiting = 1;
       }
+    } else if (!any_sync && !next_source()) {
+      // nothing left to send and no peer to move time on
+      printf("all traffic sent at %lu tics\n", cur_ts);
+      exiting = 1;
     }
   }
 
@@ -494,5 +342,7 @@ int main(int argc, char *argv[]) {
 
 #endif
 
+  if (capture)
+    SimbricksCaptureClose(capture);
   return 0;
 }
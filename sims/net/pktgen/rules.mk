@@ -24,11 +24,11 @@ include mk/subdir_pre.mk
 
 bin_pktgen := $(d)pktgen
 
-OBJS := $(d)pktgen.o
+OBJS := $(d)pktgen.o $(d)traffic.o
 
 $(OBJS): CPPFLAGS := $(CPPFLAGS) -I$(d)include/
 
-$(bin_pktgen): $(OBJS) $(lib_netif) $(lib_nicif) $(lib_base) -lpcap
+$(bin_pktgen): $(OBJS) $(lib_netport) $(lib_netif) $(lib_nicif) $(lib_base) -lpthread
 
 CLEAN := $(bin_pktgen) $(OBJS)
 ALL := $(bin_pktgen)
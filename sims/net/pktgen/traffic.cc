@@ -0,0 +1,485 @@
+/*
+ * Copyright 2024 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "sims/net/pktgen/traffic.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// simple IMIX, 7:4:1 (frame lengths without FCS)
+static const size_t kImixSizes[12] = {60, 60, 60, 60, 60, 60, 60,
+                                      590, 590, 590, 590, 1514};
+static const size_t kMinFrame = 60;
+
+void TrafficDefaultFlow(FlowParams *params, const uint8_t *smac,
+                        const uint8_t *dmac) {
+  memset(params, 0, sizeof(*params));
+  params->arrival = FlowParams::kConstant;
+  params->size = FlowParams::kFixed;
+  params->size_min = params->size_max = 1500;
+  params->flows = 1;
+  memcpy(params->smac, smac, 6);
+  memcpy(params->dmac, dmac, 6);
+  params->src_ip[0] = params->src_ip[1] = 0x0a000001;
+  params->dst_ip[0] = params->dst_ip[1] = 0x0a000002;
+  params->sport[0] = params->sport[1] = 1024;
+  params->dport[0] = params->dport[1] = 1024;
+  params->proto = IPPROTO_UDP;
+}
+
+FlowSource::FlowSource(const FlowParams &params)
+    : p_(params), rng_(params.seed), ip_id_(0) {
+  port_ = p_.port;
+  next_ = (p_.rate || p_.pps) ? p_.start : kDone;
+  if (p_.arrival == FlowParams::kPoisson && next_ != kDone)
+    Advance(0);
+}
+
+/** Move next_ on to the packet after one of `len` bytes. */
+void FlowSource::Advance(size_t len) {
+  double gap;
+  if (p_.rate) {
+    // a Poisson process has no packet length yet, use the mean
+    if (!len)
+      len = (p_.size_min + p_.size_max) / 2;
+    gap = len * 8 * 1e12 / p_.rate;
+  } else {
+    gap = 1e12 / p_.pps;
+  }
+  if (p_.arrival == FlowParams::kPoisson)
+    gap *= -std::log(1.0 - std::generate_canonical<double, 53>(rng_));
+  next_ += (uint64_t)gap;
+
+  if (p_.arrival == FlowParams::kOnOff && p_.off_time) {
+    uint64_t cycle = p_.on_time + p_.off_time;
+    uint64_t pos = (next_ - p_.start) % cycle;
+    if (pos >= p_.on_time)
+      next_ += cycle - pos;
+  }
+  if (p_.stop && next_ >= p_.stop)
+    next_ = kDone;
+}
+
+static void put16(uint8_t *p, uint16_t v) {
+  p[0] = v >> 8;
+  p[1] = v;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+  put16(p, v >> 16);
+  put16(p + 2, v);
+}
+
+size_t FlowSource::Generate(uint8_t *buf, size_t max) {
+  size_t len;
+  switch (p_.size) {
+    case FlowParams::kUniform:
+      len = p_.size_min + rng_() % (p_.size_max - p_.size_min + 1);
+      break;
+    case FlowParams::kImix:
+      len = kImixSizes[rng_() % 12];
+      break;
+    default:
+      len = p_.size_min;
+      break;
+  }
+  len = len < kMinFrame ? kMinFrame : len;
+  len = len > max ? max : len;
+
+  memcpy(buf, p_.dmac, 6);
+  memcpy(buf + 6, p_.smac, 6);
+  if (!p_.proto) {
+    // raw frames as pktgen always sent them
+    memset(buf + 12, 0xff, len - 24);
+    memset(buf + len - 12, 0, 12);
+    Advance(len);
+    return len;
+  }
+
+  // the flow picks a combination of the address and port ranges
+  uint64_t flow = p_.flows > 1 ? rng_() % p_.flows : 0;
+  // in 64 bits, a full address range has 2^32 addresses
+  uint64_t n = uint64_t{p_.src_ip[1]} - p_.src_ip[0] + 1;
+  uint32_t src = p_.src_ip[0] + flow % n;
+  flow /= n;
+  n = uint64_t{p_.dst_ip[1]} - p_.dst_ip[0] + 1;
+  uint32_t dst = p_.dst_ip[0] + flow % n;
+  flow /= n;
+  n = p_.sport[1] - p_.sport[0] + 1;
+  uint16_t sport = p_.sport[0] + flow % n;
+  flow /= n;
+  n = p_.dport[1] - p_.dport[0] + 1;
+  uint16_t dport = p_.dport[0] + flow % n;
+
+  put16(buf + 12, 0x0800);
+  uint8_t *ip = buf + 14;
+  memset(ip, 0, 20);
+  ip[0] = 0x45;
+  put16(ip + 2, len - 14);
+  put16(ip + 4, ip_id_++);
+  ip[6] = 0x40;  // don't fragment
+  ip[8] = 64;
+  ip[9] = p_.proto;
+  put32(ip + 12, src);
+  put32(ip + 16, dst);
+  uint32_t sum = 0;
+  for (int i = 0; i < 20; i += 2)
+    sum += ip[i] << 8 | ip[i + 1];
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+  put16(ip + 10, ~sum);
+
+  // no L4 checksum (0 is valid for UDP), the payload is left as it is
+  uint8_t *l4 = ip + 20;
+  put16(l4, sport);
+  put16(l4 + 2, dport);
+  if (p_.proto == IPPROTO_TCP) {
+    memset(l4 + 4, 0, 16);
+    l4[12] = 0x50;
+    l4[13] = 0x10;  // ACK
+    put16(l4 + 14, 0xffff);
+  } else {
+    put16(l4 + 4, len - 34);
+    put16(l4 + 6, 0);
+  }
+
+  Advance(len);
+  return len;
+}
+
+PcapSource::PcapSource(size_t port, uint64_t start, double scale, bool loop)
+    : map_(nullptr),
+      map_len_(0),
+      pos_(0),
+      swapped_(false),
+      nsec_(false),
+      scale_(scale),
+      loop_(loop),
+      base_(start),
+      first_(kDone),
+      last_(0) {
+  port_ = port;
+  next_ = kDone;
+}
+
+PcapSource::~PcapSource() {
+  if (map_)
+    munmap((void *)map_, map_len_);
+}
+
+uint32_t PcapSource::Field(const uint8_t *p) const {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return swapped_ ? __builtin_bswap32(v) : v;
+}
+
+bool PcapSource::Open(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror("PcapSource: open failed");
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size < 24) {
+    fprintf(stderr, "PcapSource: %s is not a pcap file\n", path);
+    close(fd);
+    return false;
+  }
+  map_len_ = st.st_size;
+  void *m = mmap(nullptr, map_len_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (m == MAP_FAILED) {
+    perror("PcapSource: mmap failed");
+    return false;
+  }
+  map_ = static_cast<const uint8_t *>(m);
+  madvise(m, map_len_, MADV_SEQUENTIAL);
+
+  uint32_t magic;
+  memcpy(&magic, map_, 4);
+  swapped_ = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+  magic = Field(map_);
+  nsec_ = magic == 0xa1b23c4d;
+  if ((magic != 0xa1b2c3d4 && !nsec_) || Field(map_ + 20) != 1) {
+    fprintf(stderr, "PcapSource: %s is not an Ethernet pcap file\n", path);
+    return false;
+  }
+
+  pos_ = 24;
+  Peek();
+  return true;
+}
+
+/** Set next_ for the record at pos_, wrapping around when looping. */
+bool PcapSource::Peek() {
+  for (int round = 0; round < 2; round++) {
+    if (pos_ + 16 <= map_len_ &&
+        pos_ + 16 + Field(map_ + pos_ + 8) <= map_len_) {
+      const uint8_t *rec = map_ + pos_;
+      uint64_t ts = Field(rec) * 1000000000000ULL +
+                    (uint64_t)Field(rec + 4) * (nsec_ ? 1000 : 1000000);
+      if (first_ == kDone)
+        first_ = ts;
+      uint64_t t = base_ + (ts > first_ ? (uint64_t)((ts - first_) * scale_)
+                                        : 0);
+      // traces are not always sorted, never go back in time
+      next_ = t > last_ ? t : last_;
+      return true;
+    }
+
+    if (!loop_ || pos_ == 24)
+      break;
+    // start over right after the last packet
+    pos_ = 24;
+    base_ = last_ + 1000;
+    first_ = kDone;
+  }
+  next_ = kDone;
+  return false;
+}
+
+size_t PcapSource::Generate(uint8_t *buf, size_t max) {
+  const uint8_t *rec = map_ + pos_;
+  size_t len = Field(rec + 8);
+  memcpy(buf, rec + 16, len > max ? max : len);
+  pos_ += 16 + len;
+  last_ = next_;
+  Peek();
+  return len > max ? max : len;
+}
+
+static bool parse_mac(const char *s, uint8_t *mac) {
+  return sscanf(s, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", mac, mac + 1, mac + 2,
+                mac + 3, mac + 4, mac + 5) == 6;
+}
+
+static uint64_t parse_scaled(const char *s) {
+  char *end;
+  double v = strtod(s, &end);
+  switch (*end) {
+    case 'k':
+    case 'K':
+      v *= 1e3;
+      break;
+    case 'm':
+    case 'M':
+      v *= 1e6;
+      break;
+    case 'g':
+    case 'G':
+      v *= 1e9;
+      break;
+  }
+  return v;
+}
+
+static bool parse_ip_range(const char *s, uint32_t *range) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%s", s);
+  char *dash = strchr(buf, '-');
+  if (dash)
+    *dash++ = 0;
+  struct in_addr a, b;
+  if (inet_pton(AF_INET, buf, &a) != 1 ||
+      (dash && inet_pton(AF_INET, dash, &b) != 1))
+    return false;
+  range[0] = ntohl(a.s_addr);
+  range[1] = dash ? ntohl(b.s_addr) : range[0];
+  return range[0] <= range[1];
+}
+
+static bool parse_u16_range(const char *s, uint16_t *range) {
+  char *end;
+  unsigned long lo = strtoul(s, &end, 0);
+  unsigned long hi = *end == '-' ? strtoul(end + 1, &end, 0) : lo;
+  range[0] = lo;
+  range[1] = hi;
+  return !*end && lo <= hi && hi <= 0xffff;
+}
+
+static bool parse_flow_opt(FlowParams &p, const char *key, const char *val) {
+  if (!strcmp(key, "port")) {
+    p.port = strtoul(val, nullptr, 0);
+  } else if (!strcmp(key, "rate")) {
+    p.rate = parse_scaled(val);
+  } else if (!strcmp(key, "pps")) {
+    p.pps = parse_scaled(val);
+  } else if (!strcmp(key, "arrival")) {
+    unsigned long long on, off;
+    if (!strcmp(val, "constant")) {
+      p.arrival = FlowParams::kConstant;
+    } else if (!strcmp(val, "poisson")) {
+      p.arrival = FlowParams::kPoisson;
+    } else if (sscanf(val, "onoff:%llu:%llu", &on, &off) == 2 && on) {
+      p.arrival = FlowParams::kOnOff;
+      p.on_time = on * 1000ULL;
+      p.off_time = off * 1000ULL;
+    } else {
+      return false;
+    }
+  } else if (!strcmp(key, "size")) {
+    unsigned long lo, hi;
+    if (!strcmp(val, "imix")) {
+      p.size = FlowParams::kImix;
+    } else if (sscanf(val, "%lu-%lu", &lo, &hi) == 2 && lo <= hi) {
+      p.size = FlowParams::kUniform;
+      p.size_min = lo;
+      p.size_max = hi;
+    } else if (sscanf(val, "%lu", &lo) == 1) {
+      p.size = FlowParams::kFixed;
+      p.size_min = p.size_max = lo;
+    } else {
+      return false;
+    }
+  } else if (!strcmp(key, "flows")) {
+    p.flows = strtoull(val, nullptr, 0);
+  } else if (!strcmp(key, "smac")) {
+    return parse_mac(val, p.smac);
+  } else if (!strcmp(key, "dmac")) {
+    return parse_mac(val, p.dmac);
+  } else if (!strcmp(key, "src")) {
+    return parse_ip_range(val, p.src_ip);
+  } else if (!strcmp(key, "dst")) {
+    return parse_ip_range(val, p.dst_ip);
+  } else if (!strcmp(key, "sport")) {
+    return parse_u16_range(val, p.sport);
+  } else if (!strcmp(key, "dport")) {
+    return parse_u16_range(val, p.dport);
+  } else if (!strcmp(key, "proto")) {
+    if (!strcmp(val, "udp"))
+      p.proto = IPPROTO_UDP;
+    else if (!strcmp(val, "tcp"))
+      p.proto = IPPROTO_TCP;
+    else
+      return false;
+  } else if (!strcmp(key, "start")) {
+    p.start = strtoull(val, nullptr, 0) * 1000ULL;
+  } else if (!strcmp(key, "stop")) {
+    p.stop = strtoull(val, nullptr, 0) * 1000ULL;
+  } else if (!strcmp(key, "seed")) {
+    p.seed = strtoull(val, nullptr, 0);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool TrafficLoadProfile(const char *path, const uint8_t *smac,
+                        const uint8_t *dmac,
+                        std::vector<TrafficSource *> &sources) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror("TrafficLoadProfile: fopen failed");
+    return false;
+  }
+
+  char line[1024];
+  unsigned lineno = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), f)) {
+    lineno++;
+    char *comment = strchr(line, '#');
+    if (comment)
+      *comment = 0;
+
+    char *save;
+    char *cmd = strtok_r(line, " \t\r\n", &save);
+    if (!cmd)
+      continue;
+
+    if (!strcmp(cmd, "stream")) {
+      FlowParams p;
+      TrafficDefaultFlow(&p, smac, dmac);
+      p.seed = sources.size() + 1;
+      char *opt;
+      while (ok && (opt = strtok_r(nullptr, " \t\r\n", &save))) {
+        char *val = strchr(opt, '=');
+        if (val)
+          *val++ = 0;
+        if (!val || !parse_flow_opt(p, opt, val)) {
+          fprintf(stderr, "%s:%u: bad stream option %s\n", path, lineno, opt);
+          ok = false;
+        }
+      }
+      if (ok && !p.rate && !p.pps) {
+        fprintf(stderr, "%s:%u: stream needs a rate or pps\n", path, lineno);
+        ok = false;
+      }
+      if (ok)
+        sources.push_back(new FlowSource(p));
+    } else if (!strcmp(cmd, "replay")) {
+      char *file = strtok_r(nullptr, " \t\r\n", &save);
+      size_t port = 0;
+      uint64_t start = 0;
+      double scale = 1.0;
+      bool loop = false;
+      char *opt;
+      while (ok && file && (opt = strtok_r(nullptr, " \t\r\n", &save))) {
+        char *val = strchr(opt, '=');
+        if (val)
+          *val++ = 0;
+        if (val && !strcmp(opt, "port")) {
+          port = strtoul(val, nullptr, 0);
+        } else if (val && !strcmp(opt, "start")) {
+          start = strtoull(val, nullptr, 0) * 1000ULL;
+        } else if (val && !strcmp(opt, "scale")) {
+          scale = strtod(val, nullptr);
+        } else if (val && !strcmp(opt, "loop")) {
+          loop = strtoul(val, nullptr, 0);
+        } else {
+          fprintf(stderr, "%s:%u: bad replay option %s\n", path, lineno, opt);
+          ok = false;
+        }
+      }
+      if (!file) {
+        fprintf(stderr, "%s:%u: replay needs a file\n", path, lineno);
+        ok = false;
+      }
+      if (ok) {
+        PcapSource *src = new PcapSource(port, start, scale, loop);
+        if (!src->Open(file)) {
+          delete src;
+          ok = false;
+        } else {
+          sources.push_back(src);
+        }
+      }
+    } else {
+      fprintf(stderr, "%s:%u: cannot parse: %s\n", path, lineno, cmd);
+      ok = false;
+    }
+  }
+  fclose(f);
+  return ok;
+}
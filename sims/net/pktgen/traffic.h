@@ -0,0 +1,151 @@
+/*
+ * Copyright 2024 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef SIMS_NET_PKTGEN_TRAFFIC_H_
+#define SIMS_NET_PKTGEN_TRAFFIC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+/** Source of packets, each due at a simulated time */
+class TrafficSource {
+ public:
+  static constexpr uint64_t kDone = UINT64_MAX;
+
+  virtual ~TrafficSource() = default;
+
+  /** When the next packet is due [ps], kDone if there are no more. */
+  uint64_t NextTime() const {
+    return next_;
+  }
+
+  /** Index of the port to send on */
+  size_t Port() const {
+    return port_;
+  }
+
+  /** Write the next packet to `buf` (room for `max` bytes) and move on to
+   * the one after. Returns the length of the packet. */
+  virtual size_t Generate(uint8_t *buf, size_t max) = 0;
+
+ protected:
+  uint64_t next_ = 0;
+  size_t port_ = 0;
+};
+
+/** Synthetic UDP/TCP traffic over a set of flows */
+struct FlowParams {
+  enum Arrival {
+    kConstant,
+    kPoisson,
+    kOnOff,
+  };
+  enum Size {
+    kFixed,
+    kUniform,
+    kImix,
+  };
+
+  size_t port;
+  uint64_t rate;  // [bit/s], 0 to use pps
+  uint64_t pps;
+  Arrival arrival;
+  uint64_t on_time;  // [ps], on-off only
+  uint64_t off_time;
+  Size size;
+  size_t size_min;  // frame length without FCS
+  size_t size_max;
+  uint64_t flows;  // spread over the address and port ranges
+  uint8_t smac[6];
+  uint8_t dmac[6];
+  uint32_t src_ip[2];  // first and last, host byte order
+  uint32_t dst_ip[2];
+  uint16_t sport[2];
+  uint16_t dport[2];
+  uint8_t proto;  // IPPROTO_UDP, IPPROTO_TCP, or 0 for raw frames
+  uint64_t start;  // [ps]
+  uint64_t stop;  // [ps], 0 for never
+  uint64_t seed;
+};
+
+/** 1500 byte UDP frames between the given MACs, rate still to be set. */
+void TrafficDefaultFlow(FlowParams *params, const uint8_t *smac,
+                        const uint8_t *dmac);
+
+class FlowSource : public TrafficSource {
+ public:
+  explicit FlowSource(const FlowParams &params);
+  size_t Generate(uint8_t *buf, size_t max) override;
+
+ protected:
+  FlowParams p_;
+  std::mt19937_64 rng_;
+  uint16_t ip_id_;
+
+  void Advance(size_t len);
+};
+
+/** Replay of an Ethernet pcap file (mapped, not read into memory), with
+ * the gaps between packets multiplied by `scale`. */
+class PcapSource : public TrafficSource {
+ public:
+  PcapSource(size_t port, uint64_t start, double scale, bool loop);
+  ~PcapSource() override;
+  bool Open(const char *path);
+  size_t Generate(uint8_t *buf, size_t max) override;
+
+ protected:
+  const uint8_t *map_;
+  size_t map_len_;
+  size_t pos_;
+  bool swapped_;
+  bool nsec_;
+  double scale_;
+  bool loop_;
+  uint64_t base_;  // simulated time of the first packet of this round
+  uint64_t first_;  // capture time of the first packet
+  uint64_t last_;  // simulated time of the last packet sent
+
+  bool Peek();
+  uint32_t Field(const uint8_t *p) const;
+};
+
+/**
+ * Load a traffic profile, one source per line ('#' starts a comment):
+ *   stream KEY=VALUE ...
+ *   replay FILE [port=N] [start=NS] [scale=X] [loop=1]
+ * with stream keys port, rate (bit/s, k/m/g suffix) or pps, arrival
+ * (constant, poisson, or onoff:ON_NS:OFF_NS), size (N, MIN-MAX or imix),
+ * flows, smac, dmac, src and dst (A.B.C.D or A.B.C.D-A.B.C.D), sport and
+ * dport (N or N-M), proto (udp, tcp), start and stop (ns), and seed.
+ * `smac` and `dmac` are the default MAC addresses.
+ */
+bool TrafficLoadProfile(const char *path, const uint8_t *smac,
+                        const uint8_t *dmac,
+                        std::vector<TrafficSource *> &sources);
+
+#endif  // SIMS_NET_PKTGEN_TRAFFIC_H_
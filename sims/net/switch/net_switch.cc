@@ -25,21 +25,30 @@
 #include <arpa/inet.h>
 #include <linux/if_ether.h>
 #include <linux/ip.h>
-#include <pcap/pcap.h>
+#include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <climits>
 #include <csignal>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
 #include <string>
-#include <unordered_map>
+#include <thread>
 #include <vector>
 
 #include <simbricks/base/cxxatomicfix.h>
+#include <simbricks/base/ts_heap.hh>
+#include <simbricks/network/lpm.hh>
+#include <simbricks/network/mac_table.hh>
+#include <simbricks/netport/netport.h>
 extern "C" {
+#include <simbricks/network/capture.h>
 #include <simbricks/network/if.h>
 #include <simbricks/nicif/nicif.h>
 };
@@ -48,241 +57,583 @@ extern "C" {
 #define NETSWITCH_STAT
 
 struct SimbricksBaseIfParams netParams;
-static pcap_dumper_t *dumpfile = nullptr;
+static struct SimbricksCapture *capture = nullptr;
 
 #ifdef NETSWITCH_STAT
 #endif
 
 #ifdef NETSWITCH_STAT
-static uint64_t d2n_poll_total = 0;
-static uint64_t d2n_poll_suc = 0;
-static uint64_t d2n_poll_sync = 0;
+// per thread in sharded mode, folded into the main thread's on exit
+static thread_local uint64_t d2n_poll_total = 0;
+static thread_local uint64_t d2n_poll_suc = 0;
+static thread_local uint64_t d2n_poll_sync = 0;
 
-static uint64_t s_d2n_poll_total = 0;
-static uint64_t s_d2n_poll_suc = 0;
-static uint64_t s_d2n_poll_sync = 0;
+static thread_local uint64_t s_d2n_poll_total = 0;
+static thread_local uint64_t s_d2n_poll_suc = 0;
+static thread_local uint64_t s_d2n_poll_sync = 0;
 
 static int stat_flag = 0;
 #endif
 
-/* MAC address type */
-struct MAC {
-  const uint8_t *data;
+using netport::NetListenPort;
+using netport::NetPort;
 
-  explicit MAC(const uint8_t *data) : data(data) {
+/* Global variables */
+static thread_local uint64_t cur_ts = 0;
+static volatile int exiting = 0;
+static std::vector<NetPort *> ports;
+
+struct Router;
+
+/** Logical switch: a set of ports sharing a MAC table, and with -R a routing
+ * table if it has router interfaces. Without a topology (-T) there is a
+ * single one with all ports. */
+struct Switch {
+  std::string name;
+  std::vector<size_t> ports;
+  std::vector<size_t> flood_ports;  // ports but links blocked to break loops
+  simbricks::MacTable mac_table;
+  Router *router = nullptr;
+};
+static std::vector<Switch *> switches;
+static std::vector<size_t> port_switch;  // indexed by port
+
+/* Flood pruning (-P): from this time on unknown unicast frames are only
+ * flooded to ports that some host has sent from. Hosts that are ever going to
+ * be addressed have announced themselves by then, flooding to silent ports
+ * (and switches behind links that never carried anything) is just copies.
+ * Broadcast and multicast still go everywhere. */
+static uint64_t flood_prune_ts = simbricks::TimestampHeap::kNever;
+// indexed by port, only written and read by the thread owning the port
+static std::vector<uint8_t> port_heard;
+
+/** What the ports served by one thread have due next: the input timestamp of
+ * each synchronized port and its first pending egress departure, indexed by
+ * the port's position in `ports`. A round only visits the ports with
+ * something due at the current timestamp instead of scanning all of them,
+ * and the next timestamp is the minimum of the two heaps. */
+struct PortSchedule {
+  std::vector<size_t> ports;
+  std::vector<size_t> unsync;  // polled in every round
+  simbricks::TimestampHeap rx;
+  simbricks::TimestampHeap tx;
+  std::vector<size_t> due;
+
+  uint64_t Next() const {
+    uint64_t rx_ts = rx.Min();
+    uint64_t tx_ts = tx.Min();
+    return rx_ts < tx_ts ? rx_ts : tx_ts;
   }
+};
+static PortSchedule schedule;
+static std::vector<PortSchedule *> port_sched;  // indexed by port
+static std::vector<size_t> port_slot;  // position in its PortSchedule
+
+/* Sharded mode (-t N): ports are assigned round-robin to N threads. A shard
+ * polls the ingress of its ports and is the only thread transmitting on
+ * them, packets for a port of another shard are handed over through a
+ * single-producer single-consumer queue per pair of shards. Each shard keeps
+ * its own copy of the MAC table, learns are replayed on the others through
+ * the same queues. All shards process the same timestamp, then meet at a
+ * barrier that agrees on the next one (the minimum next message timestamp
+ * over all ports, as in the single-threaded loop), so packets leave at the
+ * same simulated times and in timestamp order on every port.
+ *
+ * To not depend on how the threads interleave, messages are tagged with the
+ * number of barriers their sender has passed (its epoch) and only take
+ * effect once the receiver has passed the same barrier: received early they
+ * are set aside, then processed in the order of the sending shards, the own
+ * learns replayed in that order too. So all table copies stay identical (to
+ * each other and to the single table), and packets from other shards leave
+ * in the same order in every run, after those the shard switched itself. A
+ * frame does not see addresses learned at the same timestamp on another
+ * shard's ports yet, the single-threaded switch does for ports it polls
+ * earlier. */
+class ShardQueue {
+ public:
+  enum MsgType : uint16_t {
+    kMsgPacket = 1,  // send data on eport
+    kMsgFlood = 2,   // send data on all local ports but iport
+    kMsgLearn = 3,   // data is a MAC address seen on eport
+    kMsgLink = 4,    // data arrives on link port eport at time due
+  };
+
+  struct Msg {
+    uint32_t size;  // of the whole record, 0 marks a skip to the ring start
+    uint16_t type;
+    uint16_t eport;
+    uint16_t iport;
+    uint16_t len;
+    uint32_t epoch;
+    uint64_t ts;
+    uint64_t due;
+
+    const void *data() const {
+      return this + 1;
+    }
+  };
+
+ private:
+  static constexpr size_t kSize = 256 * 1024;
+
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+  size_t head_cache_ = 0;
+  alignas(64) uint8_t buf_[kSize];
 
-  bool operator==(const MAC &other) const {
-    for (int i = 0; i < 6; i++) {
-      if (data[i] != other.data[i]) {
+ public:
+  /** Returns false if the queue is full. */
+  bool Push(MsgType type, size_t eport, size_t iport, uint32_t epoch,
+            uint64_t ts, const void *data, size_t len, uint64_t due = 0) {
+    size_t size = (sizeof(Msg) + len + 7) & ~(size_t)7;
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t off = tail % kSize;
+    size_t skip = off + size > kSize ? kSize - off : 0;
+    if (tail + skip + size - head_cache_ > kSize) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail + skip + size - head_cache_ > kSize)
         return false;
-      }
     }
+
+    if (skip) {
+      reinterpret_cast<Msg *>(buf_ + off)->size = 0;
+      tail += skip;
+      off = 0;
+    }
+    Msg *m = reinterpret_cast<Msg *>(buf_ + off);
+    m->size = size;
+    m->type = type;
+    m->eport = eport;
+    m->iport = iport;
+    m->len = len;
+    m->epoch = epoch;
+    m->ts = ts;
+    m->due = due;
+    memcpy(m + 1, data, len);
+    tail_.store(tail + size, std::memory_order_release);
     return true;
   }
+
+  /** Call f(const Msg &) for queued messages up to the first one from an
+   * epoch after max_epoch. */
+  template <typename F>
+  void Drain(uint32_t max_epoch, F f) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    while (head != tail) {
+      const Msg *m = reinterpret_cast<const Msg *>(buf_ + head % kSize);
+      if (m->size == 0) {
+        head += kSize - head % kSize;
+        continue;
+      }
+      if (m->epoch > max_epoch)
+        break;
+      f(*m);
+      head += m->size;
+    }
+    head_.store(head, std::memory_order_release);
+  }
 };
-namespace std {
-template <>
-struct hash<MAC> {
-  size_t operator()(const MAC &m) const {
-    size_t res = 0;
-    for (int i = 0; i < 6; i++) {
-      res = (res << 4) | (res ^ m.data[i]);
+
+struct Shard {
+  size_t id;
+  PortSchedule sched;  // ports owned by this shard
+  std::vector<ShardQueue *> in;  // indexed by source shard
+  std::vector<ShardQueue *> out;  // indexed by destination shard
+  simbricks::MacTable mac_table;
+  uint32_t epoch = 0;  // barriers passed
+  // messages received but not processed yet, indexed by source shard
+  std::vector<std::vector<uint64_t>> held;
+  bool pushed = false;  // since the last barrier
+};
+
+/** Spinning barrier that also agrees on the minimum of a value. */
+class ShardBarrier {
+  struct alignas(64) Slot {
+    uint64_t val;
+  };
+
+  size_t n_;
+  std::vector<Slot> vals_;
+  alignas(64) std::atomic<size_t> arrived_{0};
+  alignas(64) std::atomic<uint64_t> gen_{0};
+  uint64_t min_;
+  bool stop_;
+
+ public:
+  explicit ShardBarrier(size_t n) : n_(n), vals_(n), min_(0), stop_(false) {
+  }
+
+  /** Returns the minimum of all `val`s and whether to stop, calling idle()
+   * while waiting for the other shards. */
+  template <typename F>
+  uint64_t Wait(size_t id, uint64_t val, bool &stop, F idle) {
+    uint64_t gen = gen_.load(std::memory_order_acquire);
+    vals_[id].val = val;
+    if (arrived_.fetch_add(1, std::memory_order_acq_rel) == n_ - 1) {
+      min_ = ULLONG_MAX;
+      for (const Slot &s : vals_)
+        min_ = s.val < min_ ? s.val : min_;
+      stop_ = exiting;
+      arrived_.store(0, std::memory_order_relaxed);
+      gen_.store(gen + 1, std::memory_order_release);
+    } else {
+      while (gen_.load(std::memory_order_acquire) == gen)
+        idle();
     }
-    return res;
+    stop = stop_;
+    return min_;
   }
 };
-}  // namespace std
 
-/** Normal network switch port (conneting to a NIC) */
-class NetPort {
+static std::vector<size_t> port_shard;
+static std::vector<Shard *> shards;
+// with several switches whole switches go to a shard, each keeping its own
+// MAC table, instead of spreading ports and replicating one table
+static bool shard_by_switch = false;
+static bool link_cross_shard = false;
+static thread_local Shard *shard = nullptr;
+static std::mutex dump_mtx;
+
+/* Output queueing: packets switched to a port go through a FIFO with a byte
+ * limit. With a line rate configured each packet leaves once the previous
+ * one finished and it was serialized itself, so the queue only drains at the
+ * rate of the link. Packets are handed to the egress ring at their departure
+ * time, or as soon as there is room if the peer has fallen behind, instead
+ * of spinning on a full ring while the other ports wait. */
+class EgressQueue {
  public:
-  enum RxPollState {
-    kRxPollSuccess = 0,
-    kRxPollFail = 1,
-    kRxPollSync = 2,
+  struct Pkt {
+    uint32_t size;  // of the whole record, 0 marks a skip to the ring start
+    uint16_t len;
+    uint16_t iport;
+    uint64_t depart;
+
+    void *data() {
+      return this + 1;
+    }
   };
-  struct SimbricksNetIf netif_;
 
- protected:
-  volatile union SimbricksProtoNetMsg *rx_;
-  int sync_;
-  const char *path_;
-
-  bool Init() {
-    struct SimbricksBaseIfParams params = netParams;
-    params.sync_mode =
-        (sync_ ? kSimbricksBaseIfSyncOptional : kSimbricksBaseIfSyncDisabled);
-    params.sock_path = path_;
-    params.blocking_conn = false;
-
-    if (SimbricksBaseIfInit(&netif_.base, &params)) {
-      perror("Init: SimbricksBaseIfInit failed");
-      return false;
-    }
+ private:
+  std::vector<uint64_t> buf_;
+  size_t cap_ = 0;
+  size_t head_ = 0;
+  size_t tail_ = 0;
+  size_t bytes_ = 0;
 
-    return true;
+  Pkt *At(size_t pos) {
+    return reinterpret_cast<Pkt *>(
+        reinterpret_cast<uint8_t *>(buf_.data()) + pos % cap_);
   }
 
  public:
-  NetPort(const char *path, int sync) : rx_(nullptr), sync_(sync), path_(path) {
-    memset(&netif_, 0, sizeof(netif_));
+  /** Room for `limit` bytes of packets of at least 32 bytes, record headers
+   * and the skip at the end of the ring included. The ring is only allocated
+   * once something is queued, most ports of a large topology never do. */
+  void Init(size_t limit) {
+    size_t max_rec = sizeof(Pkt) + UINT16_MAX + 8;
+    cap_ = (2 * (limit + max_rec) + 7) & ~(size_t)7;
   }
 
-  NetPort(const NetPort &other)
-      : netif_(other.netif_),
-        rx_(other.rx_),
-        sync_(other.sync_),
-        path_(other.path_) {
+  bool Empty() const {
+    return head_ == tail_;
   }
 
-  virtual bool Prepare() {
-    if (!Init())
-      return false;
+  /** Queued packet bytes */
+  size_t Bytes() const {
+    return bytes_;
+  }
 
-    if (SimbricksBaseIfConnect(&netif_.base)) {
-      perror("Prepare: SimbricksBaseIfConnect failed");
-      return false;
+  /** Returns nullptr if the ring is out of space (only happens with lots of
+   * tiny packets). */
+  Pkt *Push(const void *data, size_t len, size_t iport, uint64_t depart) {
+    if (buf_.empty())
+      buf_.resize(cap_ / 8);
+    size_t size = (sizeof(Pkt) + len + 7) & ~(size_t)7;
+    size_t off = tail_ % cap_;
+    size_t skip = off + size > cap_ ? cap_ - off : 0;
+    if (tail_ + skip + size - head_ > cap_)
+      return nullptr;
+    if (skip) {
+      At(tail_)->size = 0;
+      tail_ += skip;
     }
 
-    return true;
+    Pkt *p = At(tail_);
+    p->size = size;
+    p->len = len;
+    p->iport = iport;
+    p->depart = depart;
+    memcpy(p->data(), data, len);
+    tail_ += size;
+    bytes_ += len;
+    return p;
   }
 
-  virtual void Prepared() {
-    sync_ = SimbricksBaseIfSyncEnabled(&netif_.base);
+  Pkt &Front() {
+    if (At(head_)->size == 0)
+      head_ += cap_ - head_ % cap_;
+    return *At(head_);
   }
 
-  bool IsSync() {
-    return sync_;
+  void Pop() {
+    Pkt &p = Front();
+    bytes_ -= p.len;
+    head_ += p.size;
   }
+};
 
-  void Sync(uint64_t cur_ts) {
-    while (SimbricksNetIfOutSync(&netif_, cur_ts)) {
-    }
+struct Egress {
+  EgressQueue queue;
+  uint64_t limit;       // queue capacity [bytes]
+  uint64_t ecn_thresh;  // mark CE above this queue length [bytes], 0 = off
+  uint64_t rate;        // line rate [bits/s], 0 = no serialization delay
+  uint64_t busy_until = 0;
+  uint64_t drops = 0;
+  uint64_t marks = 0;
+};
+
+/** preamble, start of frame delimiter, FCS and inter-frame gap */
+static constexpr uint64_t kWireOverhead = 8 + 4 + 12;
+
+static std::vector<Egress *> egress;  // indexed by port
+static bool egress_timed = false;
+
+static void link_send(size_t port_id, const void *data, size_t len,
+                      uint64_t ts);
+
+/** One end of an in-process link between two switches of a topology (-T).
+ * A packet sent on it arrives at the other end after the link latency, like
+ * a message on a SimBricks channel, but without shared memory rings, sync
+ * messages or a second process polling them. Links need no sync messages:
+ * nothing can arrive before the other end sends it, and the arrival is then
+ * known. A link never refuses a packet: the receiving end can only take it
+ * in once time moves on, so holding it back at the sender would stall the
+ * switch. Packets beyond what may be in flight are dropped (and counted) on
+ * arrival instead, in both the single-threaded and the sharded mode. */
+class LinkPort : public NetPort {
+ public:
+  /** In flight on a link before packets are dropped */
+  static constexpr size_t kInFlightBytes = 256 * 1024;
+
+ protected:
+  size_t id_;
+  size_t peer_;
+  uint64_t latency_;
+  bool blocked_;
+  EgressQueue rxq_;
+  std::string name_;
+  uint64_t drops_;
+
+ public:
+  LinkPort(const std::string &name, uint64_t latency)
+      : NetPort(nullptr, 1, &netParams),
+        id_(0),
+        peer_(0),
+        latency_(latency),
+        blocked_(false),
+        name_(name),
+        drops_(0) {
+    path_ = name_.c_str();
+    rxq_.Init(kInFlightBytes);
   }
 
-  uint64_t NextTimestamp() {
-    return SimbricksNetIfInTimestamp(&netif_);
+  void Connect(size_t id, size_t peer) {
+    id_ = id;
+    peer_ = peer;
   }
 
-  enum RxPollState RxPacket(const void *&data, size_t &len, uint64_t cur_ts) {
-    assert(rx_ == nullptr);
+  size_t Peer() const {
+    return peer_;
+  }
 
-    rx_ = SimbricksNetIfInPoll(&netif_, cur_ts);
-    if (!rx_)
-      return kRxPollFail;
+  uint64_t Latency() const {
+    return latency_;
+  }
 
-    uint8_t type = SimbricksNetIfInType(&netif_, rx_);
-    if (type == SIMBRICKS_PROTO_NET_MSG_PACKET) {
-      data = (const void *)rx_->packet.data;
-      len = rx_->packet.len;
-      return kRxPollSuccess;
-    } else if (type == SIMBRICKS_PROTO_MSG_TYPE_SYNC) {
-      return kRxPollSync;
-    } else {
-      fprintf(stderr, "switch_pkt: unsupported type=%u\n", type);
-      abort();
-    }
+  void SetLatency(uint64_t latency) {
+    latency_ = latency;
   }
 
-  void RxDone() {
-    assert(rx_ != nullptr);
+  /** Set on both ends of links left out of the spanning tree, packets are
+   * never flooded on them so L2 loops do not storm. */
+  bool Blocked() const {
+    return blocked_;
+  }
 
-    SimbricksNetIfInDone(&netif_, rx_);
-    rx_ = nullptr;
+  void Block() {
+    blocked_ = true;
   }
 
-  bool TxPacket(const void *data, size_t len, uint64_t cur_ts) {
-    volatile union SimbricksProtoNetMsg *msg_to =
-        SimbricksNetIfOutAlloc(&netif_, cur_ts);
-    if (!msg_to && !sync_) {
-      return false;
-    } else if (!msg_to && sync_) {
-      while (!msg_to)
-        msg_to = SimbricksNetIfOutAlloc(&netif_, cur_ts);
-    }
-    volatile struct SimbricksProtoNetMsgPacket *rx;
-    rx = &msg_to->packet;
-    rx->len = len;
-    rx->port = 0;
-    memcpy((void *)rx->data, data, len);
+  /** Packets dropped arriving here because too much was in flight */
+  uint64_t Drops() const {
+    return drops_;
+  }
 
-    SimbricksNetIfOutSend(&netif_, msg_to, SIMBRICKS_PROTO_NET_MSG_PACKET);
+  bool Prepare() override {
     return true;
   }
-};
 
-/** Listening switch port (connected to by another network) */
-class NetListenPort : public NetPort {
- protected:
-  struct SimbricksBaseIfSHMPool pool_;
+  void Prepared() override {
+  }
 
- public:
-  NetListenPort(const char *path, int sync) : NetPort(path, sync) {
-    memset(&pool_, 0, sizeof(pool_));
+  void Sync(uint64_t cur_ts) override {
   }
 
-  NetListenPort(const NetListenPort &other)
-      : NetPort(other), pool_(other.pool_) {
+  uint64_t NextTimestamp() override {
+    return rxq_.Empty() ? simbricks::TimestampHeap::kNever
+                        : rxq_.Front().depart;
   }
 
-  bool Prepare() override {
-    if (!Init())
-      return false;
+  enum RxPollState RxPacket(const void *&data, size_t &len,
+                            uint64_t cur_ts) override {
+    if (rxq_.Empty())
+      return kRxPollFail;
+    EgressQueue::Pkt &p = rxq_.Front();
+    if (p.depart > cur_ts)
+      return kRxPollFail;
+    data = p.data();
+    len = p.len;
+    return kRxPollSuccess;
+  }
 
-    std::string shm_path = path_;
-    shm_path += "-shm";
+  void RxDone() override {
+    rxq_.Pop();
+  }
 
-    if (SimbricksBaseIfSHMPoolCreate(
-            &pool_, shm_path.c_str(),
-            SimbricksBaseIfSHMSize(&netif_.base.params)) != 0) {
-      perror("Prepare: SimbricksBaseIfSHMPoolCreate failed");
-      return false;
-    }
+  bool TxPacket(const void *data, size_t len, uint64_t cur_ts,
+                bool stream = false) override {
+    link_send(peer_, data, len, cur_ts + latency_);
+    return true;
+  }
 
-    if (SimbricksBaseIfListen(&netif_.base, &pool_) != 0) {
-      perror("Prepare: SimbricksBaseIfListen failed");
-      return false;
+  /** Queue a packet arriving at time `ts`, called by the thread owning this
+   * end. Drops it if too much is in flight already. */
+  void Deliver(const void *data, size_t len, uint64_t ts) {
+    bool first = rxq_.Empty();
+    if (rxq_.Bytes() + len > kInFlightBytes ||
+        !rxq_.Push(data, len, 0, ts)) {
+      drops_++;
+      return;
     }
-
-    return true;
+    if (first)
+      port_sched[id_]->rx.Update(port_slot[id_], ts);
   }
 };
 
-static bool ConnectAll(std::vector<NetPort *> ports) {
-  size_t n = ports.size();
-  struct SimBricksBaseIfEstablishData ests[n];
-  struct SimbricksProtoNetIntro intro;
-
-  printf("start connecting...\n");
-  for (size_t i = 0; i < n; i++) {
-    NetPort *p = ports[i];
-    ests[i].base_if = &p->netif_.base;
-    ests[i].tx_intro = &intro;
-    ests[i].tx_intro_len = sizeof(intro);
-    ests[i].rx_intro = &intro;
-    ests[i].rx_intro_len = sizeof(intro);
+static size_t add_port(NetPort *port, size_t sw_i, uint64_t limit,
+                       uint64_t ecn_thresh, uint64_t rate) {
+  Egress *e = new Egress;
+  e->queue.Init(limit);
+  e->limit = limit;
+  e->ecn_thresh = ecn_thresh;
+  e->rate = rate;
+  egress_timed = egress_timed || rate;
+
+  size_t port_i = ports.size();
+  ports.push_back(port);
+  egress.push_back(e);
+  port_switch.push_back(sw_i);
+  port_sched.push_back(nullptr);
+  port_slot.push_back(0);
+  port_heard.push_back(0);
+  switches[sw_i]->ports.push_back(port_i);
+  return port_i;
+}
 
-    if (!p->Prepare())
+/** Set the ECN field of an ECN-capable IP packet to CE. Returns false if the
+ * packet is not ECN-capable. */
+static bool ecn_mark(uint8_t *pkt, size_t len) {
+  size_t off = 12;
+  if (len >= 18 && pkt[12] == 0x81 && pkt[13] == 0x00)
+    off += 4;
+  uint16_t proto = pkt[off] << 8 | pkt[off + 1];
+  uint8_t *ip = pkt + off + 2;
+
+  if (proto == ETH_P_IP && len >= off + 2 + 20) {
+    if (!(ip[1] & 3))
+      return false;
+    // incremental checksum update (RFC 1624) for the first 16-bit word
+    uint16_t old_w = ip[0] << 8 | ip[1];
+    ip[1] |= 3;
+    uint16_t new_w = ip[0] << 8 | ip[1];
+    uint32_t sum = (uint16_t)~(ip[10] << 8 | ip[11]);
+    sum += (uint16_t)~old_w;
+    sum += new_w;
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = ~sum & 0xffff;
+    ip[10] = sum >> 8;
+    ip[11] = sum;
+    return true;
+  } else if (proto == ETH_P_IPV6 && len >= off + 2 + 40) {
+    if (!(ip[1] & 0x30))
       return false;
+    ip[1] |= 0x30;
+    return true;
   }
+  return false;
+}
 
-  if (SimBricksBaseIfEstablish(ests, n)) {
-    fprintf(stderr, "ConnectAll: SimBricksBaseIfEstablish failed\n");
+static bool egress_send(size_t port_id, const void *data, size_t len,
+                        size_t iport_id, uint64_t ts, bool stream = false) {
+  if (!ports[port_id]->TxPacket(data, len, ts, stream))
     return false;
-  }
 
-  printf("done connecting\n");
+  // capture if enabled, the capture only takes a single producer
+  if (capture) {
+    std::unique_lock<std::mutex> lock(dump_mtx, std::defer_lock);
+    if (shard)
+      lock.lock();
+    SimbricksCapturePacket(capture, ts, data, len, iport_id, port_id);
+  }
   return true;
 }
 
-/* Global variables */
-static uint64_t cur_ts = 0;
-static int exiting = 0;
-static const uint8_t bcast[6] = {0xFF};
-static const MAC bcast_addr(bcast);
-static std::vector<NetPort *> ports;
-static std::unordered_map<MAC, int> mac_table;
+/** Hand packets that are due to the egress ring. */
+static void egress_release(size_t port_id) {
+  Egress &e = *egress[port_id];
+  bool sync = ports[port_id]->IsSync();
+  uint64_t next = simbricks::TimestampHeap::kNever;
+  while (!e.queue.Empty()) {
+    EgressQueue::Pkt &p = e.queue.Front();
+    // without synchronization there is no simulated time to wait for
+    if ((sync && p.depart > cur_ts) ||
+        !egress_send(port_id, p.data(), p.len, p.iport, cur_ts)) {
+      next = p.depart;
+      break;
+    }
+    e.queue.Pop();
+  }
+  if (sync)
+    port_sched[port_id]->tx.Update(port_slot[port_id], next);
+}
+
+/** Set up `ps` for its ports once they are connected. */
+static void schedule_init(PortSchedule &ps) {
+  size_t n = ps.ports.size();
+  ps.rx.Reset(n, 0);
+  ps.tx.Reset(n, simbricks::TimestampHeap::kNever);
+  for (size_t slot = 0; slot < n; slot++) {
+    size_t port_i = ps.ports[slot];
+    if (!ports[port_i]->IsSync()) {
+      ps.rx.Update(slot, simbricks::TimestampHeap::kNever);
+      ps.unsync.push_back(port_i);
+    }
+    port_sched[port_i] = &ps;
+    port_slot[port_i] = slot;
+  }
+}
+
+/** Release the packets of `ps`'s ports that are due to depart. */
+static void schedule_tx(PortSchedule &ps) {
+  ps.due.clear();
+  ps.tx.CollectUpTo(cur_ts, ps.due);
+  for (size_t slot : ps.due)
+    egress_release(ps.ports[slot]);
+  for (size_t port_i : ps.unsync)
+    egress_release(port_i);
+}
 
 static void sigint_handler(int dummy) {
   exiting = 1;
@@ -307,20 +658,10 @@ static void sigusr2_handler(int dummy) {
 }
 #endif
 
-static void forward_pkt(const void *pkt_data, size_t pkt_len, size_t port_id,
-                        size_t iport_id) {
-  struct pcap_pkthdr ph;
-  NetPort &dest_port = *ports[port_id];
-
-  // log to pcap file if initialized
-  if (dumpfile) {
-    memset(&ph, 0, sizeof(ph));
-    ph.ts.tv_sec = cur_ts / 1000000000000ULL;
-    ph.ts.tv_usec = (cur_ts % 1000000000000ULL) / 1000ULL;
-    ph.caplen = pkt_len;
-    ph.len = pkt_len;
-    pcap_dump((unsigned char *)dumpfile, &ph, (unsigned char *)pkt_data);
-  }
+static void transmit_pkt(const void *pkt_data, size_t pkt_len, size_t port_id,
+                         size_t iport_id, uint64_t ts, bool stream = false) {
+  Egress &e = *egress[port_id];
+
   // print sending tick: [packet type] source_IP -> dest_IP len:
 
 #ifdef NETSWITCH_DEBUG
@@ -332,7 +673,7 @@ static void forward_pkt(const void *pkt_data, size_t pkt_len, size_t port_id,
   iph = (struct iphdr *)(hdr + 1);
   uint64_t dmac = (*(uint64_t *)hdr->h_dest) & 0xFFFFFFFFFFULL;
   uint64_t smac = (*(uint64_t *)hdr->h_source) & 0xFFFFFFFFFFULL;
-  fprintf(stderr, "%20lu: [P %zu -> %zu] %lx -> %lx ", cur_ts, iport_id,
+  fprintf(stderr, "%20lu: [P %zu -> %zu] %lx -> %lx ", ts, iport_id,
           port_id, smac, dmac);
   if (eth_proto == ETH_P_IP) {
     fprintf(stderr, "[ IP] ");
@@ -347,8 +688,341 @@ static void forward_pkt(const void *pkt_data, size_t pkt_len, size_t port_id,
   }
 #endif
 
-  if (!dest_port.TxPacket(pkt_data, pkt_len, cur_ts))
+  uint64_t depart = ts > e.busy_until ? ts : e.busy_until;
+  if (e.rate)
+    depart += (pkt_len + kWireOverhead) * 8 * 1000000000000ULL / e.rate;
+
+  // straight to the ring if nothing is waiting and there is room
+  if (e.queue.Empty() && depart == ts &&
+      egress_send(port_id, pkt_data, pkt_len, iport_id, ts, stream)) {
+    e.busy_until = depart;
+    return;
+  }
+
+  bool mark = e.ecn_thresh && e.queue.Bytes() > e.ecn_thresh;
+  bool first = e.queue.Empty();
+  EgressQueue::Pkt *p = nullptr;
+  if (e.queue.Bytes() + pkt_len <= e.limit)
+    p = e.queue.Push(pkt_data, pkt_len, iport_id, depart);
+  if (!p) {
+    e.drops++;
+#ifdef NETSWITCH_DEBUG
     fprintf(stderr, "forward_pkt: dropping packet on port %zu\n", port_id);
+#endif
+    return;
+  }
+  if (mark && ecn_mark(static_cast<uint8_t *>(p->data()), pkt_len))
+    e.marks++;
+  e.busy_until = depart;
+  if (first && ports[port_id]->IsSync())
+    port_sched[port_id]->tx.Update(port_slot[port_id], depart);
+}
+
+/** Whether flooding `pkt` at `ts` skips the ports no host was heard on. */
+static bool flood_pruned(const void *pkt, uint64_t ts) {
+  return ts >= flood_prune_ts &&
+         !simbricks::MacIsGroup(simbricks::MacKey(pkt));
+}
+
+static bool flood_to(size_t eport, size_t iport, bool prune) {
+  return eport != iport && (!prune || port_heard[eport]);
+}
+
+static void shard_hold(Shard &s, size_t src, const void *msg, size_t size) {
+  std::vector<uint64_t> &held = s.held[src];
+  size_t off = held.size();
+  held.resize(off + size / 8);
+  memcpy(&held[off], msg, size);
+}
+
+/** Take what other shards sent us up to epoch `max_epoch` off the queues,
+ * without acting on it yet. A shard that already passed the barrier may
+ * have queued messages for the next epoch, those stay queued until we get
+ * there. */
+static void shard_drain(Shard &s, uint32_t max_epoch) {
+  for (size_t src = 0; src < s.in.size(); src++) {
+    ShardQueue *q = s.in[src];
+    if (!q)
+      continue;
+    q->Drain(max_epoch, [&s, src](const ShardQueue::Msg &m) {
+      shard_hold(s, src, &m, m.size);
+    });
+  }
+}
+
+/** Act on the held messages, in the order of the shards they came from. */
+static void shard_process(Shard &s) {
+  for (std::vector<uint64_t> &held : s.held) {
+    for (size_t off = 0; off < held.size();) {
+      const ShardQueue::Msg &m =
+          *reinterpret_cast<const ShardQueue::Msg *>(&held[off]);
+      switch (m.type) {
+        case ShardQueue::kMsgPacket:
+          transmit_pkt(m.data(), m.len, m.eport, m.iport, m.ts);
+          break;
+        case ShardQueue::kMsgFlood: {
+          bool prune = flood_pruned(m.data(), m.ts);
+          for (size_t eport : s.sched.ports) {
+            if (flood_to(eport, m.iport, prune))
+              transmit_pkt(m.data(), m.len, eport, m.iport, m.ts, true);
+          }
+          break;
+        }
+        case ShardQueue::kMsgLearn:
+          s.mac_table.Learn(m.data(), m.eport, m.ts);
+          break;
+        case ShardQueue::kMsgLink:
+          static_cast<LinkPort *>(ports[m.eport])
+              ->Deliver(m.data(), m.len, m.due);
+          break;
+      }
+      off += m.size / 8;
+    }
+    held.clear();
+  }
+}
+
+static void shard_push(Shard &s, size_t dst, ShardQueue::MsgType type,
+                       size_t eport, size_t iport, const void *data,
+                       size_t len, uint64_t due = 0) {
+  // drain our own queues while waiting, the other side may be blocked on us
+  while (!s.out[dst]->Push(type, eport, iport, s.epoch, cur_ts, data, len,
+                           due))
+    shard_drain(s, s.epoch);
+  s.pushed = true;
+}
+
+static void link_send(size_t port_id, const void *data, size_t len,
+                      uint64_t ts) {
+  if (shard && port_shard[port_id] != shard->id) {
+    // the shard owning the far end queues it there
+    shard_push(*shard, port_shard[port_id], ShardQueue::kMsgLink, port_id,
+               port_id, data, len, ts);
+    return;
+  }
+  static_cast<LinkPort *>(ports[port_id])->Deliver(data, len, ts);
+}
+
+static void forward_pkt(const void *pkt_data, size_t pkt_len, size_t port_id,
+                        size_t iport_id) {
+  if (shard && port_shard[port_id] != shard->id)
+    shard_push(*shard, port_shard[port_id], ShardQueue::kMsgPacket, port_id,
+               iport_id, pkt_data, pkt_len);
+  else
+    transmit_pkt(pkt_data, pkt_len, port_id, iport_id, cur_ts);
+}
+
+/** Copies of a flooded frame are written with streaming stores, the frame
+ * itself is read from memory once and then stays in the cache. */
+static void flood_pkt(const void *pkt_data, size_t pkt_len, size_t iport) {
+  bool prune = flood_pruned(pkt_data, cur_ts);
+  if (!shard || shard_by_switch) {
+    // all ports of the switch are ours
+    for (size_t eport : switches[port_switch[iport]]->flood_ports) {
+      if (flood_to(eport, iport, prune))
+        transmit_pkt(pkt_data, pkt_len, eport, iport, cur_ts, true);
+    }
+    return;
+  }
+
+  // one copy per shard, the owner fans it out to its ports
+  for (size_t eport : shard->sched.ports) {
+    if (flood_to(eport, iport, prune))
+      transmit_pkt(pkt_data, pkt_len, eport, iport, cur_ts, true);
+  }
+  for (size_t i = 0; i < shards.size(); i++) {
+    if (i != shard->id)
+      shard_push(*shard, i, ShardQueue::kMsgFlood, 0, iport, pkt_data,
+                 pkt_len);
+  }
+}
+
+static void mac_learn(const uint8_t *src, size_t iport) {
+  if (!shard || shard_by_switch) {
+    switches[port_switch[iport]]->mac_table.Learn(src, iport, cur_ts);
+    return;
+  }
+
+  if (!shard->mac_table.Learn(src, iport, cur_ts))
+    return;
+  // replayed with the others' after the barrier
+  struct {
+    ShardQueue::Msg m;
+    uint8_t mac[8];
+  } l;
+  l.m.size = sizeof(l);
+  l.m.type = ShardQueue::kMsgLearn;
+  l.m.eport = iport;
+  l.m.ts = cur_ts;
+  memcpy(l.mac, src, 6);
+  shard_hold(*shard, shard->id, &l, sizeof(l));
+  for (size_t i = 0; i < shards.size(); i++) {
+    if (i != shard->id)
+      shard_push(*shard, i, ShardQueue::kMsgLearn, iport, iport, src, 6);
+  }
+}
+
+static int mac_lookup(const uint8_t *dst, size_t iport) {
+  if (shard && !shard_by_switch)
+    return shard->mac_table.Lookup(dst, cur_ts);
+  return switches[port_switch[iport]]->mac_table.Lookup(dst, cur_ts);
+}
+
+/* L3 routing (-R): ports configured as router interfaces route the IP
+ * packets addressed to their MAC by longest prefix match on the destination,
+ * rewriting the MAC addresses and decrementing the TTL / hop limit.
+ * Everything else is switched at L2 as usual. */
+struct RouterIf {
+  uint64_t mac;  // MacKey(), 0 if the port is not an interface
+  uint32_t ip4;  // answered ARP requests for it, 0 for none
+};
+
+struct NextHop {
+  size_t port;
+  uint8_t mac[6];
+};
+
+/** Routing table of one logical switch, its routes only leave through its
+ * own interfaces. */
+struct Router {
+  // next hops sharing the traffic of a route, the tables map to index + 1
+  std::vector<std::vector<NextHop>> groups;
+  simbricks::Lpm4 routes4;
+  simbricks::Lpm6 routes6;
+};
+
+static bool routing = false;
+static std::vector<RouterIf> router_ifs;  // indexed by port
+static std::atomic<uint64_t> route_drops{0};
+
+/** Hash of the flow a packet belongs to, to pick among equal-cost next hops
+ * without reordering flows: addresses, protocol, and TCP/UDP ports. */
+static uint64_t flow_hash(const uint8_t *ip, size_t len, bool v6) {
+  uint8_t proto;
+  size_t l4_off;
+  uint64_t h = 0;
+  auto mix = [&h](const uint8_t *p, size_t n) {
+    for (size_t i = 0; i < n; i += 4) {
+      uint32_t w;
+      memcpy(&w, p + i, 4);
+      h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+    }
+  };
+
+  if (v6) {
+    proto = ip[6];
+    l4_off = 40;
+    mix(ip + 8, 32);
+  } else {
+    proto = ip[9];
+    l4_off = (ip[0] & 0xf) * 4;
+    mix(ip + 12, 8);
+    // only first fragments carry the ports, leave them out for all
+    if ((ip[6] & 0x3f) || ip[7])
+      l4_off = len;
+  }
+  h = (h ^ proto) * 0x9E3779B97F4A7C15ULL;
+  if ((proto == IPPROTO_TCP || proto == IPPROTO_UDP) && len >= l4_off + 4)
+    mix(ip + l4_off, 4);
+  return h ^ h >> 32;
+}
+
+/** Answer an ARP request for the address of interface `iport`, broadcast or
+ * unicast (Linux probes reachability of known neighbors with unicast
+ * requests). */
+static bool arp_reply(const uint8_t *pkt, size_t len, size_t iport) {
+  const RouterIf &rif = router_ifs[iport];
+  if (!rif.ip4 || len < 42 || pkt[20] != 0 || pkt[21] != 1)
+    return false;
+  uint32_t tpa = pkt[38] << 24 | pkt[39] << 16 | pkt[40] << 8 | pkt[41];
+  if (tpa != rif.ip4)
+    return false;
+
+  uint8_t rep[60] = {0};
+  memcpy(rep, pkt + 6, 6);
+  memcpy(rep + 6, &rif.mac, 6);
+  memcpy(rep + 12, pkt + 12, 10);  // ethertype, hw/proto type and lengths
+  rep[21] = 2;
+  memcpy(rep + 22, &rif.mac, 6);
+  memcpy(rep + 28, pkt + 38, 4);
+  memcpy(rep + 32, pkt + 22, 10);  // requester's hw and proto address
+  forward_pkt(rep, sizeof(rep), iport, iport);
+  return true;
+}
+
+/** Route `pkt` if it is addressed to the router. Returns false if it should
+ * be switched instead. */
+static bool route_pkt(const void *pkt_data, size_t len, size_t iport) {
+  const RouterIf &rif = router_ifs[iport];
+  const uint8_t *pkt = static_cast<const uint8_t *>(pkt_data);
+  if (!rif.mac || len < 14)
+    return false;
+
+  size_t off = 12;
+  if (len >= 18 && pkt[12] == 0x81 && pkt[13] == 0x00)
+    off += 4;
+  uint16_t proto = pkt[off] << 8 | pkt[off + 1];
+  uint64_t dst = simbricks::MacKey(pkt);
+  if (proto == ETH_P_ARP && off == 12) {
+    if (arp_reply(pkt, len, iport))
+      return true;
+    // other ARP addressed to the router ends here, the rest is switched
+    return dst == rif.mac;
+  }
+  if (dst != rif.mac)
+    return false;
+
+  const Router &rt = *switches[port_switch[iport]]->router;
+  const uint8_t *ip = pkt + off + 2;
+  uint16_t value = 0;
+  bool v6 = false;
+  if (proto == ETH_P_IP && len >= off + 2 + 20 && (ip[0] >> 4) == 4) {
+    if (ip[8] > 1)
+      value = rt.routes4.Lookup(ip[16] << 24 | ip[17] << 16 | ip[18] << 8 |
+                             ip[19]);
+  } else if (proto == ETH_P_IPV6 && len >= off + 2 + 40) {
+    v6 = true;
+    if (ip[7] > 1)
+      value = rt.routes6.Lookup(ip + 24);
+  } else {
+    // not IP, nothing to route
+    return true;
+  }
+  if (!value) {
+    // no route or expired: there is no ICMP, just drop it
+    route_drops++;
+    return true;
+  }
+
+  const std::vector<NextHop> &group = rt.groups[value - 1];
+  const NextHop &nh = group.size() == 1
+                          ? group[0]
+                          : group[flow_hash(ip, len - off - 2, v6) %
+                                  group.size()];
+
+  static thread_local uint8_t buf[UINT16_MAX];
+  memcpy(buf, pkt, len);
+  memcpy(buf, nh.mac, 6);
+  memcpy(buf + 6, &router_ifs[nh.port].mac, 6);
+  uint8_t *out = buf + off + 2;
+  if (v6) {
+    out[7]--;
+  } else {
+    // incremental checksum update (RFC 1624) for the TTL/protocol word
+    uint16_t old_w = out[8] << 8 | out[9];
+    out[8]--;
+    uint16_t new_w = out[8] << 8 | out[9];
+    uint32_t sum = (uint16_t)~(out[10] << 8 | out[11]);
+    sum += (uint16_t)~old_w;
+    sum += new_w;
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = ~sum & 0xffff;
+    out[10] = sum >> 8;
+    out[11] = sum;
+  }
+  forward_pkt(buf, len, nh.port, iport);
+  return true;
 }
 
 static void switch_pkt(NetPort &port, size_t iport) {
@@ -376,25 +1050,22 @@ static void switch_pkt(NetPort &port, size_t iport) {
 
   if (poll == NetPort::kRxPollSuccess) {
     // Get MAC addresses
-    MAC dst((const uint8_t *)pkt_data), src((const uint8_t *)pkt_data + 6);
+    const uint8_t *dst = (const uint8_t *)pkt_data, *src = dst + 6;
+    if (!port_heard[iport])
+      port_heard[iport] = 1;
     // MAC learning
-    if (!(src == bcast_addr)) {
-      mac_table[src] = iport;
-    }
-    // L2 forwarding
-    auto i = mac_table.find(dst);
-    if (i != mac_table.end()) {
-      size_t eport = i->second;
-      if (eport != iport)
+    mac_learn(src, iport);
+    // L3 routing for interface ports, L2 forwarding for everything else
+    int eport;
+    if (routing && route_pkt(pkt_data, pkt_len, iport)) {
+      // routed, answered or dropped by the router
+    } else if ((eport = mac_lookup(dst, iport)) !=
+               simbricks::MacTable::kNoPort) {
+      if ((size_t)eport != iport)
         forward_pkt(pkt_data, pkt_len, eport, iport);
     } else {
       // Broadcast
-      for (size_t eport = 0; eport < ports.size(); eport++) {
-        if (eport != iport) {
-          // Do not forward to ingress port
-          forward_pkt(pkt_data, pkt_len, eport, iport);
-        }
-      }
+      flood_pkt(pkt_data, pkt_len, iport);
     }
   } else if (poll == NetPort::kRxPollSync) {
 #ifdef NETSWITCH_STAT
@@ -410,28 +1081,463 @@ static void switch_pkt(NetPort &port, size_t iport) {
   port.RxDone();
 }
 
+/** Poll the ports of `ps` that may have a message due. */
+static void schedule_rx(PortSchedule &ps) {
+  ps.due.clear();
+  ps.rx.CollectUpTo(cur_ts, ps.due);
+  // port order, as ties were always broken
+  std::sort(ps.due.begin(), ps.due.end());
+  for (size_t slot : ps.due) {
+    size_t port_i = ps.ports[slot];
+    NetPort &port = *ports[port_i];
+    switch_pkt(port, port_i);
+    ps.rx.Update(slot, port.IsSync() ? port.NextTimestamp()
+                                     : simbricks::TimestampHeap::kNever);
+  }
+  for (size_t port_i : ps.unsync)
+    switch_pkt(*ports[port_i], port_i);
+}
+
+static void shard_run(Shard &s, ShardBarrier &barrier) {
+  shard = &s;
+
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(s.id % std::thread::hardware_concurrency(), &cpus);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus))
+    fprintf(stderr, "shard_run: pinning shard %zu failed\n", s.id);
+
+  auto idle = [&s]() { shard_drain(s, s.epoch); };
+  // everything sent before the barrier was queued before the sender arrived
+  auto pass = [&](uint64_t val, bool &stop) {
+    uint64_t min = barrier.Wait(s.id, val, stop, idle);
+    shard_drain(s, s.epoch);
+    s.epoch++;
+    s.pushed = false;
+    return min;
+  };
+  while (true) {
+    // Sync own interfaces
+    for (size_t port_i : s.sched.ports)
+      ports[port_i]->Sync(cur_ts);
+
+    // Switch packets
+    uint64_t min_ts;
+    do {
+      schedule_rx(s.sched);
+      shard_drain(s, s.epoch);
+      schedule_tx(s.sched);
+      min_ts = s.sched.Next();
+    } while (!exiting && (min_ts <= cur_ts));
+
+    // Agree on the next timestamp, then process what the other shards sent
+    // for this one (still at this timestamp).
+    bool stop;
+    if (egress_timed || link_cross_shard) {
+      // packets from other shards only get their departure or arrival time
+      // once processed, and may go on over a link to yet another shard:
+      // repeat until nobody sent anything before agreeing on the next
+      // timestamp. The same barrier does both, a shard that sent something
+      // passes 0 and everyone else the next timestamp + 1, so a timestamp
+      // without cross-shard traffic costs a single round-trip.
+      uint64_t min;
+      while ((min = pass(s.pushed ? 0 : min_ts + (min_ts < ULLONG_MAX),
+                         stop)) == 0) {
+        shard_process(s);
+        schedule_tx(s.sched);
+        min_ts = s.sched.Next();
+      }
+      min_ts = min - (min < ULLONG_MAX);
+    } else {
+      min_ts = pass(min_ts, stop);
+    }
+    shard_process(s);
+    if (stop)
+      break;
+
+    // Update cur_ts
+    if (min_ts < ULLONG_MAX) {
+      cur_ts = min_ts;
+    }
+  }
+}
+
+static void run_sharded(size_t n_shards) {
+  shard_by_switch = switches.size() > 1;
+  size_t units = shard_by_switch ? switches.size() : ports.size();
+  if (n_shards > units)
+    n_shards = units;
+
+  shards.resize(n_shards);
+  for (size_t i = 0; i < n_shards; i++) {
+    shards[i] = new Shard;
+    shards[i]->id = i;
+    shards[i]->in.resize(n_shards);
+    shards[i]->out.resize(n_shards);
+    shards[i]->held.resize(n_shards);
+    // every learn is replayed (no refresh interval), so the copies age
+    // exactly like the single table
+    if (!shard_by_switch)
+      shards[i]->mac_table = switches[0]->mac_table;
+  }
+  for (size_t i = 0; i < n_shards; i++) {
+    for (size_t j = 0; j < n_shards; j++) {
+      if (i != j) {
+        ShardQueue *q = new ShardQueue;
+        shards[i]->out[j] = q;
+        shards[j]->in[i] = q;
+      }
+    }
+  }
+  port_shard.resize(ports.size());
+  for (size_t port_i = 0; port_i < ports.size(); port_i++) {
+    size_t unit = shard_by_switch ? port_switch[port_i] : port_i;
+    port_shard[port_i] = unit % n_shards;
+    shards[unit % n_shards]->sched.ports.push_back(port_i);
+  }
+  for (size_t port_i = 0; port_i < ports.size(); port_i++) {
+    LinkPort *link = dynamic_cast<LinkPort *>(ports[port_i]);
+    if (link && port_shard[port_i] != port_shard[link->Peer()])
+      link_cross_shard = true;
+  }
+  for (Shard *sh : shards)
+    schedule_init(sh->sched);
+
+  ShardBarrier barrier(n_shards);
+#ifdef NETSWITCH_STAT
+  std::mutex stat_mtx;
+  uint64_t totals[6] = {0};
+#endif
+  auto worker = [&](size_t i) {
+    shard_run(*shards[i], barrier);
+#ifdef NETSWITCH_STAT
+    std::lock_guard<std::mutex> lock(stat_mtx);
+    totals[0] += d2n_poll_total;
+    totals[1] += d2n_poll_suc;
+    totals[2] += d2n_poll_sync;
+    totals[3] += s_d2n_poll_total;
+    totals[4] += s_d2n_poll_suc;
+    totals[5] += s_d2n_poll_sync;
+#endif
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < n_shards; i++)
+    threads.emplace_back(worker, i);
+  // the main thread runs shard 0 and keeps its own counters
+  shard_run(*shards[0], barrier);
+  for (std::thread &t : threads)
+    t.join();
+  shard = nullptr;
+
+#ifdef NETSWITCH_STAT
+  d2n_poll_total += totals[0];
+  d2n_poll_suc += totals[1];
+  d2n_poll_sync += totals[2];
+  s_d2n_poll_total += totals[3];
+  s_d2n_poll_suc += totals[4];
+  s_d2n_poll_sync += totals[5];
+#endif
+}
+
+static bool parse_mac(const char *s, uint8_t *mac) {
+  return sscanf(s, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", mac, mac + 1, mac + 2,
+                mac + 3, mac + 4, mac + 5) == 6;
+}
+
+/** Read the routing configuration, one statement per line ('#' starts a
+ * comment), ports numbered in the order they were added:
+ *   interface PORT MAC [IPV4-ADDRESS]
+ *   route PREFIX/LEN PORT NEXTHOP-MAC [PORT NEXTHOP-MAC ...]
+ * Interfaces route packets sent to their MAC and answer ARP requests for
+ * their address. Routes are IPv4 or IPv6, packets leave through an
+ * interface, with several next hops flows are spread over them. With a
+ * topology (-T) each logical switch has its own routing table: a route
+ * belongs to the switch of its next hop interfaces, which must all be on the
+ * same one, and other switches are reached through links as next hops. */
+static bool load_routes(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror("load_routes: fopen failed");
+    return false;
+  }
+
+  router_ifs.assign(ports.size(), RouterIf{0, 0});
+  char line[4096];
+  unsigned lineno = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), f)) {
+    lineno++;
+    char *comment = strchr(line, '#');
+    if (comment)
+      *comment = 0;
+
+    char *save;
+    char *cmd = strtok_r(line, " \t\r\n", &save);
+    if (!cmd)
+      continue;
+
+    if (!strcmp(cmd, "interface")) {
+      char *port_s = strtok_r(nullptr, " \t\r\n", &save);
+      char *mac_s = strtok_r(nullptr, " \t\r\n", &save);
+      char *ip_s = strtok_r(nullptr, " \t\r\n", &save);
+      size_t port_i = port_s ? strtoul(port_s, nullptr, 0) : ports.size();
+      uint8_t mac[6];
+      struct in_addr ip4;
+      if (port_i >= ports.size() || !mac_s || !parse_mac(mac_s, mac) ||
+          (ip_s && inet_pton(AF_INET, ip_s, &ip4) != 1)) {
+        fprintf(stderr, "%s:%u: bad interface\n", path, lineno);
+        ok = false;
+        break;
+      }
+      router_ifs[port_i].mac = simbricks::MacKey(mac);
+      Switch *sw = switches[port_switch[port_i]];
+      if (!sw->router)
+        sw->router = new Router;
+      router_ifs[port_i].ip4 = ip_s ? ntohl(ip4.s_addr) : 0;
+    } else if (!strcmp(cmd, "route")) {
+      char *prefix_s = strtok_r(nullptr, " \t\r\n", &save);
+      char *len_s = prefix_s ? strchr(prefix_s, '/') : nullptr;
+      if (len_s)
+        *len_s++ = 0;
+      unsigned len = len_s ? strtoul(len_s, nullptr, 0) : 0;
+      uint8_t prefix[16];
+      bool v6 = prefix_s && strchr(prefix_s, ':');
+      if (!len_s ||
+          inet_pton(v6 ? AF_INET6 : AF_INET, prefix_s, prefix) != 1 ||
+          len > (v6 ? 128 : 32)) {
+        fprintf(stderr, "%s:%u: bad prefix\n", path, lineno);
+        ok = false;
+        break;
+      }
+
+      std::vector<NextHop> group;
+      char *port_s;
+      while ((port_s = strtok_r(nullptr, " \t\r\n", &save))) {
+        char *mac_s = strtok_r(nullptr, " \t\r\n", &save);
+        NextHop nh;
+        nh.port = strtoul(port_s, nullptr, 0);
+        if (nh.port >= ports.size() || !router_ifs[nh.port].mac ||
+            !mac_s || !parse_mac(mac_s, nh.mac) ||
+            (!group.empty() &&
+             port_switch[nh.port] != port_switch[group[0].port])) {
+          ok = false;
+          break;
+        }
+        group.push_back(nh);
+      }
+      Router *rt =
+          ok && !group.empty() ? switches[port_switch[group[0].port]]->router
+                               : nullptr;
+      if (!rt || rt->groups.size() >= simbricks::Lpm4::kMaxValue) {
+        fprintf(stderr,
+                "%s:%u: bad next hops (need interface ports of one switch "
+                "and MACs)\n",
+                path, lineno);
+        ok = false;
+        break;
+      }
+      rt->groups.push_back(group);
+      uint16_t value = rt->groups.size();
+      if (v6)
+        rt->routes6.Add(prefix, len, value);
+      else
+        rt->routes4.Add(prefix[0] << 24 | prefix[1] << 16 | prefix[2] << 8 |
+                            prefix[3],
+                        len, value);
+    } else {
+      fprintf(stderr, "%s:%u: cannot parse: %s\n", path, lineno, cmd);
+      ok = false;
+    }
+  }
+  fclose(f);
+
+  if (ok) {
+    size_t n_routes = 0;
+    for (Switch *sw : switches) {
+      if (!sw->router)
+        continue;
+      sw->router->routes4.Build();
+      sw->router->routes6.Build();
+      n_routes += sw->router->groups.size();
+    }
+    routing = true;
+    fprintf(stderr, "Switch: %zu routes loaded\n", n_routes);
+  }
+  return ok;
+}
+
+static int find_switch(const char *name) {
+  for (size_t i = 0; i < switches.size(); i++) {
+    if (switches[i]->name == name)
+      return i;
+  }
+  return -1;
+}
+
+/** Read a topology file with one statement per line ('#' starts a comment):
+ *   switch NAME
+ *   connect SWITCH SOCKET           (like -s, for SWITCH)
+ *   listen SWITCH SOCKET            (like -h, for SWITCH)
+ *   link SWITCH-A SWITCH-B [LATENCY-NS]
+ * Switches have to be declared before they are used. Links default to the
+ * Ethernet latency (-E). */
+static bool load_topology(const char *path, int sync, uint64_t limit,
+                          uint64_t ecn_thresh, uint64_t rate) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror("load_topology: fopen failed");
+    return false;
+  }
+
+  char line[1024];
+  unsigned lineno = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), f)) {
+    lineno++;
+    char *comment = strchr(line, '#');
+    if (comment)
+      *comment = 0;
+
+    char cmd[32], a[256], b[512];
+    unsigned long long latency;
+    int n = sscanf(line, "%31s %255s %511s %llu", cmd, a, b, &latency);
+    if (n <= 0)
+      continue;
+
+    if (!strcmp(cmd, "switch") && n == 2) {
+      if (find_switch(a) >= 0) {
+        fprintf(stderr, "%s:%u: duplicate switch %s\n", path, lineno, a);
+        ok = false;
+        break;
+      }
+      Switch *sw = new Switch;
+      sw->name = a;
+      switches.push_back(sw);
+    } else if ((!strcmp(cmd, "connect") || !strcmp(cmd, "listen")) &&
+               n == 3) {
+      int sw_i = find_switch(a);
+      if (sw_i < 0) {
+        fprintf(stderr, "%s:%u: unknown switch %s\n", path, lineno, a);
+        ok = false;
+        break;
+      }
+      char *sock = strdup(b);
+      NetPort *port;
+      if (cmd[0] == 'c') {
+        port = new NetPort(sock, sync, &netParams);
+        fprintf(stderr, "Switch %s connecting to: %s\n", a, sock);
+      } else {
+        port = new NetListenPort(sock, sync, &netParams);
+        fprintf(stderr, "Switch %s listening on: %s\n", a, sock);
+      }
+      add_port(port, sw_i, limit, ecn_thresh, rate);
+    } else if (!strcmp(cmd, "link") && (n == 3 || n == 4)) {
+      int sw_a = find_switch(a);
+      int sw_b = find_switch(b);
+      if (sw_a < 0 || sw_b < 0 || sw_a == sw_b) {
+        fprintf(stderr, "%s:%u: bad link %s - %s\n", path, lineno, a, b);
+        ok = false;
+        break;
+      }
+      uint64_t lat = n == 4 ? latency * 1000ULL : netParams.link_latency;
+      LinkPort *port_a = new LinkPort(std::string(a) + "->" + b, lat);
+      LinkPort *port_b = new LinkPort(std::string(b) + "->" + a, lat);
+      size_t id_a = add_port(port_a, sw_a, limit, ecn_thresh, rate);
+      size_t id_b = add_port(port_b, sw_b, limit, ecn_thresh, rate);
+      port_a->Connect(id_a, id_b);
+      port_b->Connect(id_b, id_a);
+    } else {
+      fprintf(stderr, "%s:%u: cannot parse: %s", path, lineno, line);
+      ok = false;
+    }
+  }
+  fclose(f);
+  return ok;
+}
+
+/** Block the links that are not on a (breadth-first) spanning tree of the
+ * switches, and flood only on the remaining ports. Unicast forwarding then
+ * also never learns an address on a blocked link. */
+static void block_loops() {
+  std::vector<bool> seen(switches.size(), false);
+  std::vector<bool> tree(ports.size(), false);
+  std::vector<size_t> work;
+  for (size_t root = 0; root < switches.size(); root++) {
+    if (seen[root])
+      continue;
+    seen[root] = true;
+    work.assign(1, root);
+    for (size_t w = 0; w < work.size(); w++) {
+      for (size_t port_i : switches[work[w]]->ports) {
+        LinkPort *link = dynamic_cast<LinkPort *>(ports[port_i]);
+        if (!link || tree[port_i] || link->Blocked())
+          continue;
+        size_t peer = link->Peer();
+        size_t peer_sw = port_switch[peer];
+        if (seen[peer_sw]) {
+          fprintf(stderr, "Switch: blocking link %s to break a loop\n",
+                  link->Name());
+          link->Block();
+          static_cast<LinkPort *>(ports[peer])->Block();
+        } else {
+          seen[peer_sw] = true;
+          tree[port_i] = tree[peer] = true;
+          work.push_back(peer_sw);
+        }
+      }
+    }
+  }
+
+  for (Switch *sw : switches) {
+    sw->flood_ports.clear();
+    for (size_t port_i : sw->ports) {
+      LinkPort *link = dynamic_cast<LinkPort *>(ports[port_i]);
+      if (!link || !link->Blocked())
+        sw->flood_ports.push_back(port_i);
+    }
+  }
+}
+
 int main(int argc, char *argv[]) {
   int c;
   int bad_option = 0;
   int sync_eth = 1;
-  pcap_t *pc = nullptr;
+  size_t n_shards = 1;
+  uint64_t queue_limit = 1024 * 1024;
+  uint64_t ecn_thresh = 0;
+  uint64_t line_rate = 0;
+  uint64_t mac_age = simbricks::MacTable::kDefaultAgeTime;
+  const char *topo_path = nullptr;
+  const char *route_path = nullptr;
+  struct SimbricksCaptureParams cap_params;
+  // ports from the command line, with the queue settings in effect for them
+  struct CmdPort {
+    NetPort *port;
+    uint64_t limit;
+    uint64_t ecn_thresh;
+    uint64_t rate;
+  };
+  std::vector<CmdPort> cmd_ports;
 
   SimbricksNetIfDefaultParams(&netParams);
+  SimbricksCaptureDefaultParams(&cap_params);
 
   // Parse command line argument
-  while ((c = getopt(argc, argv, "s:h:uS:E:p:")) != -1 && !bad_option) {
+  while ((c = getopt(argc, argv, "s:h:uS:E:p:a:t:q:K:r:T:P:R:")) != -1 &&
+         !bad_option) {
     switch (c) {
       case 's': {
-        NetPort *port = new NetPort(optarg, sync_eth);
+        NetPort *port = new NetPort(optarg, sync_eth, &netParams);
         fprintf(stderr, "Switch connecting to: %s\n", optarg);
-        ports.push_back(port);
+        cmd_ports.push_back({port, queue_limit, ecn_thresh, line_rate});
         break;
       }
 
       case 'h': {
-        NetListenPort *port = new NetListenPort(optarg, sync_eth);
+        NetListenPort *port = new NetListenPort(optarg, sync_eth, &netParams);
         fprintf(stderr, "Switch listening on: %s\n", optarg);
-        ports.push_back(port);
+        cmd_ports.push_back({port, queue_limit, ecn_thresh, line_rate});
         break;
       }
 
@@ -448,14 +1554,43 @@ int main(int argc, char *argv[]) {
         break;
 
       case 'p':
-        pc = pcap_open_dead_with_tstamp_precision(DLT_EN10MB, 65535,
-                                                  PCAP_TSTAMP_PRECISION_NANO);
-        if (pc == nullptr) {
-          perror("pcap_open_dead failed");
-          return EXIT_FAILURE;
-        }
+        if (SimbricksCaptureParseOpt(&cap_params, optarg))
+          bad_option = 1;
+        break;
+
+      case 'a':
+        mac_age = strtoull(optarg, NULL, 0) * 1000ULL;
+        break;
+
+      case 't':
+        n_shards = strtoul(optarg, NULL, 0);
+        if (n_shards < 1)
+          n_shards = 1;
+        break;
+
+      // -q, -K and -r apply to the ports following them
+      case 'q':
+        queue_limit = strtoull(optarg, NULL, 0);
+        break;
+
+      case 'K':
+        ecn_thresh = strtoull(optarg, NULL, 0);
+        break;
+
+      case 'r':
+        line_rate = strtod(optarg, NULL) * 1000000000ULL;
+        break;
 
-        dumpfile = pcap_dump_open(pc, optarg);
+      case 'T':
+        topo_path = optarg;
+        break;
+
+      case 'P':
+        flood_prune_ts = strtoull(optarg, NULL, 0) * 1000ULL;
+        break;
+
+      case 'R':
+        route_path = optarg;
         break;
 
       default:
@@ -465,13 +1600,47 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  if (ports.empty() || bad_option) {
+  // topology ports get the final settings, -s/-h ports join the first switch
+  if (topo_path && !bad_option &&
+      !load_topology(topo_path, sync_eth, queue_limit, ecn_thresh,
+                     line_rate))
+    return EXIT_FAILURE;
+  if (switches.empty()) {
+    Switch *sw = new Switch;
+    sw->name = "switch0";
+    switches.push_back(sw);
+  }
+  for (const CmdPort &cp : cmd_ports)
+    add_port(cp.port, 0, cp.limit, cp.ecn_thresh, cp.rate);
+  for (Switch *sw : switches)
+    sw->mac_table.SetAgeTime(mac_age);
+  block_loops();
+
+  std::vector<NetPort *> ext_ports;
+  for (NetPort *port : ports) {
+    if (!dynamic_cast<LinkPort *>(port))
+      ext_ports.push_back(port);
+  }
+
+  if (ext_ports.empty() || bad_option) {
     fprintf(stderr,
             "Usage: net_switch [-S SYNC-PERIOD] [-E ETH-LATENCY] "
+            "[-a MAC-AGING-TIME] [-t THREADS] [-p PCAP-FILE[,OPTS]] "
+            "[-q QUEUE-BYTES] [-K ECN-THRESH-BYTES] [-r LINE-RATE-GBPS] "
+            "[-T TOPOLOGY-FILE] [-P FLOOD-PRUNE-TIME] [-R ROUTE-FILE] "
             "-s SOCKET-A [-s SOCKET-B ...]\n");
     return EXIT_FAILURE;
   }
 
+  if (route_path && !load_routes(route_path))
+    return EXIT_FAILURE;
+
+  if (cap_params.path &&
+      !(capture = SimbricksCaptureOpen(&cap_params))) {
+    fprintf(stderr, "opening capture %s failed\n", cap_params.path);
+    return EXIT_FAILURE;
+  }
+
   signal(SIGINT, sigint_handler);
   signal(SIGTERM, sigint_handler);
   signal(SIGUSR1, sigusr1_handler);
@@ -480,10 +1649,17 @@ int main(int argc, char *argv[]) {
   signal(SIGUSR2, sigusr2_handler);
 #endif
 
-  if (!ConnectAll(ports))
+  if (!netport::ConnectAll(ext_ports))
     return EXIT_FAILURE;
 
   printf("start polling\n");
+  if (n_shards > 1) {
+    run_sharded(n_shards);
+  } else {
+    for (size_t port_i = 0; port_i < ports.size(); port_i++)
+      schedule.ports.push_back(port_i);
+    schedule_init(schedule);
+  }
   while (!exiting) {
     // Sync all interfaces
     for (auto port : ports)
@@ -492,15 +1668,9 @@ int main(int argc, char *argv[]) {
     // Switch packets
     uint64_t min_ts;
     do {
-      min_ts = ULLONG_MAX;
-      for (size_t port_i = 0; port_i < ports.size(); port_i++) {
-        auto &port = *ports[port_i];
-        switch_pkt(port, port_i);
-        if (port.IsSync()) {
-          uint64_t ts = port.NextTimestamp();
-          min_ts = ts < min_ts ? ts : min_ts;
-        }
-      }
+      schedule_rx(schedule);
+      schedule_tx(schedule);
+      min_ts = schedule.Next();
     } while (!exiting && (min_ts <= cur_ts));
 
     // Update cur_ts
@@ -521,7 +1691,20 @@ int main(int argc, char *argv[]) {
           s_d2n_poll_suc, (double)s_d2n_poll_suc / s_d2n_poll_total);
   fprintf(stderr, "%65s: %22lu  sync_rate: %f\n", "s_d2n_poll_sync",
           s_d2n_poll_sync, (double)s_d2n_poll_sync / s_d2n_poll_suc);
+
+  for (size_t port_i = 0; port_i < ports.size(); port_i++) {
+    fprintf(stderr, "[Port %zu ]: egress drops: %lu  ecn marks: %lu\n",
+            port_i, egress[port_i]->drops, egress[port_i]->marks);
+    LinkPort *link = dynamic_cast<LinkPort *>(ports[port_i]);
+    if (link)
+      fprintf(stderr, "[Port %zu ]: link drops: %lu\n", port_i,
+              link->Drops());
+  }
+  if (routing)
+    fprintf(stderr, "route drops: %lu\n", route_drops.load());
 #endif
 
+  if (capture)
+    SimbricksCaptureClose(capture);
   return 0;
 }
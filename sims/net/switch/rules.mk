@@ -28,7 +28,7 @@ OBJS := $(d)net_switch.o
 
 $(OBJS): CPPFLAGS := $(CPPFLAGS) -I$(d)include/
 
-$(bin_net_switch): $(OBJS) $(lib_netif) $(lib_nicif)  $(lib_base) -lpcap
+$(bin_net_switch): $(OBJS) $(lib_netport) $(lib_netif) $(lib_nicif)  $(lib_base) -lpthread
 
 CLEAN := $(bin_net_switch) $(OBJS)
 ALL := $(bin_net_switch)
@@ -31,6 +31,7 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <climits>
@@ -41,11 +42,11 @@
 #include <fstream>
 #include <iostream>
 #include <queue>
-#include <set>
 #include <string>
 #include <vector>
 
 #include <simbricks/base/cxxatomicfix.h>
+#include <simbricks/base/ts_heap.hh>
 extern "C" {
 #include <simbricks/network/if.h>
 };
@@ -61,6 +62,10 @@ static const int log_wait_limit_ms = 10;  // 10ms
 static ts_t cur_ts = 0;
 static int exiting = 0;
 static std::vector<struct SimbricksNetIf> nsifs;
+// input timestamp of each peer as of its last poll
+static simbricks::TimestampHeap peer_ts;
+static std::vector<int> unsync_peers;
+static std::vector<size_t> due_peers;
 static std::vector<int> tofino_fds;
 static std::ifstream log_ifs;
 static std::string log_line;  // NOLINT(runtime/string)
@@ -152,11 +157,7 @@ static std::vector<struct packet_info> get_tofino_output() {
 }
 
 static ts_t get_min_peer_time() {
-  std::set<uint64_t> peer_times;
-  for (auto &nsif : nsifs) {
-    peer_times.insert(SimbricksNetIfInTimestamp(&nsif));
-  }
-  return *peer_times.begin();
+  return peer_ts.Min();
 }
 
 static void switch_to_dev(int port) {
@@ -259,6 +260,22 @@ static void recv_from_peer(int port) {
   SimbricksNetIfInDone(nsif, msg_from);
 }
 
+/** Poll the peers that may have a message due, and the unsynchronized ones
+ * which can have one at any time. */
+static void recv_from_peers() {
+  due_peers.clear();
+  peer_ts.CollectUpTo(cur_ts, due_peers);
+  std::sort(due_peers.begin(), due_peers.end());
+  for (size_t port : due_peers) {
+    recv_from_peer(port);
+    peer_ts.Update(port, SimbricksNetIfInTimestamp(&nsifs[port]));
+  }
+  for (int port : unsync_peers) {
+    recv_from_peer(port);
+    peer_ts.Update(port, SimbricksNetIfInTimestamp(&nsifs[port]));
+  }
+}
+
 static void process_event_queue() {
   while (!event_queue.empty()) {
     const struct event &e = event_queue.top();
@@ -375,6 +392,12 @@ int main(int argc, char *argv[]) {
     tofino_fds.push_back(fd);
   }
 
+  peer_ts.Reset(nsifs.size(), 0);
+  for (size_t port = 0; port < nsifs.size(); port++) {
+    if (!SimbricksBaseIfSyncEnabled(&nsifs[port].base))
+      unsync_peers.push_back(port);
+  }
+
   fprintf(stderr, "start polling\n");
   while (!exiting) {
     // Sync all interfaces
@@ -388,9 +411,7 @@ int main(int argc, char *argv[]) {
     // Switch packets
     ts_t min_ts = 0;
     while (!exiting && min_ts <= cur_ts) {
-      for (int port = 0; port < (int)nsifs.size(); port++) {
-        recv_from_peer(port);
-      }
+      recv_from_peers();
       min_ts = get_min_peer_time();
       process_event_queue();
     }
@@ -26,7 +26,6 @@
 #include <fcntl.h>
 #include <linux/if.h>
 #include <linux/if_tun.h>
-#include <pcap/pcap.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
@@ -36,11 +35,12 @@
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <simbricks/network/capture.h>
 #include <simbricks/network/if.h>
 
 static uint64_t cur_ts;
 static int exiting = 0;
-static pcap_dumper_t *dumpfile = NULL;
+static struct SimbricksCapture *capture = NULL;
 
 static void sigint_handler(int dummy) {
   exiting = 1;
@@ -50,13 +50,13 @@ static void sigusr1_handler(int dummy) {
   fprintf(stderr, "main_time = %lu\n", cur_ts);
 }
 
-static void move_pkt(struct SimbricksNetIf *from, struct SimbricksNetIf *to) {
+static void move_pkt(struct SimbricksNetIf *from, struct SimbricksNetIf *to,
+                     int from_port) {
   volatile union SimbricksProtoNetMsg *msg_from =
       SimbricksNetIfInPoll(from, cur_ts);
   volatile union SimbricksProtoNetMsg *msg_to;
   volatile struct SimbricksProtoNetMsgPacket *tx;
   volatile struct SimbricksProtoNetMsgPacket *rx;
-  struct pcap_pkthdr ph;
   uint8_t type;
 
   if (msg_from == NULL)
@@ -66,15 +66,10 @@ static void move_pkt(struct SimbricksNetIf *from, struct SimbricksNetIf *to) {
   if (type == SIMBRICKS_PROTO_NET_MSG_PACKET) {
     tx = &msg_from->packet;
 
-    // log to pcap file if initialized
-    if (dumpfile) {
-      memset(&ph, 0, sizeof(ph));
-      ph.ts.tv_sec = cur_ts / 1000000000000ULL;
-      ph.ts.tv_usec = (cur_ts % 1000000000000ULL) / 1000ULL;
-      ph.caplen = tx->len;
-      ph.len = tx->len;
-      pcap_dump((unsigned char *)dumpfile, &ph, (unsigned char *)tx->data);
-    }
+    // capture if enabled, ports 0 and 1 give the direction
+    if (capture)
+      SimbricksCapturePacket(capture, cur_ts, (const void *)tx->data, tx->len,
+                             from_port, !from_port);
 
     msg_to = SimbricksNetIfOutAlloc(to, cur_ts);
     if (msg_to != NULL) {
@@ -101,14 +96,15 @@ int main(int argc, char *argv[]) {
   struct SimbricksNetIf nsif_a, nsif_b;
   uint64_t ts_a, ts_b;
   int sync_a, sync_b;
-  pcap_t *pc = NULL;
+  struct SimbricksCaptureParams cap_params;
 
   SimbricksNetIfDefaultParams(&params);
+  SimbricksCaptureDefaultParams(&cap_params);
 
   if (argc < 3 || argc > 7) {
     fprintf(stderr,
             "Usage: net_wire SOCKET-A SOCKET-B [SYNC-MODE (ignored)] "
-            "[SYNC-PERIOD] [ETH-LATENCY] [PCAP-FILE]\n");
+            "[SYNC-PERIOD] [ETH-LATENCY] [PCAP-FILE[,OPTS]]\n");
     return EXIT_FAILURE;
   }
 
@@ -123,14 +119,11 @@ int main(int argc, char *argv[]) {
     params.link_latency = strtoull(argv[5], NULL, 0) * 1000ULL;
 
   if (argc >= 7) {
-    pc = pcap_open_dead_with_tstamp_precision(DLT_EN10MB, 65535,
-                                              PCAP_TSTAMP_PRECISION_NANO);
-    if (pc == NULL) {
-      perror("pcap_open_dead failed");
+    if (SimbricksCaptureParseOpt(&cap_params, argv[6]) ||
+        !(capture = SimbricksCaptureOpen(&cap_params))) {
+      fprintf(stderr, "opening capture %s failed\n", argv[6]);
       return EXIT_FAILURE;
     }
-
-    dumpfile = pcap_dump_open(pc, argv[6]);
   }
 
   sync_a = sync_b = 1;
@@ -153,8 +146,8 @@ int main(int argc, char *argv[]) {
     }
 
     do {
-      move_pkt(&nsif_a, &nsif_b);
-      move_pkt(&nsif_b, &nsif_a);
+      move_pkt(&nsif_a, &nsif_b, 0);
+      move_pkt(&nsif_b, &nsif_a, 1);
       ts_a = SimbricksNetIfInTimestamp(&nsif_a);
       ts_b = SimbricksNetIfInTimestamp(&nsif_b);
     } while (!exiting &&
@@ -168,7 +161,7 @@ int main(int argc, char *argv[]) {
       cur_ts = ts_b;
   }
 
-  if (dumpfile)
-    pcap_dump_close(dumpfile);
+  if (capture)
+    SimbricksCaptureClose(capture);
   return 0;
 }
@@ -10,7 +10,7 @@ static bool debug_enable = false;
 class Gem5DMAOp : public nicbm::DMAOp, public nicbm::TimedEvent {
   public:
     EventFunctionWrapper &ev_;
-    Gem5DMAOp(EventFunctionWrapper &ev) : ev_(ev) {}
+    Gem5DMAOp(EventFunctionWrapper &ev) : ev_(ev) { kind_ = kEventDma; }
     virtual ~Gem5DMAOp() = default;
 };
 
@@ -33,6 +33,7 @@ void IGbE::SetupIntro(struct SimbricksProtoPcieDevIntro &di)
 void IGbE::RegRead(uint8_t bar, uint64_t addr, void *dest,
              size_t len)
 {
+    settleIdle(0);
     read(addr, len, dest);
     // TODO delay!
 }
@@ -40,13 +41,16 @@ void IGbE::RegRead(uint8_t bar, uint64_t addr, void *dest,
 void IGbE::RegWrite(uint8_t bar, uint64_t addr, const void *src,
               size_t len)
 {
+    settleIdle(0);
     write(addr, len, src);
     // TODO delay!
 }
 
 void IGbE::DmaComplete(nicbm::DMAOp &op)
 {
-    Gem5DMAOp *dma = dynamic_cast <Gem5DMAOp *>(&op);
+    settleIdle(0);
+    // all DMAs are issued by dmaRead/dmaWrite
+    Gem5DMAOp *dma = static_cast <Gem5DMAOp *>(&op);
     if (dma->write_) {
         delete[] ((uint8_t *) dma->data_);
     } else {
@@ -61,7 +65,8 @@ void IGbE::DmaComplete(nicbm::DMAOp &op)
 
 void IGbE::EthRx(uint8_t port, const void *data, size_t len)
 {
-    EthPacketPtr pp = std::make_shared<EthPacketData>(len);
+    settleIdle(0);
+    EthPacketPtr pp = EthPacketData::alloc(len);
     pp->length = len;
     memcpy(pp->data, data, len);
 
@@ -70,18 +75,72 @@ void IGbE::EthRx(uint8_t port, const void *data, size_t len)
 
 void IGbE::Timed(nicbm::TimedEvent &te)
 {
-    if (Gem5DMAOp *dma = dynamic_cast <Gem5DMAOp *>(&te)) {
-        runner_->IssueDma(*dma);
-    } else if (EventFunctionWrapper *evw =
-            dynamic_cast <EventFunctionWrapper *>(&te)) {
-        evw->sched = false;
-        evw->callback();
-    } else {
+    settleIdle(te.priority_);
+    switch (te.kind_) {
+      case kEventDma:
+        runner_->IssueDma(static_cast <Gem5DMAOp &>(te));
+        break;
+
+      case kEventFunction: {
+        EventFunctionWrapper &evw = static_cast <EventFunctionWrapper &>(te);
+        evw.sched = false;
+        evw.callback();
+        break;
+      }
+
+      default:
         abort();
     }
 }
 
 
+/******************************************************************************/
+/* packet buffer pool */
+
+static const unsigned kPktSmall = 2048;
+static const unsigned kPktLarge = 16384;
+static const unsigned kPktChunk = 64;
+
+static EthPacketData *pktFreeSmall = nullptr;
+static EthPacketData *pktFreeLarge = nullptr;
+
+void EthPacketData::refill(EthPacketData *&freeList, unsigned cap)
+{
+    // the pool only grows, chunks are kept for the lifetime of the process
+    EthPacketData *pds = new EthPacketData[kPktChunk];
+    uint8_t *bufs = new uint8_t[(size_t) kPktChunk * cap];
+    for (unsigned i = 0; i < kPktChunk; i++) {
+        pds[i].capacity = cap;
+        pds[i].data = bufs + (size_t) i * cap;
+        pds[i].nextFree = freeList;
+        freeList = &pds[i];
+    }
+}
+
+EthPacketPtr EthPacketData::alloc(unsigned len)
+{
+    if (len > kPktLarge)
+        panic("EthPacketData::alloc: packet too large (%u)\n", len);
+
+    EthPacketData *&freeList = len <= kPktSmall ? pktFreeSmall : pktFreeLarge;
+    if (!freeList)
+        refill(freeList, len <= kPktSmall ? kPktSmall : kPktLarge);
+
+    EthPacketData *pd = freeList;
+    freeList = pd->nextFree;
+    pd->nextFree = nullptr;
+    pd->length = 0;
+    return EthPacketPtr(pd);
+}
+
+void EthPacketData::release()
+{
+    EthPacketData *&freeList =
+        capacity == kPktSmall ? pktFreeSmall : pktFreeLarge;
+    nextFree = freeList;
+    freeList = this;
+}
+
 /******************************************************************************/
 /* gem5-ish APIs */
 
@@ -272,7 +272,7 @@ class IpPtr
 
     void set(const EthPacketPtr &ptr)
     {
-        p = 0;
+        p = nullptr;
         eth_hdr_vlan = false;
 
         if (ptr) {
@@ -285,9 +285,9 @@ class IpPtr
     }
 
   public:
-    IpPtr() : p(0), eth_hdr_vlan(false) {}
-    IpPtr(const EthPacketPtr &ptr) : p(0), eth_hdr_vlan(false) { set(ptr); }
-    IpPtr(const EthPtr &ptr) : p(0), eth_hdr_vlan(false) { set(ptr.p); }
+    IpPtr() : p(), eth_hdr_vlan(false) {}
+    IpPtr(const EthPacketPtr &ptr) : p(), eth_hdr_vlan(false) { set(ptr); }
+    IpPtr(const EthPtr &ptr) : p(), eth_hdr_vlan(false) { set(ptr.p); }
     IpPtr(const IpPtr &ptr) : p(ptr.p), eth_hdr_vlan(ptr.eth_hdr_vlan) { }
 
     IpHdr *get() { return (IpHdr *)(p->data + sizeof(eth_hdr) +
@@ -383,7 +383,7 @@ class Ip6Ptr
 
     void set(const EthPacketPtr &ptr)
     {
-        p = 0;
+        p = nullptr;
         eth_hdr_vlan = false;
 
         if (ptr) {
@@ -396,9 +396,9 @@ class Ip6Ptr
     }
 
   public:
-    Ip6Ptr() : p(0), eth_hdr_vlan(false) {}
-    Ip6Ptr(const EthPacketPtr &ptr) : p(0), eth_hdr_vlan(false) { set(ptr); }
-    Ip6Ptr(const EthPtr &ptr) : p(0), eth_hdr_vlan(false) { set(ptr.p); }
+    Ip6Ptr() : p(), eth_hdr_vlan(false) {}
+    Ip6Ptr(const EthPacketPtr &ptr) : p(), eth_hdr_vlan(false) { set(ptr); }
+    Ip6Ptr(const EthPtr &ptr) : p(), eth_hdr_vlan(false) { set(ptr.p); }
     Ip6Ptr(const Ip6Ptr &ptr) : p(ptr.p), eth_hdr_vlan(ptr.eth_hdr_vlan) { }
 
     Ip6Hdr *get() { return (Ip6Hdr *)(p->data + sizeof(eth_hdr)
@@ -536,9 +536,9 @@ class TcpPtr
     }
 
   public:
-    TcpPtr() : p(0), _off(0) {}
-    TcpPtr(const IpPtr &ptr) : p(0), _off(0) { set(ptr); }
-    TcpPtr(const Ip6Ptr &ptr) : p(0), _off(0) { set(ptr); }
+    TcpPtr() : p(), _off(0) {}
+    TcpPtr(const IpPtr &ptr) : p(), _off(0) { set(ptr); }
+    TcpPtr(const Ip6Ptr &ptr) : p(), _off(0) { set(ptr); }
     TcpPtr(const TcpPtr &ptr) : p(ptr.p), _off(ptr._off) {}
 
     TcpHdr *get() { return (TcpHdr *)(p->data + _off); }
@@ -631,9 +631,9 @@ class UdpPtr
     }
 
   public:
-    UdpPtr() : p(0), _off(0) {}
-    UdpPtr(const IpPtr &ptr) : p(0), _off(0) { set(ptr); }
-    UdpPtr(const Ip6Ptr &ptr) : p(0), _off(0) { set(ptr); }
+    UdpPtr() : p(), _off(0) {}
+    UdpPtr(const IpPtr &ptr) : p(), _off(0) { set(ptr); }
+    UdpPtr(const Ip6Ptr &ptr) : p(), _off(0) { set(ptr); }
     UdpPtr(const UdpPtr &ptr) : p(ptr.p), _off(ptr._off) {}
 
     UdpHdr *get() { return (UdpHdr *)(p->data + _off); }
@@ -38,16 +38,16 @@ PacketFifo::copyout(void *dest, unsigned offset, unsigned len)
     if (offset + len >= size())
         return false;
 
-    iterator i = fifo.begin();
-    iterator end = fifo.end();
+    iterator i = begin();
+    iterator last = end();
     while (len > 0) {
-        EthPacketPtr &pkt = i->packet;
+        const EthPacketPtr &pkt = i->packet;
         while (offset >= pkt->length) {
             offset -= pkt->length;
             ++i;
         }
 
-        if (i == end)
+        if (i == last)
             panic("invalid fifo");
 
         unsigned size = min(pkt->length - offset, len);
@@ -59,4 +59,15 @@ PacketFifo::copyout(void *dest, unsigned offset, unsigned len)
     }
 
     return true;
-}
\ No newline at end of file
+}
+
+void
+PacketFifo::grow()
+{
+    std::vector<PacketFifoEntry> bigger(ring.size() * 2);
+    for (unsigned x = 0; x < count; x++)
+        bigger[x] = at(x);
+    ring.swap(bigger);
+    mask = ring.size() - 1;
+    head = 0;
+}
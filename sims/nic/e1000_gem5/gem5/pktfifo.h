@@ -30,8 +30,8 @@
 #define __DEV_NET_PKTFIFO_HH__
 
 #include <iosfwd>
-#include <list>
 #include <string>
+#include <vector>
 
 #include "sims/nic/e1000_gem5/support.h"
 
@@ -59,6 +59,8 @@ struct PacketFifoEntry
     {
     }
 
+    PacketFifoEntry &operator=(const PacketFifoEntry &s) = default;
+
     void clear()
     {
         packet = NULL;
@@ -68,27 +70,66 @@ struct PacketFifoEntry
     }
 };
 
+/**
+ * Packet FIFO backed by a power-of-two ring of entries. The ring only grows
+ * (by doubling) when more packets are queued than ever before, so pushing and
+ * popping does not allocate in steady state.
+ */
 class PacketFifo
 {
-  public:
+  protected:
+    template <class F, class E>
+    class ring_iterator
+    {
+      protected:
+        F *fifo;
+        unsigned idx;
+
+      public:
+        ring_iterator(F *f, unsigned i) : fifo(f), idx(i) {}
+
+        E &operator*() const { return fifo->at(idx); }
+        E *operator->() const { return &fifo->at(idx); }
+        ring_iterator &operator++() { ++idx; return *this; }
+        ring_iterator &operator--() { --idx; return *this; }
+        bool operator==(const ring_iterator &o) const { return idx == o.idx; }
+        bool operator!=(const ring_iterator &o) const { return idx != o.idx; }
+        unsigned index() const { return idx; }
+    };
 
-    typedef std::list<PacketFifoEntry> fifo_list;
-    typedef fifo_list::iterator iterator;
-    typedef fifo_list::const_iterator const_iterator;
+  public:
+    typedef ring_iterator<PacketFifo, PacketFifoEntry> iterator;
+    typedef ring_iterator<const PacketFifo, const PacketFifoEntry>
+        const_iterator;
 
   protected:
-    std::list<PacketFifoEntry> fifo;
+    static const unsigned initialEntries = 256;
+
+    std::vector<PacketFifoEntry> ring;
+    unsigned mask;
+    unsigned head;
+    unsigned count;
     uint64_t _counter;
     unsigned _maxsize;
     unsigned _size;
     unsigned _reserved;
 
+    PacketFifoEntry &at(unsigned i) { return ring[(head + i) & mask]; }
+    const PacketFifoEntry &
+    at(unsigned i) const
+    {
+        return ring[(head + i) & mask];
+    }
+
+    void grow();
+
   public:
     explicit PacketFifo(int max)
-        : _counter(0), _maxsize(max), _size(0), _reserved(0) {}
+        : ring(initialEntries), mask(initialEntries - 1), head(0), count(0),
+          _counter(0), _maxsize(max), _size(0), _reserved(0) {}
     virtual ~PacketFifo() {}
 
-    unsigned packets() const { return fifo.size(); }
+    unsigned packets() const { return count; }
     unsigned maxsize() const { return _maxsize; }
     unsigned size() const { return _size; }
     unsigned reserved() const { return _reserved; }
@@ -104,15 +145,15 @@ class PacketFifo
         return _reserved;
     }
 
-    iterator begin() { return fifo.begin(); }
-    iterator end() { return fifo.end(); }
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, count); }
 
-    const_iterator begin() const { return fifo.begin(); }
-    const_iterator end() const { return fifo.end(); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
 
-    EthPacketPtr front() { return fifo.begin()->packet; }
+    const EthPacketPtr &front() { return at(0).packet; }
 
-    bool push(EthPacketPtr ptr)
+    bool push(const EthPacketPtr &ptr)
     {
         assert(ptr->length);
         assert(_reserved <= ptr->length);
@@ -121,10 +162,13 @@ class PacketFifo
 
         _size += ptr->length;
 
-        PacketFifoEntry entry;
+        if (count == ring.size())
+            grow();
+        PacketFifoEntry &entry = at(count++);
         entry.packet = ptr;
         entry.number = _counter++;
-        fifo.push_back(entry);
+        entry.slack = 0;
+        entry.priv = -1;
         _reserved = 0;
         return true;
     }
@@ -134,28 +178,29 @@ class PacketFifo
         if (empty())
             return;
 
-        iterator entry = fifo.begin();
-        _size -= entry->packet->length;
-        _size -= entry->slack;
-        entry->packet = NULL;
-        fifo.pop_front();
+        PacketFifoEntry &entry = at(0);
+        _size -= entry.packet->length;
+        _size -= entry.slack;
+        entry.clear();
+        head = (head + 1) & mask;
+        count--;
     }
 
     void clear()
     {
         for (iterator i = begin(); i != end(); ++i)
             i->clear();
-        fifo.clear();
+        head = 0;
+        count = 0;
         _size = 0;
         _reserved = 0;
     }
 
     void remove(iterator i)
     {
-        if (i != fifo.begin()) {
+        if (i != begin()) {
             iterator prev = i;
             --prev;
-            assert(prev != fifo.end());
             prev->slack += i->packet->length;
             prev->slack += i->slack;
         } else {
@@ -163,25 +208,27 @@ class PacketFifo
             _size -= i->slack;
         }
 
-        i->clear();
-        fifo.erase(i);
+        // close the gap by moving the following entries forward
+        for (unsigned x = i.index(); x + 1 < count; x++)
+            at(x) = at(x + 1);
+        at(count - 1).clear();
+        count--;
     }
 
     bool copyout(void *dest, unsigned offset, unsigned len);
 
     int countPacketsBefore(const_iterator i) const
     {
-        if (i == fifo.end())
+        if (i == end())
             return 0;
-        return i->number - fifo.begin()->number;
+        return i->number - at(0).number;
     }
 
     int countPacketsAfter(const_iterator i) const
     {
-        auto end = fifo.end();
-        if (i == end)
+        if (i == end())
             return 0;
-        return (--end)->number - i->number;
+        return at(count - 1).number - i->number;
     }
 
     void check() const
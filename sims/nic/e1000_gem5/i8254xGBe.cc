@@ -67,6 +67,7 @@ IGbE::IGbE(const Params *p)
       tadvEvent([this]{ tadvProcess(); }, "e1000-tadv", false,  7),
       tidvEvent([this]{ tidvProcess(); }, "e1000-tidv", false, 8),
       tickEvent([this]{ tick(); }, "e1000-tick", false,  9),
+      idlePending(false), idleTick(0),
       interEvent([this]{ delayIntEvent(); }, "e1000-inter", false, 12),
       rxDescCache(this, "RxDesc", p->rx_desc_cache_size),
       txDescCache(this, "TxDesc", p->tx_desc_cache_size),
@@ -764,20 +765,25 @@ IGbE::chkInterrupt()
 template<class T>
 IGbE::DescCache<T>::DescCache(IGbE *i, const std::string n, int s)
     : igbe(i), _name(n), cachePnt(0), size(s), curFetching(0),
-      wbOut(0), moreToWb(false), wbAlignment(0), pktPtr(NULL),
-      wbDelayEvent([this]{ writeback1(); }, n, false, 13),
-      fetchDelayEvent([this]{ fetchDescriptors1(); }, n, false, 14),
-      fetchEvent([this]{ fetchComplete(); }, n, false, 15),
-      wbEvent([this]{ wbComplete(); }, n, false, 16)
+      wbOut(0), moreToWb(false), wbAlignment(0), pktPtr(nullptr),
+      wbDelayEvent([this]{ writeback1(); }, _name.c_str(), false, 13),
+      fetchDelayEvent([this]{ fetchDescriptors1(); }, _name.c_str(), false,
+                      14),
+      fetchEvent([this]{ fetchComplete(); }, _name.c_str(), false, 15),
+      wbEvent([this]{ wbComplete(); }, _name.c_str(), false, 16)
 {
+    ring = new T[size];
+    ringHead = usedCnt = unusedCnt = 0;
     fetchBuf = new T[size];
     wbBuf = new T[size];
+    fetchDst = nullptr;
 }
 
 template<class T>
 IGbE::DescCache<T>::~DescCache()
 {
     reset();
+    delete[] ring;
     delete[] fetchBuf;
     delete[] wbBuf;
 }
@@ -786,7 +792,7 @@ template<class T>
 void
 IGbE::DescCache<T>::areaChanged()
 {
-    if (usedCache.size() > 0 || curFetching || wbOut)
+    if (usedCnt > 0 || curFetching || wbOut)
         panic("Descriptor Address, Length or Head changed. Bad\n");
     reset();
 
@@ -797,7 +803,7 @@ void
 IGbE::DescCache<T>::writeback(Addr aMask)
 {
     int curHead = descHead();
-    int max_to_wb = usedCache.size();
+    int max_to_wb = usedCnt;
 
     // Check if this writeback is less restrictive that the previous
     // and if so setup another one immediately following it
@@ -833,7 +839,7 @@ IGbE::DescCache<T>::writeback(Addr aMask)
         _name.c_str(), max_to_wb);
 
     if (max_to_wb <= 0) {
-        if (usedCache.size())
+        if (usedCnt)
             igbe->anBegin(annSmWb, "Wait Alignment");
         else
             igbe->anWe(annSmWb, annUsedCacheQ);
@@ -854,20 +860,27 @@ IGbE::DescCache<T>::writeback1()
     DPRINTF(EthernetDesc, "[%s] Begining DMA of %d descriptors\n",
         _name.c_str(), wbOut);
 
+    assert(wbOut && wbOut <= usedCnt);
     for (int x = 0; x < wbOut; x++) {
-        assert(usedCache.size());
-        memcpy(&wbBuf[x], usedCache[x], sizeof(T));
         igbe->anPq(annSmWb, annUsedCacheQ);
         igbe->anPq(annSmWb, annDescQ);
         igbe->anQ(annSmWb, annUsedDescQ);
     }
 
+    // dmaWrite copies the data out right away, so unless the used run wraps
+    // the ring end it can be handed the ring slots directly
+    T *src = &ring[ringHead];
+    int first = size - ringHead;
+    if (wbOut > first) {
+        memcpy(wbBuf, src, first * sizeof(T));
+        memcpy(wbBuf + first, ring, (wbOut - first) * sizeof(T));
+        src = wbBuf;
+    }
 
     igbe->anBegin(annSmWb, "Writeback Desc DMA");
 
-    assert(wbOut);
     igbe->dmaWrite(pciToDma(descBase() + descHead() * sizeof(T)),
-                   wbOut * sizeof(T), wbEvent, (uint8_t*)wbBuf,
+                   wbOut * sizeof(T), wbEvent, (uint8_t*)src,
                    igbe->wbCompDelay);
 }
 
@@ -889,7 +902,7 @@ IGbE::DescCache<T>::fetchDescriptors()
     else
         max_to_fetch = descLen() - cachePnt;
 
-    size_t free_cache = size - usedCache.size() - unusedCache.size();
+    size_t free_cache = size - usedCnt - unusedCnt;
 
     if (!max_to_fetch)
         igbe->anWe(annSmFetch, annUnusedDescQ);
@@ -934,9 +947,15 @@ IGbE::DescCache<T>::fetchDescriptors1()
             descBase() + cachePnt * sizeof(T),
             pciToDma(descBase() + cachePnt * sizeof(T)),
             curFetching * sizeof(T));
-    assert(curFetching);
+    assert(curFetching && curFetching <= size - usedCnt - unusedCnt);
+
+    // The slot after the last cached descriptor does not move while the
+    // fetch is outstanding (writebacks advance ringHead and shrink usedCnt by
+    // the same amount), so read straight into it unless the fetch wraps.
+    int tail = ringIdx(usedCnt + unusedCnt);
+    fetchDst = tail + curFetching <= size ? &ring[tail] : fetchBuf;
     igbe->dmaRead(pciToDma(descBase() + cachePnt * sizeof(T)),
-                  curFetching * sizeof(T), fetchEvent, (uint8_t*)fetchBuf,
+                  curFetching * sizeof(T), fetchEvent, (uint8_t*)fetchDst,
                   igbe->fetchCompDelay);
 }
 
@@ -944,12 +963,18 @@ template<class T>
 void
 IGbE::DescCache<T>::fetchComplete()
 {
-    T *newDesc;
     igbe->anBegin(annSmFetch, "Fetch Complete");
+
+    int tail = ringIdx(usedCnt + unusedCnt);
+    if (fetchDst != &ring[tail]) {
+        int first = std::min(curFetching, size - tail);
+        memcpy(&ring[tail], fetchDst, first * sizeof(T));
+        memcpy(ring, fetchDst + first, (curFetching - first) * sizeof(T));
+    }
+    fetchDst = nullptr;
+    unusedCnt += curFetching;
+
     for (int x = 0; x < curFetching; x++) {
-        newDesc = new T;
-        memcpy(newDesc, &fetchBuf[x], sizeof(T));
-        unusedCache.push_back(newDesc);
         igbe->anDq(annSmFetch, annUnusedDescQ);
         igbe->anQ(annSmFetch, annUnusedCacheQ);
         igbe->anQ(annSmFetch, annDescQ);
@@ -974,7 +999,7 @@ IGbE::DescCache<T>::fetchComplete()
                                                              cachePnt)) == 0)
     {
         igbe->anWe(annSmFetch, annUnusedDescQ);
-    } else if (!(size - usedCache.size() - unusedCache.size())) {
+    } else if (!(size - usedCnt - unusedCnt)) {
         igbe->anWf(annSmFetch, annDescQ);
     } else {
         igbe->anBegin(annSmFetch, "Wait");
@@ -996,11 +1021,10 @@ IGbE::DescCache<T>::wbComplete()
     long oldHead = curHead;
 #endif
 
+    assert(usedCnt >= wbOut);
+    ringHead = ringIdx(wbOut);
+    usedCnt -= wbOut;
     for (int x = 0; x < wbOut; x++) {
-        assert(usedCache.size());
-        delete usedCache[0];
-        usedCache.pop_front();
-
         igbe->anDq(annSmWb, annUsedCacheQ);
         igbe->anDq(annSmWb, annDescQ);
     }
@@ -1027,7 +1051,7 @@ IGbE::DescCache<T>::wbComplete()
 
     if (!wbOut) {
         //igbe->checkDrain();
-        if (usedCache.size())
+        if (usedCnt)
             igbe->anBegin(annSmWb, "Wait");
         else
             igbe->anWe(annSmWb, annUsedCacheQ);
@@ -1040,13 +1064,12 @@ void
 IGbE::DescCache<T>::reset()
 {
     DPRINTF(EthernetDesc, "[%s] Reseting descriptor cache\n", _name.c_str());
-    for (typename CacheType::size_type x = 0; x < usedCache.size(); x++)
-        delete usedCache[x];
-    for (typename CacheType::size_type x = 0; x < unusedCache.size(); x++)
-        delete unusedCache[x];
 
-    usedCache.clear();
-    unusedCache.clear();
+    // Drop everything but keep the ring position, so a fetch still in flight
+    // lands on the (now empty) cache's tail
+    ringHead = ringIdx(usedCnt + unusedCnt);
+    usedCnt = 0;
+    unusedCnt = 0;
 
     cachePnt = 0;
 
@@ -1056,9 +1079,9 @@ IGbE::DescCache<T>::reset()
 
 IGbE::RxDescCache::RxDescCache(IGbE *i, const std::string n, int s)
     : DescCache<RxDesc>(i, n, s), pktDone(false), splitCount(0),
-    pktEvent([this]{ pktComplete(); }, n, false, 17),
-    pktHdrEvent([this]{ pktSplitDone(); }, n, false, 18),
-    pktDataEvent([this]{ pktSplitDone(); }, n, false, 19)
+    pktEvent([this]{ pktComplete(); }, _name.c_str(), false, 17),
+    pktHdrEvent([this]{ pktSplitDone(); }, _name.c_str(), false, 18),
+    pktDataEvent([this]{ pktSplitDone(); }, _name.c_str(), false, 19)
 
 {
     annSmFetch = "RX Desc Fetch";
@@ -1088,15 +1111,15 @@ IGbE::RxDescCache::pktSplitDone()
 int
 IGbE::RxDescCache::writePacket(EthPacketPtr packet, int pkt_offset)
 {
-    assert(unusedCache.size());
-    //if (!unusedCache.size())
+    assert(unusedCnt);
+    //if (!unusedCnt)
     //    return false;
 
     pktPtr = packet;
     pktDone = false;
     unsigned buf_len, hdr_len;
 
-    RxDesc *desc = unusedCache.front();
+    RxDesc *desc = unusedFront();
     switch (igbe->regs.srrctl.desctype()) {
       case RXDT_LEGACY:
         assert(pkt_offset == 0);
@@ -1196,9 +1219,9 @@ IGbE::RxDescCache::writePacket(EthPacketPtr packet, int pkt_offset)
 void
 IGbE::RxDescCache::pktComplete()
 {
-    assert(unusedCache.size());
+    assert(unusedCnt);
     RxDesc *desc;
-    desc = unusedCache.front();
+    desc = unusedFront();
 
     igbe->anBegin("RXS", "Update Desc");
 
@@ -1352,9 +1375,8 @@ IGbE::RxDescCache::pktComplete()
     igbe->anBegin("RXS", "Done Updating Desc");
     DPRINTF(EthernetDesc, "Processing of this descriptor complete\n");
     igbe->anDq("RXS", annUnusedCacheQ);
-    unusedCache.pop_front();
+    useFront();
     igbe->anQ("RXS", annUsedCacheQ);
-    usedCache.push_back(desc);
 }
 
 void
@@ -1392,9 +1414,9 @@ IGbE::TxDescCache::TxDescCache(IGbE *i, const std::string n, int s)
       useTso(false), tsoHeaderLen(0), tsoMss(0), tsoTotalLen(0), tsoUsedLen(0),
       tsoPrevSeq(0), tsoPktPayloadBytes(0), tsoLoadedHeader(false),
       tsoPktHasHeader(false), tsoDescBytesUsed(0), tsoCopyBytes(0), tsoPkts(0),
-    pktEvent([this]{ pktComplete(); }, n, false, 20),
-    headerEvent([this]{ headerComplete(); }, n, false, 21),
-    nullEvent([this]{ nullCallback(); }, n, false, 22)
+    pktEvent([this]{ pktComplete(); }, _name.c_str(), false, 20),
+    headerEvent([this]{ headerComplete(); }, _name.c_str(), false, 21),
+    nullEvent([this]{ nullCallback(); }, _name.c_str(), false, 22)
 {
     annSmFetch = "TX Desc Fetch";
     annSmWb = "TX Desc Writeback";
@@ -1408,16 +1430,16 @@ IGbE::TxDescCache::TxDescCache(IGbE *i, const std::string n, int s)
 void
 IGbE::TxDescCache::processContextDesc()
 {
-    assert(unusedCache.size());
+    assert(unusedCnt);
     TxDesc *desc;
 
     DPRINTF(EthernetDesc, "Checking and  processing context descriptors\n");
 
-    while (!useTso && unusedCache.size() &&
-           TxdOp::isContext(unusedCache.front())) {
+    while (!useTso && unusedCnt &&
+           TxdOp::isContext(unusedFront())) {
         DPRINTF(EthernetDesc, "Got context descriptor type...\n");
 
-        desc = unusedCache.front();
+        desc = unusedFront();
         DPRINTF(EthernetDesc, "Descriptor upper: %#lx lower: %#lX\n",
                 desc->d1, desc->d2);
 
@@ -1446,16 +1468,15 @@ IGbE::TxDescCache::processContextDesc()
         }
 
         TxdOp::setDd(desc);
-        unusedCache.pop_front();
+        useFront();
         igbe->anDq("TXS", annUnusedCacheQ);
-        usedCache.push_back(desc);
         igbe->anQ("TXS", annUsedCacheQ);
     }
 
-    if (!unusedCache.size())
+    if (!unusedCnt)
         return;
 
-    desc = unusedCache.front();
+    desc = unusedFront();
     if (!useTso && TxdOp::isType(desc, TxdOp::TXD_ADVDATA) &&
         TxdOp::tse(desc)) {
         DPRINTF(EthernetDesc, "TCP offload(adv) enabled for packet "
@@ -1488,16 +1509,15 @@ IGbE::TxDescCache::headerComplete()
     DPRINTF(EthernetDesc, "TSO: Fetching TSO header complete\n");
     pktWaiting = false;
 
-    assert(unusedCache.size());
-    TxDesc *desc = unusedCache.front();
+    assert(unusedCnt);
+    TxDesc *desc = unusedFront();
     DPRINTF(EthernetDesc, "TSO: len: %ld tsoHeaderLen: %ld\n",
             TxdOp::getLen(desc), tsoHeaderLen);
 
     if (TxdOp::getLen(desc) == tsoHeaderLen) {
         tsoDescBytesUsed = 0;
         tsoLoadedHeader = true;
-        unusedCache.pop_front();
-        usedCache.push_back(desc);
+        useFront();
     } else {
         DPRINTF(EthernetDesc, "TSO: header part of larger payload\n");
         tsoDescBytesUsed = tsoHeaderLen;
@@ -1510,13 +1530,13 @@ IGbE::TxDescCache::headerComplete()
 unsigned
 IGbE::TxDescCache::getPacketSize(EthPacketPtr p)
 {
-    if (!unusedCache.size())
+    if (!unusedCnt)
         return 0;
 
     DPRINTF(EthernetDesc, "Starting processing of descriptor\n");
 
     assert(!useTso || tsoLoadedHeader);
-    TxDesc *desc = unusedCache.front();
+    TxDesc *desc = unusedFront();
 
     if (useTso) {
         DPRINTF(EthernetDesc, "getPacket(): TxDescriptor data "
@@ -1543,17 +1563,17 @@ IGbE::TxDescCache::getPacketSize(EthPacketPtr p)
     }
 
     DPRINTF(EthernetDesc, "Next TX packet is %ld bytes\n",
-            TxdOp::getLen(unusedCache.front()));
+            TxdOp::getLen(unusedFront()));
     return TxdOp::getLen(desc);
 }
 
 void
 IGbE::TxDescCache::getPacketData(EthPacketPtr p)
 {
-    assert(unusedCache.size());
+    assert(unusedCnt);
 
     TxDesc *desc;
-    desc = unusedCache.front();
+    desc = unusedFront();
 
     DPRINTF(EthernetDesc, "getPacketData(): TxDescriptor data "
             "d1: %#lx d2: %#lx\n", desc->d1, desc->d2);
@@ -1600,7 +1620,7 @@ IGbE::TxDescCache::pktComplete()
 {
 
     TxDesc *desc;
-    assert(unusedCache.size());
+    assert(unusedCnt);
     assert(pktPtr);
 
     igbe->anBegin("TXS", "Update Desc");
@@ -1608,7 +1628,7 @@ IGbE::TxDescCache::pktComplete()
     DPRINTF(EthernetDesc, "DMA of packet complete\n");
 
 
-    desc = unusedCache.front();
+    desc = unusedFront();
     assert((TxdOp::isLegacy(desc) || TxdOp::isData(desc)) &&
            TxdOp::getLen(desc));
 
@@ -1635,9 +1655,8 @@ IGbE::TxDescCache::pktComplete()
          tsoTotalLen != tsoUsedLen && useTso)) {
         assert(!useTso || (tsoDescBytesUsed == TxdOp::getLen(desc)));
         igbe->anDq("TXS", annUnusedCacheQ);
-        unusedCache.pop_front();
+        useFront();
         igbe->anQ("TXS", annUsedCacheQ);
-        usedCache.push_back(desc);
 
         tsoDescBytesUsed = 0;
         pktDone = true;
@@ -1760,9 +1779,8 @@ IGbE::TxDescCache::pktComplete()
     if (!useTso ||  TxdOp::getLen(desc) == tsoDescBytesUsed) {
         DPRINTF(EthernetDesc, "Descriptor Done\n");
         igbe->anDq("TXS", annUnusedCacheQ);
-        unusedCache.pop_front();
+        useFront();
         igbe->anQ("TXS", annUsedCacheQ);
-        usedCache.push_back(desc);
         tsoDescBytesUsed = 0;
     }
 
@@ -1783,11 +1801,11 @@ IGbE::TxDescCache::pktComplete()
         DPRINTF(EthernetDesc, "WTHRESH == 0, writing back descriptor\n");
         writeback(0);
     } else if (!igbe->regs.txdctl.gran() && igbe->regs.txdctl.wthresh() <=
-               descInBlock(usedCache.size())) {
+               descInBlock(usedCnt)) {
         DPRINTF(EthernetDesc, "used > WTHRESH, writing back descriptor\n");
         igbe->anBegin("TXS", "Desc Writeback");
         writeback((igbe->cacheBlockSize()-1)>>4);
-    } else if (igbe->regs.txdctl.wthresh() <= usedCache.size()) {
+    } else if (igbe->regs.txdctl.wthresh() <= descUsed()) {
         DPRINTF(EthernetDesc, "used > WTHRESH, writing back descriptor\n");
         igbe->anBegin("TXS", "Desc Writeback");
         writeback((igbe->cacheBlockSize()-1)>>4);
@@ -1888,7 +1906,7 @@ IGbE::txStateMachine()
     }
 
     if (!txPacket) {
-        txPacket = std::make_shared<EthPacketData>(16384);
+        txPacket = EthPacketData::alloc(16384);
     }
 
     if (!txDescCache.packetWaiting()) {
@@ -2178,7 +2196,12 @@ IGbE::tick()
     while (txFifoTick)
         txWire();
 
-    if (rxTick || txTick || txFifoTick) {
+    if ((rxTick || txTick) && (!rxTick || rxIdleNext()) &&
+        (!txTick || txIdleNext())) {
+        DPRINTF(EthernetSM, "IGbE: next cycle idle, skipping it\n");
+        idlePending = true;
+        idleTick = curTick() + 1000;
+    } else if (rxTick || txTick || txFifoTick) {
         DPRINTF(EthernetSM, "IGbE: rescheduling next cycle\n");
         schedule(tickEvent, curTick() + 1000);
     } else {
@@ -2188,6 +2211,55 @@ IGbE::tick()
     inTick = false;
 }
 
+bool
+IGbE::rxIdleNext()
+{
+    // mirrors the decisions at the top of rxStateMachine()
+    if (!regs.rctl.en())
+        return true;
+    if (rxDescCache.packetPending())
+        return false;
+    if (rxDmaPacket)
+        return true;
+    if (!rxDescCache.descUnused())
+        return false;
+    return rxFifo.empty();
+}
+
+bool
+IGbE::txIdleNext()
+{
+    // mirrors the decisions at the top of txStateMachine()
+    if (!regs.tctl.en())
+        return true;
+    if (txPacket && txDescCache.packetPending())
+        return false;
+    if (regs.txdctl.lwthresh() &&
+        txDescCache.descLeft() < (regs.txdctl.lwthresh() * 8))
+        return false;
+    if (!txPacket)
+        return false;
+    return txDescCache.packetWaiting();
+}
+
+void
+IGbE::settleIdle(int prio)
+{
+    if (!idlePending)
+        return;
+    idlePending = false;
+
+    if (curTick() < idleTick ||
+        (curTick() == idleTick && prio < tickEvent.priority_)) {
+        DPRINTF(EthernetSM, "IGbE: woken before idle cycle, scheduling it\n");
+        schedule(tickEvent, idleTick);
+    } else {
+        DPRINTF(EthernetSM, "IGbE: idle cycle passed, stopping ticking\n");
+        rxTick = false;
+        txTick = false;
+    }
+}
+
 void
 IGbE::ethTxDone()
 {
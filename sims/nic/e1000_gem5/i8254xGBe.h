@@ -33,7 +33,7 @@
 #ifndef __DEV_NET_I8254XGBE_HH__
 #define __DEV_NET_I8254XGBE_HH__
 
-#include <deque>
+#include <cassert>
 #include <string>
 
 #include "sims/nic/e1000_gem5/support.h"
@@ -163,6 +163,21 @@ class IGbE : public nicbm::Runner::Device
     void tick();
     EventFunctionWrapper tickEvent;
 
+    /* Cycles in which the state machines would only find themselves waiting
+     * and stop ticking are not scheduled. Instead idleTick records when that
+     * cycle would have run, and the first event to arrive either schedules it
+     * after all (if it arrives before it) or applies its effect. */
+    bool idlePending;
+    Tick idleTick;
+
+    /** Would the next cycle of the state machine only stop it ticking? */
+    bool rxIdleNext();
+    bool txIdleNext();
+
+    /** Resolve a skipped idle cycle on entry of an event with priority
+     * `prio`, external inputs use 0. */
+    void settleIdle(int prio);
+
 
     uint64_t macAddr;
 
@@ -204,13 +219,15 @@ class IGbE : public nicbm::Runner::Device
      */
     //void checkDrain();
 
-    void anBegin(std::string sm, std::string st, int flags = 0) {   }
-    void anQ(std::string sm, std::string q) {  }
-    void anDq(std::string sm, std::string q) {  }
-    void anPq(std::string sm, std::string q, int num = 1) { }
-    void anRq(std::string sm, std::string q, int num = 1) { }
-    void anWe(std::string sm, std::string q) {}
-    void anWf(std::string sm, std::string q) {}
+    // CPA annotations are not supported, take any arguments by reference so
+    // call sites do not build std::string temporaries
+    template<class... A> void anBegin(const A &...) { }
+    template<class... A> void anQ(const A &...) { }
+    template<class... A> void anDq(const A &...) { }
+    template<class... A> void anPq(const A &...) { }
+    template<class... A> void anRq(const A &...) { }
+    template<class... A> void anWe(const A &...) { }
+    template<class... A> void anWf(const A &...) { }
 
 
     template<class T>
@@ -226,13 +243,45 @@ class IGbE : public nicbm::Runner::Device
         virtual void actionAfterWb() {}
         virtual void fetchAfterWb() = 0;
 
-        typedef std::deque<T *> CacheType;
-        CacheType usedCache;
-        CacheType unusedCache;
+        /** Descriptor storage: a ring of size entries holding, starting at
+         * ringHead, the used descriptors (processed, waiting for writeback)
+         * followed by the unused ones (fetched, not yet processed). Fetches
+         * DMA straight into the free slots after them and writebacks DMA
+         * straight out of the used run.
+         */
+        T *ring;
+        int ringHead;
+        int usedCnt;
+        int unusedCnt;
 
+        /** Bounce buffers, only used by transfers that wrap the ring end */
         T *fetchBuf;
         T *wbBuf;
 
+        // Where the in-flight fetch lands (the ring or fetchBuf)
+        T *fetchDst;
+
+        /** Ring slot of the i-th cached descriptor, counting from the
+         * oldest used one */
+        int
+        ringIdx(int i) const
+        {
+            i += ringHead;
+            return i >= size ? i - size : i;
+        }
+
+        /** Oldest fetched descriptor that has not been processed yet */
+        T *unusedFront() { return &ring[ringIdx(usedCnt)]; }
+
+        /** Mark the front unused descriptor as used */
+        void
+        useFront()
+        {
+            assert(unusedCnt);
+            usedCnt++;
+            unusedCnt--;
+        }
+
         // Pointer to the device we cache for
         IGbE *igbe;
 
@@ -307,7 +356,7 @@ class IGbE : public nicbm::Runner::Device
         unsigned
         descLeft() const
         {
-            unsigned left = unusedCache.size();
+            unsigned left = unusedCnt;
             if (cachePnt > descTail())
                 left += (descLen() - cachePnt + descTail());
             else
@@ -318,10 +367,10 @@ class IGbE : public nicbm::Runner::Device
 
         /* Return the number of descriptors used and not written back.
          */
-        unsigned descUsed() const { return usedCache.size(); }
+        unsigned descUsed() const { return usedCnt; }
 
         /* Return the number of cache unused descriptors we have. */
-        unsigned descUnused() const { return unusedCache.size(); }
+        unsigned descUnused() const { return unusedCnt; }
 
         /* Get into a state where the descriptor address/head/etc colud be
          * changed */
@@ -378,6 +427,9 @@ class IGbE : public nicbm::Runner::Device
          */
         bool packetDone();
 
+        /** Same as packetDone() but without consuming the completion. */
+        bool packetPending() const { return pktDone; }
+
         EventFunctionWrapper pktEvent;
 
         // Event to handle issuing header and data write at the same time
@@ -459,6 +511,9 @@ class IGbE : public nicbm::Runner::Device
          */
         bool packetAvailable();
 
+        /** Same as packetAvailable() but without consuming the completion. */
+        bool packetPending() const { return pktDone; }
+
         /** Ask if we are still waiting for the packet to be transfered.
          * @return packet still in transit.
          */
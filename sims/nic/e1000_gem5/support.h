@@ -2,8 +2,10 @@
 #define SIMS_NIC_E1000_GEM5_SUPPORT_H_
 
 #include <arpa/inet.h>
-#include <functional>
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 #include <simbricks/nicbm/nicbm.h>
 
@@ -27,32 +29,114 @@ typedef uint64_t Tick;
 
 class Gem5TimerEv;
 
+class EthPacketPtr;
+
+/**
+ * Packet buffer handed out by a process-wide pool. Buffers come in two size
+ * classes (standard and jumbo/TSO frames) and return to their free list when
+ * the last EthPacketPtr referencing them goes away, so the RX and TX paths do
+ * not allocate once the pool has warmed up.
+ */
 class EthPacketData {
   public:
     unsigned length;
     uint8_t *data;
 
-    EthPacketData(unsigned len) : length(0), data(new uint8_t[len]) { }
-    ~EthPacketData() { delete[] data; }
+    /** Get an empty packet with room for at least `len` bytes. */
+    static EthPacketPtr alloc(unsigned len);
+
+  private:
+    friend class EthPacketPtr;
+
+    unsigned refcnt;
+    unsigned capacity;
+    EthPacketData *nextFree;
+
+    EthPacketData() : length(0), data(nullptr), refcnt(0), capacity(0),
+        nextFree(nullptr) { }
+    EthPacketData(const EthPacketData &) = delete;
+    EthPacketData &operator=(const EthPacketData &) = delete;
+
+    static void refill(EthPacketData *&freeList, unsigned cap);
+    /** Return to the pool, called when the last reference is dropped. */
+    void release();
 };
-typedef std::shared_ptr<EthPacketData> EthPacketPtr;
 
+/** Intrusively reference counted pointer to a pooled EthPacketData. */
+class EthPacketPtr {
+  private:
+    EthPacketData *p;
+
+  public:
+    EthPacketPtr() : p(nullptr) { }
+    EthPacketPtr(std::nullptr_t) : p(nullptr) { }
+    explicit EthPacketPtr(EthPacketData *d) : p(d) { if (p) p->refcnt++; }
+    EthPacketPtr(const EthPacketPtr &o) : p(o.p) { if (p) p->refcnt++; }
+    EthPacketPtr(EthPacketPtr &&o) : p(o.p) { o.p = nullptr; }
+    ~EthPacketPtr() { if (p && --p->refcnt == 0) p->release(); }
+
+    EthPacketPtr &
+    operator=(const EthPacketPtr &o)
+    {
+        EthPacketPtr tmp(o);
+        std::swap(p, tmp.p);
+        return *this;
+    }
+
+    EthPacketPtr &
+    operator=(EthPacketPtr &&o)
+    {
+        std::swap(p, o.p);
+        return *this;
+    }
+
+    EthPacketData *get() const { return p; }
+    EthPacketData *operator->() const { return p; }
+    EthPacketData &operator*() const { return *p; }
+    explicit operator bool() const { return p != nullptr; }
+    bool operator==(std::nullptr_t) const { return p == nullptr; }
+    bool operator!=(std::nullptr_t) const { return p != nullptr; }
+};
+
+/** Values for nicbm::TimedEvent::kind_ used by the e1000 model */
+enum EventKind {
+    kEventFunction = 1,
+    kEventDma = 2,
+};
+
+/**
+ * Event invoking a callback. The callback (typically a lambda capturing only
+ * `this`) is stored inline and invoked through a plain function pointer, so
+ * events do not allocate and calling them does not go through std::function.
+ */
 class EventFunctionWrapper : public nicbm::TimedEvent {
+  private:
+    static const size_t maxCallable = 2 * sizeof(void *);
+
+    alignas(void *) unsigned char callable[maxCallable];
+    void (*invoke)(void *);
+
   public:
     bool sched;
-    std::function<void(void)> callback;
-    std::string _name;
+    const char *_name;
 
-    EventFunctionWrapper(const std::function<void(void)> &callback,
-                         const std::string &name, bool free=false,
-                         int prio=0)
-        : sched(false), callback(callback), _name(name)
+    template <class F>
+    EventFunctionWrapper(F cb, const char *name, bool free=false, int prio=0)
+        : sched(false), _name(name)
     {
-      priority_ = prio;
+        static_assert(sizeof(F) <= maxCallable, "event callback too large");
+        static_assert(std::is_trivially_copyable<F>::value &&
+                      std::is_trivially_destructible<F>::value,
+                      "event callback must be trivially copyable");
+        new (callable) F(cb);
+        invoke = [](void *c) { (*static_cast<F *>(c))(); };
+        priority_ = prio;
+        kind_ = kEventFunction;
     }
 
     virtual ~EventFunctionWrapper() = default;
     bool scheduled() { return sched; }
+    void callback() { invoke(callable); }
 };
 
 static inline uint16_t htobe(uint16_t x) {
@@ -53,12 +53,12 @@ void queue_admin_tx::reg_updated() {
 
   if (!enabled && (reg_len & I40E_GL_ATQLEN_ATQENABLE_MASK)) {
 #ifdef DEBUG_ADMINQ
-    log << " enable base=" << base << " len=" << len << logger::endl;
+    I40E_LOG(log) << " enable base=" << base << " len=" << len << logger::endl;
 #endif
     enabled = true;
   } else if (enabled && !(reg_len & I40E_GL_ATQLEN_ATQENABLE_MASK)) {
 #ifdef DEBUG_ADMINQ
-    log << " disable" << logger::endl;
+    I40E_LOG(log) << " disable" << logger::endl;
 #endif
     enabled = false;
   }
@@ -85,8 +85,8 @@ void queue_admin_tx::admin_desc_ctx::desc_compl_prepare(uint16_t retval,
   d->retval = retval;
 
 #ifdef DEBUG_ADMINQ
-  queue.log << " desc_compl_prepare index=" << index << " retval=" << retval
-            << logger::endl;
+  I40E_LOG(queue.log) << " desc_compl_prepare index=" << index
+      << " retval=" << retval << logger::endl;
 #endif
 }
 
@@ -102,7 +102,8 @@ void queue_admin_tx::admin_desc_ctx::desc_complete_indir(uint16_t retval,
                                                          uint16_t extra_flags,
                                                          bool ignore_datalen) {
   if (!ignore_datalen && len > d->datalen) {
-    queue.log << "queue_admin_tx::desc_complete_indir: data too long (" << len
+    I40E_LOG_ERR(queue.log)
+              << "queue_admin_tx::desc_complete_indir: data too long (" << len
               << ") got buffer for (" << d->datalen << ")" << logger::endl;
     abort();
   }
@@ -120,8 +121,8 @@ void queue_admin_tx::admin_desc_ctx::prepare() {
     uint64_t addr = d->params.external.addr_low |
                     (((uint64_t)d->params.external.addr_high) << 32);
 #ifdef DEBUG_ADMINQ
-    queue.log << " desc with buffer opc=" << d->opcode << " addr=" << addr
-              << logger::endl;
+    I40E_LOG(queue.log) << " desc with buffer opc=" << d->opcode
+        << " addr=" << addr << logger::endl;
 #endif
     data_fetch(addr, d->datalen);
   } else {
@@ -131,12 +132,12 @@ void queue_admin_tx::admin_desc_ctx::prepare() {
 
 void queue_admin_tx::admin_desc_ctx::process() {
 #ifdef DEBUG_ADMINQ
-  queue.log << " descriptor " << index << " fetched" << logger::endl;
+  I40E_LOG(queue.log) << " descriptor " << index << " fetched" << logger::endl;
 #endif
 
   if (d->opcode == i40e_aqc_opc_get_version) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  get version" << logger::endl;
+    I40E_LOG(queue.log) << "  get version" << logger::endl;
 #endif
     struct i40e_aqc_get_version *gv =
         reinterpret_cast<struct i40e_aqc_get_version *>(d->params.raw);
@@ -150,37 +151,37 @@ void queue_admin_tx::admin_desc_ctx::process() {
     desc_complete(0);
   } else if (d->opcode == i40e_aqc_opc_request_resource) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  request resource" << logger::endl;
+    I40E_LOG(queue.log) << "  request resource" << logger::endl;
 #endif
     struct i40e_aqc_request_resource *rr =
         reinterpret_cast<struct i40e_aqc_request_resource *>(d->params.raw);
     rr->timeout = 180000;
 #ifdef DEBUG_ADMINQ
-    queue.log << "    res_id=" << rr->resource_id << logger::endl;
-    queue.log << "    res_nu=" << rr->resource_number << logger::endl;
+    I40E_LOG(queue.log) << "    res_id=" << rr->resource_id << logger::endl;
+    I40E_LOG(queue.log) << "    res_nu=" << rr->resource_number << logger::endl;
 #endif
     desc_complete(0);
   } else if (d->opcode == i40e_aqc_opc_release_resource) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  release resource" << logger::endl;
+    I40E_LOG(queue.log) << "  release resource" << logger::endl;
 #endif
 #ifdef DEBUG_ADMINQ
     struct i40e_aqc_request_resource *rr =
         reinterpret_cast<struct i40e_aqc_request_resource *>(d->params.raw);
-    queue.log << "    res_id=" << rr->resource_id << logger::endl;
-    queue.log << "    res_nu=" << rr->resource_number << logger::endl;
+    I40E_LOG(queue.log) << "    res_id=" << rr->resource_id << logger::endl;
+    I40E_LOG(queue.log) << "    res_nu=" << rr->resource_number << logger::endl;
 #endif
     desc_complete(0);
   } else if (d->opcode == i40e_aqc_opc_clear_pxe_mode) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  clear PXE mode" << logger::endl;
+    I40E_LOG(queue.log) << "  clear PXE mode" << logger::endl;
 #endif
     dev.regs.gllan_rctl_0 &= ~I40E_GLLAN_RCTL_0_PXE_MODE_MASK;
     desc_complete(0);
   } else if (d->opcode == i40e_aqc_opc_list_func_capabilities ||
              d->opcode == i40e_aqc_opc_list_dev_capabilities) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  get dev/fun caps" << logger::endl;
+    I40E_LOG(queue.log) << "  get dev/fun caps" << logger::endl;
 #endif
     struct i40e_aqc_list_capabilites *lc =
         reinterpret_cast<struct i40e_aqc_list_capabilites *>(d->params.raw);
@@ -197,14 +198,14 @@ void queue_admin_tx::admin_desc_ctx::process() {
 
     if (sizeof(caps) <= d->datalen) {
 #ifdef DEBUG_ADMINQ
-      queue.log << "    data fits" << logger::endl;
+      I40E_LOG(queue.log) << "    data fits" << logger::endl;
 #endif
       // data fits within the buffer
       lc->count = num_caps;
       desc_complete_indir(0, caps, sizeof(caps));
     } else {
 #ifdef DEBUG_ADMINQ
-      queue.log << "    data doesn't fit" << logger::endl;
+      I40E_LOG(queue.log) << "    data doesn't fit" << logger::endl;
 #endif
       // data does not fit
       d->datalen = sizeof(caps);
@@ -212,12 +213,12 @@ void queue_admin_tx::admin_desc_ctx::process() {
     }
   } else if (d->opcode == i40e_aqc_opc_lldp_stop) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  lldp stop" << logger::endl;
+    I40E_LOG(queue.log) << "  lldp stop" << logger::endl;
 #endif
     desc_complete(0);
   } else if (d->opcode == i40e_aqc_opc_mac_address_read) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  read mac" << logger::endl;
+    I40E_LOG(queue.log) << "  read mac" << logger::endl;
 #endif
     struct i40e_aqc_mac_address_read *ar =
         reinterpret_cast<struct i40e_aqc_mac_address_read *>(d->params.raw);
@@ -225,7 +226,7 @@ void queue_admin_tx::admin_desc_ctx::process() {
     struct i40e_aqc_mac_address_read_data ard;
     uint64_t mac = dev.runner_->GetMacAddr();
 #ifdef DEBUG_ADMINQ
-    queue.log << "    mac = " << mac << logger::endl;
+    I40E_LOG(queue.log) << "    mac = " << mac << logger::endl;
 #endif
     memcpy(ard.pf_lan_mac, &mac, 6);
     memcpy(ard.port_mac, &mac, 6);
@@ -234,7 +235,7 @@ void queue_admin_tx::admin_desc_ctx::process() {
     desc_complete_indir(0, &ard, sizeof(ard));
   } else if (d->opcode == i40e_aqc_opc_get_phy_abilities) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  get phy abilities" << logger::endl;
+    I40E_LOG(queue.log) << "  get phy abilities" << logger::endl;
 #endif
     struct i40e_aq_get_phy_abilities_resp par;
     memset(&par, 0, sizeof(par));
@@ -250,7 +251,7 @@ void queue_admin_tx::admin_desc_ctx::process() {
     desc_complete_indir(0, &par, sizeof(par), 0, true);
   } else if (d->opcode == i40e_aqc_opc_get_link_status) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  link status" << logger::endl;
+    I40E_LOG(queue.log) << "  link status" << logger::endl;
 #endif
     struct i40e_aqc_get_link_status *gls =
         reinterpret_cast<struct i40e_aqc_get_link_status *>(d->params.raw);
@@ -272,7 +273,7 @@ void queue_admin_tx::admin_desc_ctx::process() {
     desc_complete(0);
   } else if (d->opcode == i40e_aqc_opc_get_switch_config) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  get switch config" << logger::endl;
+    I40E_LOG(queue.log) << "  get switch config" << logger::endl;
 #endif
     struct i40e_aqc_switch_seid *sw =
         reinterpret_cast<struct i40e_aqc_switch_seid *>(d->params.raw);
@@ -329,7 +330,7 @@ void queue_admin_tx::admin_desc_ctx::process() {
     hr.num_reported = report;
     hr.num_total = cnt;
 #ifdef DEBUG_ADMINQ
-    queue.log << "    report=" << report << " cnt=" << cnt
+    I40E_LOG(queue.log) << "    report=" << report << " cnt=" << cnt
               << "  seid=" << sw->seid << logger::endl;
 #endif
 
@@ -342,7 +343,7 @@ void queue_admin_tx::admin_desc_ctx::process() {
     desc_complete_indir(0, buf, buflen);
   } else if (d->opcode == i40e_aqc_opc_set_switch_config) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  set switch config" << logger::endl;
+    I40E_LOG(queue.log) << "  set switch config" << logger::endl;
 #endif
     /* TODO: lots of interesting things here like l2 filtering etc. that are
      * relevant.
@@ -353,7 +354,7 @@ void queue_admin_tx::admin_desc_ctx::process() {
     desc_complete(0);
   } else if (d->opcode == i40e_aqc_opc_get_vsi_parameters) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  get vsi parameters" << logger::endl;
+    I40E_LOG(queue.log) << "  get vsi parameters" << logger::endl;
 #endif
     /*struct i40e_aqc_add_get_update_vsi *v =
         reinterpret_cast<struct i40e_aqc_add_get_update_vsi *>(
@@ -367,24 +368,24 @@ void queue_admin_tx::admin_desc_ctx::process() {
     desc_complete_indir(0, &pd, sizeof(pd));
   } else if (d->opcode == i40e_aqc_opc_update_vsi_parameters) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  update vsi parameters" << logger::endl;
+    I40E_LOG(queue.log) << "  update vsi parameters" << logger::endl;
 #endif
     /* TODO */
     desc_complete(0);
   } else if (d->opcode == i40e_aqc_opc_set_dcb_parameters) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  set dcb parameters" << logger::endl;
+    I40E_LOG(queue.log) << "  set dcb parameters" << logger::endl;
 #endif
     /* TODO */
     desc_complete(0);
   } else if (d->opcode == i40e_aqc_opc_configure_vsi_bw_limit) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  configure vsi bw limit" << logger::endl;
+    I40E_LOG(queue.log) << "  configure vsi bw limit" << logger::endl;
 #endif
     desc_complete(0);
   } else if (d->opcode == i40e_aqc_opc_query_vsi_bw_config) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  query vsi bw config" << logger::endl;
+    I40E_LOG(queue.log) << "  query vsi bw config" << logger::endl;
 #endif
     struct i40e_aqc_query_vsi_bw_config_resp bwc;
     memset(&bwc, 0, sizeof(bwc));
@@ -393,7 +394,7 @@ void queue_admin_tx::admin_desc_ctx::process() {
     desc_complete_indir(0, &bwc, sizeof(bwc));
   } else if (d->opcode == i40e_aqc_opc_query_vsi_ets_sla_config) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  query vsi ets sla config" << logger::endl;
+    I40E_LOG(queue.log) << "  query vsi ets sla config" << logger::endl;
 #endif
     struct i40e_aqc_query_vsi_ets_sla_config_resp sla;
     memset(&sla, 0, sizeof(sla));
@@ -402,7 +403,7 @@ void queue_admin_tx::admin_desc_ctx::process() {
     desc_complete_indir(0, &sla, sizeof(sla));
   } else if (d->opcode == i40e_aqc_opc_remove_macvlan) {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  remove macvlan" << logger::endl;
+    I40E_LOG(queue.log) << "  remove macvlan" << logger::endl;
 #endif
     struct i40e_aqc_macvlan *m =
         reinterpret_cast<struct i40e_aqc_macvlan *>(d->params.raw);
@@ -414,7 +415,7 @@ void queue_admin_tx::admin_desc_ctx::process() {
     desc_complete_indir(0, data, d->datalen);
   } else {
 #ifdef DEBUG_ADMINQ
-    queue.log << "  uknown opcode=" << d->opcode << logger::endl;
+    I40E_LOG(queue.log) << "  uknown opcode=" << d->opcode << logger::endl;
 #endif
     // desc_complete(I40E_AQ_RC_ESRCH);
     desc_complete(0);
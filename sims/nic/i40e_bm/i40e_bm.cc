@@ -73,16 +73,17 @@ void i40e_bm::SetupIntro(struct SimbricksProtoPcieDevIntro &di) {
 }
 
 void i40e_bm::DmaComplete(nicbm::DMAOp &op) {
-  dma_base &dma = dynamic_cast<dma_base &>(op);
+  // all DMA operations the device issues derive from dma_base
+  dma_base &dma = static_cast<dma_base &>(op);
 #ifdef DEBUG_DEV
-  log << "dma_complete(" << &op << ")" << logger::endl;
+  I40E_LOG(log) << "dma_complete(" << &op << ")" << logger::endl;
 #endif
   dma.done();
 }
 
 void i40e_bm::EthRx(uint8_t port, const void *data, size_t len) {
 #ifdef DEBUG_DEV
-  log << "i40e: received packet len=" << len << logger::endl;
+  I40E_LOG(log) << "i40e: received packet len=" << len << logger::endl;
 #endif
   lanmgr.packet_received(data, len);
 }
@@ -96,7 +97,8 @@ void i40e_bm::RegRead(uint8_t bar, uint64_t addr, void *dest, size_t len) {
     dest_p[0] = RegRead32(bar, addr);
     dest_p[1] = RegRead32(bar, addr + 4);
   } else {
-    log << "currently we only support 4/8B reads (got " << len << ")"
+    I40E_LOG_ERR(log)
+        << "currently we only support 4/8B reads (got " << len << ")"
         << logger::endl;
     abort();
   }
@@ -108,7 +110,7 @@ uint32_t i40e_bm::RegRead32(uint8_t bar, uint64_t addr) {
   } else if (bar == BAR_IO) {
     return reg_io_read(addr);
   } else {
-    log << "invalid BAR " << (int)bar << logger::endl;
+    I40E_LOG_ERR(log) << "invalid BAR " << (int)bar << logger::endl;
     abort();
   }
 }
@@ -123,7 +125,8 @@ void i40e_bm::RegWrite(uint8_t bar, uint64_t addr, const void *src,
     RegWrite32(bar, addr, src_p[0]);
     RegWrite32(bar, addr + 4, src_p[1]);
   } else {
-    log << "currently we only support 4/8B writes (got " << len << ")"
+    I40E_LOG_ERR(log)
+        << "currently we only support 4/8B writes (got " << len << ")"
         << logger::endl;
     abort();
   }
@@ -135,18 +138,20 @@ void i40e_bm::RegWrite32(uint8_t bar, uint64_t addr, uint32_t val) {
   } else if (bar == BAR_IO) {
     reg_io_write(addr, val);
   } else {
-    log << "invalid BAR " << (int)bar << logger::endl;
+    I40E_LOG_ERR(log) << "invalid BAR " << (int)bar << logger::endl;
     abort();
   }
 }
 
 uint32_t i40e_bm::reg_io_read(uint64_t addr) {
-  log << "unhandled io read addr=" << addr << logger::endl;
+  I40E_LOG(log) << sim_log::LogLevel::warn
+      << "unhandled io read addr=" << addr << logger::endl;
   return 0;
 }
 
 void i40e_bm::reg_io_write(uint64_t addr, uint32_t val) {
-  log << "unhandled io write addr=" << addr << " val=" << val << logger::endl;
+  I40E_LOG(log) << sim_log::LogLevel::warn
+      << "unhandled io write addr=" << addr << " val=" << val << logger::endl;
 }
 
 uint32_t i40e_bm::reg_mem_read32(uint64_t addr) {
@@ -496,7 +501,7 @@ uint32_t i40e_bm::reg_mem_read32(uint64_t addr) {
 
       default:
 #ifdef DEBUG_DEV
-        log << "unhandled mem read addr=" << addr << logger::endl;
+        I40E_LOG(log) << "unhandled mem read addr=" << addr << logger::endl;
 #endif
         break;
     }
@@ -743,7 +748,7 @@ void i40e_bm::reg_mem_write32(uint64_t addr, uint32_t val) {
 
       default:
 #ifdef DEBUG_DEV
-        log << "unhandled mem write addr=" << addr << " val=" << val
+        I40E_LOG(log) << "unhandled mem write addr=" << addr << " val=" << val
             << logger::endl;
 #endif
         break;
@@ -754,7 +759,7 @@ void i40e_bm::reg_mem_write32(uint64_t addr, uint32_t val) {
 void i40e_bm::Timed(nicbm::TimedEvent &ev) {
   int_ev &iev = *((int_ev *)&ev);
 #ifdef DEBUG_DEV
-  log << "timed_event: triggering interrupt (" << iev.vec << ")"
+  I40E_LOG(log) << "timed_event: triggering interrupt (" << iev.vec << ")"
       << logger::endl;
 #endif
   iev.armed = false;
@@ -762,7 +767,8 @@ void i40e_bm::Timed(nicbm::TimedEvent &ev) {
   if (int_msix_en_) {
     runner_->MsiXIssue(iev.vec);
   } else if (iev.vec > 0) {
-    log << "timed_event: MSI-X disabled, but vec != 0" << logger::endl;
+    I40E_LOG_ERR(log)
+        << "timed_event: MSI-X disabled, but vec != 0" << logger::endl;
     abort();
   } else {
     runner_->MsiIssue(0);
@@ -784,7 +790,8 @@ void i40e_bm::SignalInterrupt(uint16_t vec, uint8_t itr) {
     // noitr
     mindelay = 0;
   } else {
-    log << "signal_interrupt() invalid itr (" << itr << ")" << logger::endl;
+    I40E_LOG_ERR(log)
+        << "signal_interrupt() invalid itr (" << itr << ")" << logger::endl;
     abort();
   }
 
@@ -793,7 +800,7 @@ void i40e_bm::SignalInterrupt(uint16_t vec, uint8_t itr) {
   if (iev.armed && iev.time_ <= newtime) {
     // already armed and this is not scheduled sooner
 #ifdef DEBUG_DEV
-    log << "signal_interrupt: vec " << vec << " already scheduled"
+    I40E_LOG(log) << "signal_interrupt: vec " << vec << " already scheduled"
         << logger::endl;
 #endif
     return;
@@ -806,8 +813,8 @@ void i40e_bm::SignalInterrupt(uint16_t vec, uint8_t itr) {
   iev.time_ = newtime;
 
 #ifdef DEBUG_DEV
-  log << "signal_interrupt: scheduled vec " << vec << " for time=" << newtime
-      << " (itr " << itr << ")" << logger::endl;
+  I40E_LOG(log) << "signal_interrupt: scheduled vec " << vec
+      << " for time=" << newtime << " (itr " << itr << ")" << logger::endl;
 #endif
 
   runner_->EventSchedule(iev);
@@ -873,7 +880,8 @@ void shadow_ram::reg_updated() {
   is_write = (val & I40E_GLNVM_SRCTL_WRITE_MASK);
 
 #ifdef DEBUG_DEV
-  log << "shadow ram op addr=" << addr << " w=" << is_write << logger::endl;
+  I40E_LOG(log) << "shadow ram op addr=" << addr << " w=" << is_write
+      << logger::endl;
 #endif
 
   if (is_write) {
@@ -907,7 +915,7 @@ uint16_t shadow_ram::read(uint16_t addr) {
 
     default:
 #ifdef DEBUG_DEV
-      log << "TODO shadow memory read addr=" << addr << logger::endl;
+      I40E_LOG(log) << "TODO shadow memory read addr=" << addr << logger::endl;
 #endif
       break;
   }
@@ -917,7 +925,7 @@ uint16_t shadow_ram::read(uint16_t addr) {
 
 void shadow_ram::write(uint16_t addr, uint16_t val) {
 #ifdef DEBUG_DEV
-  log << "TODO shadow memory write addr=" << addr << " val=" << val
+  I40E_LOG(log) << "TODO shadow memory write addr=" << addr << " val=" << val
       << logger::endl;
 #endif
 }
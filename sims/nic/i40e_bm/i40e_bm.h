@@ -27,7 +27,6 @@
 #include <stdint.h>
 
 #include <deque>
-#include <sstream>
 #include <string>
 extern "C" {
 #include <simbricks/pcie/proto.h>
@@ -39,6 +38,7 @@ extern "C" {
 // #define DEBUG_LAN
 // #define DEBUG_HMC
 // #define DEBUG_QUEUES
+// #define LOG_DISABLE
 
 struct i40e_aq_desc;
 struct i40e_tx_desc;
@@ -62,29 +62,153 @@ class int_ev : public nicbm::TimedEvent {
   int_ev();
 };
 
-class logger : public std::ostream {
+/**
+ * Stream-style logger for the device model.
+ *
+ * The level of a line (info unless a `sim_log::LogLevel` is streamed in
+ * first) is checked against the logger's own threshold before anything is
+ * recorded, so disabled lines cost a branch per item. Lines are written
+ * through I40E_LOG(), which defining LOG_DISABLE compiles out entirely
+ * except for error lines written through I40E_LOG_ERR().
+ * Enabled lines are recorded in binary form and either formatted and written
+ * to stderr right away, or, with the environment variable I40E_LOG_ASYNC set,
+ * handed to a ring buffer that a background thread formats and writes out in
+ * large batches. The threshold is I40E_LOG_LEVEL (debug, info, warn, error,
+ * off) if set, and the sim_log registry level at construction otherwise.
+ */
+class logger {
  public:
   static const char endl = '\n';
+  /** Maximum size of one binary line record, longer lines are truncated. */
+  static const size_t kMaxRecord = 512;
+
+  /** Item tags in binary line records */
+  enum item_type : uint8_t {
+    kItemChar,
+    kItemHex,
+    kItemPtr,
+    kItemStr,
+  };
 
  protected:
+  enum line_state {
+    kLineStart,
+    kLineOn,
+    kLineOff,
+  };
+
   std::string label;
   nicbm::Runner::Device &dev;
   nicbm::Runner *runner;
-  std::stringstream ss;
+
+  sim_log::LogLevel level;
+  sim_log::LogLevel line_level;
+  enum line_state state;
+  size_t rec_len;
+  uint8_t rec[kMaxRecord];
+
+  /** Decide whether the current line is logged, called on its first item. */
+  void line_begin();
+  /** Hand the completed record for the current line to the backend. */
+  void line_end();
+
+  void put_hex(enum item_type t, uint64_t v);
+  void put_str(const char *str);
+
+  inline bool line_enabled() {
+    if (state == kLineStart)
+      line_begin();
+    return state == kLineOn;
+  }
 
  public:
+  /** Swallows a logged line, for I40E_LOG() with LOG_DISABLE. */
+  struct voidify {
+    void operator&(logger &) {
+    }
+  };
+
   explicit logger(const std::string &label_, nicbm::Runner::Device &dev_);
-  logger &operator<<(char c);
-  logger &operator<<(int32_t c);
-  logger &operator<<(uint8_t i);
-  logger &operator<<(uint16_t i);
-  logger &operator<<(uint32_t i);
-  logger &operator<<(uint64_t i);
-  logger &operator<<(bool c);
-  logger &operator<<(const char *str);
-  logger &operator<<(void *str);
+
+  /** Set level for the current line, must be the first item of the line. */
+  logger &operator<<(sim_log::LogLevel l) {
+    if (state == kLineStart)
+      line_level = l;
+    return *this;
+  }
+
+  logger &operator<<(char c) {
+    if (c == endl) {
+      if (line_enabled())
+        line_end();
+      state = kLineStart;
+      line_level = sim_log::LogLevel::info;
+    } else if (line_enabled() && rec_len + 2 <= kMaxRecord) {
+      rec[rec_len++] = kItemChar;
+      rec[rec_len++] = c;
+    }
+    return *this;
+  }
+
+  logger &operator<<(int32_t i) {
+    if (line_enabled())
+      put_hex(kItemHex, static_cast<uint32_t>(i));
+    return *this;
+  }
+
+  logger &operator<<(uint8_t i) {
+    if (line_enabled())
+      put_hex(kItemHex, i);
+    return *this;
+  }
+
+  logger &operator<<(uint16_t i) {
+    if (line_enabled())
+      put_hex(kItemHex, i);
+    return *this;
+  }
+
+  logger &operator<<(uint32_t i) {
+    if (line_enabled())
+      put_hex(kItemHex, i);
+    return *this;
+  }
+
+  logger &operator<<(uint64_t i) {
+    if (line_enabled())
+      put_hex(kItemHex, i);
+    return *this;
+  }
+
+  logger &operator<<(bool b) {
+    if (line_enabled())
+      put_hex(kItemHex, b);
+    return *this;
+  }
+
+  logger &operator<<(const char *str) {
+    if (line_enabled())
+      put_str(str);
+    return *this;
+  }
+
+  logger &operator<<(void *ptr) {
+    if (line_enabled())
+      put_hex(kItemPtr, reinterpret_cast<uintptr_t>(ptr));
+    return *this;
+  }
 };
 
+/* Write a line to logger `l`: I40E_LOG(log) << "x=" << x << logger::endl;
+ * With LOG_DISABLE the items are not even evaluated. Error lines, often the
+ * last words before an abort(), go through I40E_LOG_ERR() and are kept. */
+#ifdef LOG_DISABLE
+#define I40E_LOG(l) true ? (void)0 : ::i40e::logger::voidify() & (l)
+#else
+#define I40E_LOG(l) (l)
+#endif
+#define I40E_LOG_ERR(l) ((l) << sim_log::LogLevel::error)
+
 /**
  * Base-class for descriptor queues (RX/TX, Admin RX/TX).
  *
@@ -64,7 +64,7 @@ void lan::reset() {
 void lan::qena_updated(uint16_t idx, bool rx) {
   uint32_t &reg = (rx ? dev.regs.qrx_ena[idx] : dev.regs.qtx_ena[idx]);
 #ifdef DEBUG_LAN
-  log << " qena updated idx=" << idx << " rx=" << rx << " reg=" << reg
+  I40E_LOG(log) << " qena updated idx=" << idx << " rx=" << rx << " reg=" << reg
       << logger::endl;
 #endif
   lan_queue_base &q = (rx ? static_cast<lan_queue_base &>(*rxqs[idx])
@@ -79,7 +79,7 @@ void lan::qena_updated(uint16_t idx, bool rx) {
 
 void lan::tail_updated(uint16_t idx, bool rx) {
 #ifdef DEBUG_LAN
-  log << " tail updated idx=" << idx << " rx=" << rx << logger::endl;
+  I40E_LOG(log) << " tail updated idx=" << idx << " rx=" << rx << logger::endl;
 #endif
 
   lan_queue_base &q = (rx ? static_cast<lan_queue_base &>(*rxqs[idx])
@@ -122,14 +122,15 @@ bool lan::rss_steering(const void *data, size_t len, uint16_t &queue,
   uint16_t idx = hash % luts;
   queue = (dev.regs.pfqf_hlut[idx / 4] >> (8 * (idx % 4))) & 0x3f;
 #ifdef DEBUG_LAN
-  log << "  q=" << queue << " h=" << hash << " i=" << idx << logger::endl;
+  I40E_LOG(log) << "  q=" << queue << " h=" << hash << " i=" << idx
+      << logger::endl;
 #endif
   return true;
 }
 
 void lan::packet_received(const void *data, size_t len) {
 #ifdef DEBUG_LAN
-  log << " packet received len=" << len << logger::endl;
+  I40E_LOG(log) << " packet received len=" << len << logger::endl;
 #endif
 
   uint32_t hash = 0;
@@ -164,7 +165,7 @@ void lan_queue_base::enable() {
     return;
 
 #ifdef DEBUG_LAN
-  log << " lan enabling queue " << idx << logger::endl;
+  I40E_LOG(log) << " lan enabling queue " << idx << logger::endl;
 #endif
   enabling = true;
 
@@ -182,7 +183,7 @@ void lan_queue_base::enable() {
 
 void lan_queue_base::ctx_fetched() {
 #ifdef DEBUG_LAN
-  log << " lan ctx fetched " << idx << logger::endl;
+  I40E_LOG(log) << " lan ctx fetched " << idx << logger::endl;
 #endif
 
   initialize();
@@ -196,7 +197,7 @@ void lan_queue_base::ctx_fetched() {
 
 void lan_queue_base::disable() {
 #ifdef DEBUG_LAN
-  log << " lan disabling queue " << idx << logger::endl;
+  I40E_LOG(log) << " lan disabling queue " << idx << logger::endl;
 #endif
   enabled = false;
   // TODO(antoinek): write back
@@ -207,7 +208,8 @@ void lan_queue_base::interrupt() {
   uint32_t qctl = reg_intqctl;
   uint32_t gctl = lanmgr.dev.regs.pfint_dyn_ctl0;
 #ifdef DEBUG_LAN
-  log << " interrupt qctl=" << qctl << " gctl=" << gctl << logger::endl;
+  I40E_LOG(log) << " interrupt qctl=" << qctl << " gctl=" << gctl
+      << logger::endl;
 #endif
 
   uint16_t msix_idx = (qctl & I40E_QINT_TQCTL_MSIX_INDX_MASK) >>
@@ -219,14 +221,14 @@ void lan_queue_base::interrupt() {
                    !!(gctl & I40E_PFINT_DYN_CTL0_INTENA_MASK);
   if (!cause_ena) {
 #ifdef DEBUG_LAN
-    log << " interrupt cause disabled" << logger::endl;
+    I40E_LOG(log) << " interrupt cause disabled" << logger::endl;
 #endif
     return;
   }
 
   if (msix_idx == 0) {
 #ifdef DEBUG_LAN
-    log << "   setting int0.qidx=" << msix0_idx << logger::endl;
+    I40E_LOG(log) << "   setting int0.qidx=" << msix0_idx << logger::endl;
 #endif
     lanmgr.dev.regs.pfint_icr0 |=
         I40E_PFINT_ICR0_INTEVENT_MASK |
@@ -263,7 +265,7 @@ void lan_queue_rx::reset() {
 
 void lan_queue_rx::initialize() {
 #ifdef DEBUG_LAN
-  log << " initialize()" << logger::endl;
+  I40E_LOG(log) << " initialize()" << logger::endl;
 #endif
   uint8_t *ctx_p = reinterpret_cast<uint8_t *>(ctx);
 
@@ -288,14 +290,14 @@ void lan_queue_rx::initialize() {
   rxmax = (((*rxmax_p) >> 6) & ((1 << 14) - 1)) * 128;
 
   if (dtype != 0) {
-    log << "lan_queue_rx::initialize: no header split supported"
+    I40E_LOG_ERR(log) << "lan_queue_rx::initialize: no header split supported"
         << logger::endl;
     abort();
   }
 
 #ifdef DEBUG_LAN
-  log << "  head=" << reg_dummy_head << " base=" << base << " len=" << len
-      << " dbsz=" << dbuff_size << " hbsz=" << hbuff_size
+  I40E_LOG(log) << "  head=" << reg_dummy_head << " base=" << base
+      << " len=" << len << " dbsz=" << dbuff_size << " hbsz=" << hbuff_size
       << " dtype=" << (unsigned)dtype << " longdesc=" << longdesc
       << " crcstrip=" << crc_strip << " rxmax=" << rxmax << logger::endl;
 #endif
@@ -401,8 +403,8 @@ void lan_queue_rx::packet_received(const void *data, size_t pktlen,
 
   if (dcache.size() < num_descs) {
 #ifdef DEBUG_LAN
-    log << " not enough rx descs (" << num_descs << ", dropping packet"
-        << logger::endl;
+    I40E_LOG(log) << " not enough rx descs (" << num_descs
+        << ", dropping packet" << logger::endl;
 #endif
     return;
   }
@@ -426,7 +428,7 @@ void lan_queue_rx::packet_received(const void *data, size_t pktlen,
     rx_desc_ctx &ctx = *dcache.front();
 
 #ifdef DEBUG_LAN
-    log << " packet part=" << i << " received didx=" << ctx.index
+    I40E_LOG(log) << " packet part=" << i << " received didx=" << ctx.index
         << " cnt=" << dcache.size() << logger::endl;
 #endif
     dcache.pop_front();
@@ -504,7 +506,7 @@ void lan_queue_tx::reset() {
 
 void lan_queue_tx::initialize() {
 #ifdef DEBUG_LAN
-  log << " initialize()" << logger::endl;
+  I40E_LOG(log) << " initialize()" << logger::endl;
 #endif
   uint8_t *ctx_p = reinterpret_cast<uint8_t *>(ctx);
 
@@ -522,8 +524,9 @@ void lan_queue_tx::initialize() {
   hwb_addr = *hwb_addr_p;
 
 #ifdef DEBUG_LAN
-  log << "  head=" << reg_dummy_head << " base=" << base << " len=" << len
-      << " hwb=" << hwb << " hwb_addr=" << hwb_addr << logger::endl;
+  I40E_LOG(log) << "  head=" << reg_dummy_head << " base=" << base
+      << " len=" << len << " hwb=" << hwb << " hwb_addr=" << hwb_addr
+      << logger::endl;
 #endif
 }
 
@@ -542,7 +545,7 @@ void lan_queue_tx::do_writeback(uint32_t first_idx, uint32_t first_pos,
     dma->dma_addr_ = hwb_addr;
 
 #ifdef DEBUG_LAN
-    log << " hwb=" << *((uint32_t *)dma->data_) << logger::endl;
+    I40E_LOG(log) << " hwb=" << *((uint32_t *)dma->data_) << logger::endl;
 #endif
     dev.runner_->IssueDma(*dma);
   }
@@ -564,9 +567,10 @@ bool lan_queue_tx::trigger_tx_packet() {
     return false;
 
 #ifdef DEBUG_LAN
-  log << "trigger_tx_packet(n=" << n
+  I40E_LOG(log) << "trigger_tx_packet(n=" << n
       << ", firstidx=" << ready_segments.at(0)->index << ")" << logger::endl;
-  log << "  tso_off=" << tso_off << " tso_len=" << tso_len << logger::endl;
+  I40E_LOG(log) << "  tso_off=" << tso_off << " tso_len=" << tso_len
+      << logger::endl;
 #endif
 
   // check if we have a context descriptor first
@@ -585,7 +589,7 @@ bool lan_queue_tx::trigger_tx_packet() {
     tsyn = !!(cmd & I40E_TX_CTX_DESC_TSYN);
 
 #ifdef DEBUG_LAN
-    log << "  tso=" << tso << " mss=" << tso_mss << logger::endl;
+    I40E_LOG(log) << "  tso=" << tso << " mss=" << tso_mss << logger::endl;
 #endif
 
     d_skip = 1;
@@ -597,12 +601,14 @@ bool lan_queue_tx::trigger_tx_packet() {
     d1 = rd->d->cmd_type_offset_bsz;
 
 #ifdef DEBUG_LAN
-    log << " data fetched didx=" << rd->index << " d1=" << d1 << logger::endl;
+    I40E_LOG(log) << " data fetched didx=" << rd->index << " d1=" << d1
+        << logger::endl;
 #endif
 
     dtype = (d1 & I40E_TXD_QW1_DTYPE_MASK) >> I40E_TXD_QW1_DTYPE_SHIFT;
     if (dtype != I40E_TX_DESC_DTYPE_DATA) {
-      log << "trigger tx desc is not a data descriptor idx=" << rd->index
+      I40E_LOG_ERR(log)
+          << "trigger tx desc is not a data descriptor idx=" << rd->index
           << " d1=" << d1 << logger::endl;
       abort();
     }
@@ -631,7 +637,7 @@ bool lan_queue_tx::trigger_tx_packet() {
     total_len += pkt_len;
 
 #ifdef DEBUG_LAN
-    log << "    eop=" << eop << " len=" << pkt_len << logger::endl;
+    I40E_LOG(log) << "    eop=" << eop << " len=" << pkt_len << logger::endl;
 #endif
   }
 
@@ -650,7 +656,8 @@ bool lan_queue_tx::trigger_tx_packet() {
     }
   } else {
     if (total_len > MTU) {
-      log << "    packet is longer (" << total_len << ") than MTU (" << MTU
+      I40E_LOG_ERR(log)
+          << "    packet is longer (" << total_len << ") than MTU (" << MTU
           << ")" << logger::endl;
       abort();
     }
@@ -658,7 +665,7 @@ bool lan_queue_tx::trigger_tx_packet() {
   }
 
 #ifdef DEBUG_LAN
-  log << "    iipt=" << iipt << " l4t=" << l4t << " maclen=" << maclen
+  I40E_LOG(log) << "    iipt=" << iipt << " l4t=" << l4t << " maclen=" << maclen
       << " iplen=" << iplen << " l4len=" << l4len << " total_len=" << total_len
       << " data_limit=" << data_limit << logger::endl;
 
@@ -681,9 +688,9 @@ bool lan_queue_tx::trigger_tx_packet() {
         end = data_limit;
 
 #ifdef DEBUG_LAN
-      log << "    copying data from off=" << off << " idx=" << rd->index
-          << " start=" << start << " end=" << end << " tso_len=" << tso_len
-          << logger::endl;
+      I40E_LOG(log) << "    copying data from off=" << off
+          << " idx=" << rd->index << " start=" << start << " end=" << end
+          << " tso_len=" << tso_len << logger::endl;
 #endif
 
       memcpy(pktbuf + tso_len, (uint8_t *)rd->data + (start - off),
@@ -699,7 +706,7 @@ bool lan_queue_tx::trigger_tx_packet() {
 
   if (!tso) {
 #ifdef DEBUG_LAN
-    log << "    normal non-tso packet" << logger::endl;
+    I40E_LOG(log) << "    normal non-tso packet" << logger::endl;
 #endif
 
     if (l4t == I40E_TX_DESC_CMD_L4T_EOFT_TCP) {
@@ -713,7 +720,7 @@ bool lan_queue_tx::trigger_tx_packet() {
     dev.runner_->EthSend(pktbuf, tso_len);
   } else {
 #ifdef DEBUG_LAN
-    log << "    tso packet off=" << tso_off << " len=" << tso_len
+    I40E_LOG(log) << "    tso packet off=" << tso_off << " len=" << tso_len
         << logger::endl;
 #endif
 
@@ -752,7 +759,7 @@ bool lan_queue_tx::trigger_tx_packet() {
   }
 
 #ifdef DEBUG_LAN
-  log << "    unit done" << logger::endl;
+  I40E_LOG(log) << "    unit done" << logger::endl;
 #endif
   while (dcnt-- > 0) {
     ready_segments.front()->processed();
@@ -779,7 +786,8 @@ void lan_queue_tx::tx_desc_ctx::prepare() {
   uint64_t d1 = d->cmd_type_offset_bsz;
 
 #ifdef DEBUG_LAN
-  queue.log << " desc fetched didx=" << index << " d1=" << d1 << logger::endl;
+  I40E_LOG(queue.log) << " desc fetched didx=" << index << " d1=" << d1
+      << logger::endl;
 #endif
 
   uint8_t dtype = (d1 & I40E_TXD_QW1_DTYPE_MASK) >> I40E_TXD_QW1_DTYPE_SHIFT;
@@ -788,7 +796,7 @@ void lan_queue_tx::tx_desc_ctx::prepare() {
         (d1 & I40E_TXD_QW1_TX_BUF_SZ_MASK) >> I40E_TXD_QW1_TX_BUF_SZ_SHIFT;
 
 #ifdef DEBUG_LAN
-    queue.log << "  bufaddr=" << d->buffer_addr << " len=" << len
+    I40E_LOG(queue.log) << "  bufaddr=" << d->buffer_addr << " len=" << len
               << logger::endl;
 #endif
 
@@ -797,14 +805,15 @@ void lan_queue_tx::tx_desc_ctx::prepare() {
 #ifdef DEBUG_LAN
     struct i40e_tx_context_desc *ctxd =
         reinterpret_cast<struct i40e_tx_context_desc *>(d);
-    queue.log << "  context descriptor: tp=" << ctxd->tunneling_params
+    I40E_LOG(queue.log) << "  context descriptor: tp=" << ctxd->tunneling_params
               << " l2t=" << ctxd->l2tag2 << " tctm=" << ctxd->type_cmd_tso_mss
               << logger::endl;
 #endif
 
     prepared();
   } else {
-    queue.log << "txq: only support context & data descriptors" << logger::endl;
+    I40E_LOG_ERR(queue.log)
+              << "txq: only support context & data descriptors" << logger::endl;
     abort();
   }
 }
@@ -833,7 +842,7 @@ lan_queue_tx::dma_hwb::~dma_hwb() {
 
 void lan_queue_tx::dma_hwb::done() {
 #ifdef DEBUG_LAN
-  queue.log << " tx head written back" << logger::endl;
+  I40E_LOG(queue.log) << " tx head written back" << logger::endl;
 #endif
   queue.writeback_done(pos, cnt);
   queue.trigger();
@@ -76,7 +76,7 @@ void queue_base::trigger_fetch() {
     fetch_cnt = len - next_idx;
 
 #ifdef DEBUG_QUEUES
-  log << "fetching avail=" << desc_avail << " cnt=" << fetch_cnt
+  I40E_LOG(log) << "fetching avail=" << desc_avail << " cnt=" << fetch_cnt
       << " idx=" << next_idx << logger::endl;
 #endif
 
@@ -101,7 +101,7 @@ void queue_base::trigger_fetch() {
   dma->dma_addr_ = base + next_idx * desc_len;
   dma->pos = first_pos;
 #ifdef DEBUG_QUEUES
-  log << "    dma = " << dma << logger::endl;
+  I40E_LOG(log) << "    dma = " << dma << logger::endl;
 #endif
   dev.runner_->IssueDma(*dma);
 }
@@ -126,7 +126,7 @@ void queue_base::trigger_process() {
 
     ctx.state = desc_ctx::DESC_PROCESSING;
 #ifdef DEBUG_QUEUES
-    log << "processing desc " << ctx.index << logger::endl;
+    I40E_LOG(log) << "processing desc " << ctx.index << logger::endl;
 #endif
     ctx.process();
   }
@@ -148,7 +148,7 @@ void queue_base::trigger_writeback() {
     cnt = len - active_first_idx;
 
 #ifdef DEBUG_QUEUES
-  log << "writing back avail=" << avail << " cnt=" << cnt
+  I40E_LOG(log) << "writing back avail=" << avail << " cnt=" << cnt
       << " idx=" << active_first_idx << logger::endl;
 #endif
 
@@ -172,7 +172,7 @@ void queue_base::trigger() {
 
 void queue_base::reset() {
 #ifdef DEBUG_QUEUES
-  log << "reset" << logger::endl;
+  I40E_LOG(log) << "reset" << logger::endl;
 #endif
 
   enabled = false;
@@ -187,8 +187,8 @@ void queue_base::reset() {
 
 void queue_base::reg_updated() {
 #ifdef DEBUG_QUEUES
-  log << "reg_updated: tail=" << reg_tail << " enabled=" << (int)enabled
-      << logger::endl;
+  I40E_LOG(log) << "reg_updated: tail=" << reg_tail
+      << " enabled=" << (int)enabled << logger::endl;
 #endif
   if (!enabled)
     return;
@@ -244,9 +244,9 @@ void queue_base::writeback_done(uint32_t first_pos, uint32_t cnt) {
   }
 
 #ifdef DEBUG_QUEUES
-  log << "written back afi=" << active_first_idx << " afp=" << active_first_pos
-      << " acnt=" << active_cnt << " pos=" << first_pos << " cnt=" << cnt
-      << logger::endl;
+  I40E_LOG(log) << "written back afi=" << active_first_idx
+      << " afp=" << active_first_pos << " acnt=" << active_cnt
+      << " pos=" << first_pos << " cnt=" << cnt << logger::endl;
 #endif
 
   // then start at the beginning and check how many are written back and then
@@ -261,7 +261,7 @@ void queue_base::writeback_done(uint32_t first_pos, uint32_t cnt) {
     ctx.state = desc_ctx::DESC_EMPTY;
   }
 #ifdef DEBUG_QUEUES
-  log << "   bump_cnt=" << bump_cnt << logger::endl;
+  I40E_LOG(log) << "   bump_cnt=" << bump_cnt << logger::endl;
 #endif
 
   active_first_pos = (active_first_pos + bump_cnt) % MAX_ACTIVE_DESCS;
@@ -295,7 +295,7 @@ void queue_base::desc_ctx::prepare() {
 
 void queue_base::desc_ctx::prepared() {
 #ifdef DEBUG_QUEUES
-  queue.log << "prepared desc " << index << logger::endl;
+  I40E_LOG(queue.log) << "prepared desc " << index << logger::endl;
 #endif
   assert(state == DESC_PREPARING);
   state = DESC_PREPARED;
@@ -303,7 +303,7 @@ void queue_base::desc_ctx::prepared() {
 
 void queue_base::desc_ctx::processed() {
 #ifdef DEBUG_QUEUES
-  queue.log << "processed desc " << index << logger::endl;
+  I40E_LOG(queue.log) << "processed desc " << index << logger::endl;
 #endif
   assert(state == DESC_PROCESSING);
   state = DESC_PROCESSED;
@@ -314,7 +314,7 @@ void queue_base::desc_ctx::processed() {
 void queue_base::desc_ctx::data_fetch(uint64_t addr, size_t data_len) {
   if (data_capacity < data_len) {
 #ifdef DEBUG_QUEUES
-    queue.log << "data_fetch allocating" << logger::endl;
+    I40E_LOG(queue.log) << "data_fetch allocating" << logger::endl;
 #endif
     if (data_capacity != 0)
       delete[]((uint8_t *)data);
@@ -331,9 +331,9 @@ void queue_base::desc_ctx::data_fetch(uint64_t addr, size_t data_len) {
   dma->dma_addr_ = addr;
 
 #ifdef DEBUG_QUEUES
-  queue.log << "fetching data idx=" << index << " addr=" << addr
+  I40E_LOG(queue.log) << "fetching data idx=" << index << " addr=" << addr
             << " len=" << data_len << logger::endl;
-  queue.log << "  dma = " << dma << " data=" << data << logger::endl;
+  I40E_LOG(queue.log) << "  dma = " << dma << " data=" << data << logger::endl;
 #endif
   queue.dev.runner_->IssueDma(*dma);
 }
@@ -345,8 +345,8 @@ void queue_base::desc_ctx::data_fetched(uint64_t addr, size_t len) {
 void queue_base::desc_ctx::data_write(uint64_t addr, size_t data_len,
                                       const void *buf) {
 #ifdef DEBUG_QUEUES
-  queue.log << "data_write(addr=" << addr << " datalen=" << data_len << ")"
-            << logger::endl;
+  I40E_LOG(queue.log) << "data_write(addr=" << addr << " datalen=" << data_len
+      << ")" << logger::endl;
 #endif
   dma_data_wb *data_dma = new dma_data_wb(*this, data_len);
   data_dma->write_ = true;
@@ -358,8 +358,8 @@ void queue_base::desc_ctx::data_write(uint64_t addr, size_t data_len,
 
 void queue_base::desc_ctx::data_written(uint64_t addr, size_t len) {
 #ifdef DEBUG_QUEUES
-  queue.log << "data_written(addr=" << addr << " datalen=" << len << ")"
-            << logger::endl;
+  I40E_LOG(queue.log) << "data_written(addr=" << addr << " datalen=" << len
+      << ")" << logger::endl;
 #endif
   processed();
 }
@@ -381,7 +381,7 @@ void queue_base::dma_fetch::done() {
     memcpy(ctx.desc, buf + queue.desc_len * i, queue.desc_len);
 
 #ifdef DEBUG_QUEUES
-    queue.log << "preparing desc " << ctx.index << logger::endl;
+    I40E_LOG(queue.log) << "preparing desc " << ctx.index << logger::endl;
 #endif
     ctx.state = desc_ctx::DESC_PREPARING;
     ctx.prepare();
@@ -407,7 +407,8 @@ void queue_base::dma_data_fetch::done() {
 
   if (part_offset < total_len) {
 #ifdef DEBUG_QUEUES
-    ctx.queue.log << "  dma_fetch: next part of multi part dma" << logger::endl;
+    I40E_LOG(ctx.queue.log) << "  dma_fetch: next part of multi part dma"
+        << logger::endl;
 #endif
     len_ = std::min(total_len - part_offset, MAX_DMA_SIZE);
     ctx.queue.dev.runner_->IssueDma(*this);
@@ -22,77 +22,275 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
-#include <iostream>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 #include "sims/nic/i40e_bm/i40e_bm.h"
 
 namespace i40e {
 
-logger::logger(const std::string &label_, nicbm::Runner::Device &dev_)
-    : label(label_), dev(dev_), runner(dev_.runner_) {
-  ss << std::hex;
+/* formatted lines never exceed this: every record byte expands to at most 2
+ * characters, plus timestamp and separators */
+static const size_t kMaxLine = 2 * logger::kMaxRecord + 64;
+static const size_t kMaxLabel = 64;
+
+/** Format binary line record `rec` into `out`, returns length of the line. */
+static size_t format_record(const uint8_t *rec, size_t len, char *out) {
+  uint64_t ts;
+  memcpy(&ts, rec, sizeof(ts));
+  size_t label_len = rec[sizeof(ts)];
+  const char *label = reinterpret_cast<const char *>(rec + sizeof(ts) + 1);
+  size_t pos = sizeof(ts) + 1 + label_len;
+
+  size_t o = snprintf(out, kMaxLine, "%" PRIu64 " %.*s: ", ts,
+                      (int)label_len, label);
+  while (pos < len) {
+    uint8_t t = rec[pos++];
+    uint64_t v;
+    uint16_t sl;
+    switch (t) {
+      case logger::kItemChar:
+        out[o++] = rec[pos++];
+        break;
+
+      case logger::kItemHex:
+      case logger::kItemPtr:
+        memcpy(&v, rec + pos, sizeof(v));
+        pos += sizeof(v);
+        o += snprintf(out + o, kMaxLine - o,
+                      (t == logger::kItemPtr && v != 0) ? "0x%" PRIx64
+                                                        : "%" PRIx64,
+                      v);
+        break;
+
+      case logger::kItemStr:
+        memcpy(&sl, rec + pos, sizeof(sl));
+        pos += sizeof(sl);
+        memcpy(out + o, rec + pos, sl);
+        pos += sl;
+        o += sl;
+        break;
+
+      default:
+        abort();
+    }
+  }
+  out[o++] = '\n';
+  return o;
 }
 
-logger &logger::operator<<(char c) {
-  if (c == endl) {
-    uint64_t ts;
-
-    /* runner might not be initialized yet if called from a constructor
-     * somewhere, in that case see if it's set now otherwise just take 0 as the
-     * current timestamp. */
-    if (!runner) {
-      runner = dev.runner_;
-      ts = runner ? runner->TimePs() : 0;
-    } else {
-      ts = runner->TimePs();
+/**
+ * Single-producer/single-consumer byte ring of length-prefixed line records,
+ * drained by a background thread. All device models in a process run on one
+ * thread (fibers in MultiNicRunner), so there is only one producer.
+ */
+class async_writer {
+  static const size_t kRingSize = 4 << 20;
+  static const size_t kOutBuf = 64 * 1024;
+
+  uint8_t *ring;
+  std::atomic<size_t> head;
+  std::atomic<size_t> tail;
+  std::atomic<bool> stop;
+  char out[kOutBuf];
+  std::thread thread;
+
+  void copy_in(size_t pos, const void *src, size_t len) {
+    size_t off = pos % kRingSize;
+    size_t first = std::min(len, kRingSize - off);
+    memcpy(ring + off, src, first);
+    memcpy(ring, static_cast<const uint8_t *>(src) + first, len - first);
+  }
+
+  void copy_out(size_t pos, void *dst, size_t len) {
+    size_t off = pos % kRingSize;
+    size_t first = std::min(len, kRingSize - off);
+    memcpy(dst, ring + off, first);
+    memcpy(static_cast<uint8_t *>(dst) + first, ring, len - first);
+  }
+
+  void run() {
+    uint8_t rec[logger::kMaxRecord];
+    size_t t = tail.load(std::memory_order_relaxed);
+    while (true) {
+      bool stopping = stop.load(std::memory_order_acquire);
+      size_t h = head.load(std::memory_order_acquire);
+      if (h == t) {
+        if (stopping)
+          break;
+        usleep(1000);
+        continue;
+      }
+
+      /* format everything available, writing out whenever the buffer fills
+       * up, and only then release the ring space */
+      size_t o = 0;
+      while (t != h) {
+        uint32_t len;
+        copy_out(t, &len, sizeof(len));
+        copy_out(t + sizeof(len), rec, len);
+        t += sizeof(len) + len;
+
+        if (kOutBuf - o < kMaxLine) {
+          fwrite(out, 1, o, stderr);
+          o = 0;
+        }
+        o += format_record(rec, len, out + o);
+      }
+      fwrite(out, 1, o, stderr);
+      tail.store(t, std::memory_order_release);
     }
+  }
 
-    std::cerr << ts << " " << label << ": " << ss.str() << std::endl;
-    ss.str(std::string());
-    ss << std::hex;
-  } else {
-    ss << c;
+ public:
+  async_writer() : head(0), tail(0), stop(false) {
+    ring = new uint8_t[kRingSize];
+    thread = std::thread([this]() { run(); });
   }
-  return *this;
-}
 
-logger &logger::operator<<(int32_t i) {
-  ss << i;
-  return *this;
-}
+  ~async_writer() {
+    stop.store(true, std::memory_order_release);
+    thread.join();
+    delete[] ring;
+  }
 
-logger &logger::operator<<(uint8_t i) {
-  ss << (unsigned)i;
-  return *this;
-}
+  void push(const uint8_t *rec, uint32_t len) {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t need = sizeof(len) + len;
+    while (h + need - tail.load(std::memory_order_acquire) > kRingSize)
+      std::this_thread::yield();
 
-logger &logger::operator<<(uint16_t i) {
-  ss << i;
-  return *this;
+    copy_in(h, &len, sizeof(len));
+    copy_in(h + sizeof(len), rec, len);
+    head.store(h + need, std::memory_order_release);
+  }
+
+  /** Wait until all pushed records have been written out. */
+  void flush() {
+    size_t h = head.load(std::memory_order_relaxed);
+    while (tail.load(std::memory_order_acquire) != h)
+      std::this_thread::yield();
+  }
+};
+
+static async_writer *async_backend = nullptr;
+/* threshold from I40E_LOG_LEVEL, overrides the sim_log registry level */
+static bool env_level_set = false;
+static sim_log::LogLevel env_level = sim_log::LogLevel::info;
+
+/** Apply environment configuration, once per process. */
+static void log_init() {
+  static bool initialized = false;
+  if (initialized)
+    return;
+  initialized = true;
+
+  const char *level = getenv("I40E_LOG_LEVEL");
+  if (level) {
+    static const struct {
+      const char *name;
+      sim_log::LogLevel level;
+    } levels[] = {
+        {"debug", sim_log::LogLevel::debug},
+        {"info", sim_log::LogLevel::info},
+        {"warn", sim_log::LogLevel::warn},
+        {"error", sim_log::LogLevel::error},
+        {"off", sim_log::LogLevel::off},
+    };
+    bool found = false;
+    for (auto &l : levels) {
+      if (!strcmp(level, l.name)) {
+        env_level = l.level;
+        env_level_set = true;
+        found = true;
+      }
+    }
+    if (!found)
+      fprintf(stderr, "logger: ignoring unknown I40E_LOG_LEVEL=%s\n", level);
+  }
+
+  const char *async = getenv("I40E_LOG_ASYNC");
+  if (async && (!strcmp(async, "1") || !strcmp(async, "y") ||
+                !strcmp(async, "Y"))) {
+    /* static so the destructor drains the ring at exit */
+    static async_writer writer;
+    async_backend = &writer;
+  }
 }
 
-logger &logger::operator<<(uint32_t i) {
-  ss << i;
-  return *this;
+logger::logger(const std::string &label_, nicbm::Runner::Device &dev_)
+    : label(label_),
+      dev(dev_),
+      runner(dev_.runner_),
+      line_level(sim_log::LogLevel::info),
+      state(kLineStart),
+      rec_len(0) {
+  log_init();
+  level = env_level_set ? env_level
+                        : sim_log::Logger::GetRegistry().GetLevel();
 }
 
-logger &logger::operator<<(uint64_t i) {
-  ss << i;
-  return *this;
+void logger::line_begin() {
+  if (line_level < level || level == sim_log::LogLevel::off) {
+    state = kLineOff;
+    return;
+  }
+  state = kLineOn;
+
+  /* runner might not be initialized yet if called from a constructor
+   * somewhere, in that case see if it's set now otherwise just take 0 as the
+   * current timestamp. */
+  uint64_t ts;
+  if (!runner) {
+    runner = dev.runner_;
+    ts = runner ? runner->TimePs() : 0;
+  } else {
+    ts = runner->TimePs();
+  }
+
+  uint8_t label_len = std::min(label.size(), kMaxLabel);
+  memcpy(rec, &ts, sizeof(ts));
+  rec[sizeof(ts)] = label_len;
+  memcpy(rec + sizeof(ts) + 1, label.data(), label_len);
+  rec_len = sizeof(ts) + 1 + label_len;
 }
 
-logger &logger::operator<<(bool b) {
-  ss << b;
-  return *this;
+void logger::line_end() {
+  if (async_backend) {
+    async_backend->push(rec, rec_len);
+    /* make sure warnings are out before a potential abort() */
+    if (line_level >= sim_log::LogLevel::warn)
+      async_backend->flush();
+  } else {
+    char out[kMaxLine];
+    size_t len = format_record(rec, rec_len, out);
+    fwrite(out, 1, len, stderr);
+  }
 }
 
-logger &logger::operator<<(const char *str) {
-  ss << str;
-  return *this;
+void logger::put_hex(enum item_type t, uint64_t v) {
+  if (rec_len + 1 + sizeof(v) > kMaxRecord)
+    return;
+  rec[rec_len++] = t;
+  memcpy(rec + rec_len, &v, sizeof(v));
+  rec_len += sizeof(v);
 }
 
-logger &logger::operator<<(void *ptr) {
-  ss << ptr;
-  return *this;
+void logger::put_str(const char *str) {
+  size_t hdr = 1 + sizeof(uint16_t);
+  if (rec_len + hdr >= kMaxRecord)
+    return;
+  uint16_t len = std::min(strlen(str), kMaxRecord - rec_len - hdr);
+  rec[rec_len] = kItemStr;
+  memcpy(rec + rec_len + 1, &len, sizeof(len));
+  memcpy(rec + rec_len + hdr, str, len);
+  rec_len += hdr + len;
 }
 }  // namespace i40e